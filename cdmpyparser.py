@@ -20,8 +20,78 @@
 """The file holds types and a glue code between python and C python parser"""
 
 from sys import maxsize
+import os
+import struct
+import time
+from bisect import bisect_left, bisect_right
 import _cdmpyparser
 
+
+# Kinds of the recorded parser events; the values match the C enum EventKind
+EVENT_ENCODING = 0
+EVENT_GLOBAL = 1
+EVENT_FUNCTION = 2
+EVENT_CLASS = 3
+EVENT_IMPORT = 4
+EVENT_AS = 5
+EVENT_WHAT = 6
+EVENT_CLASS_ATTRIBUTE = 7
+EVENT_INSTANCE_ATTRIBUTE = 8
+EVENT_DECORATOR = 9
+EVENT_DECORATOR_ARGUMENT = 10
+EVENT_DOCSTRING = 11
+EVENT_ARGUMENT = 12
+EVENT_ARGUMENT_VALUE = 13
+EVENT_BASE_CLASS = 14
+EVENT_ERROR = 15
+EVENT_LEXER_ERROR = 16
+EVENT_STATEMENT = 17
+
+# The BriefModuleInfo methods which handle the events; indexed by event kind.
+# _onStatement() is optional and contentHash is passed to _onClass() and
+# _onFunction() only if they take it, so the objects written for the older
+# protocol keep working
+EVENT_HANDLERS = ('_onEncoding', '_onGlobal', '_onFunction', '_onClass',
+                  '_onImport', '_onAs', '_onWhat', '_onClassAttribute',
+                  '_onInstanceAttribute', '_onDecorator',
+                  '_onDecoratorArgument', '_onDocstring', '_onArgument',
+                  '_onArgumentValue', '_onBaseClass', '_onError',
+                  '_onLexerError', '_onStatement')
+
+
+def eventMask(*kinds):
+    """Provides a mask of the wanted event kinds for the parsing functions.
+
+    The items attached to other items are collected only together with
+    their owners, e.g. EVENT_ARGUMENT needs EVENT_FUNCTION and
+    EVENT_INSTANCE_ATTRIBUTE needs both EVENT_CLASS and EVENT_FUNCTION.
+    The errors are always reported.
+    """
+    mask = 0
+    for kind in kinds:
+        mask |= 1 << kind
+    return mask
+
+
+ALL_EVENTS = eventMask(*range(len(EVENT_HANDLERS)))
+
+# The parse options which could be added to a mask; keep in sync with the
+# extension
+# Only the nested functions and classes, the instance attributes and the
+# docstrings are collected from the function bodies; the scanner backend
+# skips the rest of the body text without looking at the statements
+SKIP_FUNCTION_BODIES = 1 << 24
+# The function and class bodies are not looked into at all; the items of the
+# module level statements are collected, including the statements nested in
+# if, try, for etc.
+TOP_LEVEL_ONLY = 1 << 25
+# The parse stops at the first module level statement which is not an
+# import, a string literal or an if or try statement
+STOP_AT_CODE = 1 << 26
+# The docstrings are reported as they are in the code, i.e. without the
+# trim_docstring() trimming the extension does by default
+RAW_DOCSTRINGS = 1 << 27
+
 def trim_docstring(docstring):
     """Taken from http://www.python.org/dev/peps/pep-0257/"""
     if not docstring:
@@ -254,6 +324,27 @@ class Docstring:
             str(self.endLine) + "]: '" + self.text + "'"
 
 
+class Statement:
+
+    """Holds a top level statement span and its content hash"""
+
+    __slots__ = ["line", "pos", "absPosition", "endLine", "contentHash"]
+
+    def __init__(self, line, pos, absPosition, endLine, contentHash):
+        self.line = line
+        self.pos = pos
+        self.absPosition = absPosition
+        self.endLine = endLine
+        # A hash of the statement text; it is the same while the text is
+        # the same wherever the statement is in the module
+        self.contentHash = contentHash
+
+    def __str__(self):
+        return "Statement[" + str(self.line) + ":" + str(self.pos) + ":" + \
+            str(self.absPosition) + ":" + str(self.endLine) + "]: " + \
+            format(self.contentHash, '016x')
+
+
 class Argument:
 
     """Holds an information about an argument"""
@@ -280,12 +371,12 @@ class Function(ModuleInfoBase):
 
     __slots__ = ["keywordLine", "keywordPos", "colonLine", "colonPos",
                  "docstring", "arguments", "decorators", "functions",
-                 "classes", "isAsync", "returnAnnotation"]
+                 "classes", "isAsync", "returnAnnotation", "contentHash"]
 
     def __init__(self, funcName, line, pos, absPosition,
                  keywordLine, keywordPos,
                  colonLine, colonPos, isAsync,
-                 returnAnnotation):
+                 returnAnnotation, contentHash=None):
         ModuleInfoBase.__init__(self, funcName, line, pos, absPosition)
 
         self.keywordLine = keywordLine  # line where 'def' keyword
@@ -296,6 +387,8 @@ class Function(ModuleInfoBase):
         self.colonPos = colonPos        # pos where ':' char starts (1-based)
         self.isAsync = isAsync
         self.returnAnnotation = returnAnnotation
+        self.contentHash = contentHash  # hash of the text from the 'def'
+                                        # keyword till the end of the body
 
         self.docstring = None
         self.arguments = []     # instances of the Argument class
@@ -359,11 +452,11 @@ class Class(ModuleInfoBase):
 
     __slots__ = ["keywordLine", "keywordPos", "colonLine", "colonPos",
                  "docstring", "base", "decorators", "classAttributes",
-                 "instanceAttributes", "functions", "classes"]
+                 "instanceAttributes", "functions", "classes", "contentHash"]
 
     def __init__(self, className, line, pos, absPosition,
                  keywordLine, keywordPos,
-                 colonLine, colonPos):
+                 colonLine, colonPos, contentHash=None):
         ModuleInfoBase.__init__(self, className, line, pos, absPosition)
 
         self.keywordLine = keywordLine  # line where 'def' keyword
@@ -372,6 +465,8 @@ class Class(ModuleInfoBase):
                                         # starts (1-based).
         self.colonLine = colonLine      # line where ':' char starts (1-based)
         self.colonPos = colonPos        # pos where ':' char starts (1-based)
+        self.contentHash = contentHash  # hash of the text from the 'class'
+                                        # keyword till the end of the body
 
         self.docstring = None
         self.base = []
@@ -420,7 +515,9 @@ class BriefModuleInfo:
 
     __slots__ = ["isOK", "docstring", "encoding", "imports", "globals",
                  "functions", "classes", "errors", "lexerErrors",
-                 "objectsStack", "__lastImport", "__lastDecorators"]
+                 "statements",
+                 "objectsStack", "__lastImport", "__lastDecorators",
+                 "_incremental"]
 
     def __init__(self):
         self.isOK = True
@@ -433,6 +530,7 @@ class BriefModuleInfo:
         self.classes = []
         self.errors = []
         self.lexerErrors = []
+        self.statements = []    # top level statements
 
         self.objectsStack = []
         self.__lastImport = None
@@ -503,19 +601,17 @@ class BriefModuleInfo:
 
     def _onGlobal(self, name, line, pos, absPosition, level):
         """Memorizes a global variable"""
-        # level is ignored
-        for item in self.globals:
-            if item.name == name:
-                return
+        # level is ignored; the parser reports only the first of the
+        # repeated names
         self.globals.append(Global(name, line, pos, absPosition))
 
     def _onClass(self, name, line, pos, absPosition,
                  keywordLine, keywordPos,
-                 colonLine, colonPos, level):
+                 colonLine, colonPos, level, contentHash=None):
         """Memorizes a class"""
         self.__flushLevel(level)
         c = Class(name, line, pos, absPosition, keywordLine, keywordPos,
-                  colonLine, colonPos)
+                  colonLine, colonPos, contentHash)
         if self.__lastDecorators is not None:
             c.decorators = self.__lastDecorators
             self.__lastDecorators = None
@@ -524,11 +620,12 @@ class BriefModuleInfo:
     def _onFunction(self, name, line, pos, absPosition,
                     keywordLine, keywordPos,
                     colonLine, colonPos, level,
-                    isAsync, returnAnnotation):
+                    isAsync, returnAnnotation, contentHash=None):
         """Memorizes a function"""
         self.__flushLevel(level)
         f = Function(name, line, pos, absPosition, keywordLine, keywordPos,
-                     colonLine, colonPos, isAsync, returnAnnotation)
+                     colonLine, colonPos, isAsync, returnAnnotation,
+                     contentHash)
         if self.__lastDecorators is not None:
             f.decorators = self.__lastDecorators
             self.__lastDecorators = None
@@ -554,22 +651,16 @@ class BriefModuleInfo:
     def _onClassAttribute(self, name, line, pos, absPosition, level):
         """Memorizes a class attribute"""
         # A class must be on the top of the stack
-        attributes = self.objectsStack[level].classAttributes
-        for item in attributes:
-            if item.name == name:
-                return
-        attributes.append(ClassAttribute(name, line, pos, absPosition))
+        self.objectsStack[level].classAttributes.append(
+            ClassAttribute(name, line, pos, absPosition))
 
     def _onInstanceAttribute(self, name, line, pos, absPosition, level):
         """Memorizes a class instance attribute"""
         # Instance attributes may appear in member functions only so we already
         # have a function on the stack of objects. To get the class object one
         # more step is required so we -1 here.
-        attributes = self.objectsStack[level - 1].instanceAttributes
-        for item in attributes:
-            if item.name == name:
-                return
-        attributes.append(InstanceAttribute(name, line, pos, absPosition))
+        self.objectsStack[level - 1].instanceAttributes.append(
+            InstanceAttribute(name, line, pos, absPosition))
 
     def _onDecorator(self, name, line, pos, absPosition):
         """Memorizes a function or a class decorator"""
@@ -591,10 +682,9 @@ class BriefModuleInfo:
         """Memorizes a function/class/module docstring"""
         if self.objectsStack:
             self.objectsStack[-1].docstring = \
-                Docstring(trim_docstring(docstr), startLine, endLine)
+                Docstring(docstr, startLine, endLine)
         else:
-            self.docstring = Docstring(trim_docstring(docstr),
-                                       startLine, endLine)
+            self.docstring = Docstring(docstr, startLine, endLine)
 
     def _onArgument(self, name, annotation):
         """Memorizes a function argument"""
@@ -621,23 +711,746 @@ class BriefModuleInfo:
         if message.strip() != "":
             self.lexerErrors.append(message)
 
+    def _onStatement(self, line, pos, absPosition, endLine, contentHash=None):
+        """Memorizes a top level statement"""
+        self.statements.append(Statement(line, pos, absPosition, endLine,
+                                         contentHash))
+
+
+# Raised by the parsing functions when their CancelToken fires
+ParseCancelled = _cdmpyparser.ParseCancelled
+
+
+class CancelToken:
+
+    """Tells a running parse to stop.
+
+    The parse stops when cancel() is called, e.g. from another thread, or
+    when the timeout in seconds passes; the parsing function then raises
+    ParseCancelled. A token could be shared by many parses.
+    """
+
+    __slots__ = ["_flag", "deadline"]
+
+    def __init__(self, timeout=None):
+        self._flag = bytearray(1)   # the extension reads it while parsing
+        self.deadline = None
+        if timeout is not None:
+            self.deadline = time.monotonic() + timeout
+
+    def cancel(self):
+        """Cancels the parses which use the token"""
+        self._flag[0] = 1
+
+    def isCancelled(self):
+        """True if the token is cancelled or the deadline has passed"""
+        return self._flag[0] != 0 or \
+            (self.deadline is not None and time.monotonic() >= self.deadline)
+
+
+def _cancelArgs(cancel):
+    """Provides the extension arguments for the token: the flag and the
+       timeout"""
+    if cancel is None:
+        return None, -1.0
+    if cancel.deadline is None:
+        return cancel._flag, -1.0
+    return cancel._flag, max(cancel.deadline - time.monotonic(), 0.0)
+
+
+# The native mode creates the objects below directly in the extension
+_cdmpyparser.setResultTypes({'Encoding': Encoding,
+                             'Import': Import,
+                             'ImportWhat': ImportWhat,
+                             'Global': Global,
+                             'ClassAttribute': ClassAttribute,
+                             'InstanceAttribute': InstanceAttribute,
+                             'Decorator': Decorator,
+                             'Docstring': Docstring,
+                             'Argument': Argument,
+                             'Function': Function,
+                             'Class': Class,
+                             'Statement': Statement})
+
+
+def getBriefModuleInfoFromFile(fileName, native=False, mask=ALL_EVENTS,
+                               cacheDir=None, lazy=False, cancel=None):
+    """Builds the brief module info from file.
+
+    If native is True then the extension populates the result itself
+    instead of calling the BriefModuleInfo._on* methods.
+    The mask tells what kinds of items to collect, see eventMask()
+    If cacheDir is given then the found items are stored there and the file
+    is not parsed again until its size, modification time and content
+    change. The directory is created if needed.
+    If lazy is True then a LazyBriefModuleInfo is provided; the native and
+    cacheDir arguments are not used in this case.
+    If cancel is a CancelToken then ParseCancelled is raised as soon as the
+    token is cancelled or its deadline passes.
+    """
+    if lazy:
+        return LazyBriefModuleInfo(getBriefModuleDataFromFile(fileName,
+                                                              mask, cancel))
+    if cacheDir is not None and not os.path.isdir(cacheDir):
+        os.makedirs(cacheDir)
+    modInfo = BriefModuleInfo()
+    _cdmpyparser.getBriefModuleInfoFromFile(modInfo, fileName, native, mask,
+                                            cacheDir, *_cancelArgs(cancel))
+    if not native:
+        modInfo.flush()
+    return modInfo
+
 
-def getBriefModuleInfoFromFile(fileName):
-    """Builds the brief module info from file"""
+def getBriefModuleInfoFromMemory(content, native=False, mask=ALL_EVENTS,
+                                 lazy=False, incremental=False, cancel=None):
+    """Builds the brief module info from memory.
+
+    The content is either a str or any bytes-like object; the latter is
+    parsed in place without copying.
+    If native is True then the extension populates the result itself
+    instead of calling the BriefModuleInfo._on* methods.
+    The mask tells what kinds of items to collect, see eventMask()
+    If lazy is True then a LazyBriefModuleInfo is provided; the native
+    argument is not used in this case.
+    If incremental is True then the result keeps the UTF-8 code and the top
+    level statements positions so that it could be updated after an edit
+    with reparseBriefModuleInfo(); the native and lazy arguments are not
+    used in this case.
+    If cancel is a CancelToken then ParseCancelled is raised as soon as the
+    token is cancelled or its deadline passes.
+    """
+    if incremental:
+        if isinstance(content, str):
+            return _parseIncremental(content.encode('utf-8'), mask, cancel)
+        return _parseIncremental(bytes(content), mask, cancel)
+    if lazy:
+        return LazyBriefModuleInfo(getBriefModuleDataFromMemory(content,
+                                                                mask, cancel))
     modInfo = BriefModuleInfo()
-    _cdmpyparser.getBriefModuleInfoFromFile(modInfo, fileName)
-    modInfo.flush()
+    _cdmpyparser.getBriefModuleInfoFromMemory(modInfo, content, native, mask,
+                                              None, *_cancelArgs(cancel))
+    if not native:
+        modInfo.flush()
     return modInfo
 
 
-def getBriefModuleInfoFromMemory(content):
-    """Builds the brief module info from memory"""
+def getBriefModuleInfoFromFiles(fileNames, workers=0, mask=ALL_EVENTS):
+    """Builds the brief module info for many files.
+
+    The files are read and parsed on the given number of worker threads
+    (0 means one per CPU). The results are provided in the order of the file
+    names. The mask tells what kinds of items to collect, see eventMask()
+    """
+    return _cdmpyparser.getBriefModuleInfoFromFiles(BriefModuleInfo,
+                                                    fileNames, workers, mask)
+
+
+def _importsMask(headerOnly):
+    """Provides the mask for the imports only parse"""
+    mask = eventMask(EVENT_IMPORT, EVENT_WHAT, EVENT_AS) | TOP_LEVEL_ONLY
+    if headerOnly:
+        mask |= STOP_AT_CODE
+    return mask
+
+
+def getBriefModuleImportsFromFile(fileName, headerOnly=False):
+    """Collects only the module level imports of a file.
+
+    The imports nested in if, try etc. are collected too while the function
+    and class bodies are not looked into. If headerOnly is True then the
+    parse stops at the first module level statement which is not an import,
+    a string literal or an if or try statement.
+    The result is a BriefModuleInfo with the imports and the errors only.
+    """
+    return getBriefModuleInfoFromFile(fileName, native=True,
+                                      mask=_importsMask(headerOnly))
+
+
+def getBriefModuleImportsFromMemory(content, headerOnly=False):
+    """Collects only the module level imports of a code buffer.
+
+    See getBriefModuleImportsFromFile()
+    """
+    return getBriefModuleInfoFromMemory(content, native=True,
+                                        mask=_importsMask(headerOnly))
+
+
+def getBriefModuleImportsFromFiles(fileNames, workers=0, headerOnly=False):
+    """Collects only the module level imports of many files.
+
+    See getBriefModuleInfoFromFiles() and getBriefModuleImportsFromFile()
+    """
+    return getBriefModuleInfoFromFiles(fileNames, workers,
+                                       _importsMask(headerOnly))
+
+
+class _IncrementalState:
+
+    """What reparseBriefModuleInfo() needs from the previous parse: the UTF-8
+       source, the mask and the top level statements starts"""
+
+    __slots__ = ["source", "mask", "starts", "lines"]
+
+    def __init__(self, source, mask, statements):
+        self.source = source
+        self.mask = mask
+        self.starts = [item[0] for item in statements]    # absPosition
+        self.lines = [item[1] for item in statements]
+
+
+def _parseIncremental(source, mask, cancel=None):
+    """Parses the UTF-8 source and memorizes the incremental state"""
     modInfo = BriefModuleInfo()
-    _cdmpyparser.getBriefModuleInfoFromMemory(modInfo, content)
+    statements = []
+    flag, timeout = _cancelArgs(cancel)
+    _cdmpyparser.getBriefModuleInfoFromMemory(modInfo, source, True, mask,
+                                              statements, flag, timeout)
+    modInfo._incremental = _IncrementalState(source, mask, statements)
+    return modInfo
+
+
+def _countLineEnds(text):
+    """Counts the line ends the same way the tokenizer does"""
+    return text.count(b'\n') + text.count(b'\r') - text.count(b'\r\n')
+
+
+def _isInHeader(source, offset):
+    """True if the offset is in the first two lines, i.e. where the
+       encoding could be declared"""
+    lineStart = 0
+    for _ in range(2):
+        lf = source.find(b'\n', lineStart, offset + 1)
+        cr = source.find(b'\r', lineStart, offset + 1)
+        if lf == -1 and cr == -1:
+            return True
+        if cr == -1 or (lf != -1 and lf < cr):
+            lineStart = lf + 1
+        else:
+            lineStart = cr + 1
+            if source[lineStart:lineStart + 1] == b'\n':
+                lineStart += 1
+    return offset < lineStart
+
+
+def _splitItems(items, regionStart, regionEnd):
+    """Splits the top level items sorted by position into the ones before,
+       inside and after the region"""
+    starts = [item.absPosition for item in items]
+    first = bisect_left(starts, regionStart)
+    last = bisect_left(starts, regionEnd)
+    return items[:first], items[first:last], items[last:]
+
+
+def _reparseRegion(modInfo, source, start, deletedLength, insertedText,
+                   cancel):
+    """Reparses the top level statements touched by the edit and merges them
+       into modInfo. Provides False if the whole source needs to be parsed"""
+    state = modInfo._incremental
+    oldSource = state.source
+    starts = state.starts
+    if not modInfo.isOK or not starts or _isInHeader(oldSource, start):
+        return False
+
+    # The touched statements. An insertion right at a statement start could
+    # indent it into the previous statement so the previous one is taken too
+    first = bisect_right(starts, start) - 1
+    if first > 0 and starts[first] == start:
+        first -= 1
+    first = max(first, 0)
+    last = max(bisect_right(starts, start + deletedLength) - 1, first)
+
+    # The first statement region includes the leading comments
+    regionStart = starts[first] if first > 0 else 0
+    regionLine = state.lines[first] - 1 if first > 0 else 0
+    oldRegionEnd = starts[last + 1] if last + 1 < len(starts) \
+        else len(oldSource)
+
+    delta = len(insertedText) - deletedLength
+    regionEnd = oldRegionEnd + delta
+    region = source[regionStart:regionEnd]
+    regionInfo = _parseIncremental(region, state.mask, cancel)
+    if not regionInfo.isOK or regionInfo.encoding is not None:
+        return False
+
+    # Globals are unique by name: a name which disappeared from the region
+    # may be the first occurrence of a global defined later on
+    oldBefore, oldInside, oldAfter = _splitItems(modInfo.globals,
+                                                 regionStart, oldRegionEnd)
+    beforeNames = set(item.name for item in oldBefore)
+    insideNames = set(item.name for item in regionInfo.globals)
+    for item in oldInside:
+        if item.name not in beforeNames and item.name not in insideNames:
+            if source.find(item.name.encode('utf-8'), regionEnd) != -1:
+                return False
+
+    lineDelta = _countLineEnds(region) - \
+        _countLineEnds(oldSource[regionStart:oldRegionEnd])
+    for attribute in ["imports", "globals", "functions", "classes",
+                      "statements"]:
+        before, _, after = _splitItems(getattr(modInfo, attribute),
+                                       regionStart, oldRegionEnd)
+        inside = getattr(regionInfo, attribute)
+        _cdmpyparser.shiftItems(inside, regionLine, regionStart)
+        _cdmpyparser.shiftItems(after, lineDelta, delta)
+        if attribute == "globals":
+            inside = [item for item in inside if item.name not in beforeNames]
+            after = [item for item in after if item.name not in insideNames]
+        setattr(modInfo, attribute, before + inside + after)
+    if first == 0:
+        modInfo.docstring = regionInfo.docstring
+
+    regionState = regionInfo._incremental
+    state.source = source
+    state.starts = starts[:first] + \
+        [item + regionStart for item in regionState.starts] + \
+        [item + delta for item in starts[last + 1:]]
+    state.lines = state.lines[:first] + \
+        [item + regionLine for item in regionState.lines] + \
+        [item + lineDelta for item in state.lines[last + 1:]]
+    return True
+
+
+def reparseBriefModuleInfo(modInfo, start, deletedLength, insertedText,
+                           cancel=None):
+    """Updates the brief module info after an edit of the code.
+
+    modInfo must be provided by getBriefModuleInfoFromMemory() with
+    incremental=True or by this function. The edit replaces deletedLength
+    bytes at the start offset with insertedText; the offsets are in the UTF-8
+    encoded code, the same as absPosition. Only the top level statements the
+    edit touches are parsed again and the positions of the items below them
+    are shifted. modInfo is updated in place and returned.
+    If the CancelToken cancel fires then ParseCancelled is raised and
+    modInfo stays as it was before the edit.
+    """
+    state = getattr(modInfo, "_incremental", None)
+    if state is None:
+        raise ValueError("The brief module info is not incremental")
+    if isinstance(insertedText, str):
+        insertedText = insertedText.encode('utf-8')
+    else:
+        insertedText = bytes(insertedText)
+    oldSource = state.source
+    if start < 0 or deletedLength < 0 or \
+       start + deletedLength > len(oldSource):
+        raise ValueError("The edit is out of the code range")
+
+    source = oldSource[:start] + insertedText + \
+        oldSource[start + deletedLength:]
+    if not _reparseRegion(modInfo, source, start, deletedLength,
+                          insertedText, cancel):
+        newInfo = _parseIncremental(source, state.mask, cancel)
+        for attribute in BriefModuleInfo.__slots__:
+            if not attribute.startswith("__"):
+                setattr(modInfo, attribute, getattr(newInfo, attribute))
+    return modInfo
+
+
+def getBriefModuleEventsFromFile(fileName, raw=False, mask=ALL_EVENTS):
+    """Parses a file and provides all the found items at once.
+
+    The result is a list of tuples (kind, arg1, arg2, ...) where the args are
+    exactly what the corresponding EVENT_HANDLERS method receives. Only the
+    first of the repeated globals, class and instance attributes is reported
+    per module or class.
+    If raw is True then the events are provided as a compact bytes object
+    which could be decoded with decodeEvents().
+    The mask tells what kinds of items to collect, see eventMask()
+    """
+    return _cdmpyparser.getBriefModuleEventsFromFile(fileName, raw, mask)
+
+
+def getBriefModuleEventsFromMemory(content, raw=False, mask=ALL_EVENTS):
+    """Parses a code buffer and provides all the found items at once.
+
+    See getBriefModuleEventsFromFile() for the result format
+    """
+    return _cdmpyparser.getBriefModuleEventsFromMemory(content, raw, mask)
+
+
+# The raw events layout: a header (version, count), the fixed size records
+# and then the pool of the UTF-8 encoded strings the records refer to
+_EVENTS_HEADER = struct.Struct('=2i')
+_EVENT_RECORD = struct.Struct('=15i2I')
+
+
+def decodeEvents(raw):
+    """Converts the raw events into the list of tuples"""
+    version, count = _EVENTS_HEADER.unpack_from(raw, 0)
+    if version != _cdmpyparser.eventBufferVersion:
+        raise ValueError('Unsupported events version ' + str(version))
+
+    poolStart = _EVENTS_HEADER.size + count * _EVENT_RECORD.size
+    pool = raw[poolStart:]
+
+    events = []
+    for (kind, nameOffset, nameLength, line, pos, absPosition, level,
+         keywordLine, keywordPos, colonLine, colonPos, endLine, isAsync,
+         annotationOffset, annotationLength, hashLow, hashHigh) in \
+            _EVENT_RECORD.iter_unpack(raw[_EVENTS_HEADER.size:poolStart]):
+        name = pool[nameOffset:nameOffset + nameLength].decode('utf-8')
+        annotation = None
+        if annotationLength > 0:
+            annotation = pool[annotationOffset:
+                              annotationOffset + annotationLength].decode(
+                                  'utf-8')
+
+        contentHash = hashLow | hashHigh << 32
+
+        if kind in (EVENT_ENCODING, EVENT_IMPORT, EVENT_WHAT,
+                    EVENT_DECORATOR):
+            events.append((kind, name, line, pos, absPosition))
+        elif kind in (EVENT_GLOBAL, EVENT_CLASS_ATTRIBUTE,
+                      EVENT_INSTANCE_ATTRIBUTE):
+            events.append((kind, name, line, pos, absPosition, level))
+        elif kind == EVENT_FUNCTION:
+            events.append((kind, name, line, pos, absPosition,
+                           keywordLine, keywordPos, colonLine, colonPos,
+                           level, isAsync != 0, annotation, contentHash))
+        elif kind == EVENT_CLASS:
+            events.append((kind, name, line, pos, absPosition,
+                           keywordLine, keywordPos, colonLine, colonPos,
+                           level, contentHash))
+        elif kind == EVENT_STATEMENT:
+            events.append((kind, line, pos, absPosition, endLine,
+                           contentHash))
+        elif kind == EVENT_DOCSTRING:
+            events.append((kind, name, line, endLine))
+        elif kind == EVENT_ARGUMENT:
+            events.append((kind, name, annotation))
+        else:
+            events.append((kind, name))
+    return events
+
+
+_CO_VARARGS = 0x04     # inspect.CO_VARARGS, without importing inspect
+
+
+def _takesArguments(callback, count):
+    """Tells if the callback takes the given number of positional arguments.
+
+    The same as takesArguments() in the extension: the callables other than
+    the Python functions and methods are expected to take them.
+    """
+    function = getattr(callback, '__func__', None)
+    if function is None:
+        function = callback
+    else:
+        count += 1      # self
+    code = getattr(function, '__code__', None)
+    if code is None:
+        return True
+    return bool(code.co_flags & _CO_VARARGS) or code.co_argcount >= count
+
+
+def replayEvents(events, modInfo=None):
+    """Feeds the events to a BriefModuleInfo instance and provides it.
+
+    The same as with the extension the _onStatement() handler is optional
+    and contentHash is fed to _onClass() and _onFunction() only if they take
+    it, so the objects written for the older protocol keep working.
+    """
+    if modInfo is None:
+        modInfo = BriefModuleInfo()
+    handlers = [getattr(modInfo, name) for name in EVENT_HANDLERS[:-1]]
+    handlers.append(getattr(modInfo, EVENT_HANDLERS[-1], None))
+    withHash = {EVENT_CLASS: _takesArguments(handlers[EVENT_CLASS], 10),
+                EVENT_FUNCTION: _takesArguments(handlers[EVENT_FUNCTION], 12)}
+    for event in events:
+        kind = event[0]
+        if handlers[kind] is None:
+            continue
+        if withHash.get(kind, True):
+            handlers[kind](*event[1:])
+        else:
+            handlers[kind](*event[1:-1])
     modInfo.flush()
     return modInfo
 
 
+def getBriefModuleDataFromFile(fileName, mask=ALL_EVENTS, cancel=None):
+    """Parses a file and provides the brief module info serialized.
+
+    The result is a compact bytes object which could be stored or sent to
+    another process and then read with BriefModuleData.
+    The mask tells what kinds of items to collect, see eventMask()
+    The parse could be stopped with the cancel token, see CancelToken
+    """
+    return _cdmpyparser.getBriefModuleDataFromFile(fileName, mask,
+                                                   *_cancelArgs(cancel))
+
+
+def getBriefModuleDataFromMemory(content, mask=ALL_EVENTS, cancel=None):
+    """Parses a code buffer and provides the brief module info serialized.
+
+    See getBriefModuleDataFromFile() for the details
+    """
+    return _cdmpyparser.getBriefModuleDataFromMemory(content, mask,
+                                                     *_cancelArgs(cancel))
+
+
+class BriefModuleData:
+
+    """Reads the serialized brief module info in place.
+
+    The data is a flat table of nodes. A node is a tuple which starts with
+    the node index, the kind (the EVENT_* values), the parent node index
+    (-1 for the module) and the name. The rest depends on the kind:
+    - EVENT_ENCODING, EVENT_GLOBAL, EVENT_CLASS_ATTRIBUTE,
+      EVENT_INSTANCE_ATTRIBUTE, EVENT_DECORATOR: line, pos, absPosition
+    - EVENT_IMPORT, EVENT_WHAT: line, pos, absPosition, alias
+    - EVENT_CLASS: line, pos, absPosition, keywordLine, keywordPos,
+      colonLine, colonPos, contentHash
+    - EVENT_FUNCTION: line, pos, absPosition, keywordLine, keywordPos,
+      colonLine, colonPos, isAsync, returnAnnotation, contentHash
+    - EVENT_STATEMENT: the name is ''; line, pos, absPosition, endLine,
+      contentHash
+    - EVENT_DOCSTRING: the name is the text; startLine, endLine
+    - EVENT_ARGUMENT: annotation, value
+    - EVENT_DECORATOR_ARGUMENT, EVENT_BASE_CLASS, EVENT_ERROR,
+      EVENT_LEXER_ERROR: nothing
+    The parents precede their children and the siblings are in the source
+    order.
+    """
+
+    __slots__ = ["data"]
+
+    def __init__(self, data):
+        # The header is checked the same way the extension does it
+        header = bytearray(data[:6])
+        if len(header) < 6 or header[:4] != b"CDMB":
+            raise ValueError("Not a brief module data")
+        if header[4] != _cdmpyparser.moduleDataVersion:
+            raise ValueError("Unsupported brief module data version %d" %
+                             header[4])
+        self.data = data        # bytes-like object; it is not copied
+
+    @property
+    def isOK(self):
+        """True if there were no errors"""
+        return bytearray(self.data[5:6])[0] & 1 != 0
+
+    def nodes(self, mask=ALL_EVENTS, depth=-1):
+        """Provides the nodes of the given kinds.
+
+        Only the nodes nested into at most depth functions and classes are
+        provided; negative depth means any nesting
+        """
+        return _cdmpyparser.readBriefModuleData(self.data, mask, depth)
+
+    def outline(self, depth=-1):
+        """Provides the class and function nodes"""
+        return self.nodes(eventMask(EVENT_CLASS, EVENT_FUNCTION), depth)
+
+    def toModuleInfo(self, lazy=False):
+        """Builds the BriefModuleInfo objects.
+
+        If lazy is True then a LazyBriefModuleInfo is provided
+        """
+        if lazy:
+            return LazyBriefModuleInfo(self.data)
+
+        modInfo = BriefModuleInfo()
+        modInfo.isOK = self.isOK
+        objects = {}
+        for node in self.nodes():
+            item = _newDataItem(node)
+            if node[1] in (EVENT_FUNCTION, EVENT_CLASS, EVENT_IMPORT,
+                           EVENT_DECORATOR):
+                objects[node[0]] = item
+            _attachDataItem(objects.get(node[2], modInfo), node[1], item)
+        return modInfo
+
+
+# The module data node kinds and the attributes of their parents objects
+_DATA_ITEM_TYPES = {EVENT_ENCODING: Encoding,
+                    EVENT_GLOBAL: Global,
+                    EVENT_FUNCTION: Function,
+                    EVENT_CLASS: Class,
+                    EVENT_CLASS_ATTRIBUTE: ClassAttribute,
+                    EVENT_INSTANCE_ATTRIBUTE: InstanceAttribute,
+                    EVENT_DECORATOR: Decorator,
+                    EVENT_DOCSTRING: Docstring}
+_DATA_ITEM_ATTRIBUTES = {EVENT_ENCODING: 'encoding',
+                         EVENT_GLOBAL: 'globals',
+                         EVENT_FUNCTION: 'functions',
+                         EVENT_CLASS: 'classes',
+                         EVENT_IMPORT: 'imports',
+                         EVENT_WHAT: 'what',
+                         EVENT_CLASS_ATTRIBUTE: 'classAttributes',
+                         EVENT_INSTANCE_ATTRIBUTE: 'instanceAttributes',
+                         EVENT_DECORATOR: 'decorators',
+                         EVENT_DECORATOR_ARGUMENT: 'arguments',
+                         EVENT_DOCSTRING: 'docstring',
+                         EVENT_ARGUMENT: 'arguments',
+                         EVENT_BASE_CLASS: 'base',
+                         EVENT_ERROR: 'errors',
+                         EVENT_LEXER_ERROR: 'lexerErrors',
+                         EVENT_STATEMENT: 'statements'}
+
+
+def _newDataItem(node):
+    """Creates the object for a module data node; the children are not
+       attached"""
+    kind = node[1]
+    if kind in (EVENT_IMPORT, EVENT_WHAT):
+        item = (Import if kind == EVENT_IMPORT else ImportWhat)(*node[3:7])
+        item.alias = node[7]
+        return item
+    if kind == EVENT_ARGUMENT:
+        item = Argument(node[3], node[4])
+        item.value = node[5]
+        return item
+    if kind == EVENT_STATEMENT:
+        return Statement(*node[4:])
+    if kind in _DATA_ITEM_TYPES:
+        return _DATA_ITEM_TYPES[kind](*node[3:])
+    return node[3]      # plain strings
+
+
+def _attachDataItem(owner, kind, item):
+    """Attaches the object to its parent object"""
+    attribute = _DATA_ITEM_ATTRIBUTES[kind]
+    if kind in (EVENT_ENCODING, EVENT_DOCSTRING):
+        setattr(owner, attribute, item)
+    elif kind == EVENT_DECORATOR_ARGUMENT and owner.arguments is None:
+        owner.arguments = [item]
+    else:
+        getattr(owner, attribute).append(item)
+
+
+def _newLazyDataItem(table, node):
+    """Creates the object for a node of the decoded module data. The
+       functions and classes get their children lazily, the imports and
+       the decorators right away"""
+    kind = node[1]
+    if kind in (EVENT_FUNCTION, EVENT_CLASS):
+        item = (LazyFunction if kind == EVENT_FUNCTION else LazyClass)(
+            table, node[0])
+        ModuleInfoBase.__init__(item, *node[3:7])
+        item.keywordLine, item.keywordPos, \
+            item.colonLine, item.colonPos = node[7:11]
+        if kind == EVENT_FUNCTION:
+            item.isAsync, item.returnAnnotation = node[11:13]
+        item.contentHash = node[-1]
+        return item
+
+    item = _newDataItem(node)
+    if kind in (EVENT_IMPORT, EVENT_DECORATOR):
+        for child in _cdmpyparser.getBriefModuleDataChildren(table, node[0]):
+            _attachDataItem(item, child[1], _newDataItem(child))
+    return item
+
+
+class _LazyChildren:
+
+    """Creates the children of a kind on the first access and memorizes
+       them in the slot of the base class"""
+
+    __slots__ = ["slot", "kind"]
+
+    def __init__(self, slot, kind):
+        self.slot = slot
+        self.kind = kind
+
+    def __get__(self, obj, objType=None):
+        if obj is None:
+            return self
+        try:
+            return self.slot.__get__(obj, objType)
+        except AttributeError:
+            items = [_newLazyDataItem(obj._table, node) for node in
+                     _cdmpyparser.getBriefModuleDataChildren(
+                         obj._table, obj._index, 1 << self.kind)]
+            if self.kind in (EVENT_ENCODING, EVENT_DOCSTRING):
+                items = items[-1] if items else None
+            self.slot.__set__(obj, items)
+            return items
+
+    def __set__(self, obj, value):
+        self.slot.__set__(obj, value)
+
+
+class LazyFunction(Function):
+
+    """A function which creates its nested items on the first access"""
+
+    __slots__ = ["_table", "_index"]
+
+    docstring = _LazyChildren(Function.docstring, EVENT_DOCSTRING)
+    arguments = _LazyChildren(Function.arguments, EVENT_ARGUMENT)
+    decorators = _LazyChildren(Function.decorators, EVENT_DECORATOR)
+    functions = _LazyChildren(Function.functions, EVENT_FUNCTION)
+    classes = _LazyChildren(Function.classes, EVENT_CLASS)
+
+    def __init__(self, table, index):
+        self._table = table
+        self._index = index
+
+
+class LazyClass(Class):
+
+    """A class which creates its nested items on the first access"""
+
+    __slots__ = ["_table", "_index"]
+
+    docstring = _LazyChildren(Class.docstring, EVENT_DOCSTRING)
+    base = _LazyChildren(Class.base, EVENT_BASE_CLASS)
+    decorators = _LazyChildren(Class.decorators, EVENT_DECORATOR)
+    classAttributes = _LazyChildren(Class.classAttributes,
+                                    EVENT_CLASS_ATTRIBUTE)
+    instanceAttributes = _LazyChildren(Class.instanceAttributes,
+                                       EVENT_INSTANCE_ATTRIBUTE)
+    functions = _LazyChildren(Class.functions, EVENT_FUNCTION)
+    classes = _LazyChildren(Class.classes, EVENT_CLASS)
+
+    def __init__(self, table, index):
+        self._table = table
+        self._index = index
+
+
+class LazyBriefModuleInfo(BriefModuleInfo):
+
+    """Holds the module data decoded by the extension and creates the
+       result objects only when they are accessed. The attributes are the
+       same as of BriefModuleInfo"""
+
+    __slots__ = ["_table", "_index"]
+
+    docstring = _LazyChildren(BriefModuleInfo.docstring, EVENT_DOCSTRING)
+    encoding = _LazyChildren(BriefModuleInfo.encoding, EVENT_ENCODING)
+    imports = _LazyChildren(BriefModuleInfo.imports, EVENT_IMPORT)
+    globals = _LazyChildren(BriefModuleInfo.globals, EVENT_GLOBAL)
+    functions = _LazyChildren(BriefModuleInfo.functions, EVENT_FUNCTION)
+    classes = _LazyChildren(BriefModuleInfo.classes, EVENT_CLASS)
+    errors = _LazyChildren(BriefModuleInfo.errors, EVENT_ERROR)
+    lexerErrors = _LazyChildren(BriefModuleInfo.lexerErrors,
+                                EVENT_LEXER_ERROR)
+    statements = _LazyChildren(BriefModuleInfo.statements, EVENT_STATEMENT)
+
+    def __init__(self, data):
+        self._table = _cdmpyparser.loadBriefModuleData(data)
+        self._index = -1
+        self.isOK = BriefModuleData(data).isOK
+
+
+# The ways the extension could find the items:
+# 'parser'  - the interpreter's parser; Python 3.9 and earlier only
+# 'scanner' - the extension's own structural scanner; no GIL is held
+PARSER_BACKENDS = _cdmpyparser.parserBackends
+
+
+def setParserBackend(name):
+    """Selects how the following parses find the items; one of
+       PARSER_BACKENDS"""
+    _cdmpyparser.setParserBackend(name)
+
+
+def getParserBackend():
+    """Provides the name of the backend the parses use"""
+    return _cdmpyparser.getParserBackend()
+
+
 def getVersion():
     """Provides the parser version"""
     return _cdmpyparser.version
@@ -61,7 +61,7 @@ except Exception as exc:
 # dependencies
 setup(name='cdmpyparser',
       description=description,
-      python_requires='>=3.5, <3.10',
+      python_requires='>=3.5',
       long_description=long_description,
       version=version,
       author='Sergey Satskiy',
@@ -79,9 +79,11 @@ setup(name='cdmpyparser',
        platforms=['any'],
        py_modules=['cdmpyparser'],
        ext_modules=[Extension('_cdmpyparser',
-                              ['src/cdmpyparser.c'],
+                              ['src/cdmpyparser.c', 'src/newlines.c'],
                               extra_compile_args=['-Wno-unused', '-fomit-frame-pointer',
                                                   '-DCDM_PY_PARSER_VERSION="' + version + '"',
                                                   '-ffast-math',
                                                   '-O2',
-                                                  '-std=c99'])])
+                                                  '-std=c99',
+                                                  '-pthread'],
+                              extra_link_args=['-pthread'])])
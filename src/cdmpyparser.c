@@ -20,31 +20,50 @@
 
 #include <Python.h>
 #include <sys/stat.h>
-#include <node.h>
-#include <grammar.h>
-#include <parsetok.h>
-#include <graminit.h>
-#include <errcode.h>
-#include <token.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+/* The interpreter's concrete syntax tree parser is gone since Python 3.10;
+ * the structural scanner is the only backend there */
+#if PY_VERSION_HEX < 0x030A0000
+    #define CDM_INTERPRETER_PARSER  1
+#endif
+
+#ifdef CDM_INTERPRETER_PARSER
+    #include <node.h>
+    #include <grammar.h>
+    #include <parsetok.h>
+    #include <graminit.h>
+    #include <errcode.h>
+    #include <token.h>
+#endif
+
+#include "newlines.h"
 
 #include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
 
 #ifndef CDM_PY_PARSER_VERSION
 #error "Version must be specified"
 #endif
 
-#define MAX_DOTTED_NAME_LENGTH      512
-#define MAX_ARG_VAL_SIZE            2048
-/* I saw some files which have bigger than 32kb docstrings! */
-#define MAX_DOCSTRING_SIZE          65535
 #define MAX_ERROR_MSG_SIZE          32768
 
 
+#ifdef CDM_INTERPRETER_PARSER
 extern grammar      _PyParser_Grammar;  /* From graminit.c */
+#endif
 
 
 #if PY_MAJOR_VERSION == 3
     #define PyInt_FromLong              PyLong_FromLong
+    #define PyInt_AsLong                PyLong_AsLong
     #define PyString_FromString         PyUnicode_FromString
     #define PyString_FromStringAndSize  PyUnicode_FromStringAndSize
 #endif
@@ -61,6 +80,35 @@ enum Scope {
 };
 
 
+/* The globals and the class and instance attributes already emitted by a
+ * walker; an open addressing hash of ( owner, kind, name ). The duplicates
+ * are dropped before any Python object is created, so the first one wins.
+ * The owners are numbered as the functions and classes come; the module is
+ * 0. No Python API is used. */
+struct uniqueName
+{
+    uint32_t        hash;           /* 0: empty slot */
+    int             owner;
+    int             kind;
+    int             offset;         /* in the pool */
+    int             length;
+};
+
+struct uniqueNames
+{
+    struct uniqueName *     slots;
+    int                     slotCount;      /* power of 2 */
+    int                     count;
+    char *                  pool;
+    int                     poolSize;
+    int                     poolCapacity;
+    int *                   owners;         /* per objects level, -1: none */
+    int                     ownersCount;
+    int                     ownersCapacity;
+    int                     lastOwner;
+};
+
+
 /* The structure holds resolved callbacks for Python class methods */
 struct instanceCallbacks
 {
@@ -81,17 +129,477 @@ struct instanceCallbacks
     PyObject *      onBaseClass;
     PyObject *      onError;
     PyObject *      onLexerError;
+    PyObject *      onStatement;    /* NULL if the instance has none */
+
+    /* The _onClass() and _onFunction() written before the content hashes
+     * were added do not take them */
+    int             classHash;
+    int             functionHash;
+};
+
+
+/* Kinds of the items the walker reports; one per instanceCallbacks member.
+ * The values are a part of the events interface: keep in sync with the
+ * EVENT_* constants in cdmpyparser.py */
+enum EventKind {
+    ENCODING_EVENT,
+    GLOBAL_EVENT,
+    FUNCTION_EVENT,
+    CLASS_EVENT,
+    IMPORT_EVENT,
+    AS_EVENT,
+    WHAT_EVENT,
+    CLASS_ATTRIBUTE_EVENT,
+    INSTANCE_ATTRIBUTE_EVENT,
+    DECORATOR_EVENT,
+    DECORATOR_ARGUMENT_EVENT,
+    DOCSTRING_EVENT,
+    ARGUMENT_EVENT,
+    ARGUMENT_VALUE_EVENT,
+    BASE_CLASS_EVENT,
+    ERROR_EVENT,
+    LEXER_ERROR_EVENT,
+    STATEMENT_EVENT
+};
+
+/* The wanted event kinds are passed as a mask of the bits below */
+#define EVENT_BIT( kind )   ( 1 << (kind) )
+#define ALL_EVENTS_MASK     ( EVENT_BIT( STATEMENT_EVENT + 1 ) - 1 )
+
+/* The parse options which could be added to the mask. Keep in sync with
+ * cdmpyparser.py */
+#define SKIP_FUNCTION_BODIES_OPTION     ( 1 << 24 )
+#define TOP_LEVEL_ONLY_OPTION           ( 1 << 25 )
+#define STOP_AT_CODE_OPTION             ( 1 << 26 )
+#define RAW_DOCSTRINGS_OPTION           ( 1 << 27 )
+#define ALL_OPTIONS_MASK                ( SKIP_FUNCTION_BODIES_OPTION | \
+                                          TOP_LEVEL_ONLY_OPTION | \
+                                          STOP_AT_CODE_OPTION | \
+                                          RAW_DOCSTRINGS_OPTION )
+
+
+/* A single item found by the walker. Only the members which make sense for
+ * the event kind are filled, the rest are 0. The strings are not necessarily
+ * NULL terminated; they live till the walker returns. */
+struct parserEvent
+{
+    enum EventKind      kind;
+    const char *        name;               /* also: docstring text,
+                                               argument value, message */
+    int                 nameLength;
+    int                 line;               /* docstring: first line */
+    int                 pos;
+    int                 absPosition;
+    int                 level;              /* objects level */
+    int                 keywordLine;        /* 'def' or 'class' */
+    int                 keywordPos;
+    int                 colonLine;
+    int                 colonPos;
+    int                 endLine;            /* docstring: last line */
+    int                 isAsync;
+    const char *        annotation;         /* argument or return value */
+    int                 annotationLength;   /* 0 if there is none */
+    uint64_t            contentHash;        /* function, class, statement */
+};
+
+
+/* Builds the BriefModuleInfo objects graph without calling the _on* Python
+ * methods. It repeats what the BriefModuleInfo methods do. */
+struct nativeBuilder
+{
+    PyObject *      modInfo;            /* borrowed */
+    PyObject *      objectsStack;       /* Functions and Classes */
+    PyObject *      lastImport;
+    PyObject *      lastDecorators;     /* list or NULL */
+};
+
+
+/* A recorded event. The strings are stored in the buffer pool and referred
+ * by offsets. All the members are 32 bit integers so the records could be
+ * handed over to Python as they are. */
+struct eventRecord
+{
+    int     kind;
+    int     nameOffset;
+    int     nameLength;
+    int     line;
+    int     pos;
+    int     absPosition;
+    int     level;
+    int     keywordLine;
+    int     keywordPos;
+    int     colonLine;
+    int     colonPos;
+    int     endLine;
+    int     isAsync;
+    int     annotationOffset;
+    int     annotationLength;
+    int     hashLow;
+    int     hashHigh;
+};
+
+/* The header of the raw (bytes) representation of the recorded events. It is
+ * followed by the records and then by the strings pool. */
+struct eventBufferHeader
+{
+    int     version;
+    int     count;
+};
+
+#define EVENT_BUFFER_VERSION        4
+
+/* Accumulates the events in plain C memory; no Python API is used so
+ * recording does not need the GIL */
+struct eventBuffer
+{
+    struct eventRecord *    records;
+    int                     count;
+    int                     capacity;
+    char *                  pool;
+    int                     poolSize;
+    int                     poolCapacity;
+    int                     failed;         /* memory allocation failed */
+};
+
+
+/* The per parse memory. The arena is a bump allocator over a list of chunks:
+ * an allocation takes the next aligned bytes of the current chunk and the
+ * whole parse is released in O(1) by going back to the mark saved at its
+ * start. The chunks are kept for the following parses, so a thread that
+ * parses many files does not call malloc() after the first few of them.
+ * Nested parses, e.g. from a callback, allocate above the outer one. */
+#define ARENA_CHUNK_SIZE            65536
+#define ARENA_ALIGNMENT             16
+
+struct arenaChunk
+{
+    struct arenaChunk *     next;   /* the chunks after the current one are
+                                       free */
+    size_t                  size;
+    size_t                  used;
+    char *                  data;
+};
+
+struct arena
+{
+    struct arenaChunk *     first;
+    struct arenaChunk *     current;    /* NULL if nothing is allocated */
+};
+
+struct arenaMark
+{
+    struct arenaChunk *     chunk;
+    size_t                  used;
+};
+
+
+static void
+clearArena( struct arena *  arena )
+{
+    while ( arena->first != NULL )
+    {
+        struct arenaChunk *     next = arena->first->next;
+
+        free( arena->first );
+        arena->first = next;
+    }
+    arena->current = NULL;
+}
+
+
+static struct arenaMark
+saveArena( const struct arena *  arena )
+{
+    struct arenaMark    mark = { .chunk = arena->current,
+                                 .used = arena->current == NULL
+                                            ? 0 : arena->current->used };
+    return mark;
+}
+
+
+/* Frees everything allocated after the mark was saved */
+static void
+releaseArena( struct arena *  arena, struct arenaMark  mark )
+{
+    arena->current = mark.chunk;
+    if ( mark.chunk != NULL )
+        mark.chunk->used = mark.used;
+}
+
+
+/* The offset of the next aligned allocation in the chunk */
+static size_t
+alignedUsed( const struct arenaChunk *  chunk )
+{
+    uintptr_t   top = (uintptr_t)( chunk->data + chunk->used );
+
+    top = ( top + ARENA_ALIGNMENT - 1 ) & ~(uintptr_t)( ARENA_ALIGNMENT - 1 );
+    return (char *) top - chunk->data;
+}
+
+
+/* NULL if there is no memory */
+static void *
+arenaAlloc( struct arena *  arena, size_t  size )
+{
+    struct arenaChunk *     chunk = arena->current;
+
+    if ( chunk != NULL && alignedUsed( chunk ) + size <= chunk->size )
+    {
+        void *  ptr = chunk->data + alignedUsed( chunk );
+        chunk->used = alignedUsed( chunk ) + size;
+        return ptr;
+    }
+
+    /* A free chunk which is big enough or a new one becomes the current */
+    struct arenaChunk **    head = chunk == NULL ? & arena->first
+                                                 : & chunk->next;
+    struct arenaChunk **    link = head;
+    struct arenaChunk *     found;
+
+    while ( *link != NULL && ( *link )->size < size + ARENA_ALIGNMENT )
+        link = & ( *link )->next;
+
+    if ( *link != NULL )
+    {
+        found = *link;
+        *link = found->next;
+    }
+    else
+    {
+        size_t      capacity = size + ARENA_ALIGNMENT;
+        if ( capacity < ARENA_CHUNK_SIZE )
+            capacity = ARENA_CHUNK_SIZE;
+
+        found = (struct arenaChunk *) malloc( sizeof( struct arenaChunk ) +
+                                              capacity );
+        if ( found == NULL )
+            return NULL;
+        found->size = capacity;
+        found->data = (char *)( found + 1 );
+    }
+
+    found->next = *head;
+    *head = found;
+    arena->current = found;
+
+    found->used = 0;
+    found->used = alignedUsed( found ) + size;
+    return found->data + found->used - size;
+}
+
+
+/* The same as realloc() does. The last allocation grows in place if there
+ * is room; otherwise the content is copied and the old memory stays
+ * allocated till the arena is released. */
+static void *
+arenaGrow( struct arena *  arena, void *  ptr, size_t  oldSize,
+           size_t  newSize )
+{
+    struct arenaChunk *     chunk = arena->current;
+
+    if ( ptr != NULL && chunk != NULL &&
+         (char *) ptr + oldSize == chunk->data + chunk->used &&
+         (char *) ptr - chunk->data + newSize <= chunk->size )
+    {
+        chunk->used = (char *) ptr - chunk->data + newSize;
+        return ptr;
+    }
+
+    void *  grown = arenaAlloc( arena, newSize );
+    if ( grown != NULL && ptr != NULL )
+        memcpy( grown, ptr, oldSize < newSize ? oldSize : newSize );
+    return grown;
+}
+
+
+static void
+clearUniqueNames( struct uniqueNames *  names )
+{
+    free( names->slots );
+    free( names->pool );
+    free( names->owners );
+    memset( names, 0, sizeof( struct uniqueNames ) );
+}
+
+
+/* Memorizes a new owner for the items at the objects level of a function or
+ * a class; provides 0 on success */
+static int
+addUniqueOwner( struct uniqueNames *  names, int  level )
+{
+    if ( level < 0 )
+        return 0;
+
+    if ( level >= names->ownersCapacity )
+    {
+        int     capacity = names->ownersCapacity == 0 ?
+                                        16 : names->ownersCapacity * 2;
+        while ( capacity <= level )
+            capacity *= 2;
+
+        int *   owners = (int *) realloc( names->owners,
+                                          capacity * sizeof( int ) );
+        if ( owners == NULL )
+            return 1;
+        names->owners = owners;
+        names->ownersCapacity = capacity;
+    }
+
+    /* The levels skipped by the mask have no owners */
+    for ( int  k = names->ownersCount; k < level; ++k )
+        names->owners[ k ] = -1;
+    names->owners[ level ] = ++names->lastOwner;
+    names->ownersCount = level + 1;
+    return 0;
+}
+
+
+static int
+rehashUniqueNames( struct uniqueNames *  names )
+{
+    int                     slotCount = names->slotCount == 0 ?
+                                            256 : names->slotCount * 2;
+    struct uniqueName *     slots = (struct uniqueName *)
+                                calloc( slotCount, sizeof( struct uniqueName ) );
+    if ( slots == NULL )
+        return 1;
+
+    for ( int  k = 0; k < names->slotCount; ++k )
+    {
+        if ( names->slots[ k ].hash == 0 )
+            continue;
+
+        uint32_t    slot = names->slots[ k ].hash & ( slotCount - 1 );
+        while ( slots[ slot ].hash != 0 )
+            slot = ( slot + 1 ) & ( slotCount - 1 );
+        slots[ slot ] = names->slots[ k ];
+    }
+
+    free( names->slots );
+    names->slots = slots;
+    names->slotCount = slotCount;
+    return 0;
+}
+
+
+/* Tells if a global, a class or an instance attribute event is the first
+ * one with its name in its owner: 1 if so, 0 if it is a duplicate and -1 if
+ * there is no memory. The events without a known owner are let through. */
+static int
+isUniqueName( struct uniqueNames *  names, const struct parserEvent *  e )
+{
+    int     owner = 0;
+
+    if ( e->kind != GLOBAL_EVENT )
+    {
+        /* A class attribute is owned by the class at its level; an instance
+         * attribute by the class one level above the member function */
+        int     level = e->kind == CLASS_ATTRIBUTE_EVENT ? e->level
+                                                         : e->level - 1;
+        if ( level < 0 || level >= names->ownersCount ||
+             names->owners[ level ] < 0 )
+            return 1;
+        owner = names->owners[ level ];
+    }
+
+    uint32_t    hash = 2166136261U;
+    for ( int  k = 0; k < e->nameLength; ++k )
+        hash = ( hash ^ (unsigned char) e->name[ k ] ) * 16777619U;
+    hash = ( hash ^ (uint32_t) owner * 2654435761U ) * 16777619U ^
+           (uint32_t) e->kind;
+    if ( hash == 0 )
+        hash = 1;
+
+    if ( ( names->count + 1 ) * 2 > names->slotCount &&
+         rehashUniqueNames( names ) != 0 )
+        return -1;
+
+    uint32_t    mask = names->slotCount - 1;
+    uint32_t    slot = hash & mask;
+    while ( names->slots[ slot ].hash != 0 )
+    {
+        const struct uniqueName *   other = & names->slots[ slot ];
+        if ( other->hash == hash && other->owner == owner &&
+             other->kind == (int) e->kind &&
+             other->length == e->nameLength &&
+             memcmp( names->pool + other->offset, e->name,
+                     e->nameLength ) == 0 )
+            return 0;
+        slot = ( slot + 1 ) & mask;
+    }
+
+    if ( names->poolSize + e->nameLength > names->poolCapacity )
+    {
+        int     capacity = names->poolCapacity == 0 ?
+                                        4096 : names->poolCapacity * 2;
+        while ( capacity < names->poolSize + e->nameLength )
+            capacity *= 2;
+
+        char *  pool = (char *) realloc( names->pool, capacity );
+        if ( pool == NULL )
+            return -1;
+        names->pool = pool;
+        names->poolCapacity = capacity;
+    }
+
+    memcpy( names->pool + names->poolSize, e->name, e->nameLength );
+    names->slots[ slot ].hash = hash;
+    names->slots[ slot ].owner = owner;
+    names->slots[ slot ].kind = e->kind;
+    names->slots[ slot ].offset = names->poolSize;
+    names->slots[ slot ].length = e->nameLength;
+    names->poolSize += e->nameLength;
+    ++names->count;
+    return 1;
+}
+
+
+/* The walker checks the cancellation once per this number of the visited
+ * tree nodes or the replayed events */
+#define CANCEL_CHECK_INTERVAL       1024
+
+/* Tells if a parse is to be abandoned: either the caller has set the flag
+ * byte (possibly from another thread) or the deadline has passed */
+struct cancelCheck
+{
+    const volatile char *   flag;       /* NULL if there is no flag */
+    Py_buffer               view;       /* the flag comes from */
+    double                  deadline;   /* monotonic seconds, 0 if none */
+    int                     countdown;  /* till the next check */
+    int                     cancelled;
+};
+
+
+/* Where the walker delivers the found items. Exactly one of the members is
+ * not NULL. */
+struct parserContext
+{
+    struct instanceCallbacks *  callbacks;
+    struct nativeBuilder *      builder;
+    struct eventBuffer *        events;
+    int                         mask;       /* wanted event kinds */
+    PyObject *                  statements; /* optional list of the top level
+                                               statements starts */
+    const char *                buffer;     /* the code being walked */
+    struct arena *              arena;      /* the walker scratch memory */
+    struct cancelCheck *        cancel;     /* NULL if not cancellable */
+    struct uniqueNames          names;      /* the delivered named items */
 };
 
+
+#ifdef CDM_INTERPRETER_PARSER
 /* Forward declaration */
 void walk( node *                       tree,
-           struct instanceCallbacks *   callbacks,
+           struct parserContext *       context,
            int                          objectsLevel,
            enum Scope                   scope,
            const char *                 firstArgName,
            int                          entryLevel,
            int *                        lineShifts,
            int                          isStaticMethod );
+#endif
+
 
 
 #define GET_CALLBACK( name )                                                \
@@ -102,6 +610,18 @@ void walk( node *                       tree,
         return 1;                                                           \
     }
 
+/* The callbacks added after the first release are optional, so that the
+ * objects written for the older protocol keep working */
+#define GET_OPTIONAL_CALLBACK( name )                                       \
+    callbacks->name = PyObject_GetAttrString( instance, "_" #name );        \
+    if ( ! callbacks->name )                                                \
+        PyErr_Clear();                                                      \
+    else if ( ! PyCallable_Check( callbacks->name ) )                       \
+    {                                                                       \
+        PyErr_SetString( PyExc_TypeError, "Cannot get _" #name " method" ); \
+        return 1;                                                           \
+    }
+
 #define FREE_CALLBACK( name )           \
     if ( callbacks->name )              \
     {                                   \
@@ -109,6 +629,27 @@ void walk( node *                       tree,
     }
 
 
+/* Tells if the callback takes the given number of positional arguments.
+ * Only the Python functions and methods could be checked; the other
+ * callables are expected to follow the current protocol. */
+static int
+takesArguments( PyObject *  callback, int  count )
+{
+    PyObject *  function = callback;
+
+    if ( PyMethod_Check( callback ) )
+    {
+        function = PyMethod_GET_FUNCTION( callback );
+        ++count;    /* self */
+    }
+    if ( ! PyFunction_Check( function ) )
+        return 1;
+
+    PyCodeObject *  code = (PyCodeObject *) PyFunction_GET_CODE( function );
+    return ( code->co_flags & CO_VARARGS ) != 0 || code->co_argcount >= count;
+}
+
+
 /* Helper function to extract and check method pointers */
 static int
 getInstanceCallbacks( PyObject *                  instance,
@@ -133,7 +674,10 @@ getInstanceCallbacks( PyObject *                  instance,
     GET_CALLBACK( onBaseClass );
     GET_CALLBACK( onError );
     GET_CALLBACK( onLexerError );
+    GET_OPTIONAL_CALLBACK( onStatement );
 
+    callbacks->classHash = takesArguments( callbacks->onClass, 10 );
+    callbacks->functionHash = takesArguments( callbacks->onFunction, 12 );
     return 0;
 }
 
@@ -160,336 +704,345 @@ clearCallbacks( struct instanceCallbacks *  callbacks )
     FREE_CALLBACK( onBaseClass );
     FREE_CALLBACK( onError );
     FREE_CALLBACK( onLexerError );
+    FREE_CALLBACK( onStatement );
     return;
 }
 
-static void
-callOnEncoding( PyObject *  onEncoding, const char *  encoding_,
-                int  line_,  int  pos_,  int  absPosition_ )
-{
-    PyObject *  encoding = PyString_FromString( encoding_ );
-    PyObject *  line = PyInt_FromLong( line_ );
-    PyObject *  pos = PyInt_FromLong( pos_ );
-    PyObject *  absPos = PyInt_FromLong( absPosition_ );
-    PyObject *  ret = PyObject_CallFunctionObjArgs( onEncoding, encoding,
-                                                    line, pos, absPos,
-                                                    NULL );
+/* The names (identifiers, decorators, base classes, imports) come from a
+ * direct mapped cache so that the items of the parses share one string
+ * object per name and the repeated names need no allocation and decoding.
+ * The names are not interned: the interned strings are immortal since
+ * Python 3.12. The cache is bounded; a slot holds a reference to its last
+ * name only and the next name which maps to the slot releases it. The GIL
+ * is needed. */
+#define IDENTIFIER_CACHE_SIZE       4096    /* power of 2 */
+#define IDENTIFIER_MAX_LENGTH       64      /* the longer ones are not
+                                               cached */
 
-    if ( ret != NULL )
-        Py_DECREF( ret );
-    Py_DECREF( absPos );
-    Py_DECREF( pos );
-    Py_DECREF( line );
-    Py_DECREF( encoding );
-    return;
-}
+static PyObject *   identifierCache[ IDENTIFIER_CACHE_SIZE ];
 
 
-static void
-callOnError( PyObject *  onError_, const char *  error_ )
+static PyObject *
+newIdentifier( const char *  str, int  length )
 {
-    PyObject *  error = PyString_FromString( error_ );
-    PyObject *  ret = PyObject_CallFunctionObjArgs( onError_, error, NULL );
+    if ( length == 0 || length > IDENTIFIER_MAX_LENGTH )
+        return PyString_FromStringAndSize( str, length );
+
+    uint32_t    hash = 2166136261U;
+    for ( int  k = 0; k < length; ++k )
+        hash = ( hash ^ (unsigned char) str[ k ] ) * 16777619U;
+
+    /* Only the ASCII names are cached so the content is the UTF-8 one */
+    PyObject **     slot = & identifierCache[ hash &
+                                              ( IDENTIFIER_CACHE_SIZE - 1 ) ];
+    if ( *slot != NULL && PyUnicode_GET_LENGTH( *slot ) == length &&
+         memcmp( PyUnicode_DATA( *slot ), str, length ) == 0 )
+    {
+        Py_INCREF( *slot );
+        return *slot;
+    }
 
-    if ( ret != NULL )
-        Py_DECREF( ret );
-    Py_DECREF( error );
-    return;
+    PyObject *      identifier = PyString_FromStringAndSize( str, length );
+    if ( identifier == NULL )
+        return NULL;
+
+    if ( PyUnicode_IS_ASCII( identifier ) )
+    {
+        Py_XDECREF( *slot );
+        Py_INCREF( identifier );
+        *slot = identifier;
+    }
+    return identifier;
 }
 
 
-static void
-callOnArg( PyObject *  onArg, const char *  name, int  length )
+/* The kinds of the events which name is an identifier like one */
+static int
+isNameEvent( int  kind )
 {
-    PyObject *  argName = PyString_FromStringAndSize( name, length );
-    PyObject *  ret = PyObject_CallFunctionObjArgs( onArg, argName, NULL );
-
-    if ( ret != NULL )
-        Py_DECREF( ret );
-    Py_DECREF( argName );
-    return;
+    switch ( kind )
+    {
+        case GLOBAL_EVENT:
+        case FUNCTION_EVENT:
+        case CLASS_EVENT:
+        case IMPORT_EVENT:
+        case AS_EVENT:
+        case WHAT_EVENT:
+        case CLASS_ATTRIBUTE_EVENT:
+        case INSTANCE_ATTRIBUTE_EVENT:
+        case DECORATOR_EVENT:
+        case ARGUMENT_EVENT:
+        case BASE_CLASS_EVENT:
+            return 1;
+    }
+    return 0;
 }
 
 
-static void
-callOnAnnotatedArg( PyObject *  onArg,
-                    const char *  name, int  length,
-                    const char *  annotation, int  annotationLength )
+/* The line numbers and the positions are mostly small but above the ones
+ * the interpreter caches, so their objects are created once on demand. The
+ * GIL is needed. */
+#define INT_CACHE_SIZE              8192
+
+static PyObject *   intCache[ INT_CACHE_SIZE ];
+
+
+static PyObject *
+newInt( long  value )
 {
-    PyObject *  argName = PyString_FromStringAndSize( name, length );
-    PyObject *  argumentAnnotation;
-    if ( annotationLength > 0 )
-    {
-        argumentAnnotation = PyString_FromStringAndSize( annotation,
-                                                         annotationLength );
-    }
-    else
+    if ( value < 0 || value >= INT_CACHE_SIZE )
+        return PyInt_FromLong( value );
+
+    if ( intCache[ value ] == NULL )
     {
-        argumentAnnotation = Py_None;
-        Py_INCREF( Py_None );
+        intCache[ value ] = PyInt_FromLong( value );
+        if ( intCache[ value ] == NULL )
+            return NULL;
     }
-
-    PyObject *  ret = PyObject_CallFunctionObjArgs( onArg, argName,
-                                                    argumentAnnotation, NULL );
-    if ( ret != NULL )
-        Py_DECREF( ret );
-    Py_DECREF( argumentAnnotation );
-    Py_DECREF( argName );
-    return;
+    Py_INCREF( intCache[ value ] );
+    return intCache[ value ];
 }
 
 
-static void
-callOnArgVal( PyObject *  onArgVal, const char *  value, int  length )
+static PyObject *
+newString( const char *  str, int  length )
 {
-    PyObject *  argVal = PyString_FromStringAndSize( value, length );
-    PyObject *  ret = PyObject_CallFunctionObjArgs( onArgVal, argVal, NULL );
-
-    if ( ret != NULL )
-        Py_DECREF( ret );
-    Py_DECREF( argVal );
-    return;
+    return PyString_FromStringAndSize( str, length );
 }
 
 
-static void
-callOnVariable( PyObject *  onVariable, const char *  name, int  length,
-                int  line_, int  pos_, int  absPosition_, int  objectsLevel_ )
-{
-    PyObject *  varName = PyString_FromStringAndSize( name, length );
-    PyObject *  line = PyInt_FromLong( line_ );
-    PyObject *  pos = PyInt_FromLong( pos_ );
-    PyObject *  absPos = PyInt_FromLong( absPosition_ );
-    PyObject *  objectsLevel = PyInt_FromLong( objectsLevel_ );
-    PyObject *  ret = PyObject_CallFunctionObjArgs( onVariable, varName, line, pos,
-                                                    absPos, objectsLevel, NULL );
-
-    if ( ret != NULL )
-        Py_DECREF( ret );
-    Py_DECREF( objectsLevel );
-    Py_DECREF( absPos );
-    Py_DECREF( pos );
-    Py_DECREF( line );
-    Py_DECREF( varName );
-    return;
+static PyObject *
+newOptionalString( const char *  str, int  length )
+{
+    if ( length > 0 )
+        return PyString_FromStringAndSize( str, length );
+    Py_INCREF( Py_None );
+    return Py_None;
 }
 
 
-static void
-callOnImport( PyObject *  onImport, const char *  name, int  length,
-              int  line_, int  pos_, int  absPosition_ )
-{
-    PyObject *  import = PyString_FromStringAndSize( name, length );
-    PyObject *  line = PyInt_FromLong( line_ );
-    PyObject *  pos = PyInt_FromLong( pos_ );
-    PyObject *  absPos = PyInt_FromLong( absPosition_ );
-    PyObject *  ret = PyObject_CallFunctionObjArgs( onImport, import, line, pos,
-                                                    absPos, NULL );
-
-    if ( ret != NULL )
-        Py_DECREF( ret );
-    Py_DECREF( absPos );
-    Py_DECREF( pos );
-    Py_DECREF( line );
-    Py_DECREF( import );
-    return;
+static PyObject *
+newNone( void )
+{
+    Py_INCREF( Py_None );
+    return Py_None;
 }
 
 
+/* Calls the callback with args[ 1 ] ... args[ count ] and releases them.
+ * The arguments are passed as the array itself, no tuple is built. args[ 0 ]
+ * is a spare slot: a bound method puts its instance there instead of
+ * copying the arguments. Nothing is called if an argument is NULL, i.e. if
+ * there was no memory for it. */
 static void
-callOnAs( PyObject *  onAs, const char *  name, int  length)
+callWithArgs( PyObject *  callback, PyObject **  args, int  count )
 {
-    PyObject *  as = PyString_FromStringAndSize( name, length );
-    PyObject *  ret = PyObject_CallFunctionObjArgs( onAs, as, NULL );
+    int         complete = 1;
 
-    if ( ret != NULL )
-        Py_DECREF( ret );
-    Py_DECREF( as );
-    return;
+    for ( int  k = 1; k <= count; ++k )
+        if ( args[ k ] == NULL )
+            complete = 0;
+
+    if ( complete )
+    {
+        #if PY_VERSION_HEX >= 0x03090000
+            PyObject *  ret = PyObject_Vectorcall(
+                                    callback, args + 1,
+                                    count | PY_VECTORCALL_ARGUMENTS_OFFSET,
+                                    NULL );
+        #elif PY_VERSION_HEX >= 0x03080000
+            PyObject *  ret = _PyObject_Vectorcall(
+                                    callback, args + 1,
+                                    count | PY_VECTORCALL_ARGUMENTS_OFFSET,
+                                    NULL );
+        #elif PY_VERSION_HEX >= 0x03060000
+            PyObject *  ret = _PyObject_FastCall( callback, args + 1, count );
+        #else
+            PyObject *  ret = NULL;
+            PyObject *  tuple = PyTuple_New( count );
+            if ( tuple != NULL )
+            {
+                for ( int  k = 1; k <= count; ++k )
+                {
+                    Py_INCREF( args[ k ] );
+                    PyTuple_SET_ITEM( tuple, k - 1, args[ k ] );
+                }
+                ret = PyObject_Call( callback, tuple, NULL );
+                Py_DECREF( tuple );
+            }
+        #endif
+        Py_XDECREF( ret );
+    }
+
+    for ( int  k = 1; k <= count; ++k )
+        Py_XDECREF( args[ k ] );
 }
 
 
 static void
-callOnWhat( PyObject *  onWhat, const char *  name, int  length,
-            int  line_, int  pos_, int  absPosition_ )
-{
-    PyObject *  what = PyString_FromStringAndSize( name, length );
-    PyObject *  line = PyInt_FromLong( line_ );
-    PyObject *  pos = PyInt_FromLong( pos_ );
-    PyObject *  absPos = PyInt_FromLong( absPosition_ );
-    PyObject *  ret = PyObject_CallFunctionObjArgs( onWhat, what, line, pos,
-                                                    absPos, NULL );
-
-    if ( ret != NULL )
-        Py_DECREF( ret );
-    Py_DECREF( absPos );
-    Py_DECREF( pos );
-    Py_DECREF( line );
-    Py_DECREF( what );
-    return;
+callOnEncoding( PyObject *  onEncoding, const char *  encoding, int  length,
+                int  line, int  pos, int  absPosition )
+{
+    PyObject *  args[] = { NULL, PyString_FromStringAndSize( encoding, length ),
+                           newInt( line ), newInt( pos ),
+                           newInt( absPosition ) };
+    callWithArgs( onEncoding, args, 4 );
 }
 
 
 static void
-callOnDocstring( PyObject *  onDocstring, const char *  doc, int  length,
-                 int  startLine_, int  endLine_ )
-{
-    PyObject *  docstring = PyString_FromStringAndSize( doc, length );
-    PyObject *  startLine = PyInt_FromLong( startLine_ );
-    PyObject *  endLine = PyInt_FromLong( endLine_ );
-    PyObject *  ret = PyObject_CallFunctionObjArgs( onDocstring, docstring,
-                                                    startLine, endLine,
-                                                    NULL );
-
-    if ( ret != NULL )
-        Py_DECREF( ret );
-    Py_DECREF( endLine );
-    Py_DECREF( startLine );
-    Py_DECREF( docstring );
-    return;
+callOnError( PyObject *  onError, const char *  error, int  length )
+{
+    PyObject *  args[] = { NULL, PyString_FromStringAndSize( error, length ) };
+    callWithArgs( onError, args, 1 );
 }
 
 
-
 static void
-callOnDecorator( PyObject *  onDecorator,
-                 const char *  name, int  length,
-                 int  line_, int  pos_, int  absPosition_ )
-{
-    PyObject *  decorName = PyString_FromStringAndSize( name, length );
-    PyObject *  line = PyInt_FromLong( line_ );
-    PyObject *  pos = PyInt_FromLong( pos_ );
-    PyObject *  absPos = PyInt_FromLong( absPosition_ );
-    PyObject *  ret = PyObject_CallFunctionObjArgs( onDecorator, decorName,
-                                                    line, pos,
-                                                    absPos, NULL );
-
-    if ( ret != NULL )
-        Py_DECREF( ret );
-    Py_DECREF( absPos );
-    Py_DECREF( pos );
-    Py_DECREF( line );
-    Py_DECREF( decorName );
-    return;
+callOnArg( PyObject *  onArg, const char *  name, int  length )
+{
+    PyObject *  args[] = { NULL, newIdentifier( name, length ) };
+    callWithArgs( onArg, args, 1 );
 }
 
 
 static void
-callOnClass( PyObject *  onClass,
-             const char *  name, int  length,
-             int  line_, int  pos_, int  absPosition_,
-             int  kwLine_, int  kwPos_,
-             int  colonLine_, int  colonPos_,
-             int  objectsLevel_ )
-{
-    PyObject *  className = PyString_FromStringAndSize( name, length );
-    PyObject *  line = PyInt_FromLong( line_ );
-    PyObject *  pos = PyInt_FromLong( pos_ );
-    PyObject *  absPos = PyInt_FromLong( absPosition_ );
-    PyObject *  kwLine = PyInt_FromLong( kwLine_ );
-    PyObject *  kwPos = PyInt_FromLong( kwPos_ );
-    PyObject *  colonLine = PyInt_FromLong( colonLine_ );
-    PyObject *  colonPos = PyInt_FromLong( colonPos_ );
-    PyObject *  objectsLevel = PyInt_FromLong( objectsLevel_ );
-    PyObject *  ret = PyObject_CallFunctionObjArgs(
-                                onClass, className, line, pos,
-                                absPos, kwLine, kwPos, colonLine, colonPos,
-                                objectsLevel, NULL );
-
-    if ( ret != NULL )
-        Py_DECREF( ret );
-    Py_DECREF( objectsLevel );
-    Py_DECREF( colonPos );
-    Py_DECREF( colonLine );
-    Py_DECREF( kwPos );
-    Py_DECREF( kwLine );
-    Py_DECREF( absPos );
-    Py_DECREF( pos );
-    Py_DECREF( line );
-    Py_DECREF( className );
-    return;
+callOnAnnotatedArg( PyObject *  onArg,
+                    const char *  name, int  length,
+                    const char *  annotation, int  annotationLength )
+{
+    PyObject *  args[] = { NULL, newIdentifier( name, length ),
+                           newOptionalString( annotation, annotationLength ) };
+    callWithArgs( onArg, args, 2 );
+}
+
+
+static void
+callOnArgVal( PyObject *  onArgVal, const char *  value, int  length )
+{
+    PyObject *  args[] = { NULL, PyString_FromStringAndSize( value, length ) };
+    callWithArgs( onArgVal, args, 1 );
+}
+
+
+static void
+callOnVariable( PyObject *  onVariable, const char *  name, int  length,
+                int  line, int  pos, int  absPosition, int  objectsLevel )
+{
+    PyObject *  args[] = { NULL, newIdentifier( name, length ),
+                           newInt( line ), newInt( pos ),
+                           newInt( absPosition ), newInt( objectsLevel ) };
+    callWithArgs( onVariable, args, 5 );
+}
+
+
+static void
+callOnImport( PyObject *  onImport, const char *  name, int  length,
+              int  line, int  pos, int  absPosition )
+{
+    PyObject *  args[] = { NULL, newIdentifier( name, length ),
+                           newInt( line ), newInt( pos ),
+                           newInt( absPosition ) };
+    callWithArgs( onImport, args, 4 );
+}
+
+
+static void
+callOnAs( PyObject *  onAs, const char *  name, int  length)
+{
+    PyObject *  args[] = { NULL, newIdentifier( name, length ) };
+    callWithArgs( onAs, args, 1 );
+}
+
+
+static void
+callOnWhat( PyObject *  onWhat, const char *  name, int  length,
+            int  line, int  pos, int  absPosition )
+{
+    PyObject *  args[] = { NULL, newIdentifier( name, length ),
+                           newInt( line ), newInt( pos ),
+                           newInt( absPosition ) };
+    callWithArgs( onWhat, args, 4 );
+}
+
+
+static void
+callOnDocstring( PyObject *  onDocstring, const char *  doc, int  length,
+                 int  startLine, int  endLine )
+{
+    PyObject *  args[] = { NULL, PyString_FromStringAndSize( doc, length ),
+                           newInt( startLine ), newInt( endLine ) };
+    callWithArgs( onDocstring, args, 3 );
+}
+
+
+static void
+callOnDecorator( PyObject *  onDecorator,
+                 const char *  name, int  length,
+                 int  line, int  pos, int  absPosition )
+{
+    PyObject *  args[] = { NULL, newIdentifier( name, length ),
+                           newInt( line ), newInt( pos ),
+                           newInt( absPosition ) };
+    callWithArgs( onDecorator, args, 4 );
+}
+
+
+static void
+callOnClass( PyObject *  onClass,
+             const char *  name, int  length,
+             int  line, int  pos, int  absPosition,
+             int  kwLine, int  kwPos,
+             int  colonLine, int  colonPos,
+             int  objectsLevel, uint64_t  contentHash, int  withHash )
+{
+    PyObject *  args[] = { NULL, newIdentifier( name, length ),
+                           newInt( line ), newInt( pos ),
+                           newInt( absPosition ),
+                           newInt( kwLine ), newInt( kwPos ),
+                           newInt( colonLine ), newInt( colonPos ),
+                           newInt( objectsLevel ),
+                           withHash ? PyLong_FromUnsignedLongLong( contentHash )
+                                    : NULL };
+    callWithArgs( onClass, args, withHash ? 10 : 9 );
 }
 
 
 static void
 callOnInstanceAttribute( PyObject *  onInstanceAttribute,
                          const char *  name, int  length,
-                         int  line_, int  pos_, int  absPosition_,
-                         int  objectsLevel_ )
-{
-    PyObject *  attrName = PyString_FromStringAndSize( name, length );
-    PyObject *  line = PyInt_FromLong( line_ );
-    PyObject *  pos = PyInt_FromLong( pos_ );
-    PyObject *  absPos = PyInt_FromLong( absPosition_ );
-    PyObject *  objectsLevel = PyInt_FromLong( objectsLevel_ );
-    PyObject *  ret = PyObject_CallFunctionObjArgs(
-                                onInstanceAttribute, attrName,
-                                line, pos, absPos, objectsLevel, NULL );
-
-    if ( ret != NULL )
-        Py_DECREF( ret );
-    Py_DECREF( objectsLevel );
-    Py_DECREF( absPos );
-    Py_DECREF( pos );
-    Py_DECREF( line );
-    Py_DECREF( attrName );
-    return;
+                         int  line, int  pos, int  absPosition,
+                         int  objectsLevel )
+{
+    PyObject *  args[] = { NULL, newIdentifier( name, length ),
+                           newInt( line ), newInt( pos ),
+                           newInt( absPosition ), newInt( objectsLevel ) };
+    callWithArgs( onInstanceAttribute, args, 5 );
 }
 
 
 static void
 callOnFunction( PyObject *  onFunction,
                 const char *  name, int  length,
-                int  line_, int  pos_, int  absPosition_,
-                int  kwLine_, int  kwPos_,
-                int  colonLine_, int  colonPos_,
-                int  objectsLevel_,
-                int  isAsync_,
-                const char *  retAnnotation, int  annotationLength )
-{
-    PyObject *  funcName = PyString_FromStringAndSize( name, length );
-    PyObject *  line = PyInt_FromLong( line_ );
-    PyObject *  pos = PyInt_FromLong( pos_ );
-    PyObject *  absPos = PyInt_FromLong( absPosition_ );
-    PyObject *  kwLine = PyInt_FromLong( kwLine_ );
-    PyObject *  kwPos = PyInt_FromLong( kwPos_ );
-    PyObject *  colonLine = PyInt_FromLong( colonLine_ );
-    PyObject *  colonPos = PyInt_FromLong( colonPos_ );
-    PyObject *  objectsLevel = PyInt_FromLong( objectsLevel_ );
-    PyObject *  isAsync = PyBool_FromLong(isAsync_);
-    PyObject *  annotation;
-
-    if ( annotationLength > 0 )
-    {
-        annotation = PyString_FromStringAndSize( retAnnotation,
-                                                 annotationLength );
-    }
-    else
-    {
-        annotation = Py_None;
-        Py_INCREF( Py_None );
-    }
-
-    PyObject *  ret = PyObject_CallFunctionObjArgs(
-                                onFunction, funcName, line, pos,
-                                absPos, kwLine, kwPos, colonLine, colonPos,
-                                objectsLevel, isAsync, annotation, NULL );
-
-
-    if ( ret != NULL )
-        Py_DECREF( ret );
-    Py_DECREF( annotation );
-    Py_DECREF( isAsync );
-    Py_DECREF( objectsLevel );
-    Py_DECREF( colonPos );
-    Py_DECREF( colonLine );
-    Py_DECREF( kwPos );
-    Py_DECREF( kwLine );
-    Py_DECREF( absPos );
-    Py_DECREF( pos );
-    Py_DECREF( line );
-    Py_DECREF( funcName );
-    return;
+                int  line, int  pos, int  absPosition,
+                int  kwLine, int  kwPos,
+                int  colonLine, int  colonPos,
+                int  objectsLevel,
+                int  isAsync,
+                const char *  retAnnotation, int  annotationLength,
+                uint64_t  contentHash, int  withHash )
+{
+    PyObject *  args[] = { NULL, newIdentifier( name, length ),
+                           newInt( line ), newInt( pos ),
+                           newInt( absPosition ),
+                           newInt( kwLine ), newInt( kwPos ),
+                           newInt( colonLine ), newInt( colonPos ),
+                           newInt( objectsLevel ),
+                           PyBool_FromLong( isAsync ),
+                           newOptionalString( retAnnotation, annotationLength ),
+                           withHash ? PyLong_FromUnsignedLongLong( contentHash )
+                                    : NULL };
+    callWithArgs( onFunction, args, withHash ? 12 : 11 );
 }
 
 
@@ -497,1620 +1050,9385 @@ static void
 callOnBaseClass( PyObject *  onBaseClass,
                  const char *  name, int  length )
 {
-    PyObject *  baseClassName = PyString_FromStringAndSize( name, length );
-    PyObject *  ret = PyObject_CallFunctionObjArgs(
-                                onBaseClass, baseClassName, NULL );
-
-    if ( ret != NULL )
-        Py_DECREF( ret );
-    Py_DECREF( baseClassName );
-    return;
+    PyObject *  args[] = { NULL, newIdentifier( name, length ) };
+    callWithArgs( onBaseClass, args, 1 );
 }
 
 
-/* Provides the total number of lines in the code */
-static int getTotalLines( node *  tree )
+static void
+callOnStatement( PyObject *  onStatement,
+                 int  line, int  pos, int  absPosition, int  endLine,
+                 uint64_t  contentHash )
 {
-    if ( tree == NULL )
-        return -1;
-
-    if ( tree->n_type != file_input )
-        tree = &(tree->n_child[ 0 ]);
+    PyObject *  args[] = { NULL, newInt( line ), newInt( pos ),
+                           newInt( absPosition ), newInt( endLine ),
+                           PyLong_FromUnsignedLongLong( contentHash ) };
+    callWithArgs( onStatement, args, 5 );
+}
 
-    assert( tree->n_type == file_input );
 
-    node *          child;
-    int             n = tree->n_nchildren;
-    for ( int  k = 0; k < n; ++k )
+/* Delivers an event to the corresponding Python callback */
+static void
+callOnEvent( struct instanceCallbacks *  callbacks,
+             const struct parserEvent *  e )
+{
+    switch ( e->kind )
     {
-        child = &(tree->n_child[ k ]);
-        if ( child->n_type == ENDMARKER )
-            return child->n_lineno;
+        case ENCODING_EVENT:
+            callOnEncoding( callbacks->onEncoding, e->name, e->nameLength,
+                            e->line, e->pos, e->absPosition );
+            break;
+        case GLOBAL_EVENT:
+            callOnVariable( callbacks->onGlobal, e->name, e->nameLength,
+                            e->line, e->pos, e->absPosition, e->level );
+            break;
+        case FUNCTION_EVENT:
+            callOnFunction( callbacks->onFunction, e->name, e->nameLength,
+                            e->line, e->pos, e->absPosition,
+                            e->keywordLine, e->keywordPos,
+                            e->colonLine, e->colonPos,
+                            e->level, e->isAsync,
+                            e->annotation, e->annotationLength,
+                            e->contentHash, callbacks->functionHash );
+            break;
+        case CLASS_EVENT:
+            callOnClass( callbacks->onClass, e->name, e->nameLength,
+                         e->line, e->pos, e->absPosition,
+                         e->keywordLine, e->keywordPos,
+                         e->colonLine, e->colonPos, e->level,
+                         e->contentHash, callbacks->classHash );
+            break;
+        case IMPORT_EVENT:
+            callOnImport( callbacks->onImport, e->name, e->nameLength,
+                          e->line, e->pos, e->absPosition );
+            break;
+        case AS_EVENT:
+            callOnAs( callbacks->onAs, e->name, e->nameLength );
+            break;
+        case WHAT_EVENT:
+            callOnWhat( callbacks->onWhat, e->name, e->nameLength,
+                        e->line, e->pos, e->absPosition );
+            break;
+        case CLASS_ATTRIBUTE_EVENT:
+            callOnVariable( callbacks->onClassAttribute,
+                            e->name, e->nameLength,
+                            e->line, e->pos, e->absPosition, e->level );
+            break;
+        case INSTANCE_ATTRIBUTE_EVENT:
+            callOnInstanceAttribute( callbacks->onInstanceAttribute,
+                                     e->name, e->nameLength,
+                                     e->line, e->pos, e->absPosition,
+                                     e->level );
+            break;
+        case DECORATOR_EVENT:
+            callOnDecorator( callbacks->onDecorator, e->name, e->nameLength,
+                             e->line, e->pos, e->absPosition );
+            break;
+        case DECORATOR_ARGUMENT_EVENT:
+            callOnArg( callbacks->onDecoratorArgument,
+                       e->name, e->nameLength );
+            break;
+        case DOCSTRING_EVENT:
+            callOnDocstring( callbacks->onDocstring, e->name, e->nameLength,
+                             e->line, e->endLine );
+            break;
+        case ARGUMENT_EVENT:
+            callOnAnnotatedArg( callbacks->onArgument, e->name, e->nameLength,
+                                e->annotation, e->annotationLength );
+            break;
+        case ARGUMENT_VALUE_EVENT:
+            callOnArgVal( callbacks->onArgumentValue, e->name, e->nameLength );
+            break;
+        case BASE_CLASS_EVENT:
+            callOnBaseClass( callbacks->onBaseClass, e->name, e->nameLength );
+            break;
+        case ERROR_EVENT:
+            callOnError( callbacks->onError, e->name, e->nameLength );
+            break;
+        case LEXER_ERROR_EVENT:
+            callOnError( callbacks->onLexerError, e->name, e->nameLength );
+            break;
+        case STATEMENT_EVENT:
+            if ( callbacks->onStatement != NULL )
+                callOnStatement( callbacks->onStatement, e->line, e->pos,
+                                 e->absPosition, e->endLine, e->contentHash );
+            break;
     }
-    return -1;
 }
 
 
 
-/* Fills the given buffer */
-static char *   getDottedName( node *   tree,
-                               char *   name,
-                               int *    len )
+/*
+ * Native mode support. The BriefModuleInfo and the item classes are defined
+ * in cdmpyparser.py which registers them via setResultTypes(...) at import.
+ * The objects are created without calling __init__ and their slots are
+ * populated directly.
+ */
+
+static PyObject *   encodingType = NULL;
+static PyObject *   importType = NULL;
+static PyObject *   importWhatType = NULL;
+static PyObject *   globalType = NULL;
+static PyObject *   classAttributeType = NULL;
+static PyObject *   instanceAttributeType = NULL;
+static PyObject *   decoratorType = NULL;
+static PyObject *   docstringType = NULL;
+static PyObject *   argumentType = NULL;
+static PyObject *   functionType = NULL;
+static PyObject *   classType = NULL;
+static PyObject *   statementType = NULL;
+
+static struct
 {
-    int                     n = tree->n_nchildren;
-    int                     partLen;
-    node *                  child;
-    char *                  first = NULL;
+    const char *    name;
+    PyObject **     object;
+} resultTypes[] =
+{
+    { "Encoding",           & encodingType },
+    { "Import",             & importType },
+    { "ImportWhat",         & importWhatType },
+    { "Global",             & globalType },
+    { "ClassAttribute",     & classAttributeType },
+    { "InstanceAttribute",  & instanceAttributeType },
+    { "Decorator",          & decoratorType },
+    { "Docstring",          & docstringType },
+    { "Argument",           & argumentType },
+    { "Function",           & functionType },
+    { "Class",              & classType },
+    { "Statement",          & statementType },
+    { NULL,                 NULL }
+};
 
-    /* tree must be of 'dotted_name' type */
-    assert( tree->n_type == dotted_name );
 
-    for ( int  k = 0; k < n; ++k )
+/* Interned attribute names used by the native mode */
+enum AttrName {
+    NAME_ATTR, LINE_ATTR, POS_ATTR, ABS_POSITION_ATTR,
+    ALIAS_ATTR, WHAT_ATTR, ARGUMENTS_ATTR, ANNOTATION_ATTR, VALUE_ATTR,
+    START_LINE_ATTR, END_LINE_ATTR, TEXT_ATTR,
+    KEYWORD_LINE_ATTR, KEYWORD_POS_ATTR, COLON_LINE_ATTR, COLON_POS_ATTR,
+    IS_ASYNC_ATTR, RETURN_ANNOTATION_ATTR, DOCSTRING_ATTR, DECORATORS_ATTR,
+    FUNCTIONS_ATTR, CLASSES_ATTR, BASE_ATTR, CLASS_ATTRIBUTES_ATTR,
+    INSTANCE_ATTRIBUTES_ATTR, IS_OK_ATTR, ENCODING_ATTR, IMPORTS_ATTR,
+    GLOBALS_ATTR, ERRORS_ATTR, LEXER_ERRORS_ATTR, CONTENT_HASH_ATTR,
+    STATEMENTS_ATTR,
+    ATTRS_COUNT
+};
+
+static const char *     attrNames[ ATTRS_COUNT ] =
+{
+    "name", "line", "pos", "absPosition",
+    "alias", "what", "arguments", "annotation", "value",
+    "startLine", "endLine", "text",
+    "keywordLine", "keywordPos", "colonLine", "colonPos",
+    "isAsync", "returnAnnotation", "docstring", "decorators",
+    "functions", "classes", "base", "classAttributes",
+    "instanceAttributes", "isOK", "encoding", "imports",
+    "globals", "errors", "lexerErrors", "contentHash",
+    "statements"
+};
+
+static PyObject *       attrObjects[ ATTRS_COUNT ];
+static PyObject *       emptyTuple = NULL;
+
+
+static int
+initNativeNames( void )
+{
+    for ( int  k = 0; k < ATTRS_COUNT; ++k )
     {
-        child = & (tree->n_child[k]);
-        if ( child->n_type == NAME )
-        {
-            partLen = strlen( child->n_str );
-            memcpy( name + *len, child->n_str, partLen );
-            *len += partLen;
-            if ( k == 0 )
-                first = child->n_str;
-        }
-        else
-        {
-            /* This is DOT */
-            assert( child->n_type == DOT );
-            name[ *len ] = '.';
-            *len += 1;
-        }
+        attrObjects[ k ] = PyUnicode_InternFromString( attrNames[ k ] );
+        if ( attrObjects[ k ] == NULL )
+            return -1;
     }
-    name[ *len ] = '\0';
-    return first;
+    emptyTuple = PyTuple_New( 0 );
+    if ( emptyTuple == NULL )
+        return -1;
+    return 0;
 }
 
 
-static node *  findChildOfType( node *  from, int  type )
+/* Sets the attribute and steals the value reference */
+static int
+setAttr( PyObject *  object, enum AttrName  attr, PyObject *  value )
 {
-    int         n = from->n_nchildren;
-    for ( int  k = 0; k < n; ++k )
-        if ( from->n_child[ k ].n_type == type )
-            return & (from->n_child[ k ]);
-    return NULL;
+    if ( value == NULL )
+        return -1;
+
+    int     ret = PyObject_SetAttr( object, attrObjects[ attr ], value );
+    Py_DECREF( value );
+    return ret;
 }
 
 
-/* It is used for 3.9 and up
- * Returns a pointer to:
- * - arglist if found in the last trailer
- * - LPAR if it is the case with zero arguments like @decor()
- * - NULL if there are no arguments at all
- */
-static node *  findDecoratorArgsNode( node *  atomExprNode )
+/* Provides a new reference to the attribute value */
+static PyObject *
+getAttr( PyObject *  object, enum AttrName  attr )
 {
-    int         n = atomExprNode->n_nchildren;
-    int         lastChildIndex = n - 1;
-
-    if ( lastChildIndex < 0 )
-        return NULL;
+    return PyObject_GetAttr( object, attrObjects[ attr ] );
+}
 
-    node *      lastChild = & atomExprNode->n_child[ lastChildIndex ];
-    if ( lastChild->n_type != trailer )
-        return NULL;
 
-    if ( lastChild->n_nchildren < 2 )
-        return NULL;
-    if ( lastChild->n_child[ 0 ].n_type != LPAR )
-        return NULL;
-    if ( lastChild->n_child[ 1 ].n_type == RPAR )
-        return & lastChild->n_child[ 0 ];
-    if ( lastChild->n_child[ 1 ].n_type != arglist )
-        return NULL;
+static int
+appendToAttr( PyObject *  object, enum AttrName  attr, PyObject *  value )
+{
+    PyObject *  list = getAttr( object, attr );
+    if ( list == NULL )
+        return -1;
 
-    return & lastChild->n_child[ 1 ];
+    int         ret = PyList_Append( list, value );
+    Py_DECREF( list );
+    return ret;
 }
 
 
-/* Collects the string parts of the test node recursively.  */
-/* It is used in:                                           */
-/* - the default argument values                            */
-/* - class inheritance                                      */
-/* - argumnts annotations                                   */
-/* - return value annotations                               */
-static void  collectTestString( node *  from, char *  buffer, int *  length )
+/* Creates an instance of a registered type bypassing __init__ */
+static PyObject *
+newObject( PyObject *  type )
 {
-    if ( from->n_str != NULL )
-    {
-        int     len = 0;
-        switch ( from->n_type )
-        {
-            case LPAR:
-            case RPAR:
-            case LSQB:
-            case RSQB:
-            case LBRACE:
-            case RBRACE:
-            case EQUAL:
-            case TILDE:
-            case DOT:
-                buffer[ *length ] = from->n_str[ 0 ];
-                ++(*length);
-                break;
-            case COMMA:
-                buffer[ *length ] = ',';
-                ++(*length);
-                buffer[ *length ] = ' ';
-                ++(*length);
-                break;
-            case MINUS:
-            case PLUS:
-            case SLASH:
-            case STAR:
-            case PERCENT:
-            case LESS:
-            case GREATER:
-            case VBAR:
-            case AMPER:
-            case CIRCUMFLEX:
-                buffer[ *length ] = ' ';
-                ++(*length);
-                buffer[ *length ] = from->n_str[ 0 ];
-                ++(*length);
-                buffer[ *length ] = ' ';
-                ++(*length);
-                break;
-            case COLON:
-                buffer[ *length ] = from->n_str[ 0 ];
-                ++(*length);
-                buffer[ *length ] = ' ';
-                ++(*length);
-                break;
-            case DOUBLESTAR:
-            case DOUBLESLASH:
-            case EQEQUAL:
-            case GREATEREQUAL:
-            case LESSEQUAL:
-            case NOTEQUAL:
-            case LEFTSHIFT:
-            case RIGHTSHIFT:
-                buffer[ *length ] = ' ';
-                ++(*length);
-                buffer[ *length ] = from->n_str[ 0 ];
-                ++(*length);
-                buffer[ *length ] = from->n_str[ 1 ];
-                ++(*length);
-                buffer[ *length ] = ' ';
-                ++(*length);
-                break;
-            default:
-                if ( strcmp( from->n_str, "not" ) == 0 ||
-                     strcmp( from->n_str, "in" ) == 0 ||
-                     strcmp( from->n_str, "is" ) == 0 ||
-                     strcmp( from->n_str, "or" ) == 0 ||
-                     strcmp( from->n_str, "and" ) == 0 ||
-                     strcmp( from->n_str, "if" ) == 0 ||
-                     strcmp( from->n_str, "elif" ) == 0 ||
-                     strcmp( from->n_str, "else" ) == 0 )
-                {
-                    buffer[ *length ] = ' ';
-                    ++(*length);
-                    len = strlen( from->n_str );
-                    memcpy( & ( buffer[ *length ] ), from->n_str, len );
-                    *length += len;
-                    buffer[ *length ] = ' ';
-                    ++(*length);
-                    break;
-                }
+    PyTypeObject *  t = (PyTypeObject *) type;
+    return t->tp_new( t, emptyTuple, NULL );
+}
 
-                /* Really default case: copy as is */
-                len = strlen( from->n_str );
-                memcpy( & ( buffer[ *length ] ), from->n_str, len );
-                *length += len;
-        }
 
-    }
+/* Creates a ModuleInfoBase derived object and sets the common members */
+static PyObject *
+newItem( PyObject *  type, const struct parserEvent *  e )
+{
+    PyObject *  item = newObject( type );
+    if ( item == NULL )
+        return NULL;
 
-    int         n = from->n_nchildren;
-    for ( int  k = 0; k < n; ++k )
-        collectTestString( & ( from->n_child[ k ] ), buffer, length );
+    if ( setAttr( item, NAME_ATTR, newIdentifier( e->name, e->nameLength ) ) ||
+         setAttr( item, LINE_ATTR, newInt( e->line ) ) ||
+         setAttr( item, POS_ATTR, newInt( e->pos ) ) ||
+         setAttr( item, ABS_POSITION_ATTR, newInt( e->absPosition ) ) )
+    {
+        Py_DECREF( item );
+        return NULL;
+    }
+    return item;
 }
 
 
-static void getAtomDecoratorName( node *  atomExprNode,
-                                  char *  name,
-                                  int  *  length,
-                                  node *  argsNode )
+/* Creates a Function or a Class object */
+static PyObject *
+newScopeItem( PyObject *  type, const struct parserEvent *  e )
 {
-    int         n = atomExprNode->n_nchildren;
-    if ( argsNode != NULL )
-        --n;    /* The decorator has arguments so the last child must not be
-                   participating in building the name */
+    PyObject *  item = newItem( type, e );
+    if ( item == NULL )
+        return NULL;
 
-    for ( int  k = 0; k < n; ++k )
+    if ( setAttr( item, KEYWORD_LINE_ATTR, newInt( e->keywordLine ) ) ||
+         setAttr( item, KEYWORD_POS_ATTR, newInt( e->keywordPos ) ) ||
+         setAttr( item, COLON_LINE_ATTR, newInt( e->colonLine ) ) ||
+         setAttr( item, COLON_POS_ATTR, newInt( e->colonPos ) ) ||
+         setAttr( item, CONTENT_HASH_ATTR,
+                  PyLong_FromUnsignedLongLong( e->contentHash ) ) ||
+         setAttr( item, DOCSTRING_ATTR, newNone() ) ||
+         setAttr( item, DECORATORS_ATTR, PyList_New( 0 ) ) ||
+         setAttr( item, FUNCTIONS_ATTR, PyList_New( 0 ) ) ||
+         setAttr( item, CLASSES_ATTR, PyList_New( 0 ) ) )
+    {
+        Py_DECREF( item );
+        return NULL;
+    }
+
+    int     ret;
+    if ( type == functionType )
+        ret = setAttr( item, IS_ASYNC_ATTR, PyBool_FromLong( e->isAsync ) ) ||
+              setAttr( item, RETURN_ANNOTATION_ATTR,
+                       newOptionalString( e->annotation,
+                                          e->annotationLength ) ) ||
+              setAttr( item, ARGUMENTS_ATTR, PyList_New( 0 ) );
+    else
+        ret = setAttr( item, BASE_ATTR, PyList_New( 0 ) ) ||
+              setAttr( item, CLASS_ATTRIBUTES_ATTR, PyList_New( 0 ) ) ||
+              setAttr( item, INSTANCE_ATTRIBUTES_ATTR, PyList_New( 0 ) );
+    if ( ret != 0 )
     {
-        collectTestString( & atomExprNode->n_child[ k ], name, length );
+        Py_DECREF( item );
+        return NULL;
     }
+    return item;
 }
 
 
-/* returns 1, 2, 3 or 4,
-   i.e. the number of leading quotes used in a string literal part */
-static size_t getStringLiteralPrefixLength( node *  tree )
+static int
+initNativeBuilder( struct nativeBuilder *  builder, PyObject *  modInfo )
 {
-    /* tree must be of STRING type */
-    assert( tree->n_type == STRING );
-    if ( strncmp( tree->n_str, "\"\"\"", 3 ) == 0 )
-        return 3;
-    if ( strncmp( tree->n_str, "'''", 3 ) == 0 )
-        return 3;
-    if ( strncmp( tree->n_str, "r\"\"\"", 4 ) == 0 )
-        return 4;
-    if ( strncmp( tree->n_str, "r'''", 4 ) == 0 )
-        return 4;
-    if ( strncmp( tree->n_str, "u\"\"\"", 4 ) == 0 )
-        return 4;
-    if ( strncmp( tree->n_str, "u'''", 4 ) == 0 )
-        return 4;
-    if ( strncmp( tree->n_str, "f\"\"\"", 4 ) == 0 )
-        return 4;
-    if ( strncmp( tree->n_str, "f'''", 4 ) == 0 )
-        return 4;
-    if ( strncmp( tree->n_str, "r\"", 2 ) == 0 )
-        return 2;
-    if ( strncmp( tree->n_str, "r'", 2 ) == 0 )
-        return 2;
-    if ( strncmp( tree->n_str, "u\"", 2 ) == 0 )
-        return 2;
-    if ( strncmp( tree->n_str, "u'", 2 ) == 0 )
-        return 2;
-    if ( strncmp( tree->n_str, "f\"", 2 ) == 0 )
-        return 2;
-    if ( strncmp( tree->n_str, "f'", 2 ) == 0 )
-        return 2;
-    return 1;
+    memset( builder, 0, sizeof( struct nativeBuilder ) );
+    if ( functionType == NULL )
+    {
+        PyErr_SetString( PyExc_RuntimeError,
+                         "The native mode result types are not registered" );
+        return 1;
+    }
+
+    builder->modInfo = modInfo;
+    builder->objectsStack = PyList_New( 0 );
+    if ( builder->objectsStack == NULL )
+        return 1;
+    return 0;
 }
 
 
-/* Searches for a certain  node among the first children */
-static node *  skipToNode( node *  tree, int nodeType )
+static void
+clearNativeBuilder( struct nativeBuilder *  builder )
 {
-    if ( tree == NULL )
-        return NULL;
+    Py_XDECREF( builder->objectsStack );
+    Py_XDECREF( builder->lastImport );
+    Py_XDECREF( builder->lastDecorators );
+    memset( builder, 0, sizeof( struct nativeBuilder ) );
+}
 
-    for ( ; ; )
+
+/* Merges the objects stack down to the required level */
+static int
+builderFlushLevel( struct nativeBuilder *  builder, Py_ssize_t  level )
+{
+    PyObject *      stack = builder->objectsStack;
+    Py_ssize_t      count = PyList_GET_SIZE( stack );
+
+    while ( count > level )
     {
-        if ( tree->n_type == nodeType )
-            return tree;
-        if ( tree->n_nchildren < 1 )
-            return NULL;
-        tree = & ( tree->n_child[ 0 ] );
+        PyObject *      item = PyList_GET_ITEM( stack, count - 1 );
+        PyObject *      owner = builder->modInfo;
+        enum AttrName   attr = FUNCTIONS_ATTR;
+
+        if ( count > 1 )
+            owner = PyList_GET_ITEM( stack, count - 2 );
+        if ( PyObject_TypeCheck( item, (PyTypeObject *) classType ) )
+            attr = CLASSES_ATTR;
+
+        if ( appendToAttr( owner, attr, item ) != 0 )
+            return -1;
+        if ( PyList_SetSlice( stack, count - 1, count, NULL ) != 0 )
+            return -1;
+        --count;
     }
-    return NULL;
+    return 0;
 }
 
 
+/* Provides the stack object with the given index; negative counts from the
+ * end. Borrowed reference or NULL */
+static PyObject *
+builderStackItem( struct nativeBuilder *  builder, Py_ssize_t  index )
+{
+    Py_ssize_t      count = PyList_GET_SIZE( builder->objectsStack );
 
-static void checkForDocstring( node *                       tree,
-                               struct instanceCallbacks *   callbacks )
+    if ( index < 0 )
+        index += count;
+    if ( index < 0 || index >= count )
+        return NULL;
+    return PyList_GET_ITEM( builder->objectsStack, index );
+}
+
+
+/* Appends a named item; the repeated ones are dropped by the walker */
+static int
+builderAddItem( PyObject *  owner, enum AttrName  attr,
+                PyObject *  type, const struct parserEvent *  e )
 {
-    if ( tree == NULL )
-        return;
+    PyObject *  item = newItem( type, e );
+    if ( item == NULL )
+        return -1;
 
-    node *      child = NULL;
-    int         n = tree->n_nchildren;
-    for ( int  k = 0; k < n; ++k )
-    {
-        /* need to skip NEWLINE and INDENT till stmt if so */
-        child = & ( tree->n_child[ k ] );
-        if ( child->n_type == NEWLINE )
-            continue;
-        if ( child->n_type == INDENT )
-            continue;
-        if ( child->n_type == stmt )
-            break;
+    int         ret = appendToAttr( owner, attr, item );
+    Py_DECREF( item );
+    return ret;
+}
 
-        return;
-    }
 
-    child = skipToNode( child, atom );
-    if ( child == NULL )
-        return;
+static int
+builderOnDocstring( struct nativeBuilder *  builder,
+                    const struct parserEvent *  e )
+{
+    PyObject *  text = newString( e->name, e->nameLength );
+    if ( text == NULL )
+        return -1;
 
-    /* Atom has to have children of the STRING type only */
-    char            buffer[ MAX_DOCSTRING_SIZE ];
-    int             collected = 0;
-    int             charsToSkip;
-    int             charsToCopy;
-    node *          stringChild = NULL;
-    n = child->n_nchildren;
+    PyObject *  docstring = newObject( docstringType );
+    if ( docstring == NULL )
+    {
+        Py_DECREF( text );
+        return -1;
+    }
 
-    node *          firstStringChild = NULL;
-    int             needAdjustFirst = 0;    // for python 3.7
-    int             needAdjustLast = 0;     // for python >= 3.8
-    for ( int  k = 0; k < n; ++k )
+    if ( setAttr( docstring, TEXT_ATTR, text ) ||
+         setAttr( docstring, START_LINE_ATTR, newInt( e->line ) ) ||
+         setAttr( docstring, END_LINE_ATTR, newInt( e->endLine ) ) ||
+         setAttr( docstring, LINE_ATTR, newInt( e->endLine ) ) )
     {
-        stringChild = & ( child->n_child[ k ] );
-        if ( stringChild->n_type != STRING )
-            return;
+        Py_DECREF( docstring );
+        return -1;
+    }
 
-        charsToSkip = getStringLiteralPrefixLength( stringChild );
-        charsToCopy = strlen( stringChild->n_str ) - charsToSkip;
-        if ( charsToSkip == 2 )
-            charsToCopy -= 1;
-        else if ( charsToSkip == 4 )
-            charsToCopy -= 3;
-        else
-            charsToCopy -= charsToSkip;
+    PyObject *  owner = builderStackItem( builder, -1 );
+    if ( owner == NULL )
+        owner = builder->modInfo;
+    return setAttr( owner, DOCSTRING_ATTR, docstring );
+}
 
-        #if PY_MAJOR_VERSION == 3 && (PY_MINOR_VERSION == 8 || PY_MINOR_VERSION == 9)
-        if ( charsToSkip >= 3 )
-            needAdjustLast = 1;
-        #endif
 
-        if ( k == 0 )
-        {
-            firstStringChild = stringChild;
-            #if PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION <= 7
-            if ( charsToSkip >= 3 )
-                needAdjustFirst = 1;
-            #endif
-        }
+static int
+builderOnScopeItem( struct nativeBuilder *  builder,
+                    const struct parserEvent *  e, PyObject *  type )
+{
+    if ( builderFlushLevel( builder, e->level ) != 0 )
+        return -1;
+
+    PyObject *  item = newScopeItem( type, e );
+    if ( item == NULL )
+        return -1;
 
-        if ( collected + charsToCopy + 1 > MAX_DOCSTRING_SIZE )
+    if ( builder->lastDecorators != NULL )
+    {
+        PyObject *  decoratorList = builder->lastDecorators;
+        builder->lastDecorators = NULL;
+        if ( setAttr( item, DECORATORS_ATTR, decoratorList ) != 0 )
         {
-            memcpy( buffer + collected,
-                    stringChild->n_str + charsToSkip,
-                    MAX_DOCSTRING_SIZE - collected - 1 );
-            collected = MAX_DOCSTRING_SIZE - 1;
-            break;
+            Py_DECREF( item );
+            return -1;
         }
-
-        memcpy( buffer + collected,
-                stringChild->n_str + charsToSkip,
-                charsToCopy );
-        collected += charsToCopy;
     }
 
-    // Python 3.7 and earlier -> reports the last line
-    // Python 3.8 and later   -> reports the first line
-    int     firstLine = firstStringChild->n_lineno;
-    int     lastLine = stringChild->n_lineno;
+    int     ret = PyList_Append( builder->objectsStack, item );
+    Py_DECREF( item );
+    return ret;
+}
 
-    if ( needAdjustFirst != 0 )
+
+static int
+builderOnImport( struct nativeBuilder *  builder,
+                 const struct parserEvent *  e )
+{
+    if ( builder->lastImport != NULL )
     {
-        for ( int  index = 0; ; ++index )
-        {
-            char    current = firstStringChild->n_str[index];
-            if ( current == '\0' )
-                break;
-            if ( current == '\r' )
-            {
-                if ( firstStringChild->n_str[index + 1] == '\n' )
-                {
-                    ++index;
-                }
-                --firstLine;
-                continue;
-            }
-            if ( current == '\n' )
-                --firstLine;
-        }
+        if ( appendToAttr( builder->modInfo, IMPORTS_ATTR,
+                           builder->lastImport ) != 0 )
+            return -1;
+        Py_CLEAR( builder->lastImport );
     }
-    if ( needAdjustLast != 0 )
+
+    PyObject *  import = newItem( importType, e );
+    if ( import == NULL )
+        return -1;
+    if ( setAttr( import, ALIAS_ATTR, newString( "", 0 ) ) ||
+         setAttr( import, WHAT_ATTR, PyList_New( 0 ) ) )
     {
-        for ( int  index = 0; ; ++index )
-        {
-            char    current = stringChild->n_str[index];
-            if ( current == '\0' )
-                break;
-            if ( current == '\r' )
-            {
-                if ( stringChild->n_str[index + 1] == '\n' )
-                {
-                    ++index;
-                }
-                ++lastLine;
-                continue;
-            }
-            if ( current == '\n' )
-                ++lastLine;
-        }
+        Py_DECREF( import );
+        return -1;
     }
+    builder->lastImport = import;
+    return 0;
+}
 
-    buffer[ collected ] = 0;
-    callOnDocstring( callbacks->onDocstring,
-                     buffer, collected, firstLine, lastLine );
-    return;
+
+static int
+builderOnAs( struct nativeBuilder *  builder, const struct parserEvent *  e )
+{
+    if ( builder->lastImport == NULL )
+        return 0;
+
+    PyObject *  what = getAttr( builder->lastImport, WHAT_ATTR );
+    if ( what == NULL )
+        return -1;
+
+    PyObject *  owner = builder->lastImport;
+    if ( PyList_GET_SIZE( what ) > 0 )
+        owner = PyList_GET_ITEM( what, PyList_GET_SIZE( what ) - 1 );
+
+    int     ret = setAttr( owner, ALIAS_ATTR,
+                           newIdentifier( e->name, e->nameLength ) );
+    Py_DECREF( what );
+    return ret;
 }
 
 
-static void  processImport( node *                       tree,
-                            struct instanceCallbacks *   callbacks,
-                            int *                        lineShifts )
+static int
+builderOnWhat( struct nativeBuilder *  builder, const struct parserEvent *  e )
 {
-    assert( tree->n_type == import_stmt );
-    assert( tree->n_nchildren == 1 );
+    if ( builder->lastImport == NULL )
+        return 0;
 
-    /* There must be one child of type import_from or import_name */
-    tree = & (tree->n_child[ 0 ]);
-    if ( tree->n_type == import_from )
+    PyObject *  what = newItem( importWhatType, e );
+    if ( what == NULL )
+        return -1;
+    if ( setAttr( what, ALIAS_ATTR, newString( "", 0 ) ) != 0 )
     {
-        char    name[ MAX_DOTTED_NAME_LENGTH ];
-        int     length = 0;
-        int     needFlush = 0;
-        node *  firstNameNode = NULL;
-        int     n = tree->n_nchildren;
+        Py_DECREF( what );
+        return -1;
+    }
 
-        for ( int  k = 0; k < n; ++k )
-        {
-            node *      child = & ( tree->n_child[ k ] );
-            if ( child->n_type == DOT )
-            {
-                // Part of the name
-                name[ length ] = '.';
-                ++length;
-                if ( firstNameNode == NULL )
-                    firstNameNode = child;
-                needFlush = 1;
-                continue;
-            }
-            if ( child->n_type == ELLIPSIS )
-            {
-                // Part of the name
-                name[ length ] = '.';
-                ++length;
-                name[ length ] = '.';
-                ++length;
-                name[ length ] = '.';
-                ++length;
-                if ( firstNameNode == NULL )
-                    firstNameNode = child;
-                needFlush = 1;
-                continue;
-            }
-            if ( child->n_type == dotted_name )
-            {
-                getDottedName( child, name, & length );
-                if ( firstNameNode == NULL )
-                    firstNameNode = child;
-                needFlush = 1;
-                continue;
-            }
+    int     ret = appendToAttr( builder->lastImport, WHAT_ATTR, what );
+    Py_DECREF( what );
+    return ret;
+}
 
-            if ( needFlush == 1 )
-            {
-                assert( length > 0 );
-                name[ length ] = '\0';
 
-                callOnImport( callbacks->onImport, name, length, firstNameNode->n_lineno,
-                              firstNameNode->n_col_offset + 1, /* Make it 1-based */
-                              lineShifts[ firstNameNode->n_lineno ] + firstNameNode->n_col_offset );
+static int
+builderOnDecorator( struct nativeBuilder *  builder,
+                    const struct parserEvent *  e )
+{
+    if ( builder->lastDecorators == NULL )
+    {
+        builder->lastDecorators = PyList_New( 0 );
+        if ( builder->lastDecorators == NULL )
+            return -1;
+    }
 
-                needFlush = 0;
-            }
+    PyObject *  decor = newItem( decoratorType, e );
+    if ( decor == NULL )
+        return -1;
+    if ( setAttr( decor, ARGUMENTS_ATTR, newNone() ) != 0 )
+    {
+        Py_DECREF( decor );
+        return -1;
+    }
 
-            if ( child->n_type == import_as_names )
-            {
-                // This is what is imported from the module
-                for ( int  j = 0; j < child->n_nchildren; ++j )
-                {
-                    node *      whatChild = & ( child->n_child[ j ] );
-                    if ( whatChild->n_type == import_as_name )
-                    {
-                        assert( whatChild->n_nchildren == 1 ||
-                                whatChild->n_nchildren == 3 );
-                        node *  whatName = & ( whatChild->n_child[ 0 ] );
+    int     ret = PyList_Append( builder->lastDecorators, decor );
+    Py_DECREF( decor );
+    return ret;
+}
 
-                        callOnWhat( callbacks->onWhat, whatName->n_str,
-                                    strlen( whatName->n_str ),
-                                    whatName->n_lineno,
-                                    whatName->n_col_offset + 1, /* Make it 1-based */
-                                    lineShifts[ whatName->n_lineno ] + whatName->n_col_offset );
 
-                        if ( whatChild->n_nchildren == 3 )
-                        {
-                            node *  asName = & ( whatChild->n_child[ 2 ] );
-                            callOnAs( callbacks->onAs,
-                                      asName->n_str,
-                                      strlen( asName->n_str ) );
-                        }
-                    }
-                }
-            }
+static int
+builderOnDecoratorArgument( struct nativeBuilder *  builder,
+                            const struct parserEvent *  e )
+{
+    if ( builder->lastDecorators == NULL ||
+         PyList_GET_SIZE( builder->lastDecorators ) == 0 )
+        return 0;
+
+    PyObject *  decor = PyList_GET_ITEM( builder->lastDecorators,
+                                PyList_GET_SIZE( builder->lastDecorators ) - 1 );
+    PyObject *  arguments = getAttr( decor, ARGUMENTS_ATTR );
+    if ( arguments == NULL )
+        return -1;
+    if ( arguments == Py_None )
+    {
+        Py_DECREF( arguments );
+        arguments = PyList_New( 0 );
+        if ( arguments == NULL )
+            return -1;
+        Py_INCREF( arguments );
+        if ( setAttr( decor, ARGUMENTS_ATTR, arguments ) != 0 )
+        {
+            Py_DECREF( arguments );
+            return -1;
         }
     }
-    else
-    {
-        assert( tree->n_type == import_name );
 
-        tree = findChildOfType( tree, dotted_as_names );
-        assert( tree != NULL );
+    PyObject *  value = newString( e->name, e->nameLength );
+    int         ret = -1;
+    if ( value != NULL )
+    {
+        ret = PyList_Append( arguments, value );
+        Py_DECREF( value );
+    }
+    Py_DECREF( arguments );
+    return ret;
+}
 
-        node *      child;
-        for ( int  k = 0; k < tree->n_nchildren; ++k )
+
+static int
+builderOnArgument( struct nativeBuilder *  builder,
+                   const struct parserEvent *  e )
+{
+    PyObject *  owner = builderStackItem( builder, -1 );
+    if ( owner == NULL )
+        return 0;
+
+    PyObject *  arg = newObject( argumentType );
+    if ( arg == NULL )
+        return -1;
+    if ( setAttr( arg, NAME_ATTR, newIdentifier( e->name, e->nameLength ) ) ||
+         setAttr( arg, ANNOTATION_ATTR,
+                  newOptionalString( e->annotation, e->annotationLength ) ) ||
+         setAttr( arg, VALUE_ATTR, newNone() ) )
+    {
+        Py_DECREF( arg );
+        return -1;
+    }
+
+    int     ret = appendToAttr( owner, ARGUMENTS_ATTR, arg );
+    Py_DECREF( arg );
+    return ret;
+}
+
+
+static int
+builderOnArgumentValue( struct nativeBuilder *  builder,
+                        const struct parserEvent *  e )
+{
+    PyObject *  owner = builderStackItem( builder, -1 );
+    if ( owner == NULL )
+        return 0;
+
+    PyObject *  arguments = getAttr( owner, ARGUMENTS_ATTR );
+    if ( arguments == NULL )
+        return -1;
+
+    int         ret = 0;
+    Py_ssize_t  n = PyList_GET_SIZE( arguments );
+    if ( n > 0 )
+        ret = setAttr( PyList_GET_ITEM( arguments, n - 1 ), VALUE_ATTR,
+                       newString( e->name, e->nameLength ) );
+    Py_DECREF( arguments );
+    return ret;
+}
+
+
+static int
+builderOnError( struct nativeBuilder *  builder,
+                const struct parserEvent *  e, enum AttrName  attr )
+{
+    if ( setAttr( builder->modInfo, IS_OK_ATTR, PyBool_FromLong( 0 ) ) != 0 )
+        return -1;
+
+    /* Whitespace only messages are not memorized */
+    int     empty = 1;
+    for ( int  k = 0; k < e->nameLength; ++k )
+    {
+        if ( ! isspace( (unsigned char) e->name[ k ] ) )
         {
-            child = & ( tree->n_child[ k ] );
-            if ( child->n_type == dotted_as_name )
+            empty = 0;
+            break;
+        }
+    }
+    if ( empty )
+        return 0;
+
+    PyObject *  message = newString( e->name, e->nameLength );
+    if ( message == NULL )
+        return -1;
+
+    int     ret = appendToAttr( builder->modInfo, attr, message );
+    Py_DECREF( message );
+    return ret;
+}
+
+
+static int
+builderOnStatement( struct nativeBuilder *  builder,
+                    const struct parserEvent *  e )
+{
+    PyObject *  statement = newObject( statementType );
+    if ( statement == NULL )
+        return -1;
+
+    if ( setAttr( statement, LINE_ATTR, newInt( e->line ) ) ||
+         setAttr( statement, POS_ATTR, newInt( e->pos ) ) ||
+         setAttr( statement, ABS_POSITION_ATTR,
+                  newInt( e->absPosition ) ) ||
+         setAttr( statement, END_LINE_ATTR, newInt( e->endLine ) ) ||
+         setAttr( statement, CONTENT_HASH_ATTR,
+                  PyLong_FromUnsignedLongLong( e->contentHash ) ) )
+    {
+        Py_DECREF( statement );
+        return -1;
+    }
+
+    int     ret = appendToAttr( builder->modInfo, STATEMENTS_ATTR, statement );
+    Py_DECREF( statement );
+    return ret;
+}
+
+
+static void
+builderOnEvent( struct nativeBuilder *  builder,
+                const struct parserEvent *  e )
+{
+    PyObject *  owner;
+    int         ret = 0;
+
+    /* Stop building after the first failure; the error is reported when the
+     * walker finishes */
+    if ( PyErr_Occurred() )
+        return;
+
+    switch ( e->kind )
+    {
+        case ENCODING_EVENT:
+            ret = setAttr( builder->modInfo, ENCODING_ATTR,
+                           newItem( encodingType, e ) );
+            break;
+        case GLOBAL_EVENT:
+            ret = builderAddItem( builder->modInfo, GLOBALS_ATTR,
+                                  globalType, e );
+            break;
+        case FUNCTION_EVENT:
+            ret = builderOnScopeItem( builder, e, functionType );
+            break;
+        case CLASS_EVENT:
+            ret = builderOnScopeItem( builder, e, classType );
+            break;
+        case IMPORT_EVENT:
+            ret = builderOnImport( builder, e );
+            break;
+        case AS_EVENT:
+            ret = builderOnAs( builder, e );
+            break;
+        case WHAT_EVENT:
+            ret = builderOnWhat( builder, e );
+            break;
+        case CLASS_ATTRIBUTE_EVENT:
+            /* A class must be on the top of the stack */
+            owner = builderStackItem( builder, e->level );
+            if ( owner != NULL )
+                ret = builderAddItem( owner, CLASS_ATTRIBUTES_ATTR,
+                                      classAttributeType, e );
+            break;
+        case INSTANCE_ATTRIBUTE_EVENT:
+            /* A member function is on the top; the class is one step down */
+            owner = builderStackItem( builder, e->level - 1 );
+            if ( owner != NULL )
+                ret = builderAddItem( owner, INSTANCE_ATTRIBUTES_ATTR,
+                                      instanceAttributeType, e );
+            break;
+        case DECORATOR_EVENT:
+            ret = builderOnDecorator( builder, e );
+            break;
+        case DECORATOR_ARGUMENT_EVENT:
+            ret = builderOnDecoratorArgument( builder, e );
+            break;
+        case DOCSTRING_EVENT:
+            ret = builderOnDocstring( builder, e );
+            break;
+        case ARGUMENT_EVENT:
+            ret = builderOnArgument( builder, e );
+            break;
+        case ARGUMENT_VALUE_EVENT:
+            ret = builderOnArgumentValue( builder, e );
+            break;
+        case BASE_CLASS_EVENT:
+            owner = builderStackItem( builder, -1 );
+            if ( owner != NULL )
             {
-                int     expect_as_name = 0;
-                for ( int  j = 0; j < child->n_nchildren; ++j )
+                PyObject *  base = newIdentifier( e->name, e->nameLength );
+                ret = -1;
+                if ( base != NULL )
                 {
-                    node *      subchild = & ( child->n_child[ j ] );
+                    ret = appendToAttr( owner, BASE_ATTR, base );
+                    Py_DECREF( base );
+                }
+            }
+            break;
+        case ERROR_EVENT:
+            ret = builderOnError( builder, e, ERRORS_ATTR );
+            break;
+        case LEXER_ERROR_EVENT:
+            ret = builderOnError( builder, e, LEXER_ERRORS_ATTR );
+            break;
+        case STATEMENT_EVENT:
+            ret = builderOnStatement( builder, e );
+            break;
+    }
+    (void) ret;     /* the error indicator is set if so */
+}
+
+
+/* Attaches whatever is still pending to the module info object */
+static int
+finalizeNativeBuilder( struct nativeBuilder *  builder )
+{
+    if ( PyErr_Occurred() )
+        return -1;
+    if ( builderFlushLevel( builder, 0 ) != 0 )
+        return -1;
+    if ( builder->lastImport != NULL )
+    {
+        if ( appendToAttr( builder->modInfo, IMPORTS_ATTR,
+                           builder->lastImport ) != 0 )
+            return -1;
+        Py_CLEAR( builder->lastImport );
+    }
+    return 0;
+}
+
+
+/*
+ * Events recording support
+ */
+
+static void
+initEventBuffer( struct eventBuffer *  buffer )
+{
+    memset( buffer, 0, sizeof( struct eventBuffer ) );
+}
+
+
+static void
+clearEventBuffer( struct eventBuffer *  buffer )
+{
+    free( buffer->records );
+    free( buffer->pool );
+    memset( buffer, 0, sizeof( struct eventBuffer ) );
+}
+
+
+/* Copies a string into the pool; provides its offset or -1 */
+static int
+poolString( struct eventBuffer *  buffer, const char *  str, int  length )
+{
+    if ( buffer->poolSize + length > buffer->poolCapacity )
+    {
+        int     capacity = buffer->poolCapacity * 2;
+        if ( capacity < buffer->poolSize + length )
+            capacity = buffer->poolSize + length + 4096;
+
+        char *  pool = (char *) realloc( buffer->pool, capacity );
+        if ( pool == NULL )
+            return -1;
+        buffer->pool = pool;
+        buffer->poolCapacity = capacity;
+    }
+
+    int     offset = buffer->poolSize;
+    if ( length > 0 )
+        memcpy( buffer->pool + offset, str, length );
+    buffer->poolSize += length;
+    return offset;
+}
+
+
+static void
+recordEvent( struct eventBuffer *  buffer, const struct parserEvent *  e )
+{
+    if ( buffer->failed )
+        return;
+
+    if ( buffer->count == buffer->capacity )
+    {
+        int     capacity = buffer->capacity == 0 ? 256 : buffer->capacity * 2;
+        struct eventRecord *    records = (struct eventRecord *)
+                realloc( buffer->records,
+                         capacity * sizeof( struct eventRecord ) );
+        if ( records == NULL )
+        {
+            buffer->failed = 1;
+            return;
+        }
+        buffer->records = records;
+        buffer->capacity = capacity;
+    }
+
+    struct eventRecord *    r = & buffer->records[ buffer->count ];
+
+    r->kind = e->kind;
+    r->nameOffset = poolString( buffer, e->name, e->nameLength );
+    r->nameLength = e->nameLength;
+    r->line = e->line;
+    r->pos = e->pos;
+    r->absPosition = e->absPosition;
+    r->level = e->level;
+    r->keywordLine = e->keywordLine;
+    r->keywordPos = e->keywordPos;
+    r->colonLine = e->colonLine;
+    r->colonPos = e->colonPos;
+    r->endLine = e->endLine;
+    r->isAsync = e->isAsync;
+    r->annotationOffset = poolString( buffer, e->annotation,
+                                      e->annotationLength );
+    r->annotationLength = e->annotationLength;
+    r->hashLow = (int) (uint32_t) e->contentHash;
+    r->hashHigh = (int) (uint32_t) ( e->contentHash >> 32 );
+
+    if ( r->nameOffset < 0 || r->annotationOffset < 0 )
+    {
+        buffer->failed = 1;
+        return;
+    }
+    ++buffer->count;
+}
+
+
+/* Restores an event from a record; the strings point to the pool */
+static void
+restoreEvent( const struct eventBuffer *  buffer, int  index,
+              struct parserEvent *  e )
+{
+    const struct eventRecord *  r = & buffer->records[ index ];
+
+    e->kind = (enum EventKind) r->kind;
+    e->name = buffer->pool + r->nameOffset;
+    e->nameLength = r->nameLength;
+    e->line = r->line;
+    e->pos = r->pos;
+    e->absPosition = r->absPosition;
+    e->level = r->level;
+    e->keywordLine = r->keywordLine;
+    e->keywordPos = r->keywordPos;
+    e->colonLine = r->colonLine;
+    e->colonPos = r->colonPos;
+    e->endLine = r->endLine;
+    e->isAsync = r->isAsync;
+    e->annotation = buffer->pool + r->annotationOffset;
+    e->annotationLength = r->annotationLength;
+    e->contentHash = ( (uint64_t) (uint32_t) r->hashHigh << 32 ) |
+                     (uint32_t) r->hashLow;
+}
+
+
+/* Converts an event into a tuple: the kind followed by exactly the same
+ * arguments the corresponding BriefModuleInfo._on* method receives */
+static PyObject *
+eventToTuple( const struct parserEvent *  e )
+{
+    PyObject *  name = isNameEvent( e->kind )
+                            ? newIdentifier( e->name, e->nameLength )
+                            : newString( e->name, e->nameLength );
+
+    switch ( e->kind )
+    {
+        case ENCODING_EVENT:
+        case IMPORT_EVENT:
+        case WHAT_EVENT:
+        case DECORATOR_EVENT:
+            return Py_BuildValue( "(iNiii)", e->kind, name,
+                                  e->line, e->pos, e->absPosition );
+        case GLOBAL_EVENT:
+        case CLASS_ATTRIBUTE_EVENT:
+        case INSTANCE_ATTRIBUTE_EVENT:
+            return Py_BuildValue( "(iNiiii)", e->kind, name,
+                                  e->line, e->pos, e->absPosition, e->level );
+        case FUNCTION_EVENT:
+            return Py_BuildValue( "(iNiiiiiiiiNNK)", e->kind, name,
+                                  e->line, e->pos, e->absPosition,
+                                  e->keywordLine, e->keywordPos,
+                                  e->colonLine, e->colonPos, e->level,
+                                  PyBool_FromLong( e->isAsync ),
+                                  newOptionalString( e->annotation,
+                                                     e->annotationLength ),
+                                  (unsigned long long) e->contentHash );
+        case CLASS_EVENT:
+            return Py_BuildValue( "(iNiiiiiiiiK)", e->kind, name,
+                                  e->line, e->pos, e->absPosition,
+                                  e->keywordLine, e->keywordPos,
+                                  e->colonLine, e->colonPos, e->level,
+                                  (unsigned long long) e->contentHash );
+        case STATEMENT_EVENT:
+            Py_XDECREF( name );
+            return Py_BuildValue( "(iiiiiK)", e->kind,
+                                  e->line, e->pos, e->absPosition, e->endLine,
+                                  (unsigned long long) e->contentHash );
+        case DOCSTRING_EVENT:
+            return Py_BuildValue( "(iNii)", e->kind, name,
+                                  e->line, e->endLine );
+        case ARGUMENT_EVENT:
+            return Py_BuildValue( "(iNN)", e->kind, name,
+                                  newOptionalString( e->annotation,
+                                                     e->annotationLength ) );
+        default:
+            /* as, decorator argument, argument value, base class, errors */
+            return Py_BuildValue( "(iN)", e->kind, name );
+    }
+}
+
+
+static PyObject *
+eventBufferToList( const struct eventBuffer *  buffer )
+{
+    PyObject *  list = PyList_New( buffer->count );
+    if ( list == NULL )
+        return NULL;
+
+    struct parserEvent  e;
+    for ( int  k = 0; k < buffer->count; ++k )
+    {
+        restoreEvent( buffer, k, & e );
+
+        PyObject *  item = eventToTuple( & e );
+        if ( item == NULL )
+        {
+            Py_DECREF( list );
+            return NULL;
+        }
+        PyList_SET_ITEM( list, k, item );
+    }
+    return list;
+}
+
+
+/* Provides the header, the records and the pool as a single bytes object */
+static PyObject *
+eventBufferToBytes( const struct eventBuffer *  buffer )
+{
+    size_t      recordsSize = buffer->count * sizeof( struct eventRecord );
+    PyObject *  raw = PyBytes_FromStringAndSize(
+                            NULL, sizeof( struct eventBufferHeader ) +
+                                  recordsSize + buffer->poolSize );
+    if ( raw == NULL )
+        return NULL;
+
+    char *                      data = PyBytes_AS_STRING( raw );
+    struct eventBufferHeader    header = { EVENT_BUFFER_VERSION,
+                                           buffer->count };
+
+    memcpy( data, & header, sizeof( header ) );
+    data += sizeof( header );
+    if ( recordsSize > 0 )
+        memcpy( data, buffer->records, recordsSize );
+    if ( buffer->poolSize > 0 )
+        memcpy( data + recordsSize, buffer->pool, buffer->poolSize );
+    return raw;
+}
+
+
+
+/* The single entry point for all the walker findings */
+/* Makes the mask consistent: the items which are attached to other items
+ * are not collected without their owners. The errors are always reported. */
+static int
+normalizeEventMask( int  mask )
+{
+    mask &= ALL_EVENTS_MASK | ALL_OPTIONS_MASK;
+    mask |= EVENT_BIT( ERROR_EVENT ) | EVENT_BIT( LEXER_ERROR_EVENT );
+
+    if ( ( mask & EVENT_BIT( IMPORT_EVENT ) ) == 0 )
+        mask &= ~( EVENT_BIT( WHAT_EVENT ) | EVENT_BIT( AS_EVENT ) );
+    if ( ( mask & EVENT_BIT( CLASS_EVENT ) ) == 0 )
+        mask &= ~( EVENT_BIT( CLASS_ATTRIBUTE_EVENT ) |
+                   EVENT_BIT( INSTANCE_ATTRIBUTE_EVENT ) |
+                   EVENT_BIT( BASE_CLASS_EVENT ) );
+    if ( ( mask & EVENT_BIT( FUNCTION_EVENT ) ) == 0 )
+        mask &= ~( EVENT_BIT( INSTANCE_ATTRIBUTE_EVENT ) |
+                   EVENT_BIT( ARGUMENT_EVENT ) );
+    if ( ( mask & EVENT_BIT( ARGUMENT_EVENT ) ) == 0 )
+        mask &= ~EVENT_BIT( ARGUMENT_VALUE_EVENT );
+    if ( ( mask & EVENT_BIT( DECORATOR_EVENT ) ) == 0 )
+        mask &= ~EVENT_BIT( DECORATOR_ARGUMENT_EVENT );
+    return mask;
+}
+
+
+static int
+wants( const struct parserContext *  context, enum EventKind  kind )
+{
+    return ( context->mask & EVENT_BIT( kind ) ) != 0;
+}
+
+
+/* True if anything could be found in a function or a class body */
+static int
+wantsNested( const struct parserContext *  context )
+{
+    if ( context->mask & TOP_LEVEL_ONLY_OPTION )
+        return 0;
+    return ( context->mask & ( EVENT_BIT( IMPORT_EVENT ) |
+                               EVENT_BIT( FUNCTION_EVENT ) |
+                               EVENT_BIT( CLASS_EVENT ) ) ) != 0;
+}
+
+
+/* True if only the definitions, the instance attributes and the docstring
+ * are collected from the function bodies */
+static int
+skipsFunctionBody( const struct parserContext *  context, enum Scope  scope )
+{
+    return ( context->mask & SKIP_FUNCTION_BODIES_OPTION ) != 0 &&
+           scope != GLOBAL_SCOPE && scope != CLASS_SCOPE;
+}
+
+
+static double
+getMonotonicTime( void )
+{
+    struct timespec     ts;
+
+    clock_gettime( CLOCK_MONOTONIC, & ts );
+    return ts.tv_sec + ts.tv_nsec / 1E9;
+}
+
+
+/* The flag is a writable buffer, e.g. a bytearray, whose first byte is set
+ * to cancel; the timeout is in seconds, negative means no timeout */
+static int
+initCancelCheck( struct cancelCheck *  check, PyObject *  flag,
+                 double  timeout )
+{
+    memset( check, 0, sizeof( struct cancelCheck ) );
+    if ( flag != Py_None )
+    {
+        if ( PyObject_GetBuffer( flag, & check->view, PyBUF_WRITABLE ) != 0 )
+            return 1;
+        if ( check->view.len < 1 )
+        {
+            PyBuffer_Release( & check->view );
+            PyErr_SetString( PyExc_ValueError,
+                             "The cancel flag buffer is empty" );
+            return 1;
+        }
+        check->flag = (const volatile char *) check->view.buf;
+    }
+    if ( timeout >= 0.0 )
+        check->deadline = getMonotonicTime() + timeout;
+    check->countdown = CANCEL_CHECK_INTERVAL;
+    return 0;
+}
+
+
+static void
+clearCancelCheck( struct cancelCheck *  check )
+{
+    if ( check->flag != NULL )
+        PyBuffer_Release( & check->view );
+}
+
+
+/* Checks the flag and the deadline right away */
+static int
+checkCancelled( struct cancelCheck *  check )
+{
+    if ( ! check->cancelled )
+        check->cancelled = ( check->flag != NULL && check->flag[ 0 ] != 0 ) ||
+                           ( check->deadline != 0.0 &&
+                             getMonotonicTime() >= check->deadline );
+    return check->cancelled;
+}
+
+
+/* Periodical check for the walker and the replay loops. If the walker holds
+ * the GIL and the flag could be set by another thread then that thread gets
+ * a chance to run. */
+static int
+isCancelled( struct parserContext *  context )
+{
+    struct cancelCheck *    check = context->cancel;
+
+    if ( check == NULL )
+        return 0;
+    if ( check->cancelled )
+        return 1;
+    if ( --check->countdown > 0 )
+        return 0;
+
+    check->countdown = CANCEL_CHECK_INTERVAL;
+    if ( check->flag != NULL && context->events == NULL )
+    {
+        Py_BEGIN_ALLOW_THREADS
+        Py_END_ALLOW_THREADS
+    }
+    return checkCancelled( check );
+}
+
+
+/* The items are recorded without the GIL; otherwise the exception is set */
+static void
+walkerNoMemory( struct parserContext *  context )
+{
+    if ( context->events != NULL )
+        context->events->failed = 1;
+    else if ( ! PyErr_Occurred() )
+        PyErr_NoMemory();
+}
+
+
+/* Tells if a global or an attribute has not been delivered yet. The owners
+ * are numbered even if their events are not wanted */
+static int
+isNewItem( struct parserContext *  context, const struct parserEvent *  e )
+{
+    int     unique = 1;
+
+    switch ( e->kind )
+    {
+        case FUNCTION_EVENT:
+        case CLASS_EVENT:
+            unique = addUniqueOwner( & context->names, e->level ) == 0 ? 1 : -1;
+            break;
+        case GLOBAL_EVENT:
+        case CLASS_ATTRIBUTE_EVENT:
+        case INSTANCE_ATTRIBUTE_EVENT:
+            if ( wants( context, e->kind ) )
+                unique = isUniqueName( & context->names, e );
+            break;
+        default:
+            break;
+    }
+
+    if ( unique < 0 )
+        walkerNoMemory( context );
+    return unique > 0;
+}
+
+
+static void
+deliverEvent( struct parserContext *  context, const struct parserEvent *  e )
+{
+    if ( ! wants( context, e->kind ) )
+        return;
+    if ( context->cancel != NULL && context->cancel->cancelled )
+        return;
+
+    if ( context->events != NULL )
+        recordEvent( context->events, e );
+    else if ( context->builder != NULL )
+        builderOnEvent( context->builder, e );
+    else
+        callOnEvent( context->callbacks, e );
+}
+
+
+/* The repeated globals and attributes are dropped here, so the recorded and
+ * the cached events have them once */
+static void
+emitEvent( struct parserContext *  context, const struct parserEvent *  e )
+{
+    if ( isNewItem( context, e ) )
+        deliverEvent( context, e );
+}
+
+
+/* The events are delivered as they were recorded, i.e. without duplicates */
+static void
+replayEvents( const struct eventBuffer *  events,
+              struct parserContext *      context )
+{
+    struct parserEvent      event;
+
+    for ( int  k = 0; k < events->count && ! isCancelled( context ); ++k )
+    {
+        restoreEvent( events, k, & event );
+        deliverEvent( context, & event );
+    }
+}
+
+
+/* A fast non cryptographic hash of the source content */
+static uint64_t
+hashContent( const char *  buffer, size_t  size )
+{
+    const uint64_t  prime = 0x9E3779B97F4A7C15ULL;
+    uint64_t        hash = size * prime;
+    uint64_t        word;
+
+    for ( ; size >= sizeof( word ); buffer += sizeof( word ),
+                                    size -= sizeof( word ) )
+    {
+        memcpy( & word, buffer, sizeof( word ) );
+        hash = ( hash ^ word ) * prime;
+        hash ^= hash >> 32;
+    }
+
+    word = 0;
+    memcpy( & word, buffer, size );
+    hash = ( hash ^ word ) * prime;
+    return hash ^ ( hash >> 32 );
+}
+
+
+/* The docstrings are trimmed the way trim_docstring() in cdmpyparser.py (PEP
+ * 257) does it on the UTF-8 text: the tabs are expanded, the first line is
+ * stripped, the common indentation of the other lines is removed, the lines
+ * are stripped on the right and the blank lines at the both ends are
+ * dropped. The line breaks and the whitespaces are the ones of
+ * str.splitlines() and str.isspace(). */
+#define DOC_TAB_SIZE        8
+
+/* A docstring line: the width is the expanded length, i.e. an upper limit
+ * of the trimmed length */
+struct docLine
+{
+    const char *    start;
+    const char *    end;            /* the line break or the text end */
+    const char *    contentEnd;     /* after the last non whitespace */
+    const char *    next;           /* after the line break */
+    int             column;         /* the expandtabs() column of the start */
+    int             nextColumn;
+    int             indent;         /* the leading whitespaces columns */
+    int             width;
+    int             blank;
+};
+
+
+static int
+docCharLength( const char *  str, const char *  end )
+{
+    unsigned char   c = (unsigned char) str[ 0 ];
+    int             length = 1;
+
+    if ( ( c & 0xE0 ) == 0xC0 )
+        length = 2;
+    else if ( ( c & 0xF0 ) == 0xE0 )
+        length = 3;
+    else if ( ( c & 0xF8 ) == 0xF0 )
+        length = 4;
+    return length <= end - str ? length : end - str;
+}
+
+
+/* The length of the line break at the position, 0 if there is none */
+static int
+docLineBreakLength( const char *  str, const char *  end )
+{
+    const unsigned char *   s = (const unsigned char *) str;
+
+    if ( s[ 0 ] == '\r' )
+        return end - str > 1 && s[ 1 ] == '\n' ? 2 : 1;
+    if ( s[ 0 ] == '\n' || s[ 0 ] == '\v' || s[ 0 ] == '\f' ||
+         ( s[ 0 ] >= 0x1C && s[ 0 ] <= 0x1E ) )
+        return 1;
+    if ( end - str > 1 && s[ 0 ] == 0xC2 && s[ 1 ] == 0x85 )
+        return 2;                                   /* U+0085 */
+    if ( end - str > 2 && s[ 0 ] == 0xE2 && s[ 1 ] == 0x80 &&
+         ( s[ 2 ] == 0xA8 || s[ 2 ] == 0xA9 ) )
+        return 3;                                   /* U+2028, U+2029 */
+    return 0;
+}
+
+
+/* The length of the whitespace at the position which is not a line break,
+ * 0 if there is none */
+static int
+docSpaceLength( const char *  str, const char *  end )
+{
+    const unsigned char *   s = (const unsigned char *) str;
+
+    if ( s[ 0 ] == ' ' || s[ 0 ] == '\t' || s[ 0 ] == 0x1F )
+        return 1;
+    if ( end - str > 1 && s[ 0 ] == 0xC2 && s[ 1 ] == 0xA0 )
+        return 2;                                   /* U+00A0 */
+    if ( end - str < 3 )
+        return 0;
+    if ( ( s[ 0 ] == 0xE1 && s[ 1 ] == 0x9A && s[ 2 ] == 0x80 ) ||
+         ( s[ 0 ] == 0xE2 && s[ 1 ] == 0x80 &&
+           ( s[ 2 ] <= 0x8A || s[ 2 ] == 0xAF ) ) ||
+         ( s[ 0 ] == 0xE2 && s[ 1 ] == 0x81 && s[ 2 ] == 0x9F ) ||
+         ( s[ 0 ] == 0xE3 && s[ 1 ] == 0x80 && s[ 2 ] == 0x80 ) )
+        return 3;       /* U+1680, U+2000..U+200A, U+202F, U+205F, U+3000 */
+    return 0;
+}
+
+
+static void
+getDocLine( const char *  p, const char *  end, int  column,
+            struct docLine *  line )
+{
+    int     breakLength = 0;
+
+    line->start = p;
+    line->contentEnd = p;
+    line->column = column;
+    line->indent = 0;
+    line->width = 0;
+    line->blank = 1;
+    while ( p < end && ( breakLength = docLineBreakLength( p, end ) ) == 0 )
+    {
+        int     space = docSpaceLength( p, end );
+        int     length = space != 0 ? space : docCharLength( p, end );
+        int     columns = 1;
+
+        if ( *p == '\t' )
+            columns = DOC_TAB_SIZE - column % DOC_TAB_SIZE;
+        line->width += *p == '\t' ? columns : length;
+        if ( space == 0 )
+        {
+            line->blank = 0;
+            line->contentEnd = p + length;
+        }
+        else if ( line->blank )
+            line->indent += columns;
+        column += columns;
+        p += length;
+    }
+
+    /* expandtabs() counts the columns from the '\r' and '\n' only */
+    line->end = p;
+    line->next = p + breakLength;
+    line->nextColumn = ( p < end && ( *p == '\r' || *p == '\n' ) ) ? 0
+                                                                 : column + 1;
+}
+
+
+/* Copies the line till the given position expanding the tabs; the first
+ * skip columns are dropped */
+static char *
+putDocLine( char *  out, const struct docLine *  line, int  skip,
+            const char *  to )
+{
+    int     column = line->column;
+    int     dropped = 0;
+
+    for ( const char *  p = line->start; p < to; )
+    {
+        if ( *p == '\t' )
+        {
+            for ( int  k = DOC_TAB_SIZE - column % DOC_TAB_SIZE; k > 0; --k )
+            {
+                if ( dropped++ >= skip )
+                    *out++ = ' ';
+                ++column;
+            }
+            ++p;
+            continue;
+        }
+
+        int     length = docCharLength( p, to );
+        if ( dropped++ >= skip )
+        {
+            memcpy( out, p, length );
+            out += length;
+        }
+        ++column;
+        p += length;
+    }
+    return out;
+}
+
+
+/* Provides the trimmed docstring allocated in the arena; NULL if there is
+ * no memory. The lines are looked through twice: first for the indentation
+ * and the blank lines and then to copy the kept parts. */
+static char *
+trimDocstringText( struct arena *  arena, const char *  text, int  length,
+                   int *  trimmedLength )
+{
+    const char *        end = text + length;
+    struct docLine      line;
+    int                 index = 0;
+    int                 indent = INT_MAX;
+    int                 width = 1;
+    int                 firstNonBlank = -1;
+    int                 lastNonBlank = -1;
+    int                 firstFilled = -1;   /* not empty, after the first */
+    int                 lastFilled = -1;
+
+    for ( const char *  p = text; p < end; p = line.next, ++index )
+    {
+        getDocLine( p, end, index == 0 ? 0 : line.nextColumn, & line );
+        width += line.width + 1;
+        if ( ! line.blank )
+        {
+            if ( firstNonBlank < 0 )
+                firstNonBlank = index;
+            lastNonBlank = index;
+            if ( index > 0 && line.indent < indent )
+                indent = line.indent;
+        }
+        if ( index > 0 && line.end > line.start )
+        {
+            if ( firstFilled < 0 )
+                firstFilled = index;
+            lastFilled = index;
+        }
+    }
+
+    /* If all the lines after the first one are blank then trim_docstring()
+     * leaves them as they are, so only the empty ones are dropped */
+    int     first = firstNonBlank;
+    int     last = lastNonBlank;
+    if ( indent == INT_MAX )
+    {
+        first = firstNonBlank == 0 ? 0 : firstFilled;
+        last = lastFilled >= 0 ? lastFilled : first;
+    }
+
+    char *  trimmed = (char *) arenaAlloc( arena, width );
+    char *  out = trimmed;
+    if ( trimmed == NULL )
+        return NULL;
+
+    index = 0;
+    for ( const char *  p = text; first >= 0 && index <= last;
+          p = line.next, ++index )
+    {
+        getDocLine( p, end, index == 0 ? 0 : line.nextColumn, & line );
+        if ( index < first )
+            continue;
+
+        if ( index > first )
+            *out++ = '\n';
+        if ( index == 0 )
+            out = putDocLine( out, & line, line.indent, line.contentEnd );
+        else if ( indent == INT_MAX )
+            out = putDocLine( out, & line, 0, line.end );
+        else
+            out = putDocLine( out, & line, indent, line.contentEnd );
+    }
+
+    *out = '\0';
+    *trimmedLength = out - trimmed;
+    return trimmed;
+}
+
+
+#ifdef CDM_INTERPRETER_PARSER
+/* Provides the total number of lines in the code */
+static int getTotalLines( node *  tree )
+{
+    if ( tree == NULL )
+        return -1;
+
+    if ( tree->n_type != file_input )
+        tree = &(tree->n_child[ 0 ]);
+
+    assert( tree->n_type == file_input );
+
+    node *          child;
+    int             n = tree->n_nchildren;
+    for ( int  k = 0; k < n; ++k )
+    {
+        child = &(tree->n_child[ k ]);
+        if ( child->n_type == ENDMARKER )
+            return child->n_lineno;
+    }
+    return -1;
+}
+
+
+
+/* Fills the given buffer */
+/* Provides the last line of the subtree tokens. NEWLINE, INDENT, DEDENT
+ * and ENDMARKER do not count; 0 if there are no other tokens */
+static int getLastLine( node *  tree )
+{
+    for ( int  k = tree->n_nchildren - 1; k >= 0; --k )
+    {
+        node *      child = & ( tree->n_child[ k ] );
+
+        if ( ISNONTERMINAL( child->n_type ) )
+        {
+            int     line = getLastLine( child );
+            if ( line > 0 )
+                return line;
+            continue;
+        }
+        if ( child->n_type == NEWLINE || child->n_type == INDENT ||
+             child->n_type == DEDENT || child->n_type == ENDMARKER )
+            continue;
+
+        /* Python 3.7 and earlier -> a string token has its last line
+         * Python 3.8 and later   -> its first line */
+        #if PY_MAJOR_VERSION == 3 && (PY_MINOR_VERSION == 8 || PY_MINOR_VERSION == 9)
+        if ( child->n_type == STRING )
+            return child->n_lineno +
+                   countLineEnds( child->n_str,
+                                  child->n_str + strlen( child->n_str ) );
+        #endif
+        return child->n_lineno;
+    }
+    return 0;
+}
+
+
+/* Provides the hash of the code from the absolute position till the end of
+ * the last line */
+static uint64_t
+hashSpan( struct parserContext *  context, int *  lineShifts,
+          int  absPosition, int  lastLine )
+{
+    const char *    start = context->buffer + absPosition;
+    const char *    end = start;
+
+    if ( lastLine > 0 )
+    {
+        end = context->buffer + lineShifts[ lastLine ];
+        while ( *end != '\0' && *end != '\n' && *end != '\r' )
+            ++end;
+    }
+    return hashContent( start, end - start );
+}
+
+
+/* A growable text for the walker in the context arena. The memory stays
+ * allocated till the arena is released to a mark saved before the text was
+ * started. The text is always '\0' terminated. */
+struct scratch
+{
+    struct parserContext *  context;
+    char *                  data;
+    int                     length;
+    int                     capacity;
+};
+
+
+static void
+initScratch( struct scratch *  scratch, struct parserContext *  context )
+{
+    scratch->context = context;
+    scratch->data = NULL;
+    scratch->length = 0;
+    scratch->capacity = 0;
+}
+
+
+/* If there is no memory then the text stays as it was */
+static void
+appendScratch( struct scratch *  scratch, const char *  str, int  length )
+{
+    if ( scratch->length + length + 1 > scratch->capacity )
+    {
+        int     capacity = scratch->capacity == 0 ? 256
+                                                  : scratch->capacity * 2;
+        if ( capacity < scratch->length + length + 1 )
+            capacity = scratch->length + length + 1;
+
+        char *  data = (char *) arenaGrow( scratch->context->arena,
+                                           scratch->data,
+                                           scratch->capacity, capacity );
+        if ( data == NULL )
+        {
+            walkerNoMemory( scratch->context );
+            return;
+        }
+        scratch->data = data;
+        scratch->capacity = capacity;
+    }
+    memcpy( scratch->data + scratch->length, str, length );
+    scratch->length += length;
+    scratch->data[ scratch->length ] = '\0';
+}
+
+
+/* Never NULL */
+static const char *
+scratchText( const struct scratch *  scratch )
+{
+    return scratch->data == NULL ? "" : scratch->data;
+}
+
+
+static char *   getDottedName( node *             tree,
+                               struct scratch *   name )
+{
+    int                     n = tree->n_nchildren;
+    node *                  child;
+    char *                  first = NULL;
+
+    /* tree must be of 'dotted_name' type */
+    assert( tree->n_type == dotted_name );
+
+    for ( int  k = 0; k < n; ++k )
+    {
+        child = & (tree->n_child[k]);
+        if ( child->n_type == NAME )
+        {
+            appendScratch( name, child->n_str, strlen( child->n_str ) );
+            if ( k == 0 )
+                first = child->n_str;
+        }
+        else
+        {
+            /* This is DOT */
+            assert( child->n_type == DOT );
+            appendScratch( name, ".", 1 );
+        }
+    }
+    return first;
+}
+
+
+static node *  findChildOfType( node *  from, int  type )
+{
+    int         n = from->n_nchildren;
+    for ( int  k = 0; k < n; ++k )
+        if ( from->n_child[ k ].n_type == type )
+            return & (from->n_child[ k ]);
+    return NULL;
+}
+
+
+/* It is used for 3.9 and up
+ * Returns a pointer to:
+ * - arglist if found in the last trailer
+ * - LPAR if it is the case with zero arguments like @decor()
+ * - NULL if there are no arguments at all
+ */
+static node *  findDecoratorArgsNode( node *  atomExprNode )
+{
+    int         n = atomExprNode->n_nchildren;
+    int         lastChildIndex = n - 1;
+
+    if ( lastChildIndex < 0 )
+        return NULL;
+
+    node *      lastChild = & atomExprNode->n_child[ lastChildIndex ];
+    if ( lastChild->n_type != trailer )
+        return NULL;
+
+    if ( lastChild->n_nchildren < 2 )
+        return NULL;
+    if ( lastChild->n_child[ 0 ].n_type != LPAR )
+        return NULL;
+    if ( lastChild->n_child[ 1 ].n_type == RPAR )
+        return & lastChild->n_child[ 0 ];
+    if ( lastChild->n_child[ 1 ].n_type != arglist )
+        return NULL;
+
+    return & lastChild->n_child[ 1 ];
+}
+
+
+/* Collects the string parts of the test node recursively.  */
+/* It is used in:                                           */
+/* - the default argument values                            */
+/* - class inheritance                                      */
+/* - argumnts annotations                                   */
+/* - return value annotations                               */
+static void  collectTestString( node *  from, struct scratch *  buffer )
+{
+    if ( from->n_str != NULL )
+    {
+        switch ( from->n_type )
+        {
+            case LPAR:
+            case RPAR:
+            case LSQB:
+            case RSQB:
+            case LBRACE:
+            case RBRACE:
+            case EQUAL:
+            case TILDE:
+            case DOT:
+                appendScratch( buffer, from->n_str, 1 );
+                break;
+            case COMMA:
+                appendScratch( buffer, ", ", 2 );
+                break;
+            case MINUS:
+            case PLUS:
+            case SLASH:
+            case STAR:
+            case PERCENT:
+            case LESS:
+            case GREATER:
+            case VBAR:
+            case AMPER:
+            case CIRCUMFLEX:
+                {
+                    char    op[ 3 ] = { ' ', from->n_str[ 0 ], ' ' };
+                    appendScratch( buffer, op, 3 );
+                }
+                break;
+            case COLON:
+                appendScratch( buffer, ": ", 2 );
+                break;
+            case DOUBLESTAR:
+            case DOUBLESLASH:
+            case EQEQUAL:
+            case GREATEREQUAL:
+            case LESSEQUAL:
+            case NOTEQUAL:
+            case LEFTSHIFT:
+            case RIGHTSHIFT:
+                {
+                    char    op[ 4 ] = { ' ', from->n_str[ 0 ],
+                                        from->n_str[ 1 ], ' ' };
+                    appendScratch( buffer, op, 4 );
+                }
+                break;
+            default:
+                if ( strcmp( from->n_str, "not" ) == 0 ||
+                     strcmp( from->n_str, "in" ) == 0 ||
+                     strcmp( from->n_str, "is" ) == 0 ||
+                     strcmp( from->n_str, "or" ) == 0 ||
+                     strcmp( from->n_str, "and" ) == 0 ||
+                     strcmp( from->n_str, "if" ) == 0 ||
+                     strcmp( from->n_str, "elif" ) == 0 ||
+                     strcmp( from->n_str, "else" ) == 0 )
+                {
+                    appendScratch( buffer, " ", 1 );
+                    appendScratch( buffer, from->n_str, strlen( from->n_str ) );
+                    appendScratch( buffer, " ", 1 );
+                    break;
+                }
+
+                /* Really default case: copy as is */
+                appendScratch( buffer, from->n_str, strlen( from->n_str ) );
+        }
+
+    }
+
+    int         n = from->n_nchildren;
+    for ( int  k = 0; k < n; ++k )
+        collectTestString( & ( from->n_child[ k ] ), buffer );
+}
+
+
+static void getAtomDecoratorName( node *            atomExprNode,
+                                  struct scratch *  name,
+                                  node *            argsNode )
+{
+    int         n = atomExprNode->n_nchildren;
+    if ( argsNode != NULL )
+        --n;    /* The decorator has arguments so the last child must not be
+                   participating in building the name */
+
+    for ( int  k = 0; k < n; ++k )
+    {
+        collectTestString( & atomExprNode->n_child[ k ], name );
+    }
+}
+
+
+/* returns 1, 2, 3 or 4,
+   i.e. the number of leading quotes used in a string literal part */
+static size_t getStringLiteralPrefixLength( node *  tree )
+{
+    /* tree must be of STRING type */
+    assert( tree->n_type == STRING );
+    if ( strncmp( tree->n_str, "\"\"\"", 3 ) == 0 )
+        return 3;
+    if ( strncmp( tree->n_str, "'''", 3 ) == 0 )
+        return 3;
+    if ( strncmp( tree->n_str, "r\"\"\"", 4 ) == 0 )
+        return 4;
+    if ( strncmp( tree->n_str, "r'''", 4 ) == 0 )
+        return 4;
+    if ( strncmp( tree->n_str, "u\"\"\"", 4 ) == 0 )
+        return 4;
+    if ( strncmp( tree->n_str, "u'''", 4 ) == 0 )
+        return 4;
+    if ( strncmp( tree->n_str, "f\"\"\"", 4 ) == 0 )
+        return 4;
+    if ( strncmp( tree->n_str, "f'''", 4 ) == 0 )
+        return 4;
+    if ( strncmp( tree->n_str, "r\"", 2 ) == 0 )
+        return 2;
+    if ( strncmp( tree->n_str, "r'", 2 ) == 0 )
+        return 2;
+    if ( strncmp( tree->n_str, "u\"", 2 ) == 0 )
+        return 2;
+    if ( strncmp( tree->n_str, "u'", 2 ) == 0 )
+        return 2;
+    if ( strncmp( tree->n_str, "f\"", 2 ) == 0 )
+        return 2;
+    if ( strncmp( tree->n_str, "f'", 2 ) == 0 )
+        return 2;
+    return 1;
+}
+
+
+/* Searches for a certain  node among the first children */
+static node *  skipToNode( node *  tree, int nodeType )
+{
+    if ( tree == NULL )
+        return NULL;
+
+    for ( ; ; )
+    {
+        if ( tree->n_type == nodeType )
+            return tree;
+        if ( tree->n_nchildren < 1 )
+            return NULL;
+        tree = & ( tree->n_child[ 0 ] );
+    }
+    return NULL;
+}
+
+
+
+static void checkForDocstring( node *                       tree,
+                               struct parserContext *       context )
+{
+    if ( tree == NULL )
+        return;
+
+    node *      child = NULL;
+    int         n = tree->n_nchildren;
+    for ( int  k = 0; k < n; ++k )
+    {
+        /* need to skip NEWLINE and INDENT till stmt if so */
+        child = & ( tree->n_child[ k ] );
+        if ( child->n_type == NEWLINE )
+            continue;
+        if ( child->n_type == INDENT )
+            continue;
+        if ( child->n_type == stmt )
+            break;
+
+        return;
+    }
+
+    child = skipToNode( child, atom );
+    if ( child == NULL )
+        return;
+
+    /* Atom has to have children of the STRING type only */
+    struct arenaMark    mark = saveArena( context->arena );
+    struct scratch      buffer;
+    int             charsToSkip;
+    int             charsToCopy;
+    node *          stringChild = NULL;
+    n = child->n_nchildren;
+    initScratch( & buffer, context );
+
+    node *          firstStringChild = NULL;
+    int             needAdjustFirst = 0;    // for python 3.7
+    int             needAdjustLast = 0;     // for python >= 3.8
+    for ( int  k = 0; k < n; ++k )
+    {
+        stringChild = & ( child->n_child[ k ] );
+        if ( stringChild->n_type != STRING )
+        {
+            releaseArena( context->arena, mark );
+            return;
+        }
+
+        charsToSkip = getStringLiteralPrefixLength( stringChild );
+        charsToCopy = strlen( stringChild->n_str ) - charsToSkip;
+        if ( charsToSkip == 2 )
+            charsToCopy -= 1;
+        else if ( charsToSkip == 4 )
+            charsToCopy -= 3;
+        else
+            charsToCopy -= charsToSkip;
+
+        #if PY_MAJOR_VERSION == 3 && (PY_MINOR_VERSION == 8 || PY_MINOR_VERSION == 9)
+        if ( charsToSkip >= 3 )
+            needAdjustLast = 1;
+        #endif
+
+        if ( k == 0 )
+        {
+            firstStringChild = stringChild;
+            #if PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION <= 7
+            if ( charsToSkip >= 3 )
+                needAdjustFirst = 1;
+            #endif
+        }
+
+        appendScratch( & buffer, stringChild->n_str + charsToSkip,
+                       charsToCopy );
+    }
+
+    // Python 3.7 and earlier -> reports the last line
+    // Python 3.8 and later   -> reports the first line
+    int     firstLine = firstStringChild->n_lineno;
+    int     lastLine = stringChild->n_lineno;
+
+    if ( needAdjustFirst != 0 )
+    {
+        const char *    str = firstStringChild->n_str;
+        firstLine -= countLineEnds( str, str + strlen( str ) );
+    }
+    if ( needAdjustLast != 0 )
+    {
+        const char *    str = stringChild->n_str;
+        lastLine += countLineEnds( str, str + strlen( str ) );
+    }
+
+    struct parserEvent  event = { .kind = DOCSTRING_EVENT,
+                                  .name = scratchText( & buffer ),
+                                  .nameLength = buffer.length,
+                                  .line = firstLine,
+                                  .endLine = lastLine };
+    if ( ( context->mask & RAW_DOCSTRINGS_OPTION ) == 0 )
+    {
+        int     length = 0;
+        event.name = trimDocstringText( context->arena, event.name,
+                                        event.nameLength, & length );
+        event.nameLength = length;
+    }
+    if ( event.name == NULL )
+        walkerNoMemory( context );
+    else
+        emitEvent( context, & event );
+    releaseArena( context->arena, mark );
+    return;
+}
+
+
+static void  processImport( node *                       tree,
+                            struct parserContext *       context,
+                            int *                        lineShifts )
+{
+    assert( tree->n_type == import_stmt );
+    assert( tree->n_nchildren == 1 );
+
+    /* There must be one child of type import_from or import_name */
+    tree = & (tree->n_child[ 0 ]);
+    if ( tree->n_type == import_from )
+    {
+        struct arenaMark    mark = saveArena( context->arena );
+        struct scratch      name;
+        int     needFlush = 0;
+        node *  firstNameNode = NULL;
+        int     n = tree->n_nchildren;
+
+        initScratch( & name, context );
+
+        for ( int  k = 0; k < n; ++k )
+        {
+            node *      child = & ( tree->n_child[ k ] );
+            if ( child->n_type == DOT )
+            {
+                // Part of the name
+                appendScratch( & name, ".", 1 );
+                if ( firstNameNode == NULL )
+                    firstNameNode = child;
+                needFlush = 1;
+                continue;
+            }
+            if ( child->n_type == ELLIPSIS )
+            {
+                // Part of the name
+                appendScratch( & name, "...", 3 );
+                if ( firstNameNode == NULL )
+                    firstNameNode = child;
+                needFlush = 1;
+                continue;
+            }
+            if ( child->n_type == dotted_name )
+            {
+                getDottedName( child, & name );
+                if ( firstNameNode == NULL )
+                    firstNameNode = child;
+                needFlush = 1;
+                continue;
+            }
+
+            if ( needFlush == 1 )
+            {
+                struct parserEvent  event = {
+                        .kind = IMPORT_EVENT,
+                        .name = scratchText( & name ),
+                        .nameLength = name.length,
+                        .line = firstNameNode->n_lineno,
+                        .pos = firstNameNode->n_col_offset + 1, /* Make it 1-based */
+                        .absPosition = lineShifts[ firstNameNode->n_lineno ] +
+                                       firstNameNode->n_col_offset };
+                emitEvent( context, & event );
+
+                needFlush = 0;
+            }
+
+            if ( child->n_type == import_as_names &&
+                 wants( context, WHAT_EVENT ) )
+            {
+                // This is what is imported from the module
+                for ( int  j = 0; j < child->n_nchildren; ++j )
+                {
+                    node *      whatChild = & ( child->n_child[ j ] );
+                    if ( whatChild->n_type == import_as_name )
+                    {
+                        assert( whatChild->n_nchildren == 1 ||
+                                whatChild->n_nchildren == 3 );
+                        node *  whatName = & ( whatChild->n_child[ 0 ] );
+
+                        struct parserEvent  event = {
+                                .kind = WHAT_EVENT,
+                                .name = whatName->n_str,
+                                .nameLength = strlen( whatName->n_str ),
+                                .line = whatName->n_lineno,
+                                .pos = whatName->n_col_offset + 1, /* Make it 1-based */
+                                .absPosition = lineShifts[ whatName->n_lineno ] +
+                                               whatName->n_col_offset };
+                        emitEvent( context, & event );
+
+                        if ( whatChild->n_nchildren == 3 )
+                        {
+                            node *  asName = & ( whatChild->n_child[ 2 ] );
+                            struct parserEvent  asEvent = {
+                                    .kind = AS_EVENT,
+                                    .name = asName->n_str,
+                                    .nameLength = strlen( asName->n_str ) };
+                            emitEvent( context, & asEvent );
+                        }
+                    }
+                }
+            }
+        }
+        releaseArena( context->arena, mark );
+    }
+    else
+    {
+        assert( tree->n_type == import_name );
+
+        tree = findChildOfType( tree, dotted_as_names );
+        assert( tree != NULL );
+
+        node *      child;
+        for ( int  k = 0; k < tree->n_nchildren; ++k )
+        {
+            child = & ( tree->n_child[ k ] );
+            if ( child->n_type == dotted_as_name )
+            {
+                int     expect_as_name = 0;
+                for ( int  j = 0; j < child->n_nchildren; ++j )
+                {
+                    node *      subchild = & ( child->n_child[ j ] );
+
+                    if ( subchild->n_type == dotted_name )
+                    {
+                        struct arenaMark    mark = saveArena( context->arena );
+                        struct scratch      name;
+
+                        initScratch( & name, context );
+                        getDottedName( subchild, & name );
+
+                        struct parserEvent  event = {
+                                .kind = IMPORT_EVENT,
+                                .name = scratchText( & name ),
+                                .nameLength = name.length,
+                                .line = subchild->n_lineno,
+                                .pos = subchild->n_col_offset + 1, /* Make it 1-based */
+                                .absPosition = lineShifts[ subchild->n_lineno ] +
+                                               subchild->n_col_offset };
+                        emitEvent( context, & event );
+                        releaseArena( context->arena, mark );
+                        continue;
+                    }
+                    if ( subchild->n_type == NAME )
+                    {
+                        if ( expect_as_name == 1 )
+                        {
+                            struct parserEvent  event = {
+                                    .kind = AS_EVENT,
+                                    .name = subchild->n_str,
+                                    .nameLength = strlen( subchild->n_str ) };
+                            emitEvent( context, & event );
+                            expect_as_name = 0;
+                            continue;
+                        }
+
+                        if ( strcmp( subchild->n_str, "as" ) == 0 )
+                            expect_as_name = 1;
+                    }
+                }
+
+            }
+        }
+    }
+}
+
+
+static const char *  processArgument( node *                    tree,
+                                      struct parserContext *    context )
+{
+    assert( tree->n_type == tfpdef );
+    assert( tree->n_nchildren > 0 );
+
+    node *      nameNode = & ( tree->n_child[ 0 ] );
+    assert( nameNode->n_type == NAME );
+
+    // The only 'test' node is for an annotation
+    node *      testNode = findChildOfType( tree, test );
+    struct arenaMark    mark = saveArena( context->arena );
+    struct scratch      annotation;
+
+    initScratch( & annotation, context );
+    if ( testNode != NULL )
+        collectTestString( testNode, & annotation );
+
+    struct parserEvent  event = { .kind = ARGUMENT_EVENT,
+                                  .name = nameNode->n_str,
+                                  .nameLength = strlen( nameNode->n_str ),
+                                  .annotation = scratchText( & annotation ),
+                                  .annotationLength = annotation.length };
+    emitEvent( context, & event );
+    releaseArena( context->arena, mark );
+    return nameNode->n_str;
+}
+
+
+static int processDecor( node *                        tree,
+                         struct parserContext *        context,
+                         int *                         lineShifts,
+                         int                           emit )
+{
+    int         staticMethod = 0;
+    assert( tree->n_type == decorator );
+
+    struct arenaMark    mark = saveArena( context->arena );
+    struct scratch      name;
+
+    initScratch( & name, context );
+
+    #if PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION == 9
+        /* The 3.9 grammar introduces a completely different structure of the
+         * tree. Now it could be an arbitrary expression.
+         */
+
+        node *      namedExprTestNode = findChildOfType( tree, namedexpr_test );
+
+        /* The nameNode name is not very good; actually it is the atom_tree
+         * however the common code below looks better with nameNode
+         */
+        node *      nameNode = skipToNode( namedExprTestNode, atom_expr );
+        node *      argsNode = NULL;
+
+        if ( nameNode == NULL )
+        {
+            /* E.g. @lambda f: f; the whole expression is the name */
+            nameNode = namedExprTestNode;
+            collectTestString( nameNode, & name );
+        }
+        else
+        {
+            argsNode = findDecoratorArgsNode( nameNode );
+            getAtomDecoratorName( nameNode, & name, argsNode );
+        }
+    #else
+        node *      nameNode = findChildOfType( tree, dotted_name );
+        assert( nameNode != NULL );
+
+        getDottedName( nameNode, & name );
+
+        node *      argsNode = findChildOfType( tree, arglist );
+        if ( argsNode == NULL )
+        {
+            /* Point to the '(' in case of @decor() */
+            argsNode = findChildOfType( tree, LPAR );
+        }
+    #endif
+
+    struct parserEvent  event = {
+            .kind = DECORATOR_EVENT,
+            .name = scratchText( & name ),
+            .nameLength = name.length,
+            .line = nameNode->n_lineno,
+            .pos = nameNode->n_col_offset + 1,      /* Make it 1-based */
+            .absPosition = lineShifts[ nameNode->n_lineno ] +
+                           nameNode->n_col_offset };
+    if ( emit )
+        emitEvent( context, & event );
+
+    if ( strcmp( scratchText( & name ), "staticmethod" ) == 0 )
+    {
+        staticMethod = 1;
+    }
+
+    if ( argsNode != NULL && emit &&
+         wants( context, DECORATOR_ARGUMENT_EVENT ) )
+    {
+        /* There are decorator arguments */
+
+        /* Special case:
+         * if a decorator has no arguments and looks like @decor()
+         * then the argsNode points to LPAR
+         */
+        if ( argsNode->n_type == LPAR )
+        {
+            struct parserEvent  argEvent = { .kind = DECORATOR_ARGUMENT_EVENT,
+                                             .name = "",
+                                             .nameLength = 0 };
+            emitEvent( context, & argEvent );
+            releaseArena( context->arena, mark );
+            return staticMethod;
+        }
+
+        node *      child;
+        for ( int  k = 0; k < argsNode->n_nchildren; ++k )
+        {
+            child = & ( argsNode->n_child[ k ] );
+            if ( child->n_type == argument )
+            {
+                struct arenaMark    argMark = saveArena( context->arena );
+                struct scratch      arg;
+
+                initScratch( & arg, context );
+                collectTestString( child, & arg );
+
+                struct parserEvent  argEvent = { .kind = DECORATOR_ARGUMENT_EVENT,
+                                                 .name = scratchText( & arg ),
+                                                 .nameLength = arg.length };
+                emitEvent( context, & argEvent );
+                releaseArena( context->arena, argMark );
+            }
+        }
+    }
+
+    releaseArena( context->arena, mark );
+    return staticMethod;
+}
+
+static int processDecorators( node *                        tree,
+                              struct parserContext *        context,
+                              int *                         lineShifts,
+                              int                           emit )
+{
+    int         staticMethod = 0;
+    node *      child;
+    int         n = tree->n_nchildren;
+    assert( tree->n_type == decorators );
+
+    for ( int  k = 0; k < n; ++k )
+    {
+        child = & ( tree->n_child[ k ] );
+        if ( child->n_type == decorator )
+        {
+            int     isStatic = 0;
+            isStatic = processDecor( child, context, lineShifts, emit );
+            if ( staticMethod == 0 )
+                staticMethod = isStatic;
+        }
+    }
+
+    return staticMethod;
+}
+
+
+
+static void  processClassDefinition( node *                       tree,
+                                     struct parserContext *       context,
+                                     int                          objectsLevel,
+                                     enum Scope                   scope,
+                                     int                          entryLevel,
+                                     int *                        lineShifts )
+{
+    assert( tree->n_type == classdef );
+    assert( tree->n_nchildren > 1 );
+
+    node *      classNode = & ( tree->n_child[ 0 ] );
+    node *      nameNode = & ( tree->n_child[ 1 ] );
+    node *      colonNode = findChildOfType( tree, COLON );
+
+    assert( colonNode != NULL );
+
+    /* The nested items go to the closest reported parent */
+    int         emit = wants( context, CLASS_EVENT );
+    if ( emit )
+        ++objectsLevel;
+
+    struct parserEvent  event = {
+            .kind = CLASS_EVENT,
+            .name = nameNode->n_str,
+            .nameLength = strlen( nameNode->n_str ),
+            /* Class name line and pos */
+            .line = nameNode->n_lineno,
+            .pos = nameNode->n_col_offset + 1,          /* To make it 1-based */
+            .absPosition = lineShifts[ nameNode->n_lineno ] +
+                           nameNode->n_col_offset,
+            /* Keyword 'class' line and pos */
+            .keywordLine = classNode->n_lineno,
+            .keywordPos = classNode->n_col_offset + 1,  /* To make it 1-based */
+            /* ':' line and pos */
+            .colonLine = colonNode->n_lineno,
+            .colonPos = colonNode->n_col_offset + 1,    /* To make it 1-based */
+            .level = objectsLevel };
+    if ( emit )
+        event.contentHash = hashSpan( context, lineShifts,
+                                      lineShifts[ classNode->n_lineno ] +
+                                      classNode->n_col_offset,
+                                      getLastLine( tree ) );
+    emitEvent( context, & event );
+
+    /* Collect inheritance list */
+    node *      listNode = findChildOfType( tree, arglist );
+    if ( listNode != NULL && wants( context, BASE_CLASS_EVENT ) )
+    {
+        node *      child;
+        int         n = listNode->n_nchildren;
+        for ( int  k = 0; k < n; ++k )
+        {
+            child = & ( listNode->n_child[ k ] );
+            if ( child->n_type == argument )
+            {
+                struct arenaMark    mark = saveArena( context->arena );
+                struct scratch      buffer;
+
+                initScratch( & buffer, context );
+                collectTestString( child, & buffer );
+
+                struct parserEvent  baseEvent = { .kind = BASE_CLASS_EVENT,
+                                                  .name = scratchText( & buffer ),
+                                                  .nameLength = buffer.length };
+                emitEvent( context, & baseEvent );
+                releaseArena( context->arena, mark );
+            }
+        }
+    }
+
+
+    node *      suiteNode = findChildOfType( tree, suite );
+    assert( suiteNode != NULL );
+    if ( emit && wants( context, DOCSTRING_EVENT ) )
+        checkForDocstring( suiteNode, context );
+
+    if ( wantsNested( context ) )
+        walk( suiteNode, context, objectsLevel,
+              CLASS_SCOPE, NULL, entryLevel, lineShifts, 0 );
+    return;
+}
+
+
+static void
+processFuncDefinition( node *                       tree,
+                       struct parserContext *       context,
+                       int                          objectsLevel,
+                       enum Scope                   scope,
+                       int                          entryLevel,
+                       int *                        lineShifts,
+                       int                          isStaticMethod,
+                       int                          isAsync )
+{
+    assert( tree->n_type == funcdef );
+    assert( tree->n_nchildren > 1 );
+
+    node *      defNode = & ( tree->n_child[ 0 ] );
+    node *      nameNode = & ( tree->n_child[ 1 ] );
+    node *      colonNode = findChildOfType( tree, COLON );
+    node *      annotNode = findChildOfType( tree, test );
+
+    assert( colonNode != NULL );
+
+    /* The nested items go to the closest reported parent */
+    int         emit = wants( context, FUNCTION_EVENT );
+    struct arenaMark    mark = saveArena( context->arena );
+    struct scratch      returnAnnotation;
+
+    initScratch( & returnAnnotation, context );
+    if ( annotNode != NULL && emit )
+    {
+        // The only 'test' child of a 'funcdef' is for a ret val annotation
+        collectTestString( annotNode, & returnAnnotation );
+    }
+
+    if ( emit )
+        ++objectsLevel;
+    struct parserEvent  event = {
+            .kind = FUNCTION_EVENT,
+            .name = nameNode->n_str,
+            .nameLength = strlen( nameNode->n_str ),
+            /* Function name line and pos */
+            .line = nameNode->n_lineno,
+            .pos = nameNode->n_col_offset + 1,          /* To make it 1-based */
+            .absPosition = lineShifts[ nameNode->n_lineno ] +
+                           nameNode->n_col_offset,
+            /* Keyword 'def' line and pos */
+            .keywordLine = defNode->n_lineno,
+            .keywordPos = defNode->n_col_offset + 1,    /* To make it 1-based */
+            /* ':' line and pos */
+            .colonLine = colonNode->n_lineno,
+            .colonPos = colonNode->n_col_offset + 1,    /* To make it 1-based */
+            .level = objectsLevel,
+            .isAsync = isAsync,
+            .annotation = scratchText( & returnAnnotation ),
+            .annotationLength = returnAnnotation.length };
+    if ( emit )
+        event.contentHash = hashSpan( context, lineShifts,
+                                      lineShifts[ defNode->n_lineno ] +
+                                      defNode->n_col_offset,
+                                      getLastLine( tree ) );
+    emitEvent( context, & event );
+
+    const char *    firstArgName = NULL;
+    int             firstArg = 1;
+    node *          paramNode = findChildOfType( tree, parameters );
+    assert( paramNode != NULL );
+
+    node *      argsNode = findChildOfType( paramNode, typedargslist );
+    if ( argsNode != NULL && ! wants( context, ARGUMENT_EVENT ) )
+    {
+        /* Only the first argument name is needed to detect the instance
+         * attributes */
+        node *      child = & ( argsNode->n_child[ 0 ] );
+        if ( child->n_type == tfpdef )
+            firstArgName = child->n_child[ 0 ].n_str;
+    }
+    else if ( argsNode != NULL )
+    {
+        /* The function has arguments */
+        int         k = 0;
+        node *      child;
+        while ( k < argsNode->n_nchildren )
+        {
+            child = & ( argsNode->n_child[ k ] );
+            if ( child->n_type == tfpdef )
+            {
+                if ( firstArg == 1 )
+                {
+                    firstArgName = processArgument( child, context );
+                    firstArg = 0;
+                }
+                else
+                {
+                    processArgument( child, context );
+                }
+            }
+            else if ( child->n_type == STAR )
+            {
+                firstArg = 0;
+
+                struct arenaMark    argMark = saveArena( context->arena );
+                struct scratch      starName;
+                struct scratch      annotation;
+
+                initScratch( & starName, context );
+                initScratch( & annotation, context );
+                appendScratch( & starName, "*", 1 );
+
+                /* The * argument may be without a tfpdef */
+                if ( (k + 1) < argsNode->n_nchildren )
+                {
+                    node *      nextNode = & ( argsNode->n_child[ k + 1 ] );
+                    if ( nextNode->n_type == tfpdef )
+                    {
+                        ++k;
+                        node *      tfpdefChild = nextNode;
+                        node *      nameChild = & ( tfpdefChild->n_child[ 0 ] );
+
+                        appendScratch( & starName, nameChild->n_str,
+                                       strlen( nameChild->n_str ) );
+
+                        node *      annotNode = findChildOfType( tfpdefChild, test );
+
+                        if ( annotNode != NULL )
+                            collectTestString( annotNode, & annotation );
+                    }
+                }
+
+                // *arg may not have a default value but may have an annotation
+                struct parserEvent  argEvent = {
+                        .kind = ARGUMENT_EVENT,
+                        .name = scratchText( & starName ),
+                        .nameLength = starName.length,
+                        .annotation = scratchText( & annotation ),
+                        .annotationLength = annotation.length };
+                emitEvent( context, & argEvent );
+                releaseArena( context->arena, argMark );
+            }
+            else if ( child->n_type == DOUBLESTAR )
+            {
+                ++k;
+                node *      tfpdefChild = & ( argsNode->n_child[ k ] );
+                node *      nameChild = & ( tfpdefChild->n_child[ 0 ] );
+                struct arenaMark    argMark = saveArena( context->arena );
+                struct scratch      starName;
+                struct scratch      annotation;
+
+                initScratch( & starName, context );
+                initScratch( & annotation, context );
+                appendScratch( & starName, "**", 2 );
+                appendScratch( & starName, nameChild->n_str,
+                               strlen( nameChild->n_str ) );
+
+                node *      annotNode = findChildOfType( tfpdefChild, test );
+
+                if ( annotNode != NULL )
+                    collectTestString( annotNode, & annotation );
+
+                // **arg may not have a default value but may have an
+                // annotation
+                struct parserEvent  argEvent = {
+                        .kind = ARGUMENT_EVENT,
+                        .name = scratchText( & starName ),
+                        .nameLength = starName.length,
+                        .annotation = scratchText( & annotation ),
+                        .annotationLength = annotation.length };
+                emitEvent( context, & argEvent );
+                releaseArena( context->arena, argMark );
+            }
+            else if ( child->n_type == test &&
+                      wants( context, ARGUMENT_VALUE_EVENT ) )
+            {
+                struct arenaMark    argMark = saveArena( context->arena );
+                struct scratch      buffer;
+
+                initScratch( & buffer, context );
+                collectTestString( child, & buffer );
+
+                struct parserEvent  valueEvent = { .kind = ARGUMENT_VALUE_EVENT,
+                                                   .name = scratchText( & buffer ),
+                                                   .nameLength = buffer.length };
+                emitEvent( context, & valueEvent );
+                releaseArena( context->arena, argMark );
+            }
+
+            ++k;
+        }
+    }
+    releaseArena( context->arena, mark );
+
+
+    node *      suiteNode = findChildOfType( tree, suite );
+    assert( suiteNode != NULL );
+    if ( emit && wants( context, DOCSTRING_EVENT ) )
+        checkForDocstring( suiteNode, context );
+
+    if ( ! wantsNested( context ) )
+        return;
+
+    /* Detect the new scope */
+    enum Scope  newScope = FUNCTION_SCOPE; /* Avoid the compiler complains */
+    switch ( scope )
+    {
+        case GLOBAL_SCOPE:
+        case FUNCTION_SCOPE:
+        case CLASS_METHOD_SCOPE:
+        case CLASS_STATIC_METHOD_SCOPE:
+            newScope = FUNCTION_SCOPE;
+            break;
+        case CLASS_SCOPE:
+            /* It could be a static method if there is
+             * the '@staticmethod' decorator */
+            if ( isStaticMethod != 0 ) newScope = CLASS_STATIC_METHOD_SCOPE;
+            else                       newScope = CLASS_METHOD_SCOPE;
+            break;
+    }
+
+    walk( suiteNode, context, objectsLevel,
+          newScope, firstArgName, entryLevel, lineShifts, 0 );
+    return;
+}
+
+
+static void processAssign( node *                      tree,
+                           struct parserContext *      context,
+                           enum EventKind              kind,
+                           int                         objectsLevel,
+                           int *                       lineShifts )
+{
+    assert( tree->n_type == testlist ||
+            tree->n_type == testlist_comp ||
+            tree->n_type == testlist_star_expr );
+
+    node *      child;
+    for ( int  k = 0; k < tree->n_nchildren; ++k )
+    {
+        child = & ( tree->n_child[ k ] );
+        #if PY_MAJOR_VERSION == 3 && (PY_MINOR_VERSION == 8 || PY_MINOR_VERSION == 9)
+        if ( child->n_type == namedexpr_test ||
+             child->n_type == test )
+        #else
+        if ( child->n_type == test )
+        #endif
+        {
+            node *      powerNode = skipToNode( child, power );
+            child = skipToNode( powerNode, atom );
+            if ( child == NULL )
+                continue;
+
+            /* trailer means it is usage, not the initialization */
+            node *      atomExprNode = findChildOfType( powerNode, atom_expr );
+            if ( atomExprNode != NULL )
+            {
+                if ( findChildOfType( atomExprNode, trailer ) != NULL )
+                    continue;
+            }
+
+            if ( child->n_child[ 0 ].n_type == LPAR ||
+                 child->n_child[ 0 ].n_type == LSQB )
+            {
+                node *      listNode = findChildOfType( child, testlist_comp );
+//                if ( listNode == NULL )
+//                    listNode = findChildOfType( child, listmaker );
+                if ( listNode != NULL )
+                    processAssign( listNode, context, kind,
+                                   objectsLevel, lineShifts );
+                continue;
+            }
+
+            struct arenaMark    mark = saveArena( context->arena );
+            struct scratch      name;
+
+            initScratch( & name, context );
+            collectTestString( child, & name );
+
+            struct parserEvent  event = {
+                    .kind = kind,
+                    .name = scratchText( & name ),
+                    .nameLength = name.length,
+                    .line = child->n_lineno,
+                    .pos = child->n_col_offset + 1, /* Make it 1-based */
+                    .absPosition = lineShifts[ child->n_lineno ] +
+                                   child->n_col_offset,
+                    .level = objectsLevel };
+            emitEvent( context, & event );
+            releaseArena( context->arena, mark );
+        }
+    }
+    return;
+}
+
+static void processInstanceMember( node *                      tree,
+                                   struct parserContext *      context,
+                                   const char *                firstArgName,
+                                   int                         objectsLevel,
+                                   int *                       lineShifts )
+{
+    if ( firstArgName == NULL )
+        return;
+
+    assert( tree->n_type == testlist ||
+            tree->n_type == testlist_comp ||
+            tree->n_type == testlist_star_expr );
+
+    node *      child;
+    int         n = tree->n_nchildren;
+    for ( int  k = 0; k < n; ++k )
+    {
+        child = & ( tree->n_child[ k ] );
+        #if PY_MAJOR_VERSION == 3 && (PY_MINOR_VERSION == 8 || PY_MINOR_VERSION == 9)
+        if ( child->n_type == namedexpr_test ||
+             child->n_type == test )
+        #else
+        if ( child->n_type == test )
+        #endif
+        {
+            node *      powerNode = skipToNode( child, power );
+            child = skipToNode( powerNode, atom );
+            if ( child == NULL )
+                continue;
+
+            if ( child->n_child[ 0 ].n_type == LPAR ||
+                 child->n_child[ 0 ].n_type == LSQB )
+            {
+                node *      listNode = findChildOfType( child, testlist_comp );
+//                if ( listNode == NULL )
+//                    listNode = findChildOfType( child, listmaker );
+                if ( listNode != NULL )
+                    processInstanceMember( listNode, context, firstArgName,
+                                           objectsLevel, lineShifts );
+                continue;
+            }
+
+            /* Count the trailer nodes. If there are more than one then it is
+             * the usage, not initialization */
+            int         trailerCount = 0;
+            node *      trailerNode = NULL;
+            node *      atomExprNode = findChildOfType( powerNode, atom_expr );
+
+            if ( atomExprNode == NULL )
+                continue;
+
+            for ( int  j = 0; j < atomExprNode->n_nchildren; ++j )
+            {
+                if ( atomExprNode->n_child[ j ].n_type == trailer )
+                {
+                    ++trailerCount;
+                    trailerNode = & ( atomExprNode->n_child[ j ] );
+                }
+            }
+            if ( trailerCount != 1 )
+                continue;
+            if ( trailerNode->n_nchildren != 2 )
+                continue;
+            if ( trailerNode->n_child[ 0 ].n_type != DOT )
+                continue;
+            if ( trailerNode->n_child[ 1 ].n_type != NAME )
+                continue;
+
+            /* collect the first part of the name and match it with the first
+             * argument name */
+            struct arenaMark    mark = saveArena( context->arena );
+            struct scratch      name;
+
+            initScratch( & name, context );
+            collectTestString( child, & name );
+
+            int     isFirstArg = strcmp( scratchText( & name ),
+                                         firstArgName ) == 0;
+            releaseArena( context->arena, mark );
+            if ( ! isFirstArg )
+                continue;
+
+            /* Here: the trailer is what needs to be collected */
+            node *      nameNode = & ( trailerNode->n_child[ 1 ] );
+            struct parserEvent  event = {
+                    .kind = INSTANCE_ATTRIBUTE_EVENT,
+                    .name = nameNode->n_str,
+                    .nameLength = strlen( nameNode->n_str ),
+                    .line = nameNode->n_lineno,
+                    .pos = nameNode->n_col_offset + 1, /* Make it 1-based */
+                    .absPosition = lineShifts[ nameNode->n_lineno ] +
+                                   nameNode->n_col_offset,
+                    .level = objectsLevel };
+            emitEvent( context, & event );
+        }
+    }
+
+    return;
+}
+
+
+
+/* Reports a top level statement span and its hash */
+static void processStatement( node *                      tree,
+                              struct parserContext *      context,
+                              int *                       lineShifts )
+{
+    assert( tree->n_type == stmt );
+
+    struct parserEvent  event = {
+            .kind = STATEMENT_EVENT,
+            .name = "",
+            .line = tree->n_lineno,
+            .pos = tree->n_col_offset + 1,              /* To make it 1-based */
+            .absPosition = lineShifts[ tree->n_lineno ] + tree->n_col_offset,
+            .endLine = getLastLine( tree ) };
+    event.contentHash = hashSpan( context, lineShifts, event.absPosition,
+                                  event.endLine );
+    emitEvent( context, & event );
+}
+
+
+
+/* Provides non NULL node to expr_stmt if it is an assignment */
+static node *  isAssignment( node *  tree )
+{
+    assert( tree->n_type == stmt );
+    if ( tree->n_nchildren < 1 )                            return NULL;
+    tree = & ( tree->n_child[ 0 ] );
+    if ( tree->n_type != simple_stmt )                      return NULL;
+    if ( tree->n_nchildren < 1 )                            return NULL;
+    tree = & ( tree->n_child[ 0 ] );
+    if ( tree->n_type != small_stmt )                       return NULL;
+    if ( tree->n_nchildren < 1 )                            return NULL;
+    tree = & ( tree->n_child[ 0 ] );
+    if ( tree->n_type != expr_stmt )                        return NULL;
+    if ( tree->n_nchildren < 2 )                            return NULL;
+    if ( tree->n_child[ 0 ].n_type != testlist_star_expr )  return NULL;
+    if ( tree->n_child[ 1 ].n_type != EQUAL )               return NULL;
+    return tree;
+}
+
+
+/* Tells if a top level statement could be a part of the module header:
+ * imports only, a string literal only or an if or try statement */
+static int  isHeaderStatement( node *  tree )
+{
+    assert( tree->n_type == stmt );
+    node *      child = & ( tree->n_child[ 0 ] );
+
+    if ( child->n_type == compound_stmt )
+        return child->n_child[ 0 ].n_type == if_stmt ||
+               child->n_child[ 0 ].n_type == try_stmt;
+
+    /* simple_stmt: small_stmt (';' small_stmt)* [';'] NEWLINE */
+    node *      first = & ( child->n_child[ 0 ] );
+    int         imports = 1;
+    for ( int  k = 0; k < child->n_nchildren; k += 2 )
+        if ( child->n_child[ k ].n_type == small_stmt &&
+             child->n_child[ k ].n_child[ 0 ].n_type != import_stmt )
+            imports = 0;
+    if ( imports )
+        return 1;
+
+    if ( child->n_nchildren > 3 )
+        return 0;
+    while ( first->n_type != atom && first->n_nchildren == 1 )
+        first = & ( first->n_child[ 0 ] );
+    return first->n_type == atom && first->n_child[ 0 ].n_type == STRING;
+}
+
+
+
+void walk( node *                       tree,
+           struct parserContext *       context,
+           int                          objectsLevel,
+           enum Scope                   scope,
+           const char *                 firstArgName,
+           int                          entryLevel,
+           int *                        lineShifts,
+           int                          isStaticMethod )
+{
+    if ( isCancelled( context ) )
+        return;
+
+    ++entryLevel;   // For module docstring only
+
+    switch ( tree->n_type )
+    {
+        case import_stmt:
+            if ( wants( context, IMPORT_EVENT ) &&
+                 ! skipsFunctionBody( context, scope ) )
+                processImport( tree, context, lineShifts );
+            return;
+        case funcdef:
+            processFuncDefinition( tree, context,
+                                   objectsLevel, scope, entryLevel,
+                                   lineShifts, isStaticMethod, 0 );
+            return;
+        case async_funcdef:
+            {
+                node *      funcNode = & ( tree->n_child[ 1 ] );
+                processFuncDefinition( funcNode, context,
+                                       objectsLevel, scope, entryLevel,
+                                       lineShifts, isStaticMethod, 1 );
+            }
+            return;
+        case classdef:
+            processClassDefinition( tree, context,
+                                    objectsLevel, scope, entryLevel,
+                                    lineShifts );
+            return;
+        case async_stmt:
+            // It could be funcdef, with_stmt and for_stmt
+            // Here we are only interested in a funcdef
+            {
+                node *      stmtNode = & ( tree->n_child[ 1 ] );
+                if ( stmtNode->n_type == funcdef )
+                    processFuncDefinition( stmtNode, context,
+                                           objectsLevel, scope, entryLevel,
+                                           lineShifts, isStaticMethod, 1 );
+            }
+            // No need to continue -- with & for are not for recognition by the
+            // parser and an async function has been processed if so
+            return;
+
+        case stmt:
+            {
+                node *      assignNode = isAssignment( tree );
+                if ( assignNode != NULL )
+                {
+                    node *      testListStarExprNode = & ( assignNode->n_child[ 0 ] );
+                    if ( scope == GLOBAL_SCOPE )
+                    {
+                        if ( wants( context, GLOBAL_EVENT ) )
+                            processAssign( testListStarExprNode, context,
+                                           GLOBAL_EVENT, objectsLevel,
+                                           lineShifts );
+                    }
+                    else if ( scope == CLASS_SCOPE )
+                    {
+                        if ( wants( context, CLASS_ATTRIBUTE_EVENT ) )
+                            processAssign( testListStarExprNode, context,
+                                           CLASS_ATTRIBUTE_EVENT,
+                                           objectsLevel, lineShifts );
+                    }
+                    else if ( scope == CLASS_METHOD_SCOPE &&
+                              wants( context, INSTANCE_ATTRIBUTE_EVENT ) )
+                        processInstanceMember( testListStarExprNode, context,
+                                               firstArgName, objectsLevel,
+                                               lineShifts );
+
+                    /* The other scopes are not interesting */
+                    return;
+                }
+            }
+
+        default:
+            break;
+    }
+
+
+    int         staticDecor = 0;
+    node *      child;
+    int         n = tree->n_nchildren;
+    for ( int  i = 0; i < n; ++i )
+    {
+        child = & ( tree->n_child[ i ] );
+
+        if ( (entryLevel == 1) && (i == 0) &&
+             wants( context, DOCSTRING_EVENT ) )
+        {
+            /* This could be a module docstring */
+            checkForDocstring( tree, context );
+        }
+
+        if ( (entryLevel == 1) && (child->n_type == stmt) &&
+             (context->mask & STOP_AT_CODE_OPTION) &&
+             ! isHeaderStatement( child ) )
+            break;
+
+        if ( (entryLevel == 1) && (child->n_type == stmt) &&
+             wants( context, STATEMENT_EVENT ) )
+            processStatement( child, context, lineShifts );
+
+        /* decorators are always before a class or a function definition on the
+         * same level. So they will be picked by the following deinition
+         */
+        if ( child->n_type == decorators )
+        {
+            /* The decorated definition follows the decorators */
+            int     emit = 0;
+            if ( i + 1 < n )
+            {
+                if ( tree->n_child[ i + 1 ].n_type == classdef )
+                    emit = wants( context, CLASS_EVENT );
+                else
+                    emit = wants( context, FUNCTION_EVENT );
+            }
+            emit = emit && wants( context, DECORATOR_EVENT );
+
+            /* @staticmethod matters only for the instance attributes */
+            if ( emit || wants( context, INSTANCE_ATTRIBUTE_EVENT ) )
+                staticDecor = processDecorators( child, context,
+                                                 lineShifts, emit );
+            continue;
+        }
+        walk( child, context, objectsLevel,
+              scope, firstArgName, entryLevel, lineShifts, staticDecor );
+        staticDecor = 0;
+    }
+
+    return;
+}
+
+
+
+/* Calculates the line shifts in terms of absolute position. The trailing
+ * lines after the last token are not needed so the table has only
+ * totalLines + 1 items. */
+static void
+calculateLineShifts( const char * buffer, int * lineShifts, int totalLines )
+{
+    const char *    current = buffer;
+    const char *    end = buffer + strlen( buffer );
+    int             line = 1;
+
+    /* index 0 is not used; The first line starts with shift 0 */
+    lineShifts[ 1 ] = 0;
+    while ( line < totalLines )
+    {
+        current = findNextLine( current, end );
+        if ( current == NULL )
+            break;
+        lineShifts[ ++line ] = current - buffer;
+    }
+    return;
+}
+#endif
+
+
+/* Reusable per thread parsing resources, so that consecutive parses on a
+ * thread do not allocate them */
+struct threadContext
+{
+    struct arena            arena;
+};
+
+static pthread_key_t    threadContextKey;
+static pthread_once_t   threadContextOnce = PTHREAD_ONCE_INIT;
+
+
+static void
+freeThreadContext( void *  ptr )
+{
+    struct threadContext *  threadContext = (struct threadContext *) ptr;
+
+    clearArena( & threadContext->arena );
+    free( threadContext );
+}
+
+
+static void
+createThreadContextKey( void )
+{
+    pthread_key_create( & threadContextKey, freeThreadContext );
+}
+
+
+static struct threadContext *
+getThreadContext( void )
+{
+    pthread_once( & threadContextOnce, createThreadContextKey );
+
+    struct threadContext *  threadContext = (struct threadContext *)
+                                    pthread_getspecific( threadContextKey );
+    if ( threadContext == NULL )
+    {
+        threadContext = (struct threadContext *)
+                                calloc( 1, sizeof( struct threadContext ) );
+        if ( threadContext == NULL )
+            return NULL;
+        if ( pthread_setspecific( threadContextKey, threadContext ) != 0 )
+        {
+            free( threadContext );
+            return NULL;
+        }
+    }
+    return threadContext;
+}
+
+
+/* The arena of the current thread; NULL if there is no memory */
+static struct arena *
+getThreadArena( void )
+{
+    struct threadContext *  threadContext = getThreadContext();
+
+    return threadContext == NULL ? NULL : & threadContext->arena;
+}
+
+
+/*
+ * Structural scanner. It finds the same items as walk() does but needs
+ * neither the interpreter's parser nor a syntax tree, so it is the backend
+ * for Python 3.10 and up where the concrete syntax tree parser is gone. The
+ * code is tokenized the way the interpreter's tokenizer does it and then each
+ * logical line is looked at: the definitions, the decorators, the imports
+ * and the assignments are analysed, the other statements are skipped. The
+ * tokens, the indentation and the statement headers are checked so the
+ * common errors are reported the same way the parser reports them; an error
+ * inside an expression is not necessarily detected.
+ * No Python API is used so the scanning does not need the GIL.
+ */
+
+#define SCAN_MAX_INDENT         100     /* the interpreter's MAXINDENT */
+#define SCAN_MAX_BRACKETS       200     /* the interpreter's MAXLEVEL */
+#define SCAN_TAB_SIZE           8
+
+/* Since Python 3.12 the f-string replacement fields are tokenized as code,
+ * see PEP 701 */
+#if PY_VERSION_HEX >= 0x030C0000
+    #define SCAN_FORMATTED_FIELDS   1
+#else
+    #define SCAN_FORMATTED_FIELDS   0
+#endif
+
+
+enum ScanTokenKind
+{
+    SCAN_NAME,
+    SCAN_NUMBER,
+    SCAN_STRING,
+    SCAN_OP,
+    SCAN_NEWLINE,
+    SCAN_INDENT,
+    SCAN_DEDENT,
+    SCAN_END
+};
+
+/* Keyword kinds of the names */
+#define NOT_KEYWORD         0
+#define KEYWORD             1
+#define CONSTANT_KEYWORD    2       /* None, True, False */
+
+/* A token points into the code; nothing is copied */
+struct scanToken
+{
+    const char *        start;
+    int                 length;
+    enum ScanTokenKind  kind;
+    int                 keyword;
+    int                 line;           /* where the token starts */
+    int                 col;            /* 0-based, in bytes */
+    int                 absPosition;
+    int                 lastLine;       /* where the token ends */
+    int                 depth;          /* of the brackets around */
+};
+
+/* A growable text for the collected names, values and messages */
+struct scanText
+{
+    char *      data;
+    int         length;
+    int         capacity;
+};
+
+/* A block of statements: the module, a definition body or a compound
+ * statement suite */
+struct scanBlock
+{
+    enum Scope          scope;
+    int                 objectsLevel;
+    const char *        firstArgName;   /* in the code; NULL if none */
+    int                 firstArgLength;
+    int                 silent;         /* nothing is reported from inside */
+    int                 isMatch;        /* the 'case' clauses are inside */
+    int                 checkDocstring; /* in the first statement */
+    int                 record;         /* the definition event which gets
+                                           the content hash when the block
+                                           ends; -1 if none */
+    int                 start;          /* the definition absolute position */
+};
+
+struct scanner
+{
+    struct parserContext *  context;    /* records the events */
+    struct arena *          arena;      /* all the scanner memory */
+    const char *            buffer;     /* UTF-8 */
+    const char *            source;     /* the positions are in; it differs
+                                           from buffer if converted */
+    int *                   sourceLines;    /* the source line starts if
+                                               converted */
+    int                     sourceLinesCapacity;
+
+    /* Tokenizer */
+    const char *            cur;
+    const char *            lineStart;  /* the columns are counted from */
+    int                     lineShift;  /* the line absolute position */
+    int                     line;
+    int                     atLineStart;
+    int                     lineHasTokens;
+    int                     indents[ SCAN_MAX_INDENT + 1 ];
+    int                     altIndents[ SCAN_MAX_INDENT + 1 ];
+    int                     indentLevel;
+    int                     pendingIndents; /* > 0: INDENTs, < 0: DEDENTs */
+    char                    brackets[ SCAN_MAX_BRACKETS ];
+    int                     depth;
+
+    /* The current logical line, the NEWLINE token included */
+    struct scanToken *      tokens;
+    int                     count;
+    int                     capacity;
+    const char *            lastEnd;    /* the last token before NEWLINE */
+    int                     lastLine;
+    const char *            prevEnd;    /* the same before the current line */
+    int                     prevLine;
+
+    /* Statements */
+    struct scanBlock        blocks[ SCAN_MAX_INDENT + 1 ];
+    int                     blockCount;
+    struct scanBlock        pending;    /* opens with the next INDENT */
+    int                     hasPending;
+    int                     withDecorators;  /* decorators wait for a definition */
+    int                     staticMethod;
+    int                     decoratorsCount;    /* events before decorators */
+    int                     decoratorsPoolSize;
+    int                     inStatement;    /* a top level one is open */
+    int                     continued;      /* by the next line */
+    int                     statement;      /* its event record or -1 */
+    int                     statementStart;
+
+    struct scanText         text;
+    struct scanText         annotation;
+    int *                   starts;     /* ( absPosition, line ) pairs of the
+                                           top level statements or NULL */
+    int                     startsCount;
+    int                     startsCapacity;
+    int                     collectStarts;
+    int                     noMemory;
+    int                     failed;     /* the message is in the text */
+    int                     stopped;    /* at the first non header statement */
+};
+
+
+static int
+textReserve( struct scanner *  s, struct scanText *  text, int  length )
+{
+    if ( text->length + length + 1 > text->capacity )
+    {
+        int     capacity = text->capacity == 0 ? 256 : text->capacity * 2;
+        if ( capacity < text->length + length + 1 )
+            capacity = text->length + length + 1;
+
+        char *  data = (char *) arenaGrow( s->arena, text->data,
+                                           text->capacity, capacity );
+        if ( data == NULL )
+        {
+            s->noMemory = 1;
+            return 1;
+        }
+        text->data = data;
+        text->capacity = capacity;
+    }
+    return 0;
+}
+
+
+static void
+textAppend( struct scanner *  s, struct scanText *  text,
+            const char *  str, int  length )
+{
+    if ( textReserve( s, text, length ) != 0 )
+        return;
+    memcpy( text->data + text->length, str, length );
+    text->length += length;
+    text->data[ text->length ] = '\0';
+}
+
+
+static int
+isName( const struct scanToken *  t, const char *  name )
+{
+    return t->kind == SCAN_NAME && strncmp( t->start, name, t->length ) == 0 &&
+           name[ t->length ] == '\0';
+}
+
+
+static int
+isOp( const struct scanToken *  t, const char *  op )
+{
+    return t->kind == SCAN_OP && strncmp( t->start, op, t->length ) == 0 &&
+           op[ t->length ] == '\0';
+}
+
+
+static int
+getKeywordKind( const char *  name, int  length )
+{
+    static const char *     keywords[] = {
+        "and", "as", "assert", "async", "await", "break", "class",
+        "continue", "def", "del", "elif", "else", "except", "finally", "for",
+        "from", "global", "if", "import", "in", "is", "lambda", "nonlocal",
+        "not", "or", "pass", "raise", "return", "try", "while", "with",
+        "yield", NULL };
+
+    if ( length < 2 || length > 8 || name[ 0 ] < 'A' || name[ 0 ] > 'z' )
+        return NOT_KEYWORD;
+    if ( ( length == 4 && ( memcmp( name, "None", 4 ) == 0 ||
+                            memcmp( name, "True", 4 ) == 0 ) ) ||
+         ( length == 5 && memcmp( name, "False", 5 ) == 0 ) )
+        return CONSTANT_KEYWORD;
+    for ( const char **  k = keywords; *k != NULL; ++k )
+        if ( (*k)[ 0 ] == name[ 0 ] && strncmp( *k, name, length ) == 0 &&
+             (*k)[ length ] == '\0' )
+            return KEYWORD;
+    return NOT_KEYWORD;
+}
+
+
+/*
+ * Tokenizer
+ */
+
+static int
+isIdentifierStart( unsigned char  c )
+{
+    return ( c >= 'a' && c <= 'z' ) || ( c >= 'A' && c <= 'Z' ) ||
+           c == '_' || c >= 128;
+}
+
+
+static int
+isIdentifierChar( unsigned char  c )
+{
+    return isIdentifierStart( c ) || ( c >= '0' && c <= '9' );
+}
+
+
+/* Provides the code point of the UTF-8 sequence and its length or -1 if the
+ * sequence is malformed */
+static int32_t
+decodeUtf8( const char *  str, int *  length )
+{
+    const unsigned char *   p = (const unsigned char *) str;
+    int32_t                 cp;
+    int                     count;
+
+    if ( p[ 0 ] < 0xC2 || p[ 0 ] > 0xF4 )
+        return -1;
+    if ( p[ 0 ] < 0xE0 )
+    {
+        cp = p[ 0 ] & 0x1F;
+        count = 2;
+    }
+    else if ( p[ 0 ] < 0xF0 )
+    {
+        cp = p[ 0 ] & 0x0F;
+        count = 3;
+    }
+    else
+    {
+        cp = p[ 0 ] & 0x07;
+        count = 4;
+    }
+
+    for ( int  k = 1; k < count; ++k )
+    {
+        if ( ( p[ k ] & 0xC0 ) != 0x80 )
+            return -1;
+        cp = ( cp << 6 ) | ( p[ k ] & 0x3F );
+    }
+    if ( ( count == 3 && ( cp < 0x800 || ( cp >= 0xD800 && cp < 0xE000 ) ) ) ||
+         ( count == 4 && ( cp < 0x10000 || cp > 0x10FFFF ) ) )
+        return -1;
+
+    *length = count;
+    return cp;
+}
+
+
+/* The symbols and the punctuation which are not in the identifiers. The
+ * Unicode categories are not in the public C API, so the marks and the
+ * connector punctuation a name may continue with are told from them by the
+ * block ranges. */
+static const int32_t    nonIdentifierRanges[][ 2 ] = {
+    { 0x80, 0xB6 }, { 0xB8, 0xBF }, { 0xD7, 0xD7 }, { 0xF7, 0xF7 },
+    { 0x2010, 0x203E }, { 0x2041, 0x2053 }, { 0x2055, 0x206F },
+    { 0x20A0, 0x20CF }, { 0x2190, 0x2BFF }, { 0x3000, 0x3004 },
+    { 0x3008, 0x3020 }, { 0x3030, 0x3030 }, { 0xFE10, 0xFE1F },
+    { 0xFE30, 0xFE32 }, { 0xFE35, 0xFE4C }, { 0xFE50, 0xFE6F },
+    { 0xFF01, 0xFF0F }, { 0xFF1A, 0xFF20 }, { 0xFF3B, 0xFF3E },
+    { 0xFF40, 0xFF40 }, { 0xFF5B, 0xFF65 }, { 0x1F000, 0x1FAFF } };
+
+
+/* Tells if the non ASCII code point may start or continue a name. The start
+ * check is the XID_Start one except that a few numeric symbols pass; the
+ * continuation check lets some symbols pass but never rejects a valid name
+ * character. */
+static int
+isIdentifierCodePoint( int32_t  cp, int  start )
+{
+    if ( Py_UNICODE_ISALPHA( cp ) ||
+         ( Py_UNICODE_ISNUMERIC( cp ) && ! Py_UNICODE_ISDIGIT( cp ) ) )
+        return 1;
+    if ( start )
+        /* Other_ID_Start */
+        return cp == 0x1885 || cp == 0x1886 || cp == 0x2118 || cp == 0x212E;
+
+    if ( Py_UNICODE_ISDIGIT( cp ) )
+        return 1;
+    if ( ! Py_UNICODE_ISPRINTABLE( cp ) )
+        return 0;
+    for ( size_t  k = 0; k < sizeof( nonIdentifierRanges ) /
+                             sizeof( nonIdentifierRanges[ 0 ] ); ++k )
+    {
+        if ( cp >= nonIdentifierRanges[ k ][ 0 ] &&
+             cp <= nonIdentifierRanges[ k ][ 1 ] )
+            return 0;
+    }
+    return 1;
+}
+
+
+static int
+isLineEnd( char  c )
+{
+    return c == '\n' || c == '\r' || c == '\0';
+}
+
+
+/* Moves past the line end at the current position: "\n", "\r" or "\r\n" */
+static void
+skipLineEnd( struct scanner *  s )
+{
+    if ( s->cur[ 0 ] == '\r' && s->cur[ 1 ] == '\n' )
+        s->cur += 2;
+    else
+        s->cur += 1;
+    ++s->line;
+    s->lineStart = s->cur;
+    s->lineShift = s->cur - s->buffer;
+
+    if ( s->sourceLines != NULL )
+    {
+        /* The converted code has the same lines as the source */
+        const char *    p = s->source + s->sourceLines[ s->line - 2 ];
+
+        while ( ! isLineEnd( *p ) )
+            ++p;
+        if ( *p != '\0' )
+            p += ( p[ 0 ] == '\r' && p[ 1 ] == '\n' ) ? 2 : 1;
+        s->lineShift = p - s->source;
+
+        if ( s->line > s->sourceLinesCapacity )
+        {
+            int     capacity = 2 * s->sourceLinesCapacity;
+            int *   lines = (int *) arenaGrow( s->arena, s->sourceLines,
+                            s->sourceLinesCapacity * sizeof( int ),
+                            capacity * sizeof( int ) );
+            if ( lines == NULL )
+            {
+                s->noMemory = 1;
+                s->failed = 1;
+                return;
+            }
+            s->sourceLines = lines;
+            s->sourceLinesCapacity = capacity;
+        }
+        s->sourceLines[ s->line - 1 ] = s->lineShift;
+    }
+}
+
+
+/* Reports a syntax error the way getErrorMessage() does: the position, the
+ * message and the code text; the scanning stops */
+static int
+scanError( struct scanner *  s, int  line, int  offset, const char *  message,
+           const char *  textStart, const char *  textEnd )
+{
+    char        header[ 128 ];
+
+    snprintf( header, sizeof( header ), "%d:%d %s", line, offset, message );
+    s->text.length = 0;
+    textAppend( s, & s->text, header, strlen( header ) );
+    if ( textStart != NULL )
+    {
+        textAppend( s, & s->text, "\n", 1 );
+        textAppend( s, & s->text, textStart, textEnd - textStart );
+        textAppend( s, & s->text, "\n", 1 );
+    }
+    s->failed = 1;
+    return 1;
+}
+
+
+/* The error at a token: the offset is 1-based */
+static int
+scanTokenError( struct scanner *  s, const struct scanToken *  t,
+                const char *  message )
+{
+    const char *    lineStart = t->start - t->col;
+    const char *    lineEnd = lineStart;
+
+    while ( ! isLineEnd( *lineEnd ) )
+        ++lineEnd;
+    return scanError( s, t->line, t->col + 1, message, lineStart, lineEnd );
+}
+
+
+/* The error found by the tokenizer in the current line: the offset is where
+ * the tokenizer stopped, i.e. right after the line end by default */
+static int
+scanLineError( struct scanner *  s, const char *  stop, const char *  message )
+{
+    const char *    lineEnd = s->lineStart;
+
+    while ( ! isLineEnd( *lineEnd ) )
+        ++lineEnd;
+    if ( stop == NULL )
+        stop = lineEnd + 1;
+    return scanError( s, s->line, stop - s->lineStart, message,
+                      s->lineStart, lineEnd );
+}
+
+
+/* The code ended unexpectedly: the error is at the end of the last line */
+static int
+scanEofError( struct scanner *  s, const char *  textStart,
+              const char *  message )
+{
+    const char *    end = s->cur;
+    int             line = s->line;
+
+    while ( *end != '\0' )
+        ++end;
+    if ( end > s->buffer && ( end[ -1 ] == '\n' || end[ -1 ] == '\r' ) )
+    {
+        /* The last line is the one terminated by the last line end */
+        --line;
+        --end;
+        if ( end > s->buffer && end[ 0 ] == '\n' && end[ -1 ] == '\r' )
+            --end;
+    }
+
+    const char *    lastLineStart = end;
+    while ( lastLineStart > s->buffer &&
+            lastLineStart[ -1 ] != '\n' && lastLineStart[ -1 ] != '\r' )
+        --lastLineStart;
+    if ( textStart == NULL || textStart > lastLineStart )
+        textStart = lastLineStart;
+    return scanError( s, line, end - textStart + 1, message, textStart, end );
+}
+
+
+/* An invalid character in a name. The interpreter's tokenizer raises an
+ * exception for it, so getErrorMessage() gives E_ERROR without a position */
+static int
+scanIdentifierError( struct scanner *  s )
+{
+    static const char   message[] = "execution error";
+
+    s->text.length = 0;
+    textAppend( s, & s->text, message, sizeof( message ) - 1 );
+    s->failed = 1;
+    return 1;
+}
+
+
+/* Moves past a name; the non ASCII characters are checked */
+static int
+scanName( struct scanner *  s )
+{
+    const char *    start = s->cur;
+
+    for ( ; ; )
+    {
+        unsigned char   c = *s->cur;
+        int             length;
+
+        if ( c < 128 )
+        {
+            if ( ! isIdentifierChar( c ) )
+                return 0;
+            ++s->cur;
+            continue;
+        }
+
+        int32_t     cp = decodeUtf8( s->cur, & length );
+        if ( cp < 0 || ! isIdentifierCodePoint( cp, s->cur == start ) )
+            return scanIdentifierError( s );
+        s->cur += length;
+    }
+}
+
+
+static int
+scanFormattedField( struct scanner *  s, char  quote, int  triple );
+
+
+/* Skips a string literal body; s->cur is right after the opening quotes */
+static int
+scanStringBody( struct scanner *  s, char  quote, int  triple,
+                int  formatted, const char *  tokenLineStart )
+{
+    for ( ; ; )
+    {
+        char    c = *s->cur;
+
+        if ( c == quote )
+        {
+            ++s->cur;
+            if ( ! triple )
+                return 0;
+            if ( s->cur[ 0 ] == quote && s->cur[ 1 ] == quote )
+            {
+                s->cur += 2;
+                return 0;
+            }
+        }
+        else if ( c == '\0' )
+        {
+            if ( triple )
+                return scanEofError( s, tokenLineStart,
+                            "EOF while scanning triple-quoted string literal" );
+            return scanLineError( s, NULL,
+                                  "EOL while scanning string literal" );
+        }
+        else if ( c == '\\' )
+        {
+            ++s->cur;
+            if ( *s->cur == '\n' || *s->cur == '\r' )
+                skipLineEnd( s );
+            else if ( *s->cur != '\0' && ! ( formatted && *s->cur == '{' ) )
+                ++s->cur;
+        }
+        else if ( c == '\n' || c == '\r' )
+        {
+            if ( ! triple )
+                return scanLineError( s, NULL,
+                                      "EOL while scanning string literal" );
+            skipLineEnd( s );
+        }
+        else if ( formatted && c == '{' )
+        {
+            ++s->cur;
+            if ( *s->cur == '{' )
+                ++s->cur;
+            else if ( scanFormattedField( s, quote, triple ) != 0 )
+                return 1;
+        }
+        else
+            ++s->cur;
+    }
+}
+
+
+/* Tells if the name is a string literal prefix */
+static int
+isStringPrefix( const char *  name, int  length, int *  formatted )
+{
+    int     b = 0, r = 0, u = 0, f = 0;
+
+    if ( length > 2 )
+        return 0;
+    for ( int  k = 0; k < length; ++k )
+    {
+        switch ( name[ k ] )
+        {
+            case 'b': case 'B': ++b; break;
+            case 'r': case 'R': ++r; break;
+            case 'u': case 'U': ++u; break;
+            case 'f': case 'F': ++f; break;
+            default: return 0;
+        }
+    }
+    if ( b > 1 || r > 1 || f > 1 || ( u && length > 1 ) || ( b && f ) )
+        return 0;
+    *formatted = f;
+    return 1;
+}
+
+
+/* Skips a string literal; s->cur is at the opening quote */
+static int
+scanString( struct scanner *  s, int  formatted )
+{
+    char            quote = *s->cur;
+    int             triple = s->cur[ 1 ] == quote && s->cur[ 2 ] == quote;
+    const char *    tokenLineStart = s->lineStart;
+
+    s->cur += triple ? 3 : 1;
+    return scanStringBody( s, quote, triple,
+                           formatted && SCAN_FORMATTED_FIELDS,
+                           tokenLineStart );
+}
+
+
+/* Skips an f-string replacement field; s->cur is right after '{' */
+static int
+scanFormattedField( struct scanner *  s, char  quote, int  triple )
+{
+    int     depth = 0;
+
+    for ( ; ; )
+    {
+        char    c = *s->cur;
+
+        if ( c == '\0' )
+            return scanEofError( s, NULL,
+                                 "EOF while scanning triple-quoted string literal" );
+        if ( c == '\n' || c == '\r' )
+            skipLineEnd( s );
+        else if ( c == '#' )
+        {
+            /* A comment in a multi line field */
+            while ( ! isLineEnd( *s->cur ) )
+                ++s->cur;
+        }
+        else if ( c == '\'' || c == '"' )
+        {
+            /* A nested string literal, possibly with a prefix */
+            const char *    prefix = s->cur;
+            int             formatted = 0;
+
+            while ( prefix > s->buffer && isIdentifierChar( prefix[ -1 ] ) )
+                --prefix;
+            if ( ! isStringPrefix( prefix, s->cur - prefix, & formatted ) )
+                formatted = 0;
+            if ( scanString( s, formatted ) != 0 )
+                return 1;
+        }
+        else if ( c == '(' || c == '[' || c == '{' )
+        {
+            ++depth;
+            ++s->cur;
+        }
+        else if ( c == ')' || c == ']' )
+        {
+            --depth;
+            ++s->cur;
+        }
+        else if ( c == '}' )
+        {
+            ++s->cur;
+            if ( depth-- == 0 )
+                return 0;
+        }
+        else if ( depth == 0 && ( c == ':' ||
+                                  ( c == '!' && s->cur[ 1 ] != '=' ) ) )
+        {
+            /* The conversion is followed by the format spec or '}' */
+            ++s->cur;
+            if ( c == '!' )
+                continue;
+
+            /* The format spec is a literal with nested fields */
+            for ( ; ; )
+            {
+                c = *s->cur;
+                if ( c == '}' )
+                {
+                    ++s->cur;
+                    return 0;
+                }
+                if ( c == '\0' || ( c == quote && ! triple ) ||
+                     ( ! triple && ( c == '\n' || c == '\r' ) ) )
+                    return 0;   /* the body reports it */
+                if ( c == '\n' || c == '\r' )
+                    skipLineEnd( s );
+                else if ( c == '{' )
+                {
+                    ++s->cur;
+                    if ( scanFormattedField( s, quote, triple ) != 0 )
+                        return 1;
+                }
+                else
+                    ++s->cur;
+            }
+        }
+        else
+            ++s->cur;
+    }
+}
+
+
+static int
+isDigit( char  c )
+{
+    return c >= '0' && c <= '9';
+}
+
+
+/* Skips a number literal; s->cur is at its first character */
+static int
+scanNumber( struct scanner *  s )
+{
+    const char *    p = s->cur;
+    const char *    start = p;
+    int             integer = 1;
+
+    if ( p[ 0 ] == '0' && ( p[ 1 ] == 'x' || p[ 1 ] == 'X' ||
+                            p[ 1 ] == 'o' || p[ 1 ] == 'O' ||
+                            p[ 1 ] == 'b' || p[ 1 ] == 'B' ) )
+    {
+        for ( p += 2; isxdigit( (unsigned char) *p ) || *p == '_'; ++p )
+            ;
+        s->cur = p;
+        return 0;
+    }
+
+    while ( isDigit( *p ) || *p == '_' )
+        ++p;
+    if ( *p == '.' )
+    {
+        integer = 0;
+        for ( ++p; isDigit( *p ) || *p == '_'; ++p )
+            ;
+    }
+    if ( *p == 'e' || *p == 'E' )
+    {
+        const char *    exponent = p + 1;
+
+        if ( *exponent == '+' || *exponent == '-' )
+            ++exponent;
+        if ( isDigit( *exponent ) )
+        {
+            integer = 0;
+            for ( p = exponent; isDigit( *p ) || *p == '_'; ++p )
+                ;
+        }
+    }
+    if ( *p == 'j' || *p == 'J' )
+    {
+        integer = 0;
+        ++p;
+    }
+
+    if ( integer && start[ 0 ] == '0' )
+    {
+        /* Leading zeros are not allowed in decimal integers */
+        for ( const char *  digit = start; digit < p; ++digit )
+            if ( *digit != '0' && *digit != '_' )
+            {
+                s->cur = p;
+                return scanLineError( s, start + 1, "invalid token" );
+            }
+    }
+    s->cur = p;
+    return 0;
+}
+
+
+/* Provides the operator length at the position; 0 if there is none */
+static int
+getOperatorLength( const char *  p )
+{
+    switch ( p[ 0 ] )
+    {
+        case '(': case ')': case '[': case ']': case '{': case '}':
+        case ',': case ';': case '~':
+            return 1;
+        case '.':
+            return ( p[ 1 ] == '.' && p[ 2 ] == '.' ) ? 3 : 1;
+        case ':':
+            return p[ 1 ] == '=' ? 2 : 1;
+        case '-':
+            return ( p[ 1 ] == '=' || p[ 1 ] == '>' ) ? 2 : 1;
+        case '*': case '/': case '<': case '>':
+            if ( p[ 1 ] == p[ 0 ] )
+                return p[ 2 ] == '=' ? 3 : 2;
+            if ( p[ 1 ] == '=' || ( p[ 0 ] == '<' && p[ 1 ] == '>' ) )
+                return 2;
+            return 1;
+        case '+': case '%': case '&': case '|': case '^': case '@': case '=':
+            return p[ 1 ] == '=' ? 2 : 1;
+        case '!':
+            return p[ 1 ] == '=' ? 2 : 0;
+        default:
+            return 0;
+    }
+}
+
+
+static void
+startToken( struct scanner *  s, struct scanToken *  t,
+            enum ScanTokenKind  kind )
+{
+    t->start = s->cur;
+    t->length = 0;
+    t->kind = kind;
+    t->keyword = NOT_KEYWORD;
+    t->line = s->line;
+    t->col = s->cur - s->lineStart;
+    t->absPosition = s->lineShift + t->col;
+    t->lastLine = s->line;
+    t->depth = s->depth;
+}
+
+
+/* Measures the indentation of a new line and generates INDENT/DEDENT */
+static int
+scanIndentation( struct scanner *  s )
+{
+    for ( ; ; )
+    {
+        const char *    p = s->cur;
+        int             col = 0;
+        int             altCol = 0;
+
+        for ( ; ; ++p )
+        {
+            if ( *p == ' ' )
+            {
+                ++col;
+                ++altCol;
+            }
+            else if ( *p == '\t' )
+            {
+                col = ( col / SCAN_TAB_SIZE + 1 ) * SCAN_TAB_SIZE;
+                ++altCol;
+            }
+            else if ( *p == '\014' )
+                col = altCol = 0;
+            else
+                break;
+        }
+        s->cur = p;
+
+        if ( *p == '#' )
+        {
+            /* Comment only lines do not count */
+            while ( ! isLineEnd( *p ) )
+                ++p;
+            s->cur = p;
+        }
+        if ( *p == '\n' || *p == '\r' )
+        {
+            /* Blank lines do not count either */
+            skipLineEnd( s );
+            continue;
+        }
+        if ( *p == '\0' )
+            return 0;       /* dedented at the end */
+
+        int     level = s->indentLevel;
+        if ( col == s->indents[ level ] )
+        {
+            if ( altCol != s->altIndents[ level ] )
+                return scanLineError( s, NULL,
+                        "inconsistent use of tabs and spaces in indentation" );
+        }
+        else if ( col > s->indents[ level ] )
+        {
+            if ( level + 1 >= SCAN_MAX_INDENT )
+                return scanLineError( s, NULL,
+                                      "too many levels of indentation" );
+            if ( altCol <= s->altIndents[ level ] )
+                return scanLineError( s, NULL,
+                        "inconsistent use of tabs and spaces in indentation" );
+            ++s->indentLevel;
+            s->indents[ s->indentLevel ] = col;
+            s->altIndents[ s->indentLevel ] = altCol;
+            s->pendingIndents = 1;
+        }
+        else
+        {
+            while ( s->indentLevel > 0 && col < s->indents[ s->indentLevel ] )
+            {
+                --s->indentLevel;
+                --s->pendingIndents;
+            }
+            if ( col != s->indents[ s->indentLevel ] )
+                return scanLineError( s, NULL,
+                        "unindent does not match any outer indentation level" );
+            if ( altCol != s->altIndents[ s->indentLevel ] )
+                return scanLineError( s, NULL,
+                        "inconsistent use of tabs and spaces in indentation" );
+        }
+        return 0;
+    }
+}
+
+
+/* Provides the next token; NEWLINE ends a logical line */
+static int
+scanNextToken( struct scanner *  s, struct scanToken *  t )
+{
+    if ( s->atLineStart )
+    {
+        s->atLineStart = 0;
+        if ( scanIndentation( s ) != 0 )
+            return 1;
+    }
+
+    if ( s->pendingIndents != 0 )
+    {
+        startToken( s, t, s->pendingIndents > 0 ? SCAN_INDENT : SCAN_DEDENT );
+        s->pendingIndents += s->pendingIndents > 0 ? -1 : 1;
+        return 0;
+    }
+
+    for ( ; ; )
+    {
+        while ( *s->cur == ' ' || *s->cur == '\t' || *s->cur == '\014' )
+            ++s->cur;
+        if ( *s->cur == '#' )
+            while ( ! isLineEnd( *s->cur ) )
+                ++s->cur;
+
+        char    c = *s->cur;
+        if ( c == '\0' )
+        {
+            if ( s->depth > 0 )
+                return scanEofError( s, NULL, "unexpected EOF while parsing" );
+            if ( s->lineHasTokens )
+            {
+                s->lineHasTokens = 0;
+                startToken( s, t, SCAN_NEWLINE );
+                return 0;
+            }
+            if ( s->indentLevel > 0 )
+            {
+                --s->indentLevel;
+                startToken( s, t, SCAN_DEDENT );
+                t->col = 0;
+                return 0;
+            }
+            startToken( s, t, SCAN_END );
+            return 0;
+        }
+        if ( c == '\n' || c == '\r' )
+        {
+            if ( s->depth > 0 || ! s->lineHasTokens )
+            {
+                /* Inside brackets or after a continuation */
+                skipLineEnd( s );
+                if ( s->depth == 0 )
+                {
+                    s->atLineStart = 1;
+                    return scanNextToken( s, t );
+                }
+                continue;
+            }
+            startToken( s, t, SCAN_NEWLINE );
+            skipLineEnd( s );
+            s->atLineStart = 1;
+            s->lineHasTokens = 0;
+            return 0;
+        }
+        if ( c == '\\' )
+        {
+            char    next = s->cur[ 1 ];
+            if ( next == '\n' || next == '\r' )
+            {
+                ++s->cur;
+                skipLineEnd( s );
+                continue;
+            }
+            if ( next == '\0' )
+                return scanEofError( s, NULL, "unexpected EOF while parsing" );
+            return scanLineError( s, s->cur + 2,
+                "unexpected character after line continuation character" );
+        }
+        break;
+    }
+
+    s->lineHasTokens = 1;
+
+    char    c = *s->cur;
+    if ( isIdentifierStart( c ) )
+    {
+        int     formatted = 0;
+
+        startToken( s, t, SCAN_NAME );
+        if ( scanName( s ) != 0 )
+            return 1;
+        if ( ( *s->cur == '"' || *s->cur == '\'' ) &&
+             isStringPrefix( t->start, s->cur - t->start, & formatted ) )
+        {
+            t->kind = SCAN_STRING;
+            if ( scanString( s, formatted ) != 0 )
+                return 1;
+        }
+        else
+            t->keyword = getKeywordKind( t->start, s->cur - t->start );
+    }
+    else if ( isDigit( c ) || ( c == '.' && isDigit( s->cur[ 1 ] ) ) )
+    {
+        startToken( s, t, SCAN_NUMBER );
+        if ( scanNumber( s ) != 0 )
+            return 1;
+    }
+    else if ( c == '"' || c == '\'' )
+    {
+        startToken( s, t, SCAN_STRING );
+        if ( scanString( s, 0 ) != 0 )
+            return 1;
+    }
+    else
+    {
+        int     length = getOperatorLength( s->cur );
+
+        startToken( s, t, SCAN_OP );
+        if ( length == 0 )
+            return scanTokenError( s, t, "invalid syntax" );
+        s->cur += length;
+
+        if ( c == '(' || c == '[' || c == '{' )
+        {
+            if ( s->depth >= SCAN_MAX_BRACKETS )
+                return scanTokenError( s, t, "too many nested parentheses" );
+            s->brackets[ s->depth++ ] = c;
+        }
+        else if ( c == ')' || c == ']' || c == '}' )
+        {
+            char    open = c == ')' ? '(' : ( c == ']' ? '[' : '{' );
+            if ( s->depth == 0 || s->brackets[ s->depth - 1 ] != open )
+                return scanTokenError( s, t, "invalid syntax" );
+            t->depth = --s->depth;
+        }
+    }
+
+    t->length = s->cur - t->start;
+    t->lastLine = s->line;
+    return 0;
+}
+
+
+/*
+ * Statements
+ */
+
+/* Provides the event record index or -1 if the event is not recorded */
+static int
+scanEmit( struct scanner *  s, const struct parserEvent *  e )
+{
+    struct eventBuffer *    events = s->context->events;
+    int                     count = events->count;
+
+    if ( s->blocks[ s->blockCount - 1 ].silent )
+        return -1;
+    emitEvent( s->context, e );
+    return events->count > count ? count : -1;
+}
+
+
+/* Sets the hash of the content from the start till the end of the line where
+ * the last token ends */
+static void
+setContentHash( struct scanner *  s, int  record, int  start,
+                const char *  lastEnd, int  lastLine )
+{
+    if ( record < 0 )
+        return;
+
+    const char *            end = lastEnd;
+    struct eventRecord *    r = & s->context->events->records[ record ];
+
+    if ( s->sourceLines != NULL )
+        end = s->source + s->sourceLines[ lastLine - 1 ];
+    while ( ! isLineEnd( *end ) )
+        ++end;
+
+    uint64_t    hash = hashContent( s->source + start,
+                                    end - ( s->source + start ) );
+    r->hashLow = (int) (uint32_t) hash;
+    r->hashHigh = (int) (uint32_t) ( hash >> 32 );
+    if ( r->kind == STATEMENT_EVENT )
+        r->endLine = lastLine;
+}
+
+
+/* Provides the index of the bracket which closes the given one */
+static int
+findClosing( const struct scanner *  s, int  open )
+{
+    int     depth = s->tokens[ open ].depth;
+    int     k = open + 1;
+
+    while ( s->tokens[ k ].depth != depth || s->tokens[ k ].kind != SCAN_OP )
+        ++k;
+    return k;
+}
+
+
+/* Provides the end of a comma separated item which starts at the given
+ * token; the commas of the lambda parameters do not count */
+static int
+findItemEnd( const struct scanner *  s, int  start, int  end, int  depth )
+{
+    int     lambdas = 0;
+
+    for ( int  k = start; k < end; ++k )
+    {
+        const struct scanToken *    t = & s->tokens[ k ];
+
+        if ( t->depth != depth )
+            continue;
+        if ( t->kind == SCAN_NAME && isName( t, "lambda" ) )
+            ++lambdas;
+        else if ( t->kind == SCAN_OP && t->length == 1 )
+        {
+            if ( t->start[ 0 ] == ':' && lambdas > 0 )
+                --lambdas;
+            else if ( t->start[ 0 ] == ',' && lambdas == 0 )
+                return k;
+        }
+    }
+    return end;
+}
+
+
+/* Provides the compound statement header colon index; the NEWLINE index if
+ * there is none. The lambda colons do not count. */
+static int
+findHeaderColon( const struct scanner *  s, int  start )
+{
+    int     newline = s->count - 1;
+    int     lambdas = 0;
+
+    for ( int  k = start; k < newline; ++k )
+    {
+        const struct scanToken *    t = & s->tokens[ k ];
+
+        if ( t->depth != 0 )
+            continue;
+        if ( t->kind == SCAN_NAME && isName( t, "lambda" ) )
+            ++lambdas;
+        else if ( isOp( t, ":" ) )
+        {
+            if ( lambdas == 0 )
+                return k;
+            --lambdas;
+        }
+    }
+    return newline;
+}
+
+
+/* Formats the tokens the same way collectTestString() does */
+static void
+appendTokens( struct scanner *  s, struct scanText *  text,
+              int  start, int  end )
+{
+    for ( int  k = start; k < end; ++k )
+    {
+        const struct scanToken *    t = & s->tokens[ k ];
+
+        if ( t->kind == SCAN_STRING )
+        {
+            /* The parser provides the strings with the translated newlines */
+            if ( textReserve( s, text, t->length ) != 0 )
+                return;
+            for ( const char *  p = t->start; p < t->start + t->length; ++p )
+            {
+                if ( *p == '\r' )
+                {
+                    if ( p[ 1 ] == '\n' )
+                        ++p;
+                    text->data[ text->length++ ] = '\n';
+                }
+                else
+                    text->data[ text->length++ ] = *p;
+            }
+            text->data[ text->length ] = '\0';
+            continue;
+        }
+
+        if ( t->kind == SCAN_NAME && t->keyword == KEYWORD &&
+             ( isName( t, "not" ) || isName( t, "in" ) || isName( t, "is" ) ||
+               isName( t, "or" ) || isName( t, "and" ) || isName( t, "if" ) ||
+               isName( t, "elif" ) || isName( t, "else" ) ) )
+        {
+            textAppend( s, text, " ", 1 );
+            textAppend( s, text, t->start, t->length );
+            textAppend( s, text, " ", 1 );
+            continue;
+        }
+
+        if ( t->kind == SCAN_OP && t->length == 1 )
+        {
+            switch ( t->start[ 0 ] )
+            {
+                case ',':
+                    textAppend( s, text, ", ", 2 );
+                    continue;
+                case ':':
+                    textAppend( s, text, ": ", 2 );
+                    continue;
+                case '-': case '+': case '/': case '*': case '%':
+                case '<': case '>': case '|': case '&': case '^':
+                    textAppend( s, text, " ", 1 );
+                    textAppend( s, text, t->start, 1 );
+                    textAppend( s, text, " ", 1 );
+                    continue;
+                default:
+                    break;
+            }
+        }
+        else if ( t->kind == SCAN_OP && t->length == 2 &&
+                  ( isOp( t, "**" ) || isOp( t, "//" ) || isOp( t, "==" ) ||
+                    isOp( t, ">=" ) || isOp( t, "<=" ) || isOp( t, "!=" ) ||
+                    isOp( t, "<<" ) || isOp( t, ">>" ) ) )
+        {
+            textAppend( s, text, " ", 1 );
+            textAppend( s, text, t->start, 2 );
+            textAppend( s, text, " ", 1 );
+            continue;
+        }
+        textAppend( s, text, t->start, t->length );
+    }
+}
+
+
+static void
+setText( struct scanner *  s, struct scanText *  text, int  start, int  end )
+{
+    text->length = 0;
+    if ( textReserve( s, text, 0 ) == 0 )
+        text->data[ 0 ] = '\0';
+    appendTokens( s, text, start, end );
+}
+
+
+/* Reports the docstring: the string literals at the line start */
+static void
+scanDocstring( struct scanner *  s )
+{
+    struct scanText *   text = & s->text;
+    int                 k = 0;
+    int                 triple = 0;
+
+    setText( s, text, 0, 0 );
+    for ( ; s->tokens[ k ].kind == SCAN_STRING && ! s->noMemory; ++k )
+    {
+        /* Strip the quotes and the prefix the same way checkForDocstring()
+         * does */
+        int             at = text->length;
+        appendTokens( s, text, k, k + 1 );
+
+        if ( s->noMemory )
+            return;
+
+        char *          str = text->data + at;
+        int             length = text->length - at;
+        int             skip = 1;
+        int             count;
+
+        if ( length >= 3 && ( strncmp( str, "\"\"\"", 3 ) == 0 ||
+                              strncmp( str, "'''", 3 ) == 0 ) )
+            skip = 3;
+        else if ( length >= 4 && strchr( "ruf", str[ 0 ] ) != NULL &&
+                  ( strncmp( str + 1, "\"\"\"", 3 ) == 0 ||
+                    strncmp( str + 1, "'''", 3 ) == 0 ) )
+            skip = 4;
+        else if ( length >= 2 && strchr( "ruf", str[ 0 ] ) != NULL &&
+                  ( str[ 1 ] == '"' || str[ 1 ] == '\'' ) )
+            skip = 2;
+
+        if ( skip >= 3 )
+            triple = 1;
+        count = length - skip;
+        if ( skip == 2 )
+            count -= 1;
+        else if ( skip == 4 )
+            count -= 3;
+        else
+            count -= skip;
+        if ( count < 0 )
+            count = 0;
+
+        memmove( str, str + skip, count );
+        text->length = at + count;
+        text->data[ text->length ] = '\0';
+    }
+
+    /* The parser reports the last string start line unless there are
+     * triple quoted strings */
+    const struct scanToken *    last = & s->tokens[ k - 1 ];
+    struct arenaMark            mark = saveArena( s->arena );
+    struct parserEvent          event = { .kind = DOCSTRING_EVENT,
+                                          .name = text->data,
+                                          .nameLength = text->length,
+                                          .line = s->tokens[ 0 ].line,
+                                          .endLine = triple ? last->lastLine
+                                                            : last->line };
+    if ( ( s->context->mask & RAW_DOCSTRINGS_OPTION ) == 0 )
+    {
+        int     length = 0;
+        event.name = trimDocstringText( s->arena, text->data, text->length,
+                                        & length );
+        event.nameLength = length;
+    }
+    if ( event.name == NULL )
+        s->noMemory = 1;
+    else
+        scanEmit( s, & event );
+    releaseArena( s->arena, mark );
+}
+
+
+static void
+finishTopStatement( struct scanner *  s, const char *  lastEnd, int  lastLine )
+{
+    if ( s->inStatement )
+    {
+        setContentHash( s, s->statement, s->statementStart,
+                        lastEnd, lastLine );
+        s->inStatement = 0;
+    }
+}
+
+
+static void
+startTopStatement( struct scanner *  s )
+{
+    const struct scanToken *    first = & s->tokens[ 0 ];
+
+    if ( s->continued || isName( first, "else" ) || isName( first, "elif" ) ||
+         isName( first, "except" ) || isName( first, "finally" ) )
+    {
+        s->continued = 0;
+        return;
+    }
+
+    finishTopStatement( s, s->prevEnd, s->prevLine );
+
+    struct parserEvent  event = { .kind = STATEMENT_EVENT,
+                                  .name = "",
+                                  .line = first->line,
+                                  .pos = first->col + 1,
+                                  .absPosition = first->absPosition };
+
+    s->inStatement = 1;
+    s->statementStart = first->absPosition;
+    s->statement = scanEmit( s, & event );
+
+    if ( s->collectStarts )
+    {
+        if ( s->startsCount + 2 > s->startsCapacity )
+        {
+            int     capacity = s->startsCapacity == 0 ? 256
+                                                      : s->startsCapacity * 2;
+            int *   starts = (int *) arenaGrow( s->arena, s->starts,
+                                    s->startsCapacity * sizeof( int ),
+                                    capacity * sizeof( int ) );
+            if ( starts == NULL )
+            {
+                s->noMemory = 1;
+                return;
+            }
+            s->starts = starts;
+            s->startsCapacity = capacity;
+        }
+        s->starts[ s->startsCount++ ] = first->absPosition;
+        s->starts[ s->startsCount++ ] = first->line;
+    }
+}
+
+
+static int
+isAtomStart( const struct scanToken *  t )
+{
+    switch ( t->kind )
+    {
+        case SCAN_NAME:
+            return t->keyword != KEYWORD;
+        case SCAN_NUMBER:
+        case SCAN_STRING:
+            return 1;
+        case SCAN_OP:
+            return isOp( t, "(" ) || isOp( t, "[" ) || isOp( t, "{" ) ||
+                   isOp( t, "..." );
+        default:
+            return 0;
+    }
+}
+
+
+static int
+isAtomEnd( const struct scanToken *  t )
+{
+    switch ( t->kind )
+    {
+        case SCAN_NAME:
+            return t->keyword != KEYWORD;
+        case SCAN_NUMBER:
+        case SCAN_STRING:
+            return 1;
+        case SCAN_OP:
+            return isOp( t, ")" ) || isOp( t, "]" ) || isOp( t, "}" );
+        default:
+            return 0;
+    }
+}
+
+
+/* Provides the index after the atom which starts at the given token */
+static int
+skipAtom( const struct scanner *  s, int  start )
+{
+    const struct scanToken *    t = & s->tokens[ start ];
+
+    if ( t->kind == SCAN_STRING )
+    {
+        while ( s->tokens[ start ].kind == SCAN_STRING )
+            ++start;
+        return start;
+    }
+    if ( isOp( t, "(" ) || isOp( t, "[" ) || isOp( t, "{" ) )
+        return findClosing( s, start ) + 1;
+    return start + 1;
+}
+
+
+/* Two atoms in a row, e.g. print "x", are an error for the parser */
+static int
+checkAdjacentAtoms( struct scanner *  s )
+{
+    for ( int  k = 1; k < s->count - 1; ++k )
+    {
+        const struct scanToken *    prev = & s->tokens[ k - 1 ];
+        const struct scanToken *    t = & s->tokens[ k ];
+
+        if ( t->kind == SCAN_OP && ! isOp( t, "{" ) )
+            continue;
+        if ( ! isAtomEnd( prev ) || ! isAtomStart( t ) )
+            continue;
+        if ( prev->kind == SCAN_STRING && t->kind == SCAN_STRING )
+            continue;
+        if ( t->kind == SCAN_OP && prev->kind != SCAN_NAME &&
+             prev->kind != SCAN_NUMBER && prev->kind != SCAN_STRING )
+            continue;
+        return scanTokenError( s, t, "invalid syntax" );
+    }
+    return 0;
+}
+
+
+/* Reports the names the assignment targets consist of. The names in
+ * brackets are reported as well, the subscriptions and the attributes are
+ * not. */
+static void
+scanTargets( struct scanner *  s, int  start, int  end,
+             enum EventKind  kind, int  level );
+
+static void
+scanTarget( struct scanner *  s, int  start, int  end,
+            enum EventKind  kind, int  level )
+{
+    const struct scanToken *    t = & s->tokens[ start ];
+
+    if ( ! isAtomStart( t ) )
+        return;     /* e.g. a starred target */
+
+    int     atomEnd = skipAtom( s, start );
+    if ( atomEnd < end )
+    {
+        const struct scanToken *    next = & s->tokens[ atomEnd ];
+        if ( isOp( next, "." ) || isOp( next, "(" ) || isOp( next, "[" ) )
+            return;
+    }
+
+    if ( isOp( t, "(" ) || isOp( t, "[" ) )
+    {
+        if ( atomEnd - start > 2 )
+            scanTargets( s, start + 1, atomEnd - 1, kind, level );
+        return;
+    }
+
+    setText( s, & s->text, start, atomEnd );
+
+    struct parserEvent  event = { .kind = kind,
+                                  .name = s->text.data,
+                                  .nameLength = s->text.length,
+                                  .line = t->line,
+                                  .pos = t->col + 1,
+                                  .absPosition = t->absPosition,
+                                  .level = level };
+    scanEmit( s, & event );
+}
+
+
+static void
+scanTargets( struct scanner *  s, int  start, int  end,
+             enum EventKind  kind, int  level )
+{
+    int     depth = s->tokens[ start ].depth;
+
+    while ( start < end )
+    {
+        int     itemEnd = findItemEnd( s, start, end, depth );
+
+        if ( itemEnd > start )
+            scanTarget( s, start, itemEnd, kind, level );
+        start = itemEnd + 1;
+    }
+}
+
+
+/* Reports the first decoratorArgument attributes, i.e. self.name, the assignment
+ * targets consist of */
+static void
+scanInstanceTargets( struct scanner *  s, int  start, int  end, int  level );
+
+static void
+scanInstanceTarget( struct scanner *  s, int  start, int  end, int  level )
+{
+    const struct scanToken *    t = & s->tokens[ start ];
+    const struct scanBlock *    block = & s->blocks[ s->blockCount - 1 ];
+
+    if ( ! isAtomStart( t ) )
+        return;
+
+    int     k = skipAtom( s, start );
+    if ( isOp( t, "(" ) || isOp( t, "[" ) )
+    {
+        if ( k - start > 2 )
+            scanInstanceTargets( s, start + 1, k - 1, level );
+        return;
+    }
+
+    int     trailers = 0;
+    int     attribute = -1;
+    while ( k < end )
+    {
+        const struct scanToken *    next = & s->tokens[ k ];
+
+        if ( isOp( next, "." ) && k + 1 < end &&
+             s->tokens[ k + 1 ].kind == SCAN_NAME )
+        {
+            if ( trailers++ == 0 )
+                attribute = k + 1;
+            k += 2;
+        }
+        else if ( isOp( next, "(" ) || isOp( next, "[" ) )
+        {
+            ++trailers;
+            k = findClosing( s, k ) + 1;
+        }
+        else
+            break;
+    }
+    if ( trailers != 1 || attribute < 0 )
+        return;
+    if ( t->kind != SCAN_NAME || t->length != block->firstArgLength ||
+         strncmp( t->start, block->firstArgName, t->length ) != 0 )
+        return;
+
+    const struct scanToken *    name = & s->tokens[ attribute ];
+    struct parserEvent          event = { .kind = INSTANCE_ATTRIBUTE_EVENT,
+                                          .name = name->start,
+                                          .nameLength = name->length,
+                                          .line = name->line,
+                                          .pos = name->col + 1,
+                                          .absPosition = name->absPosition,
+                                          .level = level };
+    scanEmit( s, & event );
+}
+
+
+static void
+scanInstanceTargets( struct scanner *  s, int  start, int  end, int  level )
+{
+    int     depth = s->tokens[ start ].depth;
+
+    while ( start < end )
+    {
+        int     itemEnd = findItemEnd( s, start, end, depth );
+
+        if ( itemEnd > start )
+            scanInstanceTarget( s, start, itemEnd, level );
+        start = itemEnd + 1;
+    }
+}
+
+
+/* Provides the index of '=' if the statement is an assignment or -1. The
+ * annotated and the augmented assignments do not count, the same as for
+ * walk(). */
+static int
+findAssignment( const struct scanner *  s, int  start, int  end )
+{
+    const struct scanToken *    first = & s->tokens[ start ];
+
+    if ( first->keyword == KEYWORD )
+        return -1;
+    if ( isName( first, "type" ) && start + 2 < end &&
+         s->tokens[ start + 1 ].kind == SCAN_NAME &&
+         ( isOp( & s->tokens[ start + 2 ], "=" ) ||
+           isOp( & s->tokens[ start + 2 ], "[" ) ) )
+        return -1;      /* type alias */
+
+    for ( int  k = start; k < end; ++k )
+    {
+        const struct scanToken *    t = & s->tokens[ k ];
+
+        if ( t->depth != 0 )
+            continue;
+        if ( t->kind == SCAN_NAME && isName( t, "lambda" ) )
+            return -1;
+        if ( t->kind != SCAN_OP || t->start[ t->length - 1 ] != '=' )
+        {
+            if ( isOp( t, ":" ) )
+                return -1;
+            continue;
+        }
+        if ( t->length == 1 )
+            return k;
+        if ( t->length == 3 || strchr( "=<>!:", t->start[ 0 ] ) == NULL )
+            return -1;  /* augmented assignment */
+    }
+    return -1;
+}
+
+
+static void
+scanAssignment( struct scanner *  s, int  start, int  equal )
+{
+    const struct scanBlock *    block = & s->blocks[ s->blockCount - 1 ];
+
+    switch ( block->scope )
+    {
+        case GLOBAL_SCOPE:
+            if ( wants( s->context, GLOBAL_EVENT ) )
+                scanTargets( s, start, equal, GLOBAL_EVENT,
+                             block->objectsLevel );
+            break;
+        case CLASS_SCOPE:
+            if ( wants( s->context, CLASS_ATTRIBUTE_EVENT ) )
+                scanTargets( s, start, equal, CLASS_ATTRIBUTE_EVENT,
+                             block->objectsLevel );
+            break;
+        case CLASS_METHOD_SCOPE:
+            if ( block->firstArgName != NULL &&
+                 wants( s->context, INSTANCE_ATTRIBUTE_EVENT ) )
+                scanInstanceTargets( s, start, equal, block->objectsLevel );
+            break;
+        default:
+            break;
+    }
+}
+
+
+/* Appends a dotted name; provides the index after it or -1 */
+static int
+scanDottedName( struct scanner *  s, int  k, int  end )
+{
+    for ( ; ; )
+    {
+        if ( k >= end || s->tokens[ k ].kind != SCAN_NAME ||
+             s->tokens[ k ].keyword != NOT_KEYWORD )
+            return -1;
+        textAppend( s, & s->text, s->tokens[ k ].start,
+                    s->tokens[ k ].length );
+        ++k;
+        if ( k >= end || ! isOp( & s->tokens[ k ], "." ) )
+            return k;
+        textAppend( s, & s->text, ".", 1 );
+        ++k;
+    }
+}
+
+
+static int
+isPlainName( const struct scanner *  s, int  k, int  end )
+{
+    return k < end && s->tokens[ k ].kind == SCAN_NAME &&
+           s->tokens[ k ].keyword == NOT_KEYWORD;
+}
+
+
+static void
+emitNameEvent( struct scanner *  s, enum EventKind  kind,
+               const char *  name, int  nameLength,
+               const struct scanToken *  t, int  report )
+{
+    if ( ! report )
+        return;
+
+    struct parserEvent  event = { .kind = kind,
+                                  .name = name,
+                                  .nameLength = nameLength,
+                                  .line = t->line,
+                                  .pos = t->col + 1,
+                                  .absPosition = t->absPosition };
+    scanEmit( s, & event );
+}
+
+
+/* 'import' or 'from' statement */
+static int
+scanImport( struct scanner *  s, int  start, int  end, int  report )
+{
+    int     k = start + 1;
+
+    report = report && wants( s->context, IMPORT_EVENT );
+    if ( isName( & s->tokens[ start ], "import" ) )
+    {
+        for ( ; ; )
+        {
+            int     first = k;
+
+            setText( s, & s->text, 0, 0 );
+            k = scanDottedName( s, k, end );
+            if ( k < 0 )
+                return scanTokenError( s, & s->tokens[ first ],
+                                       "invalid syntax" );
+            emitNameEvent( s, IMPORT_EVENT, s->text.data, s->text.length,
+                           & s->tokens[ first ], report );
+
+            if ( k < end && isName( & s->tokens[ k ], "as" ) )
+            {
+                if ( ! isPlainName( s, k + 1, end ) )
+                    return scanTokenError( s, & s->tokens[ k + 1 ],
+                                           "invalid syntax" );
+                emitNameEvent( s, AS_EVENT, s->tokens[ k + 1 ].start,
+                               s->tokens[ k + 1 ].length,
+                               & s->tokens[ k + 1 ], report );
+                k += 2;
+            }
+            if ( k == end )
+                return 0;
+            if ( ! isOp( & s->tokens[ k ], "," ) )
+                return scanTokenError( s, & s->tokens[ k ], "invalid syntax" );
+            ++k;
+        }
+    }
+
+    /* from ... import ... */
+    setText( s, & s->text, 0, 0 );
+    while ( k < end && ( isOp( & s->tokens[ k ], "." ) ||
+                         isOp( & s->tokens[ k ], "..." ) ) )
+    {
+        textAppend( s, & s->text, s->tokens[ k ].start,
+                    s->tokens[ k ].length );
+        ++k;
+    }
+    if ( isPlainName( s, k, end ) )
+        k = scanDottedName( s, k, end );
+    if ( k < 0 || s->text.length == 0 || k >= end ||
+         ! isName( & s->tokens[ k ], "import" ) )
+    {
+        if ( k < 0 || k > end )
+            k = end;
+        return scanTokenError( s, & s->tokens[ k ], "invalid syntax" );
+    }
+    emitNameEvent( s, IMPORT_EVENT, s->text.data, s->text.length,
+                   & s->tokens[ start + 1 ], report );
+
+    ++k;
+    if ( k < end && isOp( & s->tokens[ k ], "*" ) )
+    {
+        if ( k + 1 != end )
+            return scanTokenError( s, & s->tokens[ k + 1 ], "invalid syntax" );
+        return 0;
+    }
+
+    int     namesEnd = end;
+    if ( k < end && isOp( & s->tokens[ k ], "(" ) )
+    {
+        namesEnd = findClosing( s, k );
+        if ( namesEnd + 1 != end )
+            return scanTokenError( s, & s->tokens[ namesEnd + 1 ],
+                                   "invalid syntax" );
+        ++k;
+    }
+
+    report = report && wants( s->context, WHAT_EVENT );
+    if ( ! isPlainName( s, k, namesEnd ) )
+        return scanTokenError( s, & s->tokens[ k ], "invalid syntax" );
+    while ( k < namesEnd )
+    {
+        if ( ! isPlainName( s, k, namesEnd ) )
+            return scanTokenError( s, & s->tokens[ k ], "invalid syntax" );
+        emitNameEvent( s, WHAT_EVENT, s->tokens[ k ].start,
+                       s->tokens[ k ].length, & s->tokens[ k ], report );
+        ++k;
+        if ( k < namesEnd && isName( & s->tokens[ k ], "as" ) )
+        {
+            if ( ! isPlainName( s, k + 1, namesEnd ) )
+                return scanTokenError( s, & s->tokens[ k + 1 ],
+                                       "invalid syntax" );
+            emitNameEvent( s, AS_EVENT, s->tokens[ k + 1 ].start,
+                           s->tokens[ k + 1 ].length,
+                           & s->tokens[ k + 1 ], report );
+            k += 2;
+        }
+        if ( k < namesEnd )
+        {
+            if ( ! isOp( & s->tokens[ k ], "," ) )
+                return scanTokenError( s, & s->tokens[ k ], "invalid syntax" );
+            ++k;
+        }
+    }
+    return 0;
+}
+
+
+/* The ';' separated statements of a line or of a one line suite. Only the
+ * first statement of a line could be an assignment walk() looks at. */
+static int
+scanSimpleStatements( struct scanner *  s, int  start, int  end,
+                      int  assignments, int  reportImports )
+{
+    for ( int  first = 1; start < end; first = 0 )
+    {
+        int     statementEnd = start;
+
+        while ( statementEnd < end &&
+                ! isOp( & s->tokens[ statementEnd ], ";" ) )
+            ++statementEnd;
+        if ( statementEnd == start )
+            return scanTokenError( s, & s->tokens[ start ], "invalid syntax" );
+
+        if ( first && assignments )
+        {
+            int     equal = findAssignment( s, start, statementEnd );
+            if ( equal >= 0 )
+            {
+                scanAssignment( s, start, equal );
+                reportImports = 0;
+            }
+        }
+        if ( isName( & s->tokens[ start ], "import" ) ||
+             isName( & s->tokens[ start ], "from" ) )
+        {
+            if ( scanImport( s, start, statementEnd, reportImports ) != 0 )
+                return 1;
+        }
+        start = statementEnd + 1;
+    }
+    return 0;
+}
+
+
+static void
+openBlock( struct scanner *  s, enum Scope  scope, int  objectsLevel,
+           const char *  firstArgName, int  firstArgLength, int  silent,
+           int  isMatch, int  checkDocstring, int  record, int  start )
+{
+    struct scanBlock *  block = & s->pending;
+
+    block->scope = scope;
+    block->objectsLevel = objectsLevel;
+    block->firstArgName = firstArgName;
+    block->firstArgLength = firstArgLength;
+    block->silent = silent;
+    block->isMatch = isMatch;
+    block->checkDocstring = checkDocstring;
+    block->record = record;
+    block->start = start;
+    s->hasPending = 1;
+}
+
+
+/* Drops the decorators events unless the withDecorators definition is reported */
+static int
+takeDecorators( struct scanner *  s, int  emit )
+{
+    int     staticMethod = 0;
+
+    if ( s->withDecorators )
+    {
+        if ( ! emit || ! wants( s->context, DECORATOR_EVENT ) )
+        {
+            s->context->events->count = s->decoratorsCount;
+            s->context->events->poolSize = s->decoratorsPoolSize;
+        }
+        staticMethod = s->staticMethod;
+        s->withDecorators = 0;
+    }
+    return staticMethod;
+}
+
+
+static int
+scanDecorator( struct scanner *  s )
+{
+    int                 end = s->count - 1;
+    int                 nameEnd = end;
+    int                 args = -1;
+
+    if ( end == 1 )
+        return scanTokenError( s, & s->tokens[ 1 ], "invalid syntax" );
+    if ( ! s->withDecorators )
+    {
+        s->withDecorators = 1;
+        s->staticMethod = 0;
+        s->decoratorsCount = s->context->events->count;
+        s->decoratorsPoolSize = s->context->events->poolSize;
+    }
+    if ( s->blockCount == 1 )
+        s->continued = 1;
+
+    if ( isAtomStart( & s->tokens[ 1 ] ) )
+    {
+        /* The name is the primary without the last call */
+        int     k = skipAtom( s, 1 );
+        int     lastTrailer = -1;
+
+        while ( k < end )
+        {
+            const struct scanToken *    t = & s->tokens[ k ];
+
+            if ( isOp( t, "." ) && k + 1 < end &&
+                 s->tokens[ k + 1 ].kind == SCAN_NAME )
+            {
+                lastTrailer = k;
+                k += 2;
+            }
+            else if ( isOp( t, "(" ) || isOp( t, "[" ) )
+            {
+                lastTrailer = k;
+                k = findClosing( s, k ) + 1;
+            }
+            else
+                break;
+        }
+        nameEnd = k;
+        if ( lastTrailer >= 0 && isOp( & s->tokens[ lastTrailer ], "(" ) &&
+             k == findClosing( s, lastTrailer ) + 1 )
+        {
+            nameEnd = lastTrailer;
+            args = lastTrailer;
+        }
+    }
+
+    setText( s, & s->text, 1, nameEnd );
+    if ( s->text.length == 12 && memcmp( s->text.data, "staticmethod", 12 ) == 0 )
+        s->staticMethod = 1;
+
+    const struct scanToken *    first = & s->tokens[ 1 ];
+    struct parserEvent          event = { .kind = DECORATOR_EVENT,
+                                          .name = s->text.data,
+                                          .nameLength = s->text.length,
+                                          .line = first->line,
+                                          .pos = first->col + 1,
+                                          .absPosition = first->absPosition };
+    scanEmit( s, & event );
+
+    if ( args < 0 || ! wants( s->context, DECORATOR_ARGUMENT_EVENT ) )
+        return 0;
+
+    int     close = findClosing( s, args );
+    int     depth = s->tokens[ args ].depth + 1;
+    struct parserEvent  decoratorArgument = { .kind = DECORATOR_ARGUMENT_EVENT,
+                                     .name = "" };
+
+    if ( close == args + 1 )
+    {
+        scanEmit( s, & decoratorArgument );
+        return 0;
+    }
+    for ( int  k = args + 1; k < close; )
+    {
+        int     itemEnd = findItemEnd( s, k, close, depth );
+
+        if ( itemEnd > k )
+        {
+            setText( s, & s->text, k, itemEnd );
+            decoratorArgument.name = s->text.data;
+            decoratorArgument.nameLength = s->text.length;
+            scanEmit( s, & decoratorArgument );
+        }
+        k = itemEnd + 1;
+    }
+    return 0;
+}
+
+
+/* Reports the parameters; provides the first one if it is a plain name */
+static const struct scanToken *
+scanParameters( struct scanner *  s, int  open, int  close )
+{
+    const struct scanToken *    firstArg = NULL;
+    int                         depth = s->tokens[ open ].depth + 1;
+    int                         emit = wants( s->context, ARGUMENT_EVENT );
+
+    for ( int  k = open + 1, first = 1; k < close; first = 0 )
+    {
+        int                         end = findItemEnd( s, k, close, depth );
+        const struct scanToken *    t = & s->tokens[ k ];
+        int                         annotation = -1;
+        int                         value = -1;
+
+        if ( end == k || isOp( t, "/" ) )
+        {
+            k = end + 1;
+            continue;
+        }
+
+        setText( s, & s->text, 0, 0 );
+        if ( isOp( t, "*" ) || isOp( t, "**" ) )
+        {
+            textAppend( s, & s->text, t->start, t->length );
+            if ( k + 1 < end )
+            {
+                textAppend( s, & s->text, s->tokens[ k + 1 ].start,
+                            s->tokens[ k + 1 ].length );
+                if ( k + 2 < end && isOp( & s->tokens[ k + 2 ], ":" ) )
+                    annotation = k + 3;
+            }
+        }
+        else
+        {
+            if ( first && t->kind == SCAN_NAME )
+                firstArg = t;
+            textAppend( s, & s->text, t->start, t->length );
+            if ( k + 1 < end && isOp( & s->tokens[ k + 1 ], ":" ) )
+                annotation = k + 2;
+            for ( int  j = k + 1; j < end; ++j )
+                if ( s->tokens[ j ].depth == depth &&
+                     isOp( & s->tokens[ j ], "=" ) )
+                {
+                    value = j + 1;
+                    break;
+                }
+        }
+
+        if ( emit )
+        {
+            struct parserEvent  event = { .kind = ARGUMENT_EVENT,
+                                          .name = s->text.data,
+                                          .nameLength = s->text.length };
+            if ( annotation >= 0 )
+            {
+                setText( s, & s->annotation, annotation,
+                         value >= 0 ? value - 1 : end );
+                event.annotation = s->annotation.data;
+                event.annotationLength = s->annotation.length;
+            }
+            scanEmit( s, & event );
+
+            if ( value >= 0 && wants( s->context, ARGUMENT_VALUE_EVENT ) )
+            {
+                setText( s, & s->text, value, end );
+                struct parserEvent  argValue = {
+                                        .kind = ARGUMENT_VALUE_EVENT,
+                                        .name = s->text.data,
+                                        .nameLength = s->text.length };
+                scanEmit( s, & argValue );
+            }
+        }
+        k = end + 1;
+    }
+    return firstArg;
+}
+
+
+/* The body after the header colon: either a block or a one line suite */
+static int
+scanBody( struct scanner *  s, int  colon, enum Scope  scope, int  level,
+          const char *  firstArgName, int  firstArgLength, int  silent,
+          int  isMatch, int  checkDocstring, int  record, int  start )
+{
+    if ( colon + 1 == s->count - 1 )
+    {
+        openBlock( s, scope, level, firstArgName, firstArgLength, silent,
+                   isMatch, checkDocstring, record, start );
+        return 0;
+    }
+
+    /* One line suite: only the imports are reported from there */
+    if ( scanSimpleStatements( s, colon + 1, s->count - 1, 0,
+                               ! silent &&
+                               ! skipsFunctionBody( s->context, scope ) ) != 0 )
+        return 1;
+    setContentHash( s, record, start, s->lastEnd, s->lastLine );
+    return 0;
+}
+
+
+static int
+scanFunction( struct scanner *  s, int  keyword )
+{
+    const struct scanBlock *    block = & s->blocks[ s->blockCount - 1 ];
+    const struct scanToken *    def = & s->tokens[ keyword ];
+    const struct scanToken *    name = & s->tokens[ keyword + 1 ];
+    int                         k = keyword + 2;
+
+    if ( name->kind != SCAN_NAME || name->keyword != NOT_KEYWORD )
+        return scanTokenError( s, name, "invalid syntax" );
+    if ( isOp( & s->tokens[ k ], "[" ) )
+        k = findClosing( s, k ) + 1;        /* type parameters */
+    if ( ! isOp( & s->tokens[ k ], "(" ) )
+        return scanTokenError( s, & s->tokens[ k ], "invalid syntax" );
+
+    int     open = k;
+    int     close = findClosing( s, open );
+    int     annotation = -1;
+
+    k = close + 1;
+    if ( isOp( & s->tokens[ k ], "->" ) )
+    {
+        annotation = k + 1;
+        k = findHeaderColon( s, annotation );
+        if ( k == annotation )
+            return scanTokenError( s, & s->tokens[ k ], "invalid syntax" );
+    }
+    if ( ! isOp( & s->tokens[ k ], ":" ) )
+        return scanTokenError( s, & s->tokens[ k ], "invalid syntax" );
+
+    int     colon = k;
+    int     emit = wants( s->context, FUNCTION_EVENT );
+    int     staticMethod = takeDecorators( s, emit );
+    int     level = block->objectsLevel + ( emit ? 1 : 0 );
+
+    struct parserEvent  event = { .kind = FUNCTION_EVENT,
+                                  .name = name->start,
+                                  .nameLength = name->length,
+                                  .line = name->line,
+                                  .pos = name->col + 1,
+                                  .absPosition = name->absPosition,
+                                  .keywordLine = def->line,
+                                  .keywordPos = def->col + 1,
+                                  .colonLine = s->tokens[ colon ].line,
+                                  .colonPos = s->tokens[ colon ].col + 1,
+                                  .level = level,
+                                  .isAsync = keyword > 0 };
+    if ( emit && annotation >= 0 )
+    {
+        setText( s, & s->annotation, annotation, colon );
+        event.annotation = s->annotation.data;
+        event.annotationLength = s->annotation.length;
+    }
+    int     record = scanEmit( s, & event );
+
+    const struct scanToken *    firstArg = scanParameters( s, open, close );
+
+    enum Scope  scope = FUNCTION_SCOPE;
+    if ( block->scope == CLASS_SCOPE )
+        scope = staticMethod ? CLASS_STATIC_METHOD_SCOPE : CLASS_METHOD_SCOPE;
+
+    int     silent = block->silent || ! wantsNested( s->context );
+    return scanBody( s, colon, scope, level,
+                     firstArg == NULL ? NULL : firstArg->start,
+                     firstArg == NULL ? 0 : firstArg->length, silent, 0,
+                     emit && wants( s->context, DOCSTRING_EVENT ),
+                     record, def->absPosition );
+}
+
+
+static int
+scanClass( struct scanner *  s )
+{
+    const struct scanBlock *    block = & s->blocks[ s->blockCount - 1 ];
+    const struct scanToken *    keyword = & s->tokens[ 0 ];
+    const struct scanToken *    name = & s->tokens[ 1 ];
+    int                         k = 2;
+    int                         open = -1;
+    int                         close = -1;
+
+    if ( name->kind != SCAN_NAME || name->keyword != NOT_KEYWORD )
+        return scanTokenError( s, name, "invalid syntax" );
+    if ( isOp( & s->tokens[ k ], "[" ) )
+        k = findClosing( s, k ) + 1;        /* type parameters */
+    if ( isOp( & s->tokens[ k ], "(" ) )
+    {
+        open = k;
+        close = findClosing( s, open );
+        k = close + 1;
+    }
+    if ( ! isOp( & s->tokens[ k ], ":" ) )
+        return scanTokenError( s, & s->tokens[ k ], "invalid syntax" );
+
+    int     colon = k;
+    int     emit = wants( s->context, CLASS_EVENT );
+    int     level = block->objectsLevel + ( emit ? 1 : 0 );
+
+    takeDecorators( s, emit );
+
+    struct parserEvent  event = { .kind = CLASS_EVENT,
+                                  .name = name->start,
+                                  .nameLength = name->length,
+                                  .line = name->line,
+                                  .pos = name->col + 1,
+                                  .absPosition = name->absPosition,
+                                  .keywordLine = keyword->line,
+                                  .keywordPos = keyword->col + 1,
+                                  .colonLine = s->tokens[ colon ].line,
+                                  .colonPos = s->tokens[ colon ].col + 1,
+                                  .level = level };
+    int     record = scanEmit( s, & event );
+
+    if ( open >= 0 && wants( s->context, BASE_CLASS_EVENT ) )
+    {
+        int     depth = s->tokens[ open ].depth + 1;
+
+        for ( k = open + 1; k < close; )
+        {
+            int     itemEnd = findItemEnd( s, k, close, depth );
+
+            if ( itemEnd > k )
+            {
+                setText( s, & s->text, k, itemEnd );
+                struct parserEvent  base = { .kind = BASE_CLASS_EVENT,
+                                             .name = s->text.data,
+                                             .nameLength = s->text.length };
+                scanEmit( s, & base );
+            }
+            k = itemEnd + 1;
+        }
+    }
+
+    int     silent = block->silent || ! wantsNested( s->context );
+    return scanBody( s, colon, CLASS_SCOPE, level, NULL, 0, silent, 0,
+                     emit && wants( s->context, DOCSTRING_EVENT ),
+                     record, keyword->absPosition );
+}
+
+
+/* if, while, for, try, with, match etc. The suites keep the scope. */
+static int
+scanCompound( struct scanner *  s, int  keyword )
+{
+    const struct scanBlock *    block = & s->blocks[ s->blockCount - 1 ];
+    const struct scanToken *    t = & s->tokens[ keyword ];
+    int                         colon = findHeaderColon( s, keyword + 1 );
+
+    if ( ! isOp( & s->tokens[ colon ], ":" ) )
+        return scanTokenError( s, & s->tokens[ colon ], "invalid syntax" );
+    if ( isName( t, "else" ) || isName( t, "try" ) || isName( t, "finally" ) )
+    {
+        if ( colon != keyword + 1 )
+            return scanTokenError( s, & s->tokens[ keyword + 1 ],
+                                   "invalid syntax" );
+    }
+    else if ( colon == keyword + 1 && ! isName( t, "except" ) )
+        return scanTokenError( s, & s->tokens[ colon ], "invalid syntax" );
+
+    /* walk() does not look into 'async for' and 'async with' */
+    return scanBody( s, colon, block->scope, block->objectsLevel,
+                     block->firstArgName, block->firstArgLength,
+                     block->silent || keyword > 0, isName( t, "match" ),
+                     0, -1, 0 );
+}
+
+
+static int
+isCompoundKeyword( const struct scanToken *  t )
+{
+    static const char *     keywords[] = {
+        "if", "elif", "else", "while", "for", "try", "except", "finally",
+        "with", NULL };
+
+    if ( t->keyword != KEYWORD )
+        return 0;
+    for ( const char **  k = keywords; *k != NULL; ++k )
+        if ( isName( t, *k ) )
+            return 1;
+    return 0;
+}
+
+
+/* 'match' and 'case' are keywords only at the compound statement start */
+static int
+isSoftCompound( const struct scanner *  s )
+{
+    const struct scanToken *    first = & s->tokens[ 0 ];
+
+    if ( isName( first, "match" ) )
+        return s->count > 3 && isOp( & s->tokens[ s->count - 2 ], ":" ) &&
+               ! isOp( & s->tokens[ 1 ], "=" ) &&
+               ! isOp( & s->tokens[ 1 ], "." );
+    if ( isName( first, "case" ) )
+        return s->blocks[ s->blockCount - 1 ].isMatch && s->count > 3;
+    return 0;
+}
+
+
+static int
+isTypeAlias( const struct scanner *  s )
+{
+    return s->count > 4 && isName( & s->tokens[ 0 ], "type" ) &&
+           s->tokens[ 1 ].kind == SCAN_NAME &&
+           ( isOp( & s->tokens[ 2 ], "=" ) || isOp( & s->tokens[ 2 ], "[" ) );
+}
+
+
+/* The same as isHeaderStatement() tells for the CST */
+static int
+isScannedHeader( const struct scanner *  s )
+{
+    const struct scanToken *    first = & s->tokens[ 0 ];
+    int                         end = s->count - 1;
+
+    if ( isName( first, "if" ) || isName( first, "elif" ) ||
+         isName( first, "else" ) || isName( first, "try" ) ||
+         isName( first, "except" ) || isName( first, "finally" ) )
+        return 1;
+
+    if ( first->kind == SCAN_STRING )
+    {
+        if ( isOp( & s->tokens[ end - 1 ], ";" ) )
+            --end;
+        for ( int  k = 1; k < end; ++k )
+            if ( s->tokens[ k ].kind != SCAN_STRING )
+                return 0;
+        return 1;
+    }
+
+    for ( int  k = 0; k < end; ++k )
+    {
+        if ( ! isName( & s->tokens[ k ], "import" ) &&
+             ! isName( & s->tokens[ k ], "from" ) )
+            return 0;
+        while ( k < end && ! isOp( & s->tokens[ k ], ";" ) )
+            ++k;
+    }
+    return 1;
+}
+
+
+static int
+scanLogicalLine( struct scanner *  s )
+{
+    struct scanBlock *          block = & s->blocks[ s->blockCount - 1 ];
+    const struct scanToken *    first = & s->tokens[ 0 ];
+    int                         softCompound = isSoftCompound( s );
+
+    if ( block->checkDocstring )
+    {
+        block->checkDocstring = 0;
+        if ( first->kind == SCAN_STRING )
+            scanDocstring( s );
+    }
+    if ( s->blockCount == 1 )
+    {
+        if ( ( s->context->mask & STOP_AT_CODE_OPTION ) &&
+             ! isScannedHeader( s ) )
+        {
+            s->stopped = 1;
+            return 0;
+        }
+        startTopStatement( s );
+    }
+
+    if ( ! softCompound && ! isTypeAlias( s ) &&
+         checkAdjacentAtoms( s ) != 0 )
+        return 1;
+
+    if ( isOp( first, "@" ) )
+        return scanDecorator( s );
+
+    int     async = isName( first, "async" ) && s->count > 2;
+    if ( s->withDecorators && ! isName( first, "def" ) &&
+         ! isName( first, "class" ) &&
+         ! ( async && isName( & s->tokens[ 1 ], "def" ) ) )
+        return scanTokenError( s, first, "invalid syntax" );
+
+    if ( isName( first, "def" ) )
+        return scanFunction( s, 0 );
+    if ( isName( first, "class" ) )
+        return scanClass( s );
+    if ( async && isName( & s->tokens[ 1 ], "def" ) )
+        return scanFunction( s, 1 );
+    if ( async && ( isName( & s->tokens[ 1 ], "for" ) ||
+                    isName( & s->tokens[ 1 ], "with" ) ) )
+        return scanCompound( s, 1 );
+    if ( isCompoundKeyword( first ) || softCompound )
+        return scanCompound( s, 0 );
+    return scanSimpleStatements( s, 0, s->count - 1, 1,
+                                 ! skipsFunctionBody( s->context,
+                                                      block->scope ) );
+}
+
+
+/* Tells if a line of a skipped function body needs the full scan: a
+ * definition, a decorator or the docstring */
+static int
+needsFullScan( const struct scanner *  s, const struct scanToken *  first )
+{
+    if ( s->withDecorators || isOp( first, "@" ) )
+        return 1;
+    if ( first->kind == SCAN_STRING )
+        return s->blocks[ s->blockCount - 1 ].checkDocstring;
+    return first->kind == SCAN_NAME &&
+           ( isName( first, "def" ) || isName( first, "class" ) ||
+             isName( first, "async" ) );
+}
+
+
+/* The characters skipLogicalLine() looks at: 1 - always, 2 - when an
+ * instance attribute assignment is looked for */
+static const unsigned char  skipStops[ 256 ] = {
+    [ '\0' ] = 1, [ '\n' ] = 1, [ '\r' ] = 1, [ '#' ] = 1, [ '\\' ] = 1,
+    [ '"' ] = 1, [ '\'' ] = 1, [ '(' ] = 1, [ ')' ] = 1, [ '[' ] = 1,
+    [ ']' ] = 1, [ '{' ] = 1, [ '}' ] = 1, [ '.' ] = 2, [ '=' ] = 2 };
+
+
+/* Provides the start of the identifier which ends at the given position */
+static const char *
+getIdentifierStart( const struct scanner *  s, const char *  end )
+{
+    while ( end > s->buffer && isIdentifierChar( end[ -1 ] ) )
+        --end;
+    return end;
+}
+
+
+/* Skips the rest of a logical line of a skipped function body. The tokens
+ * are not built: only the strings, the brackets and the line ends are
+ * recognized. A line which ends with ':' opens a block of the same scope.
+ * Provides 2 and restores the position after the first token if the line
+ * looks like an assignment to an instance attribute. */
+static int
+skipLogicalLine( struct scanner *  s, const struct scanToken *  first )
+{
+    struct scanBlock *  block = & s->blocks[ s->blockCount - 1 ];
+    const char *        lastEnd = first->start + first->length;
+    int                 lastLine = first->lastLine;
+    const char *        lineEnd = NULL;     /* before a comment */
+    int                 attributes = block->scope == CLASS_METHOD_SCOPE &&
+                                     block->firstArgName != NULL &&
+                                     ! block->silent &&
+                                     wants( s->context,
+                                            INSTANCE_ATTRIBUTE_EVENT );
+    unsigned char       stops = attributes ? 3 : 1;
+    int                 attribute = 0;
+    struct scanToken    t;
+
+    /* The tokenizer state to scan the line again; the first token could
+     * only be an opening bracket */
+    const char *        savedCur = s->cur;
+    const char *        savedLineStart = s->lineStart;
+    int                 savedLineShift = s->lineShift;
+    int                 savedLine = s->line;
+    int                 savedDepth = s->depth;
+    char                savedBracket = s->brackets[ 0 ];
+
+    for ( ; ; )
+    {
+        const char *    p = s->cur;
+
+        while ( ( skipStops[ (unsigned char) *p ] & stops ) == 0 )
+            ++p;
+        s->cur = p;
+
+        char    c = *p;
+        if ( c == '\0' || c == '\n' || c == '\r' || c == '\\' )
+        {
+            /* The last token of the physical line ends the logical one so
+             * far */
+            const char *    end = lineEnd != NULL ? lineEnd : p;
+
+            while ( end > s->lineStart &&
+                    ( end[ -1 ] == ' ' || end[ -1 ] == '\t' ||
+                      end[ -1 ] == '\014' ) )
+                --end;
+            if ( end > s->lineStart )
+            {
+                lastEnd = end;
+                lastLine = s->line;
+            }
+            lineEnd = NULL;
+        }
+
+        if ( c == '\0' )
+        {
+            if ( s->depth > 0 )
+                return scanEofError( s, NULL, "unexpected EOF while parsing" );
+            break;
+        }
+        if ( c == '\n' || c == '\r' )
+        {
+            skipLineEnd( s );
+            if ( s->depth == 0 )
+            {
+                s->atLineStart = 1;
+                break;
+            }
+            continue;
+        }
+        if ( c == '\\' )
+        {
+            char    next = p[ 1 ];
+            if ( next == '\n' || next == '\r' )
+            {
+                ++s->cur;
+                skipLineEnd( s );
+                continue;
+            }
+            if ( next == '\0' )
+                return scanEofError( s, NULL, "unexpected EOF while parsing" );
+            return scanLineError( s, p + 2,
+                "unexpected character after line continuation character" );
+        }
+
+        switch ( c )
+        {
+            case '#':
+                lineEnd = p;
+                while ( ! isLineEnd( *s->cur ) )
+                    ++s->cur;
+                break;
+            case '"':
+            case '\'':
+                {
+                    const char *    prefix = getIdentifierStart( s, p );
+                    int             formatted = 0;
+
+                    if ( ! isStringPrefix( prefix, p - prefix, & formatted ) )
+                        formatted = 0;
+                    if ( scanString( s, formatted ) != 0 )
+                        return 1;
+                }
+                break;
+            case '(':
+            case '[':
+            case '{':
+                startToken( s, & t, SCAN_OP );
+                if ( s->depth >= SCAN_MAX_BRACKETS )
+                    return scanTokenError( s, & t,
+                                           "too many nested parentheses" );
+                s->brackets[ s->depth++ ] = c;
+                ++s->cur;
+                break;
+            case ')':
+            case ']':
+            case '}':
+                {
+                    char    open = c == ')' ? '(' : ( c == ']' ? '[' : '{' );
+
+                    startToken( s, & t, SCAN_OP );
+                    if ( s->depth == 0 || s->brackets[ s->depth - 1 ] != open )
+                        return scanTokenError( s, & t, "invalid syntax" );
+                    --s->depth;
+                    ++s->cur;
+                }
+                break;
+            case '.':
+                {
+                    const char *    name = getIdentifierStart( s, p );
+
+                    if ( p - name == block->firstArgLength &&
+                         strncmp( name, block->firstArgName,
+                                  block->firstArgLength ) == 0 )
+                        attribute = 1;
+                    ++s->cur;
+                }
+                break;
+            default:    /* '=' */
+                if ( attribute && s->depth == 0 && p[ 1 ] != '=' &&
+                     strchr( "=!<>+-*/%&|^@:", p[ -1 ] ) == NULL )
+                {
+                    s->cur = savedCur;
+                    s->lineStart = savedLineStart;
+                    s->lineShift = savedLineShift;
+                    s->line = savedLine;
+                    s->depth = savedDepth;
+                    s->brackets[ 0 ] = savedBracket;
+                    return 2;
+                }
+                s->cur += p[ 1 ] == '=' ? 2 : 1;
+                break;
+        }
+    }
+
+    block->checkDocstring = 0;
+    s->lineHasTokens = 0;
+    s->prevEnd = s->lastEnd;
+    s->prevLine = s->lastLine;
+    s->lastEnd = lastEnd;
+    s->lastLine = lastLine;
+    if ( lastEnd[ -1 ] == ':' )
+        openBlock( s, block->scope, block->objectsLevel,
+                   block->firstArgName, block->firstArgLength,
+                   block->silent, 0, 0, -1, 0 );
+    return 0;
+}
+
+
+/* Reads the rest of the logical line which starts with the given token */
+static int
+readLogicalLine( struct scanner *  s, const struct scanToken *  first )
+{
+    s->prevEnd = s->lastEnd;
+    s->prevLine = s->lastLine;
+    s->tokens[ 0 ] = *first;
+    s->count = 1;
+
+    while ( s->tokens[ s->count - 1 ].kind != SCAN_NEWLINE )
+    {
+        if ( s->count == s->capacity )
+        {
+            int                 capacity = s->capacity * 2;
+            struct scanToken *  tokens = (struct scanToken *)
+                arenaGrow( s->arena, s->tokens,
+                           s->capacity * sizeof( struct scanToken ),
+                           capacity * sizeof( struct scanToken ) );
+            if ( tokens == NULL )
+            {
+                s->noMemory = 1;
+                return 1;
+            }
+            s->tokens = tokens;
+            s->capacity = capacity;
+        }
+        if ( scanNextToken( s, & s->tokens[ s->count ] ) != 0 )
+            return 1;
+        ++s->count;
+    }
+
+    const struct scanToken *    last = & s->tokens[ s->count - 2 ];
+    s->lastEnd = last->start + last->length;
+    s->lastLine = last->lastLine;
+    return 0;
+}
+
+
+static int
+scanStatements( struct scanner *  s )
+{
+    struct scanToken    t;
+
+    for ( ; ; )
+    {
+        if ( isCancelled( s->context ) )
+            return 0;
+        if ( scanNextToken( s, & t ) != 0 )
+            return 1;
+
+        if ( t.kind == SCAN_INDENT )
+        {
+            if ( ! s->hasPending )
+            {
+                const char *    lineEnd = t.start;
+                while ( ! isLineEnd( *lineEnd ) )
+                    ++lineEnd;
+                return scanError( s, t.line, t.col, "unexpected indent",
+                                  t.start - t.col, lineEnd );
+            }
+            s->blocks[ s->blockCount++ ] = s->pending;
+            s->hasPending = 0;
+            continue;
+        }
+        if ( t.kind == SCAN_DEDENT || t.kind == SCAN_END )
+        {
+            if ( s->hasPending && *t.start == '\0' )
+                return scanEofError( s, NULL, "unexpected EOF while parsing" );
+            if ( s->hasPending )
+                return scanTokenError( s, & t, "expected an indented block" );
+            if ( s->withDecorators )
+            {
+                if ( *t.start == '\0' )
+                    return scanEofError( s, NULL,
+                                         "unexpected EOF while parsing" );
+            {
+                const char *    lineEnd = t.start;
+                while ( ! isLineEnd( *lineEnd ) )
+                    ++lineEnd;
+                return scanError( s, t.line, t.col, "unexpected unindent",
+                                  t.start - t.col, lineEnd );
+            }
+            }
+            if ( t.kind == SCAN_END )
+            {
+                finishTopStatement( s, s->lastEnd, s->lastLine );
+                return 0;
+            }
+
+            struct scanBlock *  block = & s->blocks[ --s->blockCount ];
+            setContentHash( s, block->record, block->start,
+                            s->lastEnd, s->lastLine );
+            continue;
+        }
+
+        if ( s->hasPending )
+            return scanTokenError( s, & t, "expected an indented block" );
+        const struct scanBlock *    block = & s->blocks[ s->blockCount - 1 ];
+        if ( t.kind != SCAN_NEWLINE &&
+             ( ( block->silent &&
+                 ( s->context->mask & TOP_LEVEL_ONLY_OPTION ) ) ||
+               ( skipsFunctionBody( s->context, block->scope ) &&
+                 ! needsFullScan( s, & t ) ) ) )
+        {
+            int     status = skipLogicalLine( s, & t );
+
+            if ( status == 0 )
+                continue;
+            if ( status == 1 )
+                return 1;
+        }
+        if ( readLogicalLine( s, & t ) != 0 || scanLogicalLine( s ) != 0 )
+            return 1;
+        if ( s->noMemory )
+            return 1;
+        if ( s->stopped )
+        {
+            finishTopStatement( s, s->prevEnd, s->prevLine );
+            return 0;
+        }
+    }
+}
+
+
+/* The normalized encoding name the same way the interpreter's tokenizer
+ * makes it */
+static void
+normalizeEncodingName( const char *  name, int  length,
+                       char *  buffer, int  size )
+{
+    char    lowered[ 13 ];
+    int     k;
+
+    for ( k = 0; k < 12 && k < length; ++k )
+        lowered[ k ] = name[ k ] == '_' ? '-' : tolower( (unsigned char) name[ k ] );
+    lowered[ k ] = '\0';
+
+    if ( strcmp( lowered, "utf-8" ) == 0 || strncmp( lowered, "utf-8-", 6 ) == 0 )
+        snprintf( buffer, size, "utf-8" );
+    else if ( strcmp( lowered, "latin-1" ) == 0 ||
+              strcmp( lowered, "iso-8859-1" ) == 0 ||
+              strcmp( lowered, "iso-latin-1" ) == 0 ||
+              strncmp( lowered, "latin-1-", 8 ) == 0 ||
+              strncmp( lowered, "iso-8859-1-", 11 ) == 0 ||
+              strncmp( lowered, "iso-latin-1-", 12 ) == 0 )
+        snprintf( buffer, size, "iso-8859-1" );
+    else
+        snprintf( buffer, size, "%.*s", length, name );
+}
+
+
+/* Looks for the coding spec in a line; 1 if the line is not a comment */
+static int
+getCodingSpec( const char *  line, int  size, char *  buffer, int  bufferSize,
+               int *  found )
+{
+    int     k;
+
+    *found = 0;
+    for ( k = 0; k < size - 6; ++k )
+    {
+        if ( line[ k ] == '#' )
+            break;
+        if ( line[ k ] != ' ' && line[ k ] != '\t' && line[ k ] != '\014' )
+            return 1;
+    }
+    for ( ; k < size - 6; ++k )
+    {
+        const char *    t = line + k;
+
+        if ( strncmp( t, "coding", 6 ) != 0 || ( t[ 6 ] != ':' && t[ 6 ] != '=' ) )
+            continue;
+
+        t += 7;
+        while ( *t == ' ' || *t == '\t' )
+            ++t;
+
+        const char *    begin = t;
+        while ( isalnum( (unsigned char) *t ) ||
+                *t == '-' || *t == '_' || *t == '.' )
+            ++t;
+        if ( begin < t )
+        {
+            normalizeEncodingName( begin, t - begin, buffer, bufferSize );
+            *found = 1;
+            return 0;
+        }
+    }
+
+    /* Without a coding spec the line must be blank or a comment for the
+     * second line to be checked */
+    for ( k = 0; k < size; ++k )
+    {
+        if ( line[ k ] == '#' )
+            return 0;
+        if ( line[ k ] != ' ' && line[ k ] != '\t' && line[ k ] != '\014' )
+            return 1;
+    }
+    return 0;
+}
+
+
+/* Provides 1 and the declared encoding of the code: either the BOM or the
+ * coding spec in one of the first two lines, PEP 263. -1 if the BOM and the
+ * coding spec do not agree. */
+static int
+getDeclaredEncoding( const char *  buffer, char *  name, int  size )
+{
+    const char *    line = buffer;
+    int             bom = strncmp( buffer, "\xEF\xBB\xBF", 3 ) == 0;
+    int             found;
+
+    if ( bom )
+        line += 3;
+    for ( int  k = 0; k < 2; ++k )
+    {
+        const char *    end = line;
+        while ( ! isLineEnd( *end ) )
+            ++end;
+
+        if ( getCodingSpec( line, end - line, name, size, & found ) != 0 )
+            break;
+        if ( found )
+            return ( bom && strcmp( name, "utf-8" ) != 0 ) ? -1 : 1;
+        if ( *end == '\0' )
+            break;
+        line = end + ( ( end[ 0 ] == '\r' && end[ 1 ] == '\n' ) ? 2 : 1 );
+    }
+
+    if ( bom )
+        snprintf( name, size, "utf-8" );
+    return bom;
+}
+
+
+/* The same as processEncoding() does */
+static void
+scanEncoding( struct scanner *  s )
+{
+    char            name[ 128 ];
+
+    if ( ! wants( s->context, ENCODING_EVENT ) ||
+         getDeclaredEncoding( s->buffer, name, sizeof( name ) ) <= 0 )
+        return;
+
+    const char *    start = strstr( s->buffer, name );
+    if ( start == NULL )
+        return;
+
+    const char *    lineStart = start;
+    while ( lineStart != s->buffer &&
+            lineStart[ -1 ] != '\n' && lineStart[ -1 ] != '\r' )
+        --lineStart;
+
+    struct parserEvent  event = { .kind = ENCODING_EVENT,
+                                  .name = name,
+                                  .nameLength = strlen( name ),
+                                  .line = 1 + countLineEnds( s->buffer, start ),
+                                  .pos = start - lineStart + 1,
+                                  .absPosition = start - s->buffer };
+    emitEvent( s->context, & event );
+}
+
+
+/* Scans the code and records the found items into context->events. If
+ * there is an error then only the error is reported, the same as with the
+ * interpreter's parser. The top level statements starts are provided as
+ * ( absPosition, line ) pairs if asked. If the code was converted to UTF-8
+ * then the converted one is scanned while the positions and the hashes
+ * are for the buffer as the interpreter's parser has them. No Python API
+ * is used. */
+static void
+scanCode( const char *  buffer, const char *  converted,
+          struct arena *  arena, struct parserContext *  context,
+          int **  starts, int *  startsCount )
+{
+    struct eventBuffer *    events = context->events;
+    struct scanner *        s = (struct scanner *) arenaAlloc( arena,
+                                                sizeof( struct scanner ) );
+    int                     count = events->count;
+    int                     poolSize = events->poolSize;
+
+    if ( s == NULL )
+    {
+        events->failed = 1;
+        return;
+    }
+
+    memset( s, 0, sizeof( struct scanner ) );
+    s->arena = arena;
+    s->context = context;
+    s->source = buffer;
+    if ( converted != NULL )
+    {
+        buffer = converted;
+        s->sourceLinesCapacity = 256;
+        s->sourceLines = (int *) arenaAlloc( arena, s->sourceLinesCapacity *
+                                                    sizeof( int ) );
+        if ( s->sourceLines == NULL )
+            s->noMemory = 1;
+        else
+            s->sourceLines[ 0 ] = 0;
+    }
+    s->buffer = buffer;
+    s->cur = buffer;
+    s->lineStart = buffer;
+    s->line = 1;
+    s->atLineStart = 1;
+    s->statement = -1;
+    s->collectStarts = starts != NULL;
+    s->blockCount = 1;
+    s->blocks[ 0 ].scope = GLOBAL_SCOPE;
+    s->blocks[ 0 ].objectsLevel = -1;
+    s->blocks[ 0 ].checkDocstring = wants( context, DOCSTRING_EVENT );
+    s->blocks[ 0 ].record = -1;
+    if ( strncmp( buffer, "\xEF\xBB\xBF", 3 ) == 0 )
+    {
+        /* The columns are counted after the BOM */
+        s->cur += 3;
+        s->lineStart += 3;
+    }
+
+    s->capacity = 256;
+    s->tokens = (struct scanToken *) arenaAlloc( arena, s->capacity *
+                                                 sizeof( struct scanToken ) );
+
+    if ( s->tokens == NULL )
+        s->noMemory = 1;
+    else if ( ! s->noMemory )
+    {
+        scanEncoding( s );
+        scanStatements( s );
+    }
+
+    if ( s->failed && ! s->noMemory )
+    {
+        /* Only the error is reported */
+        struct parserEvent  event = { .kind = ERROR_EVENT,
+                                      .name = s->text.data,
+                                      .nameLength = s->text.length };
+
+        events->count = count;
+        events->poolSize = poolSize;
+        s->startsCount = 0;
+        emitEvent( context, & event );
+    }
+    if ( s->noMemory )
+        events->failed = 1;
+
+    /* Everything else goes with the arena release */
+    if ( starts != NULL )
+    {
+        *starts = s->starts;
+        *startsCount = s->startsCount;
+    }
+}
+
+
+/* The scanner needs UTF-8. The code in another declared encoding is
+ * converted with the interpreter's codecs, so the GIL is needed. Provides 0
+ * and NULL if there is no need in conversion, 0 and the converted code in
+ * the arena, 1 if the code cannot be decoded and -1 with the exception set
+ * if there is no memory. */
+static int
+decodeCode( const char *  buffer, struct arena *  arena, char **  converted )
+{
+    char            name[ 128 ];
+    Py_ssize_t      size;
+
+    *converted = NULL;
+    switch ( getDeclaredEncoding( buffer, name, sizeof( name ) ) )
+    {
+        case -1:
+            return 1;
+        case 0:
+            return 0;
+    }
+    if ( strcmp( name, "utf-8" ) == 0 )
+        return 0;
+
+    PyObject *      text = PyUnicode_Decode( buffer, strlen( buffer ),
+                                             name, "strict" );
+    const char *    utf8 = text == NULL ? NULL
+                                        : PyUnicode_AsUTF8AndSize( text, & size );
+    if ( utf8 == NULL )
+    {
+        Py_XDECREF( text );
+        PyErr_Clear();
+        return 1;
+    }
+
+    *converted = (char *) arenaAlloc( arena, size + 1 );
+    if ( *converted == NULL )
+    {
+        Py_DECREF( text );
+        PyErr_NoMemory();
+        return -1;
+    }
+    memcpy( *converted, utf8, size + 1 );
+    Py_DECREF( text );
+    return 0;
+}
+
+
+/* Tells if decodeCode() has anything to do, i.e. if the GIL is needed */
+static int
+needsDecoding( const char *  buffer )
+{
+    char    name[ 128 ];
+
+    int     declared = getDeclaredEncoding( buffer, name, sizeof( name ) );
+
+    return declared < 0 || ( declared > 0 && strcmp( name, "utf-8" ) != 0 );
+}
+
+
+/* The same the interpreter's parser reports for the undecodable code */
+static void
+emitDecodeError( struct parserContext *  context )
+{
+    struct parserEvent  event = { .kind = ERROR_EVENT,
+                                  .name = "0:0 decode error",
+                                  .nameLength = 16 };
+    emitEvent( context, & event );
+}
+
+
+#ifdef CDM_INTERPRETER_PARSER
+static void getErrorMessage( char *  buffer, perrdetail *  err)
+{
+    sprintf( buffer, "%d:%d ", err->lineno, err->offset );
+    int     len = strlen( buffer );
+
+    switch ( err->error )
+    {
+        case E_ERROR:
+            sprintf( buffer,
+                     "execution error" );
+            return;
+        case E_SYNTAX:
+            if ( err->expected == INDENT )
+                sprintf( & buffer[ len ],
+                         "expected an indented block" );
+            else if ( err->token == INDENT )
+                sprintf( & buffer[ len ],
+                         "unexpected indent" );
+            else if (err->token == DEDENT)
+                sprintf( & buffer[ len ],
+                         "unexpected unindent" );
+            else
+                sprintf( & buffer[ len ],
+                         "invalid syntax" );
+            break;
+        case E_TOKEN:
+            sprintf( & buffer[ len ],
+                     "invalid token" );
+            break;
+        case E_EOFS:
+            sprintf( & buffer[ len ],
+                     "EOF while scanning triple-quoted string literal" );
+            break;
+        case E_EOLS:
+            sprintf( & buffer[ len ],
+                     "EOL while scanning string literal" );
+            break;
+        case E_INTR:
+            sprintf( buffer,
+                     "keyboard interrupt" );
+            goto cleanup;
+        case E_NOMEM:
+            sprintf( buffer,
+                    "no memory" );
+            goto cleanup;
+        case E_EOF:
+            sprintf( & buffer[ len ],
+                     "unexpected EOF while parsing" );
+            break;
+        case E_TABSPACE:
+            sprintf( & buffer[ len ],
+                     "inconsistent use of tabs and spaces in indentation" );
+            break;
+        case E_OVERFLOW:
+            sprintf( & buffer[ len ],
+                     "expression too long" );
+            break;
+        case E_DEDENT:
+            sprintf( & buffer[ len ],
+                     "unindent does not match any outer indentation level" );
+            break;
+        case E_TOODEEP:
+            sprintf( & buffer[ len ],
+                     "too many levels of indentation" );
+            break;
+        case E_DECODE:
+            sprintf( & buffer[ len ],
+                     "decode error" );
+            break;
+        case E_LINECONT:
+            sprintf( & buffer[ len ],
+                     "unexpected character after line continuation character" );
+            break;
+        default:
+            sprintf( & buffer[ len ],
+                     "unknown parsing error (error code %d)", err->error);
+            break;
+    }
+
+    /* The text may be a long multiline string so it is truncated */
+    if ( err->text != NULL )
+    {
+        len = strlen( buffer );
+        snprintf( & buffer[ len ], MAX_ERROR_MSG_SIZE - len,
+                  "\n%s", err->text );
+    }
+
+    cleanup:
+    if (err->text != NULL)
+    {
+        PyObject_FREE(err->text);
+        err->text = NULL;
+    }
+}
+
+
+
+static void processEncoding( char *                         buffer,
+                             node *                         tree,
+                             struct parserContext *         context )
+{
+    /* Unfortunately, the parser does not provide the position of the encoding
+     * so it needs to be calculated
+     */
+    char *      start = strstr( buffer, tree->n_str );
+    if ( start == NULL )
+        return;     /* would be really strange */
+
+    int         line = 1 + countLineEnds( buffer, start );
+    char *      lineStart = start;
+    while ( lineStart != buffer &&
+            lineStart[ -1 ] != '\n' && lineStart[ -1 ] != '\r' )
+        --lineStart;
+    int         col = start - lineStart + 1;
+
+    struct parserEvent  event = { .kind = ENCODING_EVENT,
+                                  .name = tree->n_str,
+                                  .nameLength = strlen( tree->n_str ),
+                                  .line = line,
+                                  .pos = col,
+                                  .absPosition = start - buffer };
+    emitEvent( context, & event );
+}
+#endif
+
+
+enum FileStatus
+{
+    FILE_OK,
+    FILE_CANNOT_OPEN,
+    FILE_CANNOT_READ,
+    FILE_NO_MEMORY
+};
+
+struct fileJob
+{
+    const char *            fileName;
+    struct eventBuffer      events;
+    enum FileStatus         status;
+    int                     finished;
+};
+
+struct filePool
+{
+    struct fileJob *        jobs;
+    int                     count;
+    int                     next;           /* the next job to take */
+    int                     cancelled;
+    int                     mask;
+    pthread_mutex_t         lock;
+    pthread_cond_t          finished;
+};
+
+
+/* The file content as the parser needs it, i.e. terminated with '\0' */
+struct fileContent
+{
+    char *      buffer;         /* NULL for an empty file */
+    size_t      size;
+    size_t      fileSize;       /* as reported by stat */
+    int64_t     mtime;          /* nanoseconds */
+};
+
+
+static int64_t
+getModificationTime( const struct stat *  st )
+{
+#ifdef __APPLE__
+    return (int64_t) st->st_mtimespec.tv_sec * 1000000000 +
+           st->st_mtimespec.tv_nsec;
+#else
+    return (int64_t) st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+#endif
+}
+
+
+/* Reads the file content into a heap buffer terminated with "\n\0" */
+static enum FileStatus
+readFileContent( int  fd, size_t  size, struct fileContent *  content )
+{
+    size_t      total = 0;
+
+    content->buffer = (char *)malloc( size + 2 );
+    if ( content->buffer == NULL )
+        return FILE_NO_MEMORY;
+
+    while ( total < size )
+    {
+        ssize_t     count = read( fd, content->buffer + total, size - total );
+        if ( count < 0 && errno == EINTR )
+            continue;
+        if ( count <= 0 )
+        {
+            free( content->buffer );
+            content->buffer = NULL;
+            return FILE_CANNOT_READ;
+        }
+        total += count;
+    }
+
+    content->buffer[ size ] = '\n';
+    content->buffer[ size + 1 ] = '\0';
+    content->size = size + 1;
+    return FILE_OK;
+}
+
+
+/* Provides the file content in a heap buffer. The file is read once and
+ * the parse runs over that copy, so a file changed or truncated by another
+ * process meanwhile gives a short read and not a fault. No Python API is
+ * used. */
+static enum FileStatus
+openFileContent( const char *  fileName, struct fileContent *  content )
+{
+    struct stat         st;
+    enum FileStatus     status = FILE_OK;
+
+    memset( content, 0, sizeof( struct fileContent ) );
+
+    int     fd = open( fileName, O_RDONLY );
+    if ( fd < 0 )
+        return FILE_CANNOT_OPEN;
+
+    if ( fstat( fd, &st ) != 0 )
+    {
+        close( fd );
+        return FILE_CANNOT_READ;
+    }
+
+    content->fileSize = st.st_size;
+    content->mtime = getModificationTime( & st );
+    if ( st.st_size > 0 )
+        status = readFileContent( fd, st.st_size, content );
+
+    close( fd );
+    return status;
+}
+
+
+static void
+closeFileContent( struct fileContent *  content )
+{
+    free( content->buffer );
+    memset( content, 0, sizeof( struct fileContent ) );
+}
+
+
+#ifdef CDM_INTERPRETER_PARSER
+/* Walks the tree and reports the found items */
+static void
+walkTree( node *                    tree,
+          char *                    buffer,
+          int *                     lineShifts,
+          struct arena *            arena,
+          struct parserContext *    context )
+{
+    node *      root = tree;
+
+    context->buffer = buffer;
+    context->arena = arena;
+    if ( root->n_type == encoding_decl )
+    {
+        if ( wants( context, ENCODING_EVENT ) )
+            processEncoding( buffer, tree, context );
+        root = & (root->n_child[ 0 ]);
+    }
+
+    assert( root->n_type == file_input );
+    walk( root, context, -1, GLOBAL_SCOPE, NULL, 0, lineShifts, 0 );
+}
+
+
+/* Appends ( absPosition, line ) of each top level statement to the list */
+static int
+collectStatements( node *  tree, int *  lineShifts, PyObject *  statements )
+{
+    if ( tree->n_type != file_input )
+        tree = & ( tree->n_child[ 0 ] );
+
+    node *      child;
+    int         n = tree->n_nchildren;
+    for ( int  k = 0; k < n; ++k )
+    {
+        child = & ( tree->n_child[ k ] );
+        if ( child->n_type != stmt )
+            continue;
+
+        PyObject *  item = Py_BuildValue( "(ii)",
+                                          lineShifts[ child->n_lineno ] +
+                                          child->n_col_offset,
+                                          child->n_lineno );
+        if ( item == NULL )
+            return 1;
+        if ( PyList_Append( statements, item ) != 0 )
+        {
+            Py_DECREF( item );
+            return 1;
+        }
+        Py_DECREF( item );
+    }
+    return 0;
+}
+#endif
+
+
+static PyObject *  parseCancelledError = NULL;
+
+
+/* What finds the items in the code */
+enum ParserBackend
+{
+    INTERPRETER_PARSER_BACKEND,     /* the interpreter's parser and walk() */
+    SCANNER_BACKEND                 /* the structural scanner */
+};
+
+static const char *     parserBackendNames[] = { "parser", "scanner" };
+
+#ifdef CDM_INTERPRETER_PARSER
+static enum ParserBackend   parserBackend = INTERPRETER_PARSER_BACKEND;
+#else
+static enum ParserBackend   parserBackend = SCANNER_BACKEND;
+#endif
+
+
+static PyObject *
+setCancelledError( void )
+{
+    PyErr_SetString( parseCancelledError, "The parse has been cancelled" );
+    return NULL;
+}
+
+
+/* Finds the items with the structural scanner. The scanning is done
+ * without the GIL; the items are recorded and then delivered to the context
+ * if it is not a recording one. */
+static PyObject *
+scan_input( const char *  buffer, struct parserContext *  context )
+{
+    struct eventBuffer      events;
+    struct parserContext    recorder;
+    struct parserContext *  target = context;
+    struct arena *          arena = getThreadArena();
+    struct arenaMark        mark;
+    char *                  converted = NULL;
+    int *                   starts = NULL;
+    int                     startsCount = 0;
+    int                     status;
+
+    if ( context->cancel != NULL && checkCancelled( context->cancel ) )
+        return setCancelledError();
+    if ( arena == NULL )
+        return PyErr_NoMemory();
+
+    /* The callbacks may parse other files on the thread, so the memory of
+     * this parse stays allocated till the very end */
+    mark = saveArena( arena );
+    status = decodeCode( buffer, arena, & converted );
+    if ( status < 0 )
+    {
+        releaseArena( arena, mark );
+        return NULL;
+    }
+    if ( status > 0 )
+        emitDecodeError( context );
+    else
+    {
+        if ( context->events == NULL )
+        {
+            initEventBuffer( & events );
+            memset( & recorder, 0, sizeof( struct parserContext ) );
+            recorder.events = & events;
+            recorder.mask = context->mask;
+            recorder.cancel = context->cancel;
+            target = & recorder;
+        }
+
+        Py_BEGIN_ALLOW_THREADS
+        scanCode( buffer, converted, arena, target,
+                  context->statements != NULL ? & starts : NULL,
+                  & startsCount );
+        Py_END_ALLOW_THREADS
+
+        if ( target != context )
+        {
+            if ( events.failed )
+                PyErr_NoMemory();
+            else
+                replayEvents( & events, context );
+            clearEventBuffer( & events );
+            clearUniqueNames( & recorder.names );
+        }
+    }
+
+    for ( int  k = 0; k < startsCount && ! PyErr_Occurred(); k += 2 )
+    {
+        PyObject *  item = Py_BuildValue( "(ii)", starts[ k ],
+                                          starts[ k + 1 ] );
+        if ( item != NULL )
+        {
+            PyList_Append( context->statements, item );
+            Py_DECREF( item );
+        }
+    }
+    releaseArena( arena, mark );
+
+    if ( PyErr_Occurred() )
+        return NULL;
+    if ( context->cancel != NULL && context->cancel->cancelled )
+        return setCancelledError();
+
+    Py_INCREF( Py_None );
+    return Py_None;
+}
+
+
+static PyObject *
+parse_input( char *                         buffer,
+             const char *                   fileName,
+             struct parserContext *         context )
+{
+#ifdef CDM_INTERPRETER_PARSER
+    perrdetail          error;
+    PyCompilerFlags     flags = { 0 };
+    node *              tree;
+
+    if ( parserBackend == SCANNER_BACKEND )
+        return scan_input( buffer, context );
+
+    /* The interpreter's parser itself cannot be interrupted so the
+     * cancellation is checked before and after it and then by the walker */
+    if ( context->cancel != NULL && checkCancelled( context->cancel ) )
+        return setCancelledError();
+
+    tree = PyParser_ParseStringFlagsFilename( buffer, fileName,
+                                              &_PyParser_Grammar,
+                                              file_input, &error,
+                                              flags.cf_flags );
+    if ( context->cancel != NULL && checkCancelled( context->cancel ) )
+    {
+        if ( tree == NULL )
+            PyErr_Clear();
+        else
+            PyNode_Free( tree );
+        return setCancelledError();
+    }
+
+    if ( tree == NULL )
+    {
+        char        buffer[ MAX_ERROR_MSG_SIZE ];
+
+        getErrorMessage( buffer, & error );
+        PyErr_Clear();
+
+        struct parserEvent  event = { .kind = ERROR_EVENT,
+                                      .name = buffer,
+                                      .nameLength = strlen( buffer ) };
+        emitEvent( context, & event );
+    }
+    else
+    {
+        int                 totalLines = getTotalLines( tree );
+        struct arena *      arena = getThreadArena();
+
+        assert( totalLines >= 0 );
+        if ( arena == NULL )
+        {
+            PyNode_Free( tree );
+            return PyErr_NoMemory();
+        }
+
+        struct arenaMark    mark = saveArena( arena );
+        int *               lineShifts = (int *) arenaAlloc( arena,
+                                    ( totalLines + 1 ) * sizeof( int ) );
+        if ( lineShifts == NULL )
+        {
+            releaseArena( arena, mark );
+            PyNode_Free( tree );
+            return PyErr_NoMemory();
+        }
+
+        /* The recorded events do not need the GIL at all; otherwise only the
+         * buffer scan could be done without it */
+        Py_BEGIN_ALLOW_THREADS
+        calculateLineShifts( buffer, lineShifts, totalLines );
+        if ( context->events != NULL )
+            walkTree( tree, buffer, lineShifts, arena, context );
+        Py_END_ALLOW_THREADS
+
+        if ( context->events == NULL )
+            walkTree( tree, buffer, lineShifts, arena, context );
+        if ( context->statements != NULL && ! PyErr_Occurred() )
+            collectStatements( tree, lineShifts, context->statements );
+        releaseArena( arena, mark );
+        PyNode_Free( tree );
+    }
+
+    if ( PyErr_Occurred() )
+        return NULL;
+    if ( context->cancel != NULL && context->cancel->cancelled )
+        return setCancelledError();
+
+    Py_INCREF( Py_None );
+    return Py_None;
+#else
+    return scan_input( buffer, context );
+#endif
+}
+
+
+/* Sets the exception which corresponds to the file reading failure */
+static PyObject *
+setFileStatusError( enum FileStatus  status )
+{
+    switch ( status )
+    {
+        case FILE_CANNOT_OPEN:
+            PyErr_SetString( PyExc_RuntimeError, "Cannot open file" );
+            return NULL;
+        case FILE_CANNOT_READ:
+            PyErr_SetString( PyExc_RuntimeError, "Cannot read file" );
+            return NULL;
+        default:
+            return PyErr_NoMemory();
+    }
+}
+
+
+/* Reads the file and parses its content */
+static PyObject *
+parse_file( const char *  fileName, struct parserContext *  context )
+{
+    struct fileContent  content;
+    enum FileStatus     status;
+    PyObject *          retValue;
+
+    Py_BEGIN_ALLOW_THREADS
+    status = openFileContent( fileName, & content );
+    Py_END_ALLOW_THREADS
+
+    if ( status != FILE_OK )
+        return setFileStatusError( status );
+
+    if ( content.buffer == NULL )
+    {
+        /* Empty file */
+        Py_INCREF( Py_None );
+        return Py_None;
+    }
+
+    retValue = parse_input( content.buffer, fileName, context );
+    closeFileContent( & content );
+    return retValue;
+}
+
+
+/*
+ * Persistent parse cache. Each source file has a cache file named after a
+ * hash of the source real path. The cache file holds the key and the events
+ * recorded for the source, so a hit needs neither the parser nor the walker:
+ * the events are replayed straight from the mapped cache file.
+ * The key is the source size and modification time. If the time differs but
+ * the size is the same then the content hash decides. The entries made by
+ * another parser backend or another extension version are not used.
+ */
+
+#define CACHE_MAGIC         0x43444d43      /* "CDMC" */
+#define CACHE_VERSION       2
+#define CACHE_FILE_SUFFIX   ".cdmcache"
+
+/* The cache file layout: the header, the source real path padded to 8 bytes
+ * and then the raw events exactly as eventBufferToBytes() makes them */
+struct cacheHeader
+{
+    int32_t     magic;
+    int32_t     version;            /* CACHE_VERSION */
+    int32_t     eventsVersion;      /* EVENT_BUFFER_VERSION */
+    int32_t     mask;               /* the events were collected with */
+    int32_t     backend;            /* the parser backend, ParserBackend */
+    int64_t     size;               /* the source file size */
+    int64_t     mtime;              /* the source modification time, ns */
+    uint64_t    hash;               /* the source content hash */
+    uint64_t    parserVersion;      /* CDM_PY_PARSER_VERSION hash */
+    int32_t     pathLength;
+    int32_t     eventsSize;
+};
+
+#define CACHE_PADDED( size )    ( ( (size) + 7 ) & ~ (size_t) 7 )
+
+struct cacheEntry
+{
+    void *                  address;    /* NULL if there is no valid entry */
+    size_t                  size;
+    struct cacheHeader      header;
+    struct eventBuffer      events;     /* refers to the mapped memory */
+};
+
+
+
+static uint64_t
+hashString( const char *  str )
+{
+    uint64_t    hash = 0xCBF29CE484222325ULL;      /* FNV-1a */
+
+    for ( const char *  c = str; *c != '\0'; ++c )
+        hash = ( hash ^ (unsigned char) *c ) * 0x100000001B3ULL;
+    return hash;
+}
+
+
+/* Provides 0 if the cache file name fits the buffer of PATH_MAX */
+static int
+getCachePath( const char *  cacheDir, const char *  key, char *  cachePath )
+{
+    int     length = snprintf( cachePath, PATH_MAX, "%s/%016llx%s", cacheDir,
+                               (unsigned long long) hashString( key ),
+                               CACHE_FILE_SUFFIX );
+    return length < 0 || length >= PATH_MAX;
+}
+
+
+static int
+isPoolRange( int  offset, int  length, int  poolSize )
+{
+    return offset >= 0 && length >= 0 && length <= poolSize &&
+           offset <= poolSize - length;
+}
+
+
+/* The cache file could be truncated, corrupted or written by another
+ * version, so everything is checked before the events are used */
+static int
+checkCacheEntry( struct cacheEntry *  entry, const char *  key, int  mask )
+{
+    const char *                data = (const char *) entry->address;
+    struct cacheHeader *        header = & entry->header;
+    struct eventBufferHeader    eventsHeader;
+    size_t                      keyLength = strlen( key );
+
+    memcpy( header, data, sizeof( struct cacheHeader ) );
+    if ( header->magic != CACHE_MAGIC ||
+         header->version != CACHE_VERSION ||
+         header->eventsVersion != EVENT_BUFFER_VERSION ||
+         header->mask != mask ||
+         header->backend != (int32_t) parserBackend ||
+         header->parserVersion != hashString( CDM_PY_PARSER_VERSION ) ||
+         header->pathLength != (int32_t) keyLength ||
+         header->eventsSize < (int32_t) sizeof( struct eventBufferHeader ) )
+        return 1;
+
+    size_t      eventsStart = sizeof( struct cacheHeader ) +
+                              CACHE_PADDED( keyLength );
+    if ( eventsStart + header->eventsSize != entry->size ||
+         memcmp( data + sizeof( struct cacheHeader ), key, keyLength ) != 0 )
+        return 1;
+
+    size_t      recordsSpace = header->eventsSize - sizeof( eventsHeader );
+
+    memcpy( & eventsHeader, data + eventsStart, sizeof( eventsHeader ) );
+    if ( eventsHeader.version != EVENT_BUFFER_VERSION ||
+         eventsHeader.count < 0 ||
+         (size_t) eventsHeader.count >
+                recordsSpace / sizeof( struct eventRecord ) )
+        return 1;
+
+    struct eventBuffer *    events = & entry->events;
+
+    events->records = (struct eventRecord *)( data + eventsStart +
+                                              sizeof( eventsHeader ) );
+    events->count = eventsHeader.count;
+    events->pool = (char *)( events->records + events->count );
+    events->poolSize = recordsSpace -
+                       events->count * sizeof( struct eventRecord );
+
+    for ( int  k = 0; k < events->count; ++k )
+    {
+        const struct eventRecord *  r = & events->records[ k ];
+
+        if ( r->kind < 0 || r->kind > STATEMENT_EVENT ||
+             ! isPoolRange( r->nameOffset, r->nameLength,
+                            events->poolSize ) ||
+             ! isPoolRange( r->annotationOffset, r->annotationLength,
+                            events->poolSize ) )
+            return 1;
+    }
+    return 0;
+}
+
+
+static void
+unmapCacheEntry( struct cacheEntry *  entry )
+{
+    if ( entry->address != NULL )
+        munmap( entry->address, entry->size );
+    memset( entry, 0, sizeof( struct cacheEntry ) );
+}
+
+
+/* Provides 0 if there is a valid cache entry for the source and mask */
+static int
+mapCacheEntry( const char *  cachePath, const char *  key, int  mask,
+               struct cacheEntry *  entry )
+{
+    struct stat     st;
+
+    memset( entry, 0, sizeof( struct cacheEntry ) );
+
+    int     fd = open( cachePath, O_RDONLY );
+    if ( fd < 0 )
+        return 1;
+
+    if ( fstat( fd, & st ) != 0 ||
+         st.st_size < (off_t) sizeof( struct cacheHeader ) )
+    {
+        close( fd );
+        return 1;
+    }
+
+    void *  address = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( address == MAP_FAILED )
+        return 1;
+
+    entry->address = address;
+    entry->size = st.st_size;
+    if ( checkCacheEntry( entry, key, mask ) != 0 )
+    {
+        unmapCacheEntry( entry );
+        return 1;
+    }
+    return 0;
+}
+
+
+static int
+writeAll( int  fd, const void *  data, size_t  size )
+{
+    const char *    current = (const char *) data;
+
+    while ( size > 0 )
+    {
+        ssize_t     count = write( fd, current, size );
+        if ( count < 0 && errno == EINTR )
+            continue;
+        if ( count <= 0 )
+            return 1;
+        current += count;
+        size -= count;
+    }
+    return 0;
+}
+
+
+/* Stores the events recorded for the source. The cache file is replaced
+ * atomically so the concurrent readers see either the old or the new one.
+ * The errors are ignored: the cache is only an optimization. */
+static void
+writeCacheEntry( const char *                cachePath,
+                 const char *                key,
+                 int                         mask,
+                 const struct fileContent *  content,
+                 uint64_t                    hash,
+                 const struct eventBuffer *  events )
+{
+    static const char           padding[ 8 ] = { 0 };
+    char                        tempPath[ PATH_MAX + 8 ];
+    size_t                      keyLength = strlen( key );
+    size_t                      recordsSize = events->count *
+                                              sizeof( struct eventRecord );
+    struct eventBufferHeader    eventsHeader = { EVENT_BUFFER_VERSION,
+                                                 events->count };
+    struct cacheHeader          header;
+
+    memset( & header, 0, sizeof( header ) );
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.eventsVersion = EVENT_BUFFER_VERSION;
+    header.mask = mask;
+    header.backend = parserBackend;
+    header.size = content->fileSize;
+    header.mtime = content->mtime;
+    header.hash = hash;
+    header.parserVersion = hashString( CDM_PY_PARSER_VERSION );
+    header.pathLength = keyLength;
+    header.eventsSize = sizeof( eventsHeader ) + recordsSize +
+                        events->poolSize;
+
+    snprintf( tempPath, sizeof( tempPath ), "%s.XXXXXX", cachePath );
+    int     fd = mkstemp( tempPath );
+    if ( fd < 0 )
+        return;
+
+    int     failed = writeAll( fd, & header, sizeof( header ) ) ||
+                     writeAll( fd, key, keyLength ) ||
+                     writeAll( fd, padding,
+                               CACHE_PADDED( keyLength ) - keyLength ) ||
+                     writeAll( fd, & eventsHeader, sizeof( eventsHeader ) ) ||
+                     writeAll( fd, events->records, recordsSize ) ||
+                     writeAll( fd, events->pool, events->poolSize );
+
+    if ( close( fd ) != 0 || failed || rename( tempPath, cachePath ) != 0 )
+        unlink( tempPath );
+}
+
+
+/* The content is the same but the time has changed, e.g. after a checkout.
+ * The new time is remembered so the next lookup does not read the source. */
+static void
+touchCacheEntry( const char *  cachePath, int64_t  mtime )
+{
+    int     fd = open( cachePath, O_WRONLY );
+
+    if ( fd >= 0 )
+    {
+        if ( pwrite( fd, & mtime, sizeof( mtime ),
+                     offsetof( struct cacheHeader, mtime ) ) !=
+             sizeof( mtime ) )
+            unlink( cachePath );
+        close( fd );
+    }
+}
+
+
+/* Provides 1 if the cache entry is good for the source. Otherwise the source
+ * content and its hash are provided. No Python API is used. */
+static int
+lookupCache( const char *           fileName,
+             const char *           key,
+             const char *           cachePath,
+             int                    mask,
+             struct cacheEntry *    entry,
+             struct fileContent *   content,
+             enum FileStatus *      status,
+             uint64_t *             hash )
+{
+    struct stat     st;
+
+    if ( stat( key, & st ) == 0 &&
+         mapCacheEntry( cachePath, key, mask, entry ) == 0 &&
+         entry->header.size == st.st_size &&
+         entry->header.mtime == getModificationTime( & st ) )
+        return 1;
+
+    *status = openFileContent( fileName, content );
+    if ( *status != FILE_OK || content->buffer == NULL )
+        return 0;
+
+    *hash = hashContent( content->buffer, content->fileSize );
+    if ( entry->address != NULL &&
+         entry->header.size == (int64_t) content->fileSize &&
+         entry->header.hash == *hash )
+    {
+        touchCacheEntry( cachePath, content->mtime );
+        return 1;
+    }
+    return 0;
+}
+
+
+/* Provides the items from the cache or parses the file and caches them */
+static PyObject *
+parse_cached( const char *  fileName, const char *  cacheDir,
+              struct parserContext *  context )
+{
+    char                    key[ PATH_MAX ];
+    char                    cachePath[ PATH_MAX ];
+    struct cacheEntry       entry;
+    struct fileContent      content;
+    enum FileStatus         status = FILE_OK;
+    uint64_t                hash = 0;
+    int                     usable = 0;
+    int                     hit = 0;
+
+    memset( & entry, 0, sizeof( entry ) );
+    memset( & content, 0, sizeof( content ) );
+
+    Py_BEGIN_ALLOW_THREADS
+    if ( realpath( fileName, key ) != NULL &&
+         getCachePath( cacheDir, key, cachePath ) == 0 )
+    {
+        usable = 1;
+        hit = lookupCache( fileName, key, cachePath, context->mask,
+                           & entry, & content, & status, & hash );
+    }
+    Py_END_ALLOW_THREADS
+
+    if ( ! usable )
+        return parse_file( fileName, context );
+
+    if ( hit )
+    {
+        replayEvents( & entry.events, context );
+        unmapCacheEntry( & entry );
+        closeFileContent( & content );
+        if ( PyErr_Occurred() )
+            return NULL;
+        if ( context->cancel != NULL && context->cancel->cancelled )
+            return setCancelledError();
+        Py_INCREF( Py_None );
+        return Py_None;
+    }
+
+    unmapCacheEntry( & entry );
+    if ( status != FILE_OK )
+        return setFileStatusError( status );
+
+    if ( content.buffer == NULL )
+    {
+        /* Empty file */
+        Py_INCREF( Py_None );
+        return Py_None;
+    }
+
+    /* The events are recorded first so that they could be stored */
+    struct eventBuffer      events;
+    struct parserContext    recorder;
+    PyObject *              retValue;
+
+    initEventBuffer( & events );
+    memset( & recorder, 0, sizeof( struct parserContext ) );
+    recorder.events = & events;
+    recorder.mask = context->mask;
+    recorder.cancel = context->cancel;
+
+    retValue = parse_input( content.buffer, fileName, & recorder );
+    if ( retValue != NULL && events.failed )
+    {
+        Py_DECREF( retValue );
+        retValue = PyErr_NoMemory();
+    }
+
+    if ( retValue != NULL )
+    {
+        Py_BEGIN_ALLOW_THREADS
+        writeCacheEntry( cachePath, key, context->mask,
+                         & content, hash, & events );
+        Py_END_ALLOW_THREADS
+
+        replayEvents( & events, context );
+        if ( PyErr_Occurred() )
+            Py_CLEAR( retValue );
+        else if ( context->cancel != NULL && context->cancel->cancelled )
+        {
+            Py_DECREF( retValue );
+            retValue = setCancelledError();
+        }
+    }
+
+    clearEventBuffer( & events );
+    clearUniqueNames( & recorder.names );
+    closeFileContent( & content );
+    return retValue;
+}
+
+
+/* The code passed from python: a str or any object supporting the buffer
+ * protocol. The parser needs the code terminated with '\0' which is
+ * guaranteed for str, bytes and bytearray and for a memoryview which
+ * covers the whole bytes object. Other buffers are copied. */
+struct memoryContent
+{
+    const char *    buffer;
+    Py_ssize_t      size;
+    Py_buffer       view;
+    int             hasView;
+    char *          copy;
+};
+
+
+static int
+isTerminatedBuffer( PyObject *  object, const Py_buffer *  view )
+{
+    if ( PyBytes_Check( object ) || PyByteArray_Check( object ) )
+        return 1;
+    if ( PyMemoryView_Check( object ) )
+    {
+        PyObject *  base = PyMemoryView_GET_BUFFER( object )->obj;
+        if ( base != NULL && PyBytes_Check( base ) &&
+             PyBuffer_IsContiguous( view, 'C' ) &&
+             (const char *) view->buf + view->len ==
+                PyBytes_AS_STRING( base ) + PyBytes_GET_SIZE( base ) )
+            return 1;
+    }
+    return 0;
+}
+
+
+static int
+getMemoryContent( PyObject *  object, struct memoryContent *  content )
+{
+    memset( content, 0, sizeof( struct memoryContent ) );
+
+    #if PY_MAJOR_VERSION >= 3
+    if ( PyUnicode_Check( object ) )
+    {
+        content->buffer = PyUnicode_AsUTF8AndSize( object, & content->size );
+        if ( content->buffer == NULL )
+            return -1;
+    }
+    else
+    #endif
+    {
+        if ( PyObject_GetBuffer( object, & content->view,
+                                 PyBUF_C_CONTIGUOUS ) != 0 )
+        {
+            PyErr_SetString( PyExc_TypeError, "The python code must be a "
+                                              "str or a bytes-like object" );
+            return -1;
+        }
+        content->hasView = 1;
+        content->buffer = (const char *) content->view.buf;
+        content->size = content->view.len;
+
+        if ( ! isTerminatedBuffer( object, & content->view ) )
+        {
+            content->copy = (char *)malloc( content->size + 1 );
+            if ( content->copy == NULL )
+            {
+                PyBuffer_Release( & content->view );
+                PyErr_NoMemory();
+                return -1;
+            }
+            memcpy( content->copy, content->buffer, content->size );
+            content->copy[ content->size ] = '\0';
+            content->buffer = content->copy;
+        }
+    }
+
+    if ( memchr( content->buffer, '\0', content->size ) != NULL )
+    {
+        if ( content->hasView )
+            PyBuffer_Release( & content->view );
+        free( content->copy );
+        PyErr_SetString( PyExc_ValueError,
+                         "The python code cannot contain null bytes" );
+        return -1;
+    }
+    return 0;
+}
+
+
+static void
+releaseMemoryContent( struct memoryContent *  content )
+{
+    if ( content->hasView )
+        PyBuffer_Release( & content->view );
+    free( content->copy );
+    memset( content, 0, sizeof( struct memoryContent ) );
+}
+
+
+/* Parses the code; a missing trailing new line is added by the tokenizer */
+static PyObject *
+parse_memory( PyObject *  code, struct parserContext *  context )
+{
+    struct memoryContent    content;
+    PyObject *              retValue;
+
+    if ( getMemoryContent( code, & content ) != 0 )
+        return NULL;
+
+    if ( content.size == 0 )
+    {
+        Py_INCREF( Py_None );
+        retValue = Py_None;
+    }
+    else
+        retValue = parse_input( (char *) content.buffer, "dummy.py", context );
+
+    releaseMemoryContent( & content );
+    return retValue;
+}
+
+
+/* Prepares the context for either the Python callbacks or the native mode */
+static int
+initContext( struct parserContext *      context,
+             struct instanceCallbacks *  callbacks,
+             struct nativeBuilder *      builder,
+             PyObject *                  instance,
+             int                         native,
+             int                         mask )
+{
+    memset( context, 0, sizeof( struct parserContext ) );
+    context->mask = normalizeEventMask( mask );
+    if ( native )
+    {
+        if ( initNativeBuilder( builder, instance ) != 0 )
+        {
+            clearNativeBuilder( builder );
+            return 1;
+        }
+        context->builder = builder;
+        return 0;
+    }
+
+    /* Get pointers to the members */
+    if ( getInstanceCallbacks( instance, callbacks ) != 0 )
+    {
+        clearCallbacks( callbacks );
+        return 1;
+    }
+    context->callbacks = callbacks;
+    if ( callbacks->onStatement == NULL )
+        context->mask &= ~EVENT_BIT( STATEMENT_EVENT );
+    return 0;
+}
+
+
+/* Finalizes the native mode result if needed and releases the context */
+static PyObject *
+clearContext( struct parserContext *  context, PyObject *  retValue )
+{
+    clearUniqueNames( & context->names );
+    if ( context->builder != NULL )
+    {
+        if ( retValue != NULL && finalizeNativeBuilder( context->builder ) != 0 )
+            Py_CLEAR( retValue );
+        clearNativeBuilder( context->builder );
+    }
+    else
+        clearCallbacks( context->callbacks );
+    return retValue;
+}
+
+
+
+/* Parses the given file */
+static char py_modinfo_from_file_doc[] = "Get brief module info from a file";
+static PyObject *
+py_modinfo_from_file( PyObject *  self,     /* unused */
+                      PyObject *  args )
+{
+    PyObject *                  callbackClass = NULL;
+    char *                      fileName;
+    int                         native = 0;
+    int                         mask = ALL_EVENTS_MASK;
+    char *                      cacheDir = NULL;
+    PyObject *                  cancelFlag = Py_None;
+    double                      timeout = -1.0;
+    struct instanceCallbacks    callbacks;
+    struct nativeBuilder        builder;
+    struct parserContext        context;
+    struct cancelCheck          cancel;
+    PyObject *                  retValue;
+
+    /* Parse the passed arguments */
+    if ( ! PyArg_ParseTuple( args, "Os|pizOd", & callbackClass, & fileName,
+                                               & native, & mask, & cacheDir,
+                                               & cancelFlag, & timeout ) )
+    {
+        PyErr_SetString( PyExc_TypeError, "Incorrect arguments. "
+                                          "Expected: callback class "
+                                          "instance, file name, "
+                                          "optional native mode flag, "
+                                          "optional event kinds mask, "
+                                          "optional cache directory, "
+                                          "optional cancel flag and "
+                                          "optional timeout" );
+        return NULL;
+    }
+
+    /* Check the passed argument */
+    if ( ! fileName )
+    {
+        PyErr_SetString( PyExc_TypeError, "Incorrect file name" );
+        return NULL;
+    }
+    if ( ! callbackClass )
+    {
+        PyErr_SetString( PyExc_TypeError, "Invalid callback class argument" );
+        return NULL;
+    }
+    /*
+       Ommit the check below: the old style classes worked fine with
+       PyInstance_Check(...). With new style classes (i.e. derived from
+       'object') none of the checks PyInstance_Check(...) or PyType_Check(...)
+       is working. It is though more or less ok not to have the check at all
+       because the member functions are retrieved with checks anyway.
+       if ( ! PyInstance_Check( callbackClass ) )
+       if ( ! PyType_Check( callbackClass ) )
+       {
+           PyErr_SetString( PyExc_TypeError, "Incorrect callback class instance" );
+           return NULL;
+       }
+    */
+
+    if ( initCancelCheck( & cancel, cancelFlag, timeout ) != 0 )
+        return NULL;
+    if ( initContext( & context, & callbacks, & builder,
+                      callbackClass, native, mask ) != 0 )
+    {
+        clearCancelCheck( & cancel );
+        return NULL;
+    }
+    context.cancel = & cancel;
+
+    if ( cacheDir != NULL )
+        retValue = clearContext( & context, parse_cached( fileName, cacheDir,
+                                                          & context ) );
+    else
+        retValue = clearContext( & context, parse_file( fileName, & context ) );
+    clearCancelCheck( & cancel );
+    return retValue;
+}
+
+
+/* Parses the given code */
+static char py_modinfo_from_mem_doc[] = "Get brief module info from memory";
+static PyObject *
+py_modinfo_from_mem( PyObject *  self,      /* unused */
+                     PyObject *  args )
+{
+    PyObject *                  callbackClass;
+    PyObject *                  content;
+    int                         native = 0;
+    int                         mask = ALL_EVENTS_MASK;
+    PyObject *                  statements = Py_None;
+    PyObject *                  cancelFlag = Py_None;
+    double                      timeout = -1.0;
+    struct instanceCallbacks    callbacks;
+    struct nativeBuilder        builder;
+    struct parserContext        context;
+    struct cancelCheck          cancel;
+    PyObject *                  retValue;
+
+
+    /* Parse the passed arguments */
+    if ( ! PyArg_ParseTuple( args, "OO|piOOd", & callbackClass, & content,
+                                               & native, & mask, & statements,
+                                               & cancelFlag, & timeout ) )
+    {
+        PyErr_SetString( PyExc_TypeError, "Incorrect arguments. "
+                                          "Expected: callback class "
+                                          "instance, buffer with python code, "
+                                          "optional native mode flag, "
+                                          "optional event kinds mask, "
+                                          "optional statements list, "
+                                          "optional cancel flag and "
+                                          "optional timeout" );
+        return NULL;
+    }
+    if ( statements != Py_None && ! PyList_Check( statements ) )
+    {
+        PyErr_SetString( PyExc_TypeError, "Statements must be a list" );
+        return NULL;
+    }
+
+    /* Check the passed argument */
+    if ( ! content )
+    {
+        PyErr_SetString( PyExc_TypeError, "Incorrect memory buffer" );
+        return NULL;
+    }
+    if ( ! callbackClass )
+    {
+        PyErr_SetString( PyExc_TypeError, "Invalid callback class argument" );
+        return NULL;
+    }
+    /*
+       Ommit the check below: the old style classes worked fine with
+       PyInstance_Check(...). With new style classes (i.e. derived from
+       'object') none of the checks PyInstance_Check(...) or PyType_Check(...)
+       is working. It is though more or less ok not to have the check at all
+       because the member functions are retrieved with checks anyway.
+       if ( ! PyInstance_Check( callbackClass ) )
+       if ( ! PyType_Check( callbackClass ) )
+       {
+           PyErr_SetString( PyExc_TypeError, "Incorrect callback class instance" );
+           return NULL;
+       }
+    */
+
+    if ( initCancelCheck( & cancel, cancelFlag, timeout ) != 0 )
+        return NULL;
+    if ( initContext( & context, & callbacks, & builder,
+                      callbackClass, native, mask ) != 0 )
+    {
+        clearCancelCheck( & cancel );
+        return NULL;
+    }
+    if ( statements != Py_None )
+        context.statements = statements;
+    context.cancel = & cancel;
+
+    retValue = clearContext( & context, parse_memory( content, & context ) );
+    clearCancelCheck( & cancel );
+    return retValue;
+}
+
+
+/* Parses the file or the code and records the events. Provides None or NULL
+ * if there is an error; the buffer is to be cleared in both cases */
+static PyObject *
+recordEvents( const char *  fileName, PyObject *  content, int  mask,
+              struct cancelCheck *  cancel, struct eventBuffer *  buffer )
+{
+    struct parserContext        context;
+    PyObject *                  retValue;
+
+    initEventBuffer( buffer );
+    memset( & context, 0, sizeof( struct parserContext ) );
+    context.events = buffer;
+    context.mask = normalizeEventMask( mask );
+    context.cancel = cancel;
+
+    if ( fileName != NULL )
+        retValue = parse_file( fileName, & context );
+    else
+        retValue = parse_memory( content, & context );
+    clearUniqueNames( & context.names );
+
+    if ( retValue != NULL && buffer->failed )
+    {
+        Py_DECREF( retValue );
+        retValue = PyErr_NoMemory();
+    }
+    return retValue;
+}
+
+
+/* Records the events while parsing and provides them in one go */
+static PyObject *
+collectEvents( const char *  fileName, PyObject *  content,
+               int  raw, int  mask )
+{
+    struct eventBuffer          buffer;
+    PyObject *                  retValue;
+
+    retValue = recordEvents( fileName, content, mask, NULL, & buffer );
+    if ( retValue != NULL )
+    {
+        Py_DECREF( retValue );
+        if ( raw )
+            retValue = eventBufferToBytes( & buffer );
+        else
+            retValue = eventBufferToList( & buffer );
+    }
+
+    clearEventBuffer( & buffer );
+    return retValue;
+}
+
+
+static char py_events_from_file_doc[] = "Get the recorded parser events from a file";
+static PyObject *
+py_events_from_file( PyObject *  self,      /* unused */
+                     PyObject *  args )
+{
+    char *      fileName;
+    int         raw = 0;
+    int         mask = ALL_EVENTS_MASK;
+
+    if ( ! PyArg_ParseTuple( args, "s|pi", & fileName, & raw, & mask ) )
+        return NULL;
+    return collectEvents( fileName, NULL, raw, mask );
+}
+
+
+static char py_events_from_mem_doc[] = "Get the recorded parser events from memory";
+static PyObject *
+py_events_from_mem( PyObject *  self,       /* unused */
+                    PyObject *  args )
+{
+    PyObject *  content;
+    int         raw = 0;
+    int         mask = ALL_EVENTS_MASK;
+
+    if ( ! PyArg_ParseTuple( args, "O|pi", & content, & raw, & mask ) )
+        return NULL;
+    return collectEvents( NULL, content, raw, mask );
+}
+
+
+/*
+ * Compact module data. The brief module info is serialized as:
+ * - the header: "CDMB", the version byte and the flags byte (bit 0: isOK)
+ * - the string table: the count and then each UTF-8 string prefixed with its
+ *   length; every string is stored once
+ * - the node table: the count and then the nodes. Each node starts with its
+ *   kind (the event kind numbers), the parent node index + 1 (0 is the
+ *   module) and the name string index. The parents always precede their
+ *   children and the siblings are in the source order.
+ * All the numbers are varints. The lines and the absolute positions are
+ * stored as zigzag encoded deltas from the previous node ones; the keyword
+ * and the colon lines are deltas from the node line. The optional strings
+ * are stored as the string index + 1, 0 means None (alias: '').
+ * The content hashes are stored as 8 little endian bytes.
+ */
+
+#define MODULE_DATA_MAGIC       "CDMB"
+#define MODULE_DATA_VERSION     2
+#define MODULE_DATA_HEADER_SIZE 6
+
+struct dataNode
+{
+    int     kind;
+    int     parent;             /* -1 for the module */
+    int     name;               /* also: docstring text, error message */
+    int     line;               /* docstring: first line */
+    int     pos;
+    int     absPosition;
+    int     keywordLine;
+    int     keywordPos;
+    int     colonLine;
+    int     colonPos;
+    int     endLine;            /* docstring: last line */
+    int     isAsync;
+    int     extra;              /* alias, annotation or return annotation */
+    int     value;              /* argument value */
+    uint64_t    contentHash;    /* function, class, statement */
+};
+
+/* Unique strings; an open addressing hash of the string indexes */
+struct stringTable
+{
+    char *      pool;
+    int         poolSize;
+    int         poolCapacity;
+    int *       offsets;
+    int *       lengths;
+    int         count;
+    int         capacity;
+    int *       slots;          /* -1: empty */
+    int         slotCount;      /* power of 2 */
+};
+
+/* Builds the node table from the recorded events the same way the
+ * BriefModuleInfo methods build the objects graph */
+struct dataBuilder
+{
+    struct stringTable  strings;
+    struct dataNode *   nodes;
+    int                 count;
+    int                 capacity;
+    int *               stack;              /* functions and classes */
+    int                 stackSize;
+    int                 stackCapacity;
+    struct dataNode *   pendingDecorators;  /* waiting for the owner */
+    int                 pendingCount;
+    int                 pendingCapacity;
+    int                 lastImport;
+    int                 lastWhat;
+    int                 lastArgument;
+    int *               uniqueSlots;        /* named items which must be
+                                               unique within the owner */
+    int                 uniqueSlotCount;
+    int                 uniqueCount;
+    int                 isOK;
+    int                 failed;
+};
+
+
+/* Makes room for one more item; provides 0 on success */
+static int
+growArray( void **  items, int *  capacity, int  count, size_t  itemSize )
+{
+    if ( count < *capacity )
+        return 0;
+
+    int     newCapacity = *capacity == 0 ? 64 : *capacity * 2;
+    void *  newItems = realloc( *items, newCapacity * itemSize );
+    if ( newItems == NULL )
+        return 1;
+    *items = newItems;
+    *capacity = newCapacity;
+    return 0;
+}
+
+
+static uint32_t
+hashBytes( const char *  str, int  length )
+{
+    uint32_t    hash = 2166136261U;         /* FNV-1a */
+
+    for ( int  k = 0; k < length; ++k )
+        hash = ( hash ^ (unsigned char) str[ k ] ) * 16777619U;
+    return hash;
+}
+
+
+static void
+clearStringTable( struct stringTable *  table )
+{
+    free( table->pool );
+    free( table->offsets );
+    free( table->lengths );
+    free( table->slots );
+    memset( table, 0, sizeof( struct stringTable ) );
+}
+
+
+static int
+rehashStringTable( struct stringTable *  table )
+{
+    int     slotCount = table->slotCount == 0 ? 256 : table->slotCount * 2;
+    int *   slots = (int *) malloc( slotCount * sizeof( int ) );
+
+    if ( slots == NULL )
+        return 1;
+    memset( slots, 0xFF, slotCount * sizeof( int ) );
+
+    for ( int  k = 0; k < table->count; ++k )
+    {
+        uint32_t    slot = hashBytes( table->pool + table->offsets[ k ],
+                                      table->lengths[ k ] ) & ( slotCount - 1 );
+        while ( slots[ slot ] != -1 )
+            slot = ( slot + 1 ) & ( slotCount - 1 );
+        slots[ slot ] = k;
+    }
+
+    free( table->slots );
+    table->slots = slots;
+    table->slotCount = slotCount;
+    return 0;
+}
+
+
+/* Provides the string index or -1 if there is no memory */
+static int
+internString( struct stringTable *  table, const char *  str, int  length )
+{
+    if ( ( table->count + 1 ) * 2 > table->slotCount &&
+         rehashStringTable( table ) != 0 )
+        return -1;
+
+    uint32_t    slot = hashBytes( str, length ) & ( table->slotCount - 1 );
+    while ( table->slots[ slot ] != -1 )
+    {
+        int     index = table->slots[ slot ];
+        if ( table->lengths[ index ] == length &&
+             memcmp( table->pool + table->offsets[ index ], str, length ) == 0 )
+            return index;
+        slot = ( slot + 1 ) & ( table->slotCount - 1 );
+    }
+
+    if ( table->count == table->capacity )
+    {
+        int     capacity = table->capacity == 0 ? 64 : table->capacity * 2;
+        int *   offsets = (int *) realloc( table->offsets,
+                                           capacity * sizeof( int ) );
+        if ( offsets == NULL )
+            return -1;
+        table->offsets = offsets;
+
+        int *   lengths = (int *) realloc( table->lengths,
+                                           capacity * sizeof( int ) );
+        if ( lengths == NULL )
+            return -1;
+        table->lengths = lengths;
+        table->capacity = capacity;
+    }
+
+    if ( table->poolSize + length > table->poolCapacity )
+    {
+        int     capacity = table->poolCapacity * 2;
+        if ( capacity < table->poolSize + length )
+            capacity = table->poolSize + length + 4096;
+
+        char *  pool = (char *) realloc( table->pool, capacity );
+        if ( pool == NULL )
+            return -1;
+        table->pool = pool;
+        table->poolCapacity = capacity;
+    }
+
+    if ( length > 0 )
+        memcpy( table->pool + table->poolSize, str, length );
+    table->offsets[ table->count ] = table->poolSize;
+    table->lengths[ table->count ] = length;
+    table->poolSize += length;
+    table->slots[ slot ] = table->count;
+    return table->count++;
+}
 
-                    if ( subchild->n_type == dotted_name )
-                    {
-                        char    name[ MAX_DOTTED_NAME_LENGTH ];
-                        int     length = 0;
 
-                        getDottedName( subchild, name, & length );
+static void
+clearDataBuilder( struct dataBuilder *  builder )
+{
+    clearStringTable( & builder->strings );
+    free( builder->nodes );
+    free( builder->stack );
+    free( builder->pendingDecorators );
+    free( builder->uniqueSlots );
+    memset( builder, 0, sizeof( struct dataBuilder ) );
+}
 
-                        callOnImport( callbacks->onImport, name, length, subchild->n_lineno,
-                                      subchild->n_col_offset + 1, /* Make it 1-based */
-                                      lineShifts[ subchild->n_lineno ] + subchild->n_col_offset );
-                        continue;
-                    }
-                    if ( subchild->n_type == NAME )
-                    {
-                        if ( expect_as_name == 1 )
-                        {
-                            callOnAs( callbacks->onAs, subchild->n_str, strlen( subchild->n_str ) );
-                            expect_as_name = 0;
-                            continue;
-                        }
 
-                        if ( strcmp( subchild->n_str, "as" ) == 0 )
-                            expect_as_name = 1;
-                    }
-                }
+static void
+initDataBuilder( struct dataBuilder *  builder )
+{
+    memset( builder, 0, sizeof( struct dataBuilder ) );
+    builder->lastImport = -1;
+    builder->lastWhat = -1;
+    builder->lastArgument = -1;
+    builder->isOK = 1;
+}
 
-            }
-        }
+
+/* Provides the new node index or -1 */
+static int
+addDataNode( struct dataBuilder *  builder, const struct dataNode *  n )
+{
+    if ( growArray( (void **) & builder->nodes, & builder->capacity,
+                    builder->count, sizeof( struct dataNode ) ) != 0 )
+    {
+        builder->failed = 1;
+        return -1;
     }
+    builder->nodes[ builder->count ] = *n;
+    return builder->count++;
 }
 
 
-static const char *  processArgument( node *        tree,
-                                      PyObject *    onArg )
+static uint32_t
+hashUniqueNode( const struct dataNode *  n )
 {
-    assert( tree->n_type == tfpdef );
-    assert( tree->n_nchildren > 0 );
+    return ( (uint32_t) n->kind * 31 + (uint32_t) n->parent ) * 2654435761U ^
+           (uint32_t) n->name * 40503U;
+}
 
-    node *      nameNode = & ( tree->n_child[ 0 ] );
-    assert( nameNode->n_type == NAME );
 
-    // The only 'test' node is for an annotation
-    node *      testNode = findChildOfType( tree, test );
-    char        annotation[ MAX_ARG_VAL_SIZE ];
-    int         annotationLength = 0;
+static int
+rehashUniqueNodes( struct dataBuilder *  builder )
+{
+    int     slotCount = builder->uniqueSlotCount == 0 ?
+                                        256 : builder->uniqueSlotCount * 2;
+    int *   slots = (int *) malloc( slotCount * sizeof( int ) );
 
-    if ( testNode != NULL )
-        collectTestString( testNode, annotation, & annotationLength );
+    if ( slots == NULL )
+        return 1;
+    memset( slots, 0xFF, slotCount * sizeof( int ) );
 
-    callOnAnnotatedArg( onArg, nameNode->n_str, strlen( nameNode->n_str ),
-                        annotation, annotationLength );
-    return nameNode->n_str;
+    for ( int  k = 0; k < builder->uniqueSlotCount; ++k )
+    {
+        int     index = builder->uniqueSlots[ k ];
+        if ( index == -1 )
+            continue;
+
+        uint32_t    slot = hashUniqueNode( & builder->nodes[ index ] ) &
+                           ( slotCount - 1 );
+        while ( slots[ slot ] != -1 )
+            slot = ( slot + 1 ) & ( slotCount - 1 );
+        slots[ slot ] = index;
+    }
+
+    free( builder->uniqueSlots );
+    builder->uniqueSlots = slots;
+    builder->uniqueSlotCount = slotCount;
+    return 0;
 }
 
 
-static int processDecor( node *                        tree,
-                         struct instanceCallbacks *    callbacks,
-                         int *                         lineShifts )
+/* Adds a node unless the owner already has one of the same kind and name */
+static void
+addUniqueDataNode( struct dataBuilder *  builder, const struct dataNode *  n )
 {
-    int         staticMethod = 0;
-    assert( tree->n_type == decorator );
+    if ( ( builder->uniqueCount + 1 ) * 2 > builder->uniqueSlotCount &&
+         rehashUniqueNodes( builder ) != 0 )
+    {
+        builder->failed = 1;
+        return;
+    }
 
-    char        name[ MAX_DOTTED_NAME_LENGTH ];
-    int         length = 0;
+    uint32_t    mask = builder->uniqueSlotCount - 1;
+    uint32_t    slot = hashUniqueNode( n ) & mask;
+    while ( builder->uniqueSlots[ slot ] != -1 )
+    {
+        const struct dataNode *     other =
+                        & builder->nodes[ builder->uniqueSlots[ slot ] ];
+        if ( other->kind == n->kind && other->parent == n->parent &&
+             other->name == n->name )
+            return;
+        slot = ( slot + 1 ) & mask;
+    }
 
-    #if PY_MAJOR_VERSION == 3 && PY_MINOR_VERSION == 9
-        /* The 3.9 grammar introduces a completely different structure of the
-         * tree. Now it could be an arbitrary expression.
-         */
+    int     index = addDataNode( builder, n );
+    if ( index >= 0 )
+    {
+        builder->uniqueSlots[ slot ] = index;
+        ++builder->uniqueCount;
+    }
+}
 
-        node *      namedExprTestNode = findChildOfType( tree, namedexpr_test );
 
-        /* The nameNode name is not very good; actually it is the atom_tree
-         * however the common code below looks better with nameNode
-         */
-        node *      nameNode = skipToNode( namedExprTestNode, atom_expr );
-        assert( nameNode != NULL );
+/* Provides the stack node index; negative counts from the end. -1 if there
+ * is no such node */
+static int
+dataStackItem( const struct dataBuilder *  builder, int  index )
+{
+    if ( index < 0 )
+        index += builder->stackSize;
+    if ( index < 0 || index >= builder->stackSize )
+        return -1;
+    return builder->stack[ index ];
+}
 
-        node *      argsNode = findDecoratorArgsNode( nameNode );
-        getAtomDecoratorName( nameNode, name, & length, argsNode );
-    #else
-        node *      nameNode = findChildOfType( tree, dotted_name );
-        assert( nameNode != NULL );
 
-        getDottedName( nameNode, name, & length );
+/* Provides the string index + 1 or 0 for an absent string */
+static int
+internOptionalString( struct dataBuilder *  builder,
+                      const char *  str, int  length )
+{
+    if ( length <= 0 )
+        return 0;
 
-        node *      argsNode = findChildOfType( tree, arglist );
-        if ( argsNode == NULL )
-        {
-            /* Point to the '(' in case of @decor() */
-            argsNode = findChildOfType( tree, LPAR );
-        }
-    #endif
+    int     index = internString( & builder->strings, str, length );
+    if ( index < 0 )
+        builder->failed = 1;
+    return index + 1;
+}
+
+
+static int
+internName( struct dataBuilder *  builder, const struct parserEvent *  e )
+{
+    int     index = internString( & builder->strings, e->name, e->nameLength );
+    if ( index < 0 )
+        builder->failed = 1;
+    return index;
+}
 
-    callOnDecorator( callbacks->onDecorator,
-                     name, length,
-                     nameNode->n_lineno,
-                     nameNode->n_col_offset + 1,    /* Make it 1-based */
-                     lineShifts[ nameNode->n_lineno ] + nameNode->n_col_offset );
 
-    name[length] = '\0';
-    if ( strcmp( name, "staticmethod" ) == 0 )
+static void
+dataOnScopeItem( struct dataBuilder *  builder, const struct parserEvent *  e )
+{
+    struct dataNode     n = { .kind = e->kind,
+                              .name = internName( builder, e ),
+                              .line = e->line,
+                              .pos = e->pos,
+                              .absPosition = e->absPosition,
+                              .keywordLine = e->keywordLine,
+                              .keywordPos = e->keywordPos,
+                              .colonLine = e->colonLine,
+                              .colonPos = e->colonPos,
+                              .contentHash = e->contentHash };
+
+    if ( e->kind == FUNCTION_EVENT )
     {
-        staticMethod = 1;
+        n.isAsync = e->isAsync;
+        n.extra = internOptionalString( builder, e->annotation,
+                                        e->annotationLength );
     }
 
-    if ( argsNode != NULL )
-    {
-        /* There are decorator arguments */
+    if ( builder->stackSize > e->level )
+        builder->stackSize = e->level;
+    n.parent = dataStackItem( builder, -1 );
 
-        /* Special case:
-         * if a decorator has no arguments and looks like @decor()
-         * then the argsNode points to LPAR
-         */
-        if ( argsNode->n_type == LPAR )
-        {
-            char        arg[ MAX_ARG_VAL_SIZE ];
-            int         length = 0;
-            callOnArg( callbacks->onDecoratorArgument, arg, length );
-            return staticMethod;
-        }
+    int     index = addDataNode( builder, & n );
+    if ( index < 0 )
+        return;
 
-        node *      child;
-        for ( int  k = 0; k < argsNode->n_nchildren; ++k )
-        {
-            child = & ( argsNode->n_child[ k ] );
-            if ( child->n_type == argument )
-            {
-                char        arg[ MAX_ARG_VAL_SIZE ];
-                int         length = 0;
-                collectTestString( child, arg, & length );
+    /* The decorators precede the owner in the source but follow it here */
+    int     first = builder->count;
+    for ( int  k = 0; k < builder->pendingCount; ++k )
+    {
+        struct dataNode     decor = builder->pendingDecorators[ k ];
 
-                callOnArg( callbacks->onDecoratorArgument, arg, length );
-            }
-        }
+        if ( decor.kind == DECORATOR_EVENT )
+            decor.parent = index;
+        else
+            decor.parent += first;
+        addDataNode( builder, & decor );
     }
+    builder->pendingCount = 0;
 
-    return staticMethod;
+    if ( growArray( (void **) & builder->stack, & builder->stackCapacity,
+                    builder->stackSize, sizeof( int ) ) != 0 )
+    {
+        builder->failed = 1;
+        return;
+    }
+    builder->stack[ builder->stackSize++ ] = index;
 }
 
-static int processDecorators( node *                        tree,
-                              struct instanceCallbacks *    callbacks,
-                              int *                         lineShifts )
+
+/* The decorator arguments refer to their decorator index in the pending
+ * decorators list */
+static void
+dataOnDecorator( struct dataBuilder *  builder, const struct parserEvent *  e )
 {
-    int         staticMethod = 0;
-    node *      child;
-    int         n = tree->n_nchildren;
-    assert( tree->n_type == decorators );
+    struct dataNode     n = { .kind = e->kind,
+                              .name = internName( builder, e ) };
 
-    for ( int  k = 0; k < n; ++k )
+    if ( e->kind == DECORATOR_EVENT )
     {
-        child = & ( tree->n_child[ k ] );
-        if ( child->n_type == decorator )
-        {
-            int     isStatic = 0;
-            isStatic = processDecor( child, callbacks, lineShifts );
-            if ( staticMethod == 0 )
-                staticMethod = isStatic;
-        }
+        n.line = e->line;
+        n.pos = e->pos;
+        n.absPosition = e->absPosition;
+    }
+    else
+    {
+        /* An argument of the last decorator */
+        n.parent = builder->pendingCount - 1;
+        while ( n.parent >= 0 &&
+                builder->pendingDecorators[ n.parent ].kind != DECORATOR_EVENT )
+            --n.parent;
+        if ( n.parent < 0 )
+            return;
     }
 
-    return staticMethod;
+    if ( growArray( (void **) & builder->pendingDecorators,
+                    & builder->pendingCapacity, builder->pendingCount,
+                    sizeof( struct dataNode ) ) != 0 )
+    {
+        builder->failed = 1;
+        return;
+    }
+    builder->pendingDecorators[ builder->pendingCount++ ] = n;
 }
 
 
-
-static void  processClassDefinition( node *                       tree,
-                                     struct instanceCallbacks *   callbacks,
-                                     int                          objectsLevel,
-                                     enum Scope                   scope,
-                                     int                          entryLevel,
-                                     int *                        lineShifts )
+/* The docstring text is trimmed by the walkers already */
+static void
+dataOnDocstring( struct dataBuilder *  builder, const struct parserEvent *  e )
 {
-    assert( tree->n_type == classdef );
-    assert( tree->n_nchildren > 1 );
+    struct dataNode     n = { .kind = e->kind,
+                              .parent = dataStackItem( builder, -1 ),
+                              .name = internName( builder, e ),
+                              .line = e->line,
+                              .endLine = e->endLine };
+    if ( n.name >= 0 )
+        addDataNode( builder, & n );
+}
 
-    node *      classNode = & ( tree->n_child[ 0 ] );
-    node *      nameNode = & ( tree->n_child[ 1 ] );
-    node *      colonNode = findChildOfType( tree, COLON );
 
-    assert( colonNode != NULL );
+static void
+dataOnEvent( struct dataBuilder *  builder, const struct parserEvent *  e )
+{
+    struct dataNode     n = { .kind = e->kind,
+                              .parent = -1,
+                              .line = e->line,
+                              .pos = e->pos,
+                              .absPosition = e->absPosition };
+    int                 owner;
+
+    switch ( e->kind )
+    {
+        case ENCODING_EVENT:
+            n.name = internName( builder, e );
+            addDataNode( builder, & n );
+            break;
+        case GLOBAL_EVENT:
+            n.name = internName( builder, e );
+            addUniqueDataNode( builder, & n );
+            break;
+        case STATEMENT_EVENT:
+            n.name = internName( builder, e );
+            n.endLine = e->endLine;
+            n.contentHash = e->contentHash;
+            addDataNode( builder, & n );
+            break;
+        case FUNCTION_EVENT:
+        case CLASS_EVENT:
+            dataOnScopeItem( builder, e );
+            break;
+        case IMPORT_EVENT:
+            n.name = internName( builder, e );
+            builder->lastImport = addDataNode( builder, & n );
+            builder->lastWhat = -1;
+            break;
+        case AS_EVENT:
+            owner = builder->lastWhat >= 0 ? builder->lastWhat
+                                           : builder->lastImport;
+            if ( owner >= 0 )
+                builder->nodes[ owner ].extra =
+                            internOptionalString( builder, e->name,
+                                                  e->nameLength );
+            break;
+        case WHAT_EVENT:
+            if ( builder->lastImport >= 0 )
+            {
+                n.parent = builder->lastImport;
+                n.name = internName( builder, e );
+                builder->lastWhat = addDataNode( builder, & n );
+            }
+            break;
+        case CLASS_ATTRIBUTE_EVENT:
+        case INSTANCE_ATTRIBUTE_EVENT:
+            /* A class is on the top or a member function is on the top and
+             * the class is one step down */
+            n.parent = dataStackItem( builder,
+                                      e->kind == CLASS_ATTRIBUTE_EVENT ?
+                                                e->level : e->level - 1 );
+            if ( n.parent >= 0 )
+            {
+                n.name = internName( builder, e );
+                addUniqueDataNode( builder, & n );
+            }
+            break;
+        case DECORATOR_EVENT:
+        case DECORATOR_ARGUMENT_EVENT:
+            dataOnDecorator( builder, e );
+            break;
+        case DOCSTRING_EVENT:
+            dataOnDocstring( builder, e );
+            break;
+        case ARGUMENT_EVENT:
+            n = (struct dataNode) { .kind = e->kind,
+                                    .parent = dataStackItem( builder, -1 ),
+                                    .name = internName( builder, e ),
+                                    .extra = internOptionalString(
+                                                    builder, e->annotation,
+                                                    e->annotationLength ) };
+            if ( n.parent >= 0 )
+                builder->lastArgument = addDataNode( builder, & n );
+            break;
+        case ARGUMENT_VALUE_EVENT:
+            owner = dataStackItem( builder, -1 );
+            if ( owner >= 0 && builder->lastArgument >= 0 &&
+                 builder->nodes[ builder->lastArgument ].parent == owner )
+                builder->nodes[ builder->lastArgument ].value =
+                            internOptionalString( builder, e->name,
+                                                  e->nameLength );
+            break;
+        case BASE_CLASS_EVENT:
+            n = (struct dataNode) { .kind = e->kind,
+                                    .parent = dataStackItem( builder, -1 ),
+                                    .name = internName( builder, e ) };
+            if ( n.parent >= 0 )
+                addDataNode( builder, & n );
+            break;
+        case ERROR_EVENT:
+        case LEXER_ERROR_EVENT:
+            builder->isOK = 0;
+            /* Whitespace only messages are not memorized */
+            for ( int  k = 0; k < e->nameLength; ++k )
+            {
+                if ( ! isspace( (unsigned char) e->name[ k ] ) )
+                {
+                    n = (struct dataNode) { .kind = e->kind,
+                                            .parent = -1,
+                                            .name = internName( builder, e ) };
+                    addDataNode( builder, & n );
+                    break;
+                }
+            }
+            break;
+    }
+}
 
 
-    ++objectsLevel;
-    callOnClass( callbacks->onClass,
-                 nameNode->n_str, strlen( nameNode->n_str ),
-                 /* Class name line and pos */
-                 nameNode->n_lineno,
-                 nameNode->n_col_offset + 1,         /* To make it 1-based */
-                 lineShifts[ nameNode->n_lineno ] + nameNode->n_col_offset,
-                 /* Keyword 'class' line and pos */
-                 classNode->n_lineno,
-                 classNode->n_col_offset + 1,          /* To make it 1-based */
-                 /* ':' line and pos */
-                 colonNode->n_lineno,
-                 colonNode->n_col_offset + 1,        /* To make it 1-based */
-                 objectsLevel );
+/* A growable output buffer; failed is set if there is no memory */
+struct byteBuffer
+{
+    unsigned char *     data;
+    size_t              size;
+    size_t              capacity;
+    int                 failed;
+};
 
-    /* Collect inheritance list */
-    node *      listNode = findChildOfType( tree, arglist );
-    if ( listNode != NULL )
+
+static void
+putBytes( struct byteBuffer *  buffer, const void *  data, size_t  size )
+{
+    if ( buffer->size + size > buffer->capacity )
     {
-        node *      child;
-        int         n = listNode->n_nchildren;
-        for ( int  k = 0; k < n; ++k )
-        {
-            child = & ( listNode->n_child[ k ] );
-            if ( child->n_type == argument )
-            {
-                char        buffer[ MAX_ARG_VAL_SIZE ];
-                int         length = 0;
+        size_t  capacity = buffer->capacity * 2;
+        if ( capacity < buffer->size + size )
+            capacity = buffer->size + size + 4096;
 
-                collectTestString( child, buffer, & length );
-                callOnBaseClass( callbacks->onBaseClass, buffer, length );
-            }
+        unsigned char *     newData = (unsigned char *) realloc( buffer->data,
+                                                                 capacity );
+        if ( newData == NULL )
+        {
+            buffer->failed = 1;
+            return;
         }
+        buffer->data = newData;
+        buffer->capacity = capacity;
     }
+    if ( size > 0 )
+        memcpy( buffer->data + buffer->size, data, size );
+    buffer->size += size;
+}
 
 
-    node *      suiteNode = findChildOfType( tree, suite );
-    assert( suiteNode != NULL );
-    checkForDocstring( suiteNode, callbacks );
+static void
+putVarint( struct byteBuffer *  buffer, uint32_t  value )
+{
+    unsigned char   bytes[ 5 ];
+    int             count = 0;
 
-    walk( suiteNode, callbacks, objectsLevel,
-          CLASS_SCOPE, NULL, entryLevel, lineShifts, 0 );
-    return;
+    while ( value >= 0x80 )
+    {
+        bytes[ count++ ] = (unsigned char) ( value | 0x80 );
+        value >>= 7;
+    }
+    bytes[ count++ ] = (unsigned char) value;
+    putBytes( buffer, bytes, count );
 }
 
 
 static void
-processFuncDefinition( node *                       tree,
-                       struct instanceCallbacks *   callbacks,
-                       int                          objectsLevel,
-                       enum Scope                   scope,
-                       int                          entryLevel,
-                       int *                        lineShifts,
-                       int                          isStaticMethod,
-                       int                          isAsync )
+putSigned( struct byteBuffer *  buffer, int  value )
 {
-    assert( tree->n_type == funcdef );
-    assert( tree->n_nchildren > 1 );
-
-    node *      defNode = & ( tree->n_child[ 0 ] );
-    node *      nameNode = & ( tree->n_child[ 1 ] );
-    node *      colonNode = findChildOfType( tree, COLON );
-    node *      annotNode = findChildOfType( tree, test );
-
-    assert( colonNode != NULL );
+    putVarint( buffer, ( (uint32_t) value << 1 ) ^ (uint32_t) ( value >> 31 ) );
+}
 
-    char        returnAnnotation[ MAX_ARG_VAL_SIZE ];
-    int         annotationLength = 0;
-    if ( annotNode != NULL )
-    {
-        // The only 'test' child of a 'funcdef' is for a ret val annotation
-        collectTestString( annotNode, returnAnnotation, & annotationLength );
-    }
-
-    ++objectsLevel;
-    callOnFunction( callbacks->onFunction,
-                    nameNode->n_str, strlen( nameNode->n_str ),
-                    /* Function name line and pos */
-                    nameNode->n_lineno,
-                    nameNode->n_col_offset + 1,         /* To make it 1-based */
-                    lineShifts[ nameNode->n_lineno ] + nameNode->n_col_offset,
-                    /* Keyword 'def' line and pos */
-                    defNode->n_lineno,
-                    defNode->n_col_offset + 1,          /* To make it 1-based */
-                    /* ':' line and pos */
-                    colonNode->n_lineno,
-                    colonNode->n_col_offset + 1,        /* To make it 1-based */
-                    objectsLevel,
-                    isAsync,
-                    returnAnnotation, annotationLength );
 
-    const char *    firstArgName = NULL;
-    int             firstArg = 1;
-    node *          paramNode = findChildOfType( tree, parameters );
-    assert( paramNode != NULL );
+static void
+putHash( struct byteBuffer *  buffer, uint64_t  value )
+{
+    unsigned char   bytes[ 8 ];
 
-    node *      argsNode = findChildOfType( paramNode, typedargslist );
-    if ( argsNode != NULL )
-    {
-        /* The function has arguments */
-        int         k = 0;
-        node *      child;
-        while ( k < argsNode->n_nchildren )
-        {
-            child = & ( argsNode->n_child[ k ] );
-            if ( child->n_type == tfpdef )
-            {
-                if ( firstArg == 1 )
-                {
-                    firstArgName = processArgument( child,
-                                                    callbacks->onArgument );
-                    firstArg = 0;
-                }
-                else
-                {
-                    processArgument( child, callbacks->onArgument );
-                }
-            }
-            else if ( child->n_type == STAR )
-            {
-                firstArg = 0;
+    for ( int  k = 0; k < 8; ++k )
+        bytes[ k ] = (unsigned char) ( value >> ( 8 * k ) );
+    putBytes( buffer, bytes, sizeof( bytes ) );
+}
 
-                char        starName[ MAX_DOTTED_NAME_LENGTH ];
-                int         nameLen = 1;
-                char        annotation[ MAX_ARG_VAL_SIZE ];
-                int         annotationLength = 0;
 
-                starName[ 0 ] = '*';
+static void
+encodeDataNode( struct byteBuffer *  buffer, const struct dataNode *  n,
+                int *  prevLine, int *  prevAbsPosition )
+{
+    putVarint( buffer, n->kind );
+    putVarint( buffer, n->parent + 1 );
+    putVarint( buffer, n->name );
 
-                /* The * argument may be without a tfpdef */
-                if ( (k + 1) < argsNode->n_nchildren )
-                {
-                    node *      nextNode = & ( argsNode->n_child[ k + 1 ] );
-                    if ( nextNode->n_type == tfpdef )
-                    {
-                        ++k;
-                        node *      tfpdefChild = nextNode;
-                        node *      nameChild = & ( tfpdefChild->n_child[ 0 ] );
+    switch ( n->kind )
+    {
+        case DOCSTRING_EVENT:
+            putVarint( buffer, n->line );
+            putSigned( buffer, n->endLine - n->line );
+            return;
+        case ARGUMENT_EVENT:
+            putVarint( buffer, n->extra );
+            putVarint( buffer, n->value );
+            return;
+        case DECORATOR_ARGUMENT_EVENT:
+        case BASE_CLASS_EVENT:
+        case ERROR_EVENT:
+        case LEXER_ERROR_EVENT:
+            return;
+        default:
+            break;
+    }
 
-                        nameLen = strlen( nameChild->n_str );
-                        memcpy( & ( starName[ 1 ] ), nameChild->n_str, nameLen );
-                        ++nameLen;
+    putSigned( buffer, n->line - *prevLine );
+    putVarint( buffer, n->pos );
+    putSigned( buffer, n->absPosition - *prevAbsPosition );
+    *prevLine = n->line;
+    *prevAbsPosition = n->absPosition;
 
-                        node *      annotNode = findChildOfType( tfpdefChild, test );
+    if ( n->kind == FUNCTION_EVENT || n->kind == CLASS_EVENT )
+    {
+        putSigned( buffer, n->keywordLine - n->line );
+        putVarint( buffer, n->keywordPos );
+        putSigned( buffer, n->colonLine - n->line );
+        putVarint( buffer, n->colonPos );
+    }
+    if ( n->kind == FUNCTION_EVENT )
+        putVarint( buffer, n->isAsync );
+    if ( n->kind == FUNCTION_EVENT || n->kind == IMPORT_EVENT ||
+         n->kind == WHAT_EVENT )
+        putVarint( buffer, n->extra );
+    if ( n->kind == STATEMENT_EVENT )
+        putSigned( buffer, n->endLine - n->line );
+    if ( n->kind == FUNCTION_EVENT || n->kind == CLASS_EVENT ||
+         n->kind == STATEMENT_EVENT )
+        putHash( buffer, n->contentHash );
+}
 
-                        if ( annotNode != NULL )
-                            collectTestString( annotNode, annotation, & annotationLength );
-                    }
-                }
 
-                // *arg may not have a default value but may have an annotation
-                callOnAnnotatedArg( callbacks->onArgument,
-                                    starName, nameLen,
-                                    annotation, annotationLength );
-            }
-            else if ( child->n_type == DOUBLESTAR )
-            {
-                ++k;
-                node *      tfpdefChild = & ( argsNode->n_child[ k ] );
-                node *      nameChild = & ( tfpdefChild->n_child[ 0 ] );
-                int         nameLen = strlen( nameChild->n_str );
-                char        starName[ MAX_DOTTED_NAME_LENGTH ];
+static PyObject *
+encodeModuleData( const struct dataBuilder *  builder )
+{
+    struct byteBuffer   buffer;
+    unsigned char       header[ MODULE_DATA_HEADER_SIZE ] =
+                                { 'C', 'D', 'M', 'B', MODULE_DATA_VERSION,
+                                  builder->isOK ? 1 : 0 };
+    int                 prevLine = 0;
+    int                 prevAbsPosition = 0;
+
+    memset( & buffer, 0, sizeof( buffer ) );
+    putBytes( & buffer, header, sizeof( header ) );
+
+    putVarint( & buffer, builder->strings.count );
+    for ( int  k = 0; k < builder->strings.count; ++k )
+    {
+        putVarint( & buffer, builder->strings.lengths[ k ] );
+        putBytes( & buffer, builder->strings.pool + builder->strings.offsets[ k ],
+                  builder->strings.lengths[ k ] );
+    }
 
-                starName[ 0 ] = '*';
-                starName[ 1 ] = '*';
-                memcpy( & ( starName[ 2 ] ), nameChild->n_str, nameLen );
+    putVarint( & buffer, builder->count );
+    for ( int  k = 0; k < builder->count; ++k )
+        encodeDataNode( & buffer, & builder->nodes[ k ],
+                        & prevLine, & prevAbsPosition );
 
-                char        annotation[ MAX_ARG_VAL_SIZE ];
-                int         annotationLength = 0;
-                node *      annotNode = findChildOfType( tfpdefChild, test );
+    PyObject *  data = NULL;
+    if ( buffer.failed )
+        PyErr_NoMemory();
+    else
+        data = PyBytes_FromStringAndSize( (const char *) buffer.data,
+                                          buffer.size );
+    free( buffer.data );
+    return data;
+}
 
-                if ( annotNode != NULL )
-                    collectTestString( annotNode, annotation, & annotationLength );
 
-                // **arg may not have a default value but may have an
-                // annotation
-                callOnAnnotatedArg( callbacks->onArgument,
-                                    starName, nameLen + 2,
-                                    annotation, annotationLength );
-            }
-            else if ( child->n_type == test )
-            {
-                char        buffer[ MAX_ARG_VAL_SIZE ];
-                int         length = 0;
+/* Converts the recorded events into the module data bytes */
+static PyObject *
+eventBufferToModuleData( const struct eventBuffer *  events )
+{
+    struct dataBuilder  builder;
+    struct parserEvent  event;
+    PyObject *          data = NULL;
 
-                collectTestString( child, buffer, & length );
-                callOnArgVal( callbacks->onArgumentValue, buffer, length );
-            }
+    initDataBuilder( & builder );
+    for ( int  k = 0; k < events->count && ! builder.failed; ++k )
+    {
+        restoreEvent( events, k, & event );
+        dataOnEvent( & builder, & event );
+        if ( PyErr_Occurred() )
+            break;
+    }
 
-            ++k;
-        }
+    if ( ! PyErr_Occurred() )
+    {
+        if ( builder.failed )
+            PyErr_NoMemory();
+        else
+            data = encodeModuleData( & builder );
     }
+    clearDataBuilder( & builder );
+    return data;
+}
 
 
-    node *      suiteNode = findChildOfType( tree, suite );
-    assert( suiteNode != NULL );
-    checkForDocstring( suiteNode, callbacks );
+static char py_data_from_file_doc[] = "Get the serialized brief module info from a file";
+static PyObject *
+py_data_from_file( PyObject *  self,        /* unused */
+                   PyObject *  args )
+{
+    char *                  fileName;
+    int                     mask = ALL_EVENTS_MASK;
+    PyObject *              cancelFlag = Py_None;
+    double                  timeout = -1.0;
+    struct cancelCheck      cancel;
+    struct eventBuffer      buffer;
+    PyObject *              retValue;
+
+    if ( ! PyArg_ParseTuple( args, "s|iOd", & fileName, & mask,
+                                            & cancelFlag, & timeout ) )
+        return NULL;
+    if ( initCancelCheck( & cancel, cancelFlag, timeout ) != 0 )
+        return NULL;
 
-    /* Detect the new scope */
-    enum Scope  newScope = FUNCTION_SCOPE; /* Avoid the compiler complains */
-    switch ( scope )
+    retValue = recordEvents( fileName, NULL, mask, & cancel, & buffer );
+    if ( retValue != NULL )
     {
-        case GLOBAL_SCOPE:
-        case FUNCTION_SCOPE:
-        case CLASS_METHOD_SCOPE:
-        case CLASS_STATIC_METHOD_SCOPE:
-            newScope = FUNCTION_SCOPE;
-            break;
-        case CLASS_SCOPE:
-            /* It could be a static method if there is
-             * the '@staticmethod' decorator */
-            if ( isStaticMethod != 0 ) newScope = CLASS_STATIC_METHOD_SCOPE;
-            else                       newScope = CLASS_METHOD_SCOPE;
-            break;
+        Py_DECREF( retValue );
+        retValue = eventBufferToModuleData( & buffer );
     }
-
-    walk( suiteNode, callbacks, objectsLevel,
-          newScope, firstArgName, entryLevel, lineShifts, 0 );
-    return;
+    clearEventBuffer( & buffer );
+    clearCancelCheck( & cancel );
+    return retValue;
 }
 
 
-static void processAssign( node *              tree,
-                           PyObject *          onVariable,
-                           int                 objectsLevel,
-                           int *               lineShifts )
+static char py_data_from_mem_doc[] = "Get the serialized brief module info from memory";
+static PyObject *
+py_data_from_mem( PyObject *  self,         /* unused */
+                  PyObject *  args )
 {
-    assert( tree->n_type == testlist ||
-            tree->n_type == testlist_comp ||
-            tree->n_type == testlist_star_expr );
+    PyObject *              content;
+    int                     mask = ALL_EVENTS_MASK;
+    PyObject *              cancelFlag = Py_None;
+    double                  timeout = -1.0;
+    struct cancelCheck      cancel;
+    struct eventBuffer      buffer;
+    PyObject *              retValue;
+
+    if ( ! PyArg_ParseTuple( args, "O|iOd", & content, & mask,
+                                            & cancelFlag, & timeout ) )
+        return NULL;
+    if ( initCancelCheck( & cancel, cancelFlag, timeout ) != 0 )
+        return NULL;
 
-    node *      child;
-    for ( int  k = 0; k < tree->n_nchildren; ++k )
+    retValue = recordEvents( NULL, content, mask, & cancel, & buffer );
+    if ( retValue != NULL )
     {
-        child = & ( tree->n_child[ k ] );
-        #if PY_MAJOR_VERSION == 3 && (PY_MINOR_VERSION == 8 || PY_MINOR_VERSION == 9)
-        if ( child->n_type == namedexpr_test ||
-             child->n_type == test )
-        #else
-        if ( child->n_type == test )
-        #endif
-        {
-            node *      powerNode = skipToNode( child, power );
-            child = skipToNode( powerNode, atom );
-            if ( child == NULL )
-                continue;
+        Py_DECREF( retValue );
+        retValue = eventBufferToModuleData( & buffer );
+    }
+    clearEventBuffer( & buffer );
+    clearCancelCheck( & cancel );
+    return retValue;
+}
 
-            /* trailer means it is usage, not the initialization */
-            node *      atomExprNode = findChildOfType( powerNode, atom_expr );
-            if ( atomExprNode != NULL )
-            {
-                if ( findChildOfType( atomExprNode, trailer ) != NULL )
-                    continue;
-            }
 
-            if ( child->n_child[ 0 ].n_type == LPAR ||
-                 child->n_child[ 0 ].n_type == LSQB )
-            {
-                node *      listNode = findChildOfType( child, testlist_comp );
-//                if ( listNode == NULL )
-//                    listNode = findChildOfType( child, listmaker );
-                if ( listNode != NULL )
-                    processAssign( listNode, onVariable,
-                                   objectsLevel, lineShifts );
-                continue;
-            }
+/* Reads the module data in place; failed is set for the malformed data */
+struct dataReader
+{
+    const unsigned char *   current;
+    const unsigned char *   end;
+    int                     failed;
+};
 
-            char    name[ MAX_ARG_VAL_SIZE ];
-            int     length = 0;
 
-            collectTestString( child, name, & length );
-            callOnVariable( onVariable,
-                            name, length,
-                            child->n_lineno,
-                            child->n_col_offset + 1, /* Make it 1-based */
-                            lineShifts[ child->n_lineno ] + child->n_col_offset,
-                            objectsLevel );
-        }
+static uint32_t
+getVarint( struct dataReader *  reader )
+{
+    uint32_t    value = 0;
+
+    for ( int  shift = 0; shift < 35; shift += 7 )
+    {
+        if ( reader->current >= reader->end )
+            break;
+
+        unsigned char   byte = *reader->current++;
+        value |= (uint32_t) ( byte & 0x7F ) << shift;
+        if ( ( byte & 0x80 ) == 0 )
+            return value;
     }
-    return;
+    reader->failed = 1;
+    return 0;
 }
 
-static void processInstanceMember( node *                      tree,
-                                   struct instanceCallbacks *  callbacks,
-                                   const char *                firstArgName,
-                                   int                         objectsLevel,
-                                   int *                       lineShifts )
+
+static int
+getSigned( struct dataReader *  reader )
 {
-    if ( firstArgName == NULL )
-        return;
+    uint32_t    value = getVarint( reader );
+    return (int) ( value >> 1 ) ^ - (int) ( value & 1 );
+}
 
-    assert( tree->n_type == testlist ||
-            tree->n_type == testlist_comp ||
-            tree->n_type == testlist_star_expr );
 
-    node *      child;
-    int         n = tree->n_nchildren;
-    for ( int  k = 0; k < n; ++k )
+static uint64_t
+getHash( struct dataReader *  reader )
+{
+    uint64_t    value = 0;
+
+    if ( reader->end - reader->current < 8 )
     {
-        child = & ( tree->n_child[ k ] );
-        #if PY_MAJOR_VERSION == 3 && (PY_MINOR_VERSION == 8 || PY_MINOR_VERSION == 9)
-        if ( child->n_type == namedexpr_test ||
-             child->n_type == test )
-        #else
-        if ( child->n_type == test )
-        #endif
-        {
-            node *      powerNode = skipToNode( child, power );
-            child = skipToNode( powerNode, atom );
-            if ( child == NULL )
-                continue;
+        reader->failed = 1;
+        return 0;
+    }
+    for ( int  k = 0; k < 8; ++k )
+        value |= (uint64_t) reader->current[ k ] << ( 8 * k );
+    reader->current += 8;
+    return value;
+}
 
-            if ( child->n_child[ 0 ].n_type == LPAR ||
-                 child->n_child[ 0 ].n_type == LSQB )
-            {
-                node *      listNode = findChildOfType( child, testlist_comp );
-//                if ( listNode == NULL )
-//                    listNode = findChildOfType( child, listmaker );
-                if ( listNode != NULL )
-                    processInstanceMember( listNode, callbacks, firstArgName,
-                                           objectsLevel, lineShifts );
-                continue;
-            }
 
-            /* Count the trailer nodes. If there are more than one then it is
-             * the usage, not initialization */
-            int         trailerCount = 0;
-            node *      trailerNode = NULL;
-            node *      atomExprNode = findChildOfType( powerNode, atom_expr );
+/* Provides an index which must be below the limit */
+static int
+getIndex( struct dataReader *  reader, int  limit )
+{
+    uint32_t    value = getVarint( reader );
 
-            if ( atomExprNode == NULL )
-                continue;
+    if ( value >= (uint32_t) limit )
+    {
+        reader->failed = 1;
+        return 0;
+    }
+    return (int) value;
+}
 
-            for ( int  j = 0; j < atomExprNode->n_nchildren; ++j )
-            {
-                if ( atomExprNode->n_child[ j ].n_type == trailer )
-                {
-                    ++trailerCount;
-                    trailerNode = & ( atomExprNode->n_child[ j ] );
-                }
-            }
-            if ( trailerCount != 1 )
-                continue;
-            if ( trailerNode->n_nchildren != 2 )
-                continue;
-            if ( trailerNode->n_child[ 0 ].n_type != DOT )
-                continue;
-            if ( trailerNode->n_child[ 1 ].n_type != NAME )
-                continue;
 
-            /* collect the first part of the name and match it with the first
-             * argument name */
-            char    name[ MAX_ARG_VAL_SIZE ];
-            int     length = 0;
+static int
+decodeDataNode( struct dataReader *  reader, int  index, int  stringCount,
+                struct dataNode *  n, int *  prevLine, int *  prevAbsPosition )
+{
+    memset( n, 0, sizeof( struct dataNode ) );
+    n->kind = getIndex( reader, STATEMENT_EVENT + 1 );
+    n->parent = getIndex( reader, index + 1 ) - 1;
+    n->name = getIndex( reader, stringCount );
 
-            collectTestString( child, name, & length );
-            name[ length ] = '\0';
-            if ( strcmp( name, firstArgName ) != 0 )
-                continue;
+    switch ( n->kind )
+    {
+        case DOCSTRING_EVENT:
+            n->line = getVarint( reader );
+            n->endLine = n->line + getSigned( reader );
+            return reader->failed;
+        case ARGUMENT_EVENT:
+            n->extra = getIndex( reader, stringCount + 1 );
+            n->value = getIndex( reader, stringCount + 1 );
+            return reader->failed;
+        case DECORATOR_ARGUMENT_EVENT:
+        case BASE_CLASS_EVENT:
+        case ERROR_EVENT:
+        case LEXER_ERROR_EVENT:
+            return reader->failed;
+        case AS_EVENT:
+        case ARGUMENT_VALUE_EVENT:
+            /* There are no such nodes */
+            return 1;
+        default:
+            break;
+    }
 
-            /* Here: the trailer is what needs to be collected */
-            node *      nameNode = & ( trailerNode->n_child[ 1 ] );
-            callOnInstanceAttribute( callbacks->onInstanceAttribute,
-                                     nameNode->n_str, strlen( nameNode->n_str ),
-                                     nameNode->n_lineno,
-                                     nameNode->n_col_offset + 1, /* Make it 1-based */
-                                     lineShifts[ nameNode->n_lineno ] + nameNode->n_col_offset,
-                                     objectsLevel );
-        }
+    n->line = *prevLine + getSigned( reader );
+    n->pos = getVarint( reader );
+    n->absPosition = *prevAbsPosition + getSigned( reader );
+    *prevLine = n->line;
+    *prevAbsPosition = n->absPosition;
+
+    if ( n->kind == FUNCTION_EVENT || n->kind == CLASS_EVENT )
+    {
+        n->keywordLine = n->line + getSigned( reader );
+        n->keywordPos = getVarint( reader );
+        n->colonLine = n->line + getSigned( reader );
+        n->colonPos = getVarint( reader );
     }
+    if ( n->kind == FUNCTION_EVENT )
+        n->isAsync = getVarint( reader );
+    if ( n->kind == FUNCTION_EVENT || n->kind == IMPORT_EVENT ||
+         n->kind == WHAT_EVENT )
+        n->extra = getIndex( reader, stringCount + 1 );
+    if ( n->kind == STATEMENT_EVENT )
+        n->endLine = n->line + getSigned( reader );
+    if ( n->kind == FUNCTION_EVENT || n->kind == CLASS_EVENT ||
+         n->kind == STATEMENT_EVENT )
+        n->contentHash = getHash( reader );
+    return reader->failed;
+}
 
-    return;
+
+/* The strings refer to the module data buffer */
+struct dataStrings
+{
+    const char **   starts;
+    int *           lengths;
+    int             count;
+};
+
+
+static PyObject *
+newDataString( const struct dataStrings *  strings, int  index )
+{
+    return newString( strings->starts[ index ], strings->lengths[ index ] );
 }
 
 
+static PyObject *
+newDataIdentifier( const struct dataStrings *  strings, int  index )
+{
+    return newIdentifier( strings->starts[ index ],
+                          strings->lengths[ index ] );
+}
 
-/* Provides non NULL node to expr_stmt if it is an assignment */
-static node *  isAssignment( node *  tree )
+
+/* The optional strings are stored as index + 1 */
+static PyObject *
+newOptionalDataString( const struct dataStrings *  strings, int  index,
+                       int  noneAsEmpty )
 {
-    assert( tree->n_type == stmt );
-    if ( tree->n_nchildren < 1 )                            return NULL;
-    tree = & ( tree->n_child[ 0 ] );
-    if ( tree->n_type != simple_stmt )                      return NULL;
-    if ( tree->n_nchildren < 1 )                            return NULL;
-    tree = & ( tree->n_child[ 0 ] );
-    if ( tree->n_type != small_stmt )                       return NULL;
-    if ( tree->n_nchildren < 1 )                            return NULL;
-    tree = & ( tree->n_child[ 0 ] );
-    if ( tree->n_type != expr_stmt )                        return NULL;
-    if ( tree->n_nchildren < 2 )                            return NULL;
-    if ( tree->n_child[ 0 ].n_type != testlist_star_expr )  return NULL;
-    if ( tree->n_child[ 1 ].n_type != EQUAL )               return NULL;
-    return tree;
+    if ( index > 0 )
+        return newDataString( strings, index - 1 );
+    if ( noneAsEmpty )
+        return newString( "", 0 );
+    return newNone();
+}
+
+
+static PyObject *
+dataNodeToTuple( const struct dataStrings *  strings, int  index,
+                 const struct dataNode *  n )
+{
+    PyObject *  name = isNameEvent( n->kind )
+                            ? newDataIdentifier( strings, n->name )
+                            : newDataString( strings, n->name );
+
+    switch ( n->kind )
+    {
+        case ENCODING_EVENT:
+        case GLOBAL_EVENT:
+        case CLASS_ATTRIBUTE_EVENT:
+        case INSTANCE_ATTRIBUTE_EVENT:
+        case DECORATOR_EVENT:
+            return Py_BuildValue( "(iiiNiii)", index, n->kind, n->parent,
+                                  name, n->line, n->pos, n->absPosition );
+        case IMPORT_EVENT:
+        case WHAT_EVENT:
+            return Py_BuildValue( "(iiiNiiiN)", index, n->kind, n->parent,
+                                  name, n->line, n->pos, n->absPosition,
+                                  newOptionalDataString( strings, n->extra,
+                                                         1 ) );
+        case FUNCTION_EVENT:
+            return Py_BuildValue( "(iiiNiiiiiiiNNK)", index, n->kind,
+                                  n->parent, name,
+                                  n->line, n->pos, n->absPosition,
+                                  n->keywordLine, n->keywordPos,
+                                  n->colonLine, n->colonPos,
+                                  PyBool_FromLong( n->isAsync ),
+                                  newOptionalDataString( strings, n->extra,
+                                                         0 ),
+                                  (unsigned long long) n->contentHash );
+        case CLASS_EVENT:
+            return Py_BuildValue( "(iiiNiiiiiiiK)", index, n->kind,
+                                  n->parent, name,
+                                  n->line, n->pos, n->absPosition,
+                                  n->keywordLine, n->keywordPos,
+                                  n->colonLine, n->colonPos,
+                                  (unsigned long long) n->contentHash );
+        case STATEMENT_EVENT:
+            return Py_BuildValue( "(iiiNiiiiK)", index, n->kind, n->parent,
+                                  name, n->line, n->pos, n->absPosition,
+                                  n->endLine,
+                                  (unsigned long long) n->contentHash );
+        case DOCSTRING_EVENT:
+            return Py_BuildValue( "(iiiNii)", index, n->kind, n->parent,
+                                  name, n->line, n->endLine );
+        case ARGUMENT_EVENT:
+            return Py_BuildValue( "(iiiNNN)", index, n->kind, n->parent, name,
+                                  newOptionalDataString( strings, n->extra,
+                                                         0 ),
+                                  newOptionalDataString( strings, n->value,
+                                                         0 ) );
+        default:
+            /* decorator argument, base class, errors */
+            return Py_BuildValue( "(iiiN)", index, n->kind, n->parent, name );
+    }
 }
 
 
+/* The decoded module data. The strings refer to the data buffer which is
+ * held while the table lives. */
+struct moduleData
+{
+    Py_buffer           view;
+    struct dataStrings  strings;
+    struct dataNode *   nodes;
+    int                 count;
+    int *               depths;         /* functions and classes around */
+    int *               firstChild;     /* the last one is of the module */
+    int *               nextSibling;
+};
+
+#define MODULE_DATA_CAPSULE     "_cdmpyparser.moduleData"
+
 
-void walk( node *                       tree,
-           struct instanceCallbacks *   callbacks,
-           int                          objectsLevel,
-           enum Scope                   scope,
-           const char *                 firstArgName,
-           int                          entryLevel,
-           int *                        lineShifts,
-           int                          isStaticMethod )
+static void
+clearModuleData( struct moduleData *  md )
 {
-    ++entryLevel;   // For module docstring only
+    free( md->strings.starts );
+    free( md->strings.lengths );
+    free( md->nodes );
+    free( md->depths );
+    free( md->firstChild );
+    free( md->nextSibling );
+    if ( md->view.obj != NULL )
+        PyBuffer_Release( & md->view );
+    memset( md, 0, sizeof( struct moduleData ) );
+}
 
-    switch ( tree->n_type )
-    {
-        case import_stmt:
-            processImport( tree, callbacks, lineShifts );
-            return;
-        case funcdef:
-            processFuncDefinition( tree, callbacks,
-                                   objectsLevel, scope, entryLevel,
-                                   lineShifts, isStaticMethod, 0 );
-            return;
-        case async_funcdef:
-            {
-                node *      funcNode = & ( tree->n_child[ 1 ] );
-                processFuncDefinition( funcNode, callbacks,
-                                       objectsLevel, scope, entryLevel,
-                                       lineShifts, isStaticMethod, 1 );
-            }
-            return;
-        case classdef:
-            processClassDefinition( tree, callbacks,
-                                    objectsLevel, scope, entryLevel,
-                                    lineShifts );
-            return;
-        case async_stmt:
-            // It could be funcdef, with_stmt and for_stmt
-            // Here we are only interested in a funcdef
-            {
-                node *      stmtNode = & ( tree->n_child[ 1 ] );
-                if ( stmtNode->n_type == funcdef )
-                    processFuncDefinition( stmtNode, callbacks,
-                                           objectsLevel, scope, entryLevel,
-                                           lineShifts, isStaticMethod, 1 );
-            }
-            // No need to continue -- with & for are not for recognition by the
-            // parser and an async function has been processed if so
-            return;
 
-        case stmt:
-            {
-                node *      assignNode = isAssignment( tree );
-                if ( assignNode != NULL )
-                {
-                    node *      testListStarExprNode = & ( assignNode->n_child[ 0 ] );
-                    if ( scope == GLOBAL_SCOPE )
-                        processAssign( testListStarExprNode, callbacks->onGlobal,
-                                       objectsLevel, lineShifts );
-                    else if ( scope == CLASS_SCOPE )
-                        processAssign( testListStarExprNode,
-                                       callbacks->onClassAttribute,
-                                       objectsLevel, lineShifts );
-                    else if ( scope == CLASS_METHOD_SCOPE )
-                        processInstanceMember( testListStarExprNode, callbacks,
-                                               firstArgName, objectsLevel,
-                                               lineShifts );
+/* Decodes the data the view refers to; provides 0 or -1 with the exception
+ * set. The malformed data never leads to reading outside of the buffer. */
+static int
+decodeModuleData( struct moduleData *  md )
+{
+    const unsigned char *   data = (const unsigned char *) md->view.buf;
+    Py_ssize_t              size = md->view.len;
+    struct dataReader       reader = { data + MODULE_DATA_HEADER_SIZE,
+                                       data + size, 0 };
+    struct dataStrings *    strings = & md->strings;
+    int                     prevLine = 0;
+    int                     prevAbsPosition = 0;
+
+    if ( size < MODULE_DATA_HEADER_SIZE ||
+         memcmp( data, MODULE_DATA_MAGIC, 4 ) != 0 )
+    {
+        PyErr_SetString( PyExc_ValueError, "Not a brief module data" );
+        return -1;
+    }
+    if ( data[ 4 ] != MODULE_DATA_VERSION )
+    {
+        PyErr_Format( PyExc_ValueError,
+                      "Unsupported brief module data version %d", data[ 4 ] );
+        return -1;
+    }
 
-                    /* The other scopes are not interesting */
-                    return;
-                }
-            }
+    /* Each string takes at least one byte */
+    strings->count = getIndex( & reader, reader.end - reader.current + 1 );
+    strings->starts = (const char **) malloc( ( strings->count + 1 ) *
+                                              sizeof( const char * ) );
+    strings->lengths = (int *) malloc( ( strings->count + 1 ) * sizeof( int ) );
+    if ( strings->starts == NULL || strings->lengths == NULL )
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
 
-        default:
-            break;
+    for ( int  k = 0; k < strings->count && ! reader.failed; ++k )
+    {
+        strings->lengths[ k ] = getIndex( & reader,
+                                          reader.end - reader.current + 1 );
+        strings->starts[ k ] = (const char *) reader.current;
+        reader.current += strings->lengths[ k ];
     }
 
+    /* Each node takes at least three bytes */
+    md->count = getIndex( & reader, ( reader.end - reader.current ) / 3 + 1 );
+    md->nodes = (struct dataNode *) malloc( ( md->count + 1 ) *
+                                            sizeof( struct dataNode ) );
+    md->depths = (int *) malloc( ( md->count + 1 ) * sizeof( int ) );
+    md->firstChild = (int *) malloc( ( md->count + 1 ) * sizeof( int ) );
+    md->nextSibling = (int *) malloc( ( md->count + 1 ) * sizeof( int ) );
+    int *   lastChild = (int *) malloc( ( md->count + 1 ) * sizeof( int ) );
+    if ( md->nodes == NULL || md->depths == NULL || md->firstChild == NULL ||
+         md->nextSibling == NULL || lastChild == NULL )
+    {
+        free( lastChild );
+        PyErr_NoMemory();
+        return -1;
+    }
+    memset( md->firstChild, 0xFF, ( md->count + 1 ) * sizeof( int ) );
 
-    int         staticDecor = 0;
-    node *      child;
-    int         n = tree->n_nchildren;
-    for ( int  i = 0; i < n; ++i )
+    for ( int  k = 0; k < md->count && ! reader.failed; ++k )
     {
-        child = & ( tree->n_child[ i ] );
+        struct dataNode *   n = & md->nodes[ k ];
 
-        if ( (entryLevel == 1) && (i == 0) )
+        if ( decodeDataNode( & reader, k, strings->count, n,
+                             & prevLine, & prevAbsPosition ) != 0 )
         {
-            /* This could be a module docstring */
-            checkForDocstring( tree, callbacks );
+            reader.failed = 1;
+            break;
         }
 
-        /* decorators are always before a class or a function definition on the
-         * same level. So they will be picked by the following deinition
-         */
-        if ( child->n_type == decorators )
+        int     parent = n->parent < 0 ? md->count : n->parent;
+
+        md->depths[ k ] = 0;
+        if ( n->parent >= 0 )
         {
-            staticDecor = processDecorators( child, callbacks, lineShifts );
-            continue;
+            int     parentKind = md->nodes[ n->parent ].kind;
+            md->depths[ k ] = md->depths[ n->parent ] +
+                              ( parentKind == FUNCTION_EVENT ||
+                                parentKind == CLASS_EVENT );
         }
-        walk( child, callbacks, objectsLevel,
-              scope, firstArgName, entryLevel, lineShifts, staticDecor );
-        staticDecor = 0;
+
+        md->nextSibling[ k ] = -1;
+        if ( md->firstChild[ parent ] < 0 )
+            md->firstChild[ parent ] = k;
+        else
+            md->nextSibling[ lastChild[ parent ] ] = k;
+        lastChild[ parent ] = k;
     }
+    free( lastChild );
 
-    return;
+    if ( reader.failed || reader.current != reader.end )
+    {
+        PyErr_SetString( PyExc_ValueError, "Corrupted brief module data" );
+        return -1;
+    }
+    return 0;
 }
 
 
-
-/* Calculates the line shifts in terms of absolute position */
-static void
-calculateLineShifts( const char * buffer, int * lineShifts )
+/* Provides the nodes of the wanted kinds which are nested into at most depth
+ * functions and classes */
+static PyObject *
+readModuleData( const struct moduleData *  md, int  mask, int  depth )
 {
-    int     absPos = 0;
-    char    symbol;
-    int     line = 1;
+    PyObject *  nodes = PyList_New( 0 );
+    if ( nodes == NULL )
+        return NULL;
 
-    /* index 0 is not used; The first line starts with shift 0 */
-    lineShifts[ 1 ] = 0;
-    while ( buffer[ absPos ] != '\0' )
+    for ( int  k = 0; k < md->count; ++k )
     {
-        symbol = buffer[ absPos ];
-        if ( symbol == '\r' )
-        {
-            ++absPos;
-            if ( buffer[ absPos ] == '\n' )
-            {
-                ++absPos;
-            }
-            ++line;
-            lineShifts[ line ] = absPos;
+        const struct dataNode *     n = & md->nodes[ k ];
+
+        if ( ( mask & EVENT_BIT( n->kind ) ) == 0 ||
+             ( depth >= 0 && md->depths[ k ] > depth ) )
             continue;
-        }
 
-        if ( symbol == '\n' )
+        PyObject *  item = dataNodeToTuple( & md->strings, k, n );
+        if ( item == NULL || PyList_Append( nodes, item ) != 0 )
         {
-            ++absPos;
-            ++line;
-            lineShifts[ line ] = absPos;
+            Py_XDECREF( item );
+            Py_DECREF( nodes );
+            return NULL;
+        }
+        Py_DECREF( item );
+    }
+    return nodes;
+}
+
+
+/* Provides the children of the node (-1: the module) of the wanted kinds */
+static PyObject *
+readModuleDataChildren( const struct moduleData *  md, int  parent,
+                        int  mask )
+{
+    if ( parent < -1 || parent >= md->count )
+    {
+        PyErr_SetString( PyExc_IndexError, "Invalid node index" );
+        return NULL;
+    }
+
+    PyObject *  nodes = PyList_New( 0 );
+    if ( nodes == NULL )
+        return NULL;
+
+    for ( int  k = md->firstChild[ parent < 0 ? md->count : parent ];
+          k >= 0; k = md->nextSibling[ k ] )
+    {
+        if ( ( mask & EVENT_BIT( md->nodes[ k ].kind ) ) == 0 )
             continue;
+
+        PyObject *  item = dataNodeToTuple( & md->strings, k,
+                                            & md->nodes[ k ] );
+        if ( item == NULL || PyList_Append( nodes, item ) != 0 )
+        {
+            Py_XDECREF( item );
+            Py_DECREF( nodes );
+            return NULL;
         }
-        ++absPos;
+        Py_DECREF( item );
     }
-    return;
+    return nodes;
 }
 
-/* Copied and adjusted from Python/pythonrun.c
- * static void err_input(perrdetail *err)
- */
-static void getErrorMessage( char *  buffer, perrdetail *  err)
+
+static char py_read_data_doc[] = "Get the nodes of the serialized brief module info";
+static PyObject *
+py_read_data( PyObject *  self,             /* unused */
+              PyObject *  args )
 {
-    sprintf( buffer, "%d:%d ", err->lineno, err->offset );
-    int     len = strlen( buffer );
+    PyObject *          data;
+    int                 mask = ALL_EVENTS_MASK;
+    int                 depth = -1;
+    struct moduleData   md;
+    PyObject *          nodes = NULL;
 
-    switch ( err->error )
+    if ( ! PyArg_ParseTuple( args, "O|ii", & data, & mask, & depth ) )
+        return NULL;
+
+    memset( & md, 0, sizeof( md ) );
+    if ( PyObject_GetBuffer( data, & md.view, PyBUF_C_CONTIGUOUS ) != 0 )
+        return NULL;
+
+    if ( decodeModuleData( & md ) == 0 )
+        nodes = readModuleData( & md, mask, depth );
+    clearModuleData( & md );
+    return nodes;
+}
+
+
+static void
+freeModuleDataCapsule( PyObject *  capsule )
+{
+    struct moduleData *     md = (struct moduleData *)
+                        PyCapsule_GetPointer( capsule, MODULE_DATA_CAPSULE );
+    if ( md != NULL )
     {
-        case E_ERROR:
-            sprintf( buffer,
-                     "execution error" );
-            return;
-        case E_SYNTAX:
-            if ( err->expected == INDENT )
-                sprintf( & buffer[ len ],
-                         "expected an indented block" );
-            else if ( err->token == INDENT )
-                sprintf( & buffer[ len ],
-                         "unexpected indent" );
-            else if (err->token == DEDENT)
-                sprintf( & buffer[ len ],
-                         "unexpected unindent" );
-            else
-                sprintf( & buffer[ len ],
-                         "invalid syntax" );
-            break;
-        case E_TOKEN:
-            sprintf( & buffer[ len ],
-                     "invalid token" );
-            break;
-        case E_EOFS:
-            sprintf( & buffer[ len ],
-                     "EOF while scanning triple-quoted string literal" );
-            break;
-        case E_EOLS:
-            sprintf( & buffer[ len ],
-                     "EOL while scanning string literal" );
-            break;
-        case E_INTR:
-            sprintf( buffer,
-                     "keyboard interrupt" );
-            goto cleanup;
-        case E_NOMEM:
-            sprintf( buffer,
-                    "no memory" );
-            goto cleanup;
-        case E_EOF:
-            sprintf( & buffer[ len ],
-                     "unexpected EOF while parsing" );
-            break;
-        case E_TABSPACE:
-            sprintf( & buffer[ len ],
-                     "inconsistent use of tabs and spaces in indentation" );
-            break;
-        case E_OVERFLOW:
-            sprintf( & buffer[ len ],
-                     "expression too long" );
-            break;
-        case E_DEDENT:
-            sprintf( & buffer[ len ],
-                     "unindent does not match any outer indentation level" );
-            break;
-        case E_TOODEEP:
-            sprintf( & buffer[ len ],
-                     "too many levels of indentation" );
-            break;
-        case E_DECODE:
-            sprintf( & buffer[ len ],
-                     "decode error" );
-            break;
-        case E_LINECONT:
-            sprintf( & buffer[ len ],
-                     "unexpected character after line continuation character" );
-            break;
-        default:
-            sprintf( & buffer[ len ],
-                     "unknown parsing error (error code %d)", err->error);
-            break;
+        clearModuleData( md );
+        free( md );
     }
+}
 
-    if ( err->text != NULL )
-        sprintf( & buffer[ strlen( buffer ) ], "\n%s", err->text );
 
-    cleanup:
-    if (err->text != NULL)
+static char py_load_data_doc[] = "Decode the serialized brief module info for the node queries";
+static PyObject *
+py_load_data( PyObject *  self,             /* unused */
+              PyObject *  args )
+{
+    PyObject *          data;
+    struct moduleData * md;
+
+    if ( ! PyArg_ParseTuple( args, "O", & data ) )
+        return NULL;
+
+    md = (struct moduleData *) calloc( 1, sizeof( struct moduleData ) );
+    if ( md == NULL )
+        return PyErr_NoMemory();
+
+    if ( PyObject_GetBuffer( data, & md->view, PyBUF_C_CONTIGUOUS ) != 0 )
     {
-        PyObject_FREE(err->text);
-        err->text = NULL;
+        free( md );
+        return NULL;
+    }
+
+    PyObject *  capsule = NULL;
+    if ( decodeModuleData( md ) == 0 )
+        capsule = PyCapsule_New( md, MODULE_DATA_CAPSULE,
+                                 freeModuleDataCapsule );
+    if ( capsule == NULL )
+    {
+        clearModuleData( md );
+        free( md );
     }
+    return capsule;
 }
 
 
+static char py_data_children_doc[] = "Get the children of a decoded brief module info node";
+static PyObject *
+py_data_children( PyObject *  self,         /* unused */
+                  PyObject *  args )
+{
+    PyObject *          capsule;
+    int                 parent;
+    int                 mask = ALL_EVENTS_MASK;
 
-static void processEncoding( char *                         buffer,
-                             node *                         tree,
-                             struct instanceCallbacks *     callbacks )
+    if ( ! PyArg_ParseTuple( args, "Oi|i", & capsule, & parent, & mask ) )
+        return NULL;
+
+    struct moduleData *     md = (struct moduleData *)
+                        PyCapsule_GetPointer( capsule, MODULE_DATA_CAPSULE );
+    if ( md == NULL )
+        return NULL;
+    return readModuleDataChildren( md, parent, mask );
+}
+
+
+/* Registers the classes the native mode creates */
+/* Parsing of many files on the worker threads. The workers read the files
+ * and walk the trees without the GIL; the GIL is taken only for the parser
+ * itself because it allocates the tree nodes with the Python allocator. The
+ * found items are recorded as events and the results are built on the
+ * calling thread. */
+
+/* Called without the GIL by a worker which has the given thread state */
+static enum FileStatus
+parseFileJob( struct fileJob *  job, int  mask, PyThreadState *  threadState )
 {
-    /* Unfortunately, the parser does not provide the position of the encoding
-     * so it needs to be calculated
-     */
-    char *      start = strstr( buffer, tree->n_str );
-    if ( start == NULL )
-        return;     /* would be really strange */
+    struct fileContent      content;
+    enum FileStatus         status = openFileContent( job->fileName,
+                                                      & content );
+
+    if ( status != FILE_OK || content.buffer == NULL )
+        return status;
 
-    int         line = 1;
-    int         col = 1;
-    char *      current = buffer;
-    while ( current != start )
+    char *                  buffer = content.buffer;
+    struct parserContext    context;
+    struct arena *          arena = getThreadArena();
+
+    if ( arena == NULL )
     {
-        if ( * current == '\r' )
-        {
-            if ( * (current + 1) == '\n' )
-                ++current;
-            ++line;
-            col = 0;
-        }
-        else if ( * current == '\n' )
-        {
-            ++line;
-            col = 0;
-        }
-        ++col;
-        ++current;
+        closeFileContent( & content );
+        return FILE_NO_MEMORY;
     }
 
-    callOnEncoding( callbacks->onEncoding, tree->n_str,
-                    line, col, start - buffer );
-}
+    memset( & context, 0, sizeof( struct parserContext ) );
+    context.events = & job->events;
+    context.mask = mask;
+
+    if ( parserBackend == SCANNER_BACKEND )
+    {
+        /* The GIL is needed only for the codecs */
+        struct arenaMark    mark = saveArena( arena );
+        char *              converted = NULL;
+        int                 decoded = 0;
+
+        if ( needsDecoding( buffer ) )
+        {
+            PyEval_RestoreThread( threadState );
+            decoded = decodeCode( buffer, arena, & converted );
+            PyErr_Clear();
+            PyEval_SaveThread();
+        }
 
+        if ( decoded > 0 )
+            emitDecodeError( & context );
+        else if ( decoded < 0 )
+            job->events.failed = 1;
+        else
+            scanCode( buffer, converted, arena, & context, NULL, NULL );
+        releaseArena( arena, mark );
+        clearUniqueNames( & context.names );
+        closeFileContent( & content );
+        return job->events.failed ? FILE_NO_MEMORY : FILE_OK;
+    }
 
-static PyObject *
-parse_input( char *                         buffer,
-             const char *                   fileName,
-             struct instanceCallbacks *     callbacks )
-{
-    perrdetail          error;
-    PyCompilerFlags     flags = { 0 };
-    node *              tree = PyParser_ParseStringFlagsFilename(
-                                    buffer, fileName, &_PyParser_Grammar,
-                                    file_input, &error, flags.cf_flags );
+#ifdef CDM_INTERPRETER_PARSER
+    perrdetail              error;
+    char                    message[ MAX_ERROR_MSG_SIZE ];
 
+    PyEval_RestoreThread( threadState );
+    node *      tree = PyParser_ParseStringFlagsFilename(
+                            buffer, job->fileName, &_PyParser_Grammar,
+                            file_input, &error, 0 );
     if ( tree == NULL )
     {
-        char        buffer[ MAX_ERROR_MSG_SIZE ];
-
-        getErrorMessage( buffer, & error );
-        callOnError( callbacks->onError, buffer );
+        getErrorMessage( message, & error );
         PyErr_Clear();
     }
+    PyEval_SaveThread();
+
+    if ( tree == NULL )
+    {
+        struct parserEvent  event = { .kind = ERROR_EVENT,
+                                      .name = message,
+                                      .nameLength = strlen( message ) };
+        emitEvent( & context, & event );
+    }
     else
     {
-        /* Walk the tree and populate the python structures */
-        node *      root = tree;
-        int         totalLines = getTotalLines( tree );
+        int                 totalLines = getTotalLines( tree );
 
         assert( totalLines >= 0 );
-        int         lineShifts[ totalLines + 1 ];
+        struct arenaMark    mark = saveArena( arena );
+        int *               lineShifts = (int *) arenaAlloc( arena,
+                                    ( totalLines + 1 ) * sizeof( int ) );
 
-        calculateLineShifts( buffer, lineShifts );
-
-        if ( root->n_type == encoding_decl )
+        if ( lineShifts == NULL )
+            job->events.failed = 1;
+        else
         {
-            processEncoding( buffer, tree, callbacks );
-            root = & (root->n_child[ 0 ]);
+            calculateLineShifts( buffer, lineShifts, totalLines );
+            walkTree( tree, buffer, lineShifts, arena, & context );
         }
+        releaseArena( arena, mark );
 
-
-        assert( root->n_type == file_input );
-        walk( root, callbacks, -1, GLOBAL_SCOPE, NULL, 0, lineShifts, 0 );
+        PyEval_RestoreThread( threadState );
         PyNode_Free( tree );
+        PyEval_SaveThread();
     }
+#endif
 
-    Py_INCREF( Py_None );
-    return Py_None;
+    clearUniqueNames( & context.names );
+    closeFileContent( & content );
+    return job->events.failed ? FILE_NO_MEMORY : FILE_OK;
 }
 
 
+static void *
+fileWorker( void *  arg )
+{
+    struct filePool *   pool = (struct filePool *) arg;
+    PyGILState_STATE    gilState = PyGILState_Ensure();
+    PyThreadState *     threadState = PyEval_SaveThread();
 
-/* Parses the given file */
-static char py_modinfo_from_file_doc[] = "Get brief module info from a file";
+    for ( ; ; )
+    {
+        int     index;
+
+        pthread_mutex_lock( & pool->lock );
+        if ( pool->cancelled || pool->next >= pool->count )
+            index = -1;
+        else
+            index = pool->next++;
+        pthread_mutex_unlock( & pool->lock );
+
+        if ( index < 0 )
+            break;
+
+        struct fileJob *    job = & pool->jobs[ index ];
+        enum FileStatus     status = parseFileJob( job, pool->mask,
+                                                   threadState );
+
+        pthread_mutex_lock( & pool->lock );
+        job->status = status;
+        job->finished = 1;
+        pthread_cond_broadcast( & pool->finished );
+        pthread_mutex_unlock( & pool->lock );
+    }
+
+    PyEval_RestoreThread( threadState );
+    PyGILState_Release( gilState );
+    return NULL;
+}
+
+
+/* Builds the module info from the recorded events of a finished job */
 static PyObject *
-py_modinfo_from_file( PyObject *  self,     /* unused */
-                      PyObject *  args )
+buildModuleInfo( PyObject *  infoType, const struct fileJob *  job )
 {
-    PyObject *                  callbackClass = NULL;
-    char *                      fileName;
-    struct instanceCallbacks    callbacks;
-    PyObject *                  retValue;
-    FILE *                      f;
-    struct stat                 st;
+    struct nativeBuilder    builder;
+    struct parserEvent      event;
 
-    /* Parse the passed arguments */
-    if ( ! PyArg_ParseTuple( args, "Os", & callbackClass, & fileName ) )
+    switch ( job->status )
     {
-        PyErr_SetString( PyExc_TypeError, "Incorrect arguments. "
-                                          "Expected: callback class "
-                                          "instance and file name" );
-        return NULL;
+        case FILE_CANNOT_OPEN:
+            PyErr_Format( PyExc_RuntimeError, "Cannot open file %s",
+                          job->fileName );
+            return NULL;
+        case FILE_CANNOT_READ:
+            PyErr_Format( PyExc_RuntimeError, "Cannot read file %s",
+                          job->fileName );
+            return NULL;
+        case FILE_NO_MEMORY:
+            return PyErr_NoMemory();
+        default:
+            break;
     }
 
-    /* Check the passed argument */
-    if ( ! fileName )
+    PyObject *  modInfo = PyObject_CallObject( infoType, NULL );
+    if ( modInfo == NULL )
+        return NULL;
+
+    if ( initNativeBuilder( & builder, modInfo ) != 0 )
     {
-        PyErr_SetString( PyExc_TypeError, "Incorrect file name" );
+        clearNativeBuilder( & builder );
+        Py_DECREF( modInfo );
         return NULL;
     }
-    if ( ! callbackClass )
+
+    for ( int  k = 0; k < job->events.count; ++k )
     {
-        PyErr_SetString( PyExc_TypeError, "Invalid callback class argument" );
+        restoreEvent( & job->events, k, & event );
+        builderOnEvent( & builder, & event );
+    }
+
+    if ( finalizeNativeBuilder( & builder ) != 0 )
+        Py_CLEAR( modInfo );
+    clearNativeBuilder( & builder );
+    return modInfo;
+}
+
+
+static char py_modinfo_from_files_doc[] = "Get brief module info for many files";
+static PyObject *
+py_modinfo_from_files( PyObject *  self,    /* unused */
+                       PyObject *  args )
+{
+    PyObject *          infoType;
+    PyObject *          paths;
+    int                 workers = 0;
+    int                 mask = ALL_EVENTS_MASK;
+    struct filePool     pool;
+
+    if ( ! PyArg_ParseTuple( args, "OO|ii", & infoType, & paths,
+                                            & workers, & mask ) )
         return NULL;
+
+    paths = PySequence_Fast( paths, "The file names must be a sequence" );
+    if ( paths == NULL )
+        return NULL;
+
+    Py_ssize_t  count = PySequence_Fast_GET_SIZE( paths );
+    PyObject *  results = PyList_New( count );
+    if ( results == NULL || count == 0 )
+    {
+        Py_DECREF( paths );
+        return results;
     }
-    /*
-       Ommit the check below: the old style classes worked fine with
-       PyInstance_Check(...). With new style classes (i.e. derived from
-       'object') none of the checks PyInstance_Check(...) or PyType_Check(...)
-       is working. It is though more or less ok not to have the check at all
-       because the member functions are retrieved with checks anyway.
-       if ( ! PyInstance_Check( callbackClass ) )
-       if ( ! PyType_Check( callbackClass ) )
-       {
-           PyErr_SetString( PyExc_TypeError, "Incorrect callback class instance" );
-           return NULL;
-       }
-    */
 
-    /* Get pointers to the members */
-    if ( getInstanceCallbacks( callbackClass, & callbacks ) != 0 )
+    memset( & pool, 0, sizeof( struct filePool ) );
+    pool.count = count;
+    pool.mask = normalizeEventMask( mask );
+    pool.jobs = (struct fileJob *)calloc( count, sizeof( struct fileJob ) );
+    if ( pool.jobs == NULL )
     {
-        clearCallbacks( & callbacks );
-        return NULL;
+        Py_DECREF( results );
+        Py_DECREF( paths );
+        return PyErr_NoMemory();
     }
 
-    f = fopen( fileName, "r" );
-    if ( f == NULL )
+    /* The file name buffers belong to the items of the paths sequence */
+    for ( Py_ssize_t  k = 0; k < count; ++k )
     {
-        clearCallbacks( & callbacks );
-        PyErr_SetString( PyExc_RuntimeError, "Cannot open file" );
-        return NULL;
+        PyObject *  item = PySequence_Fast_GET_ITEM( paths, k );
+        if ( ! PyArg_Parse( item, "s", & pool.jobs[ k ].fileName ) )
+        {
+            free( pool.jobs );
+            Py_DECREF( results );
+            Py_DECREF( paths );
+            return NULL;
+        }
     }
 
-    /* Get the file size */
-    stat( fileName, &st );
+    if ( workers <= 0 )
+        workers = (int)sysconf( _SC_NPROCESSORS_ONLN );
+    if ( workers <= 0 )
+        workers = 1;
+    if ( workers > count )
+        workers = count;
 
-    if ( st.st_size > 0 )
+    pthread_t *     threads = (pthread_t *)malloc( workers * sizeof( pthread_t ) );
+    if ( threads == NULL )
+    {
+        free( pool.jobs );
+        Py_DECREF( results );
+        Py_DECREF( paths );
+        return PyErr_NoMemory();
+    }
+
+    #if PY_MAJOR_VERSION < 3 || PY_MINOR_VERSION < 7
+    PyEval_InitThreads();
+    #endif
+    pthread_mutex_init( & pool.lock, NULL );
+    pthread_cond_init( & pool.finished, NULL );
+
+    int     started = 0;
+    for ( ; started < workers; ++started )
+        if ( pthread_create( & threads[ started ], NULL,
+                             fileWorker, & pool ) != 0 )
+            break;
+
+    int     failed = 0;
+    if ( started == 0 )
+    {
+        PyErr_SetString( PyExc_RuntimeError, "Cannot start a worker thread" );
+        failed = 1;
+    }
+
+    /* Materialize the results in batches of the consecutive finished jobs */
+    for ( int  next = 0; next < count && ! failed; )
     {
-        char            buffer[st.st_size + 2];
-        int             elem = fread( buffer, st.st_size, 1, f );
-        if ( elem != 1 )
+        int     ready;
+
+        Py_BEGIN_ALLOW_THREADS
+        pthread_mutex_lock( & pool.lock );
+        while ( ! pool.jobs[ next ].finished )
+            pthread_cond_wait( & pool.finished, & pool.lock );
+        for ( ready = next; ready < count; ++ready )
+            if ( ! pool.jobs[ ready ].finished )
+                break;
+        pthread_mutex_unlock( & pool.lock );
+        Py_END_ALLOW_THREADS
+
+        for ( ; next < ready; ++next )
         {
-            fclose( f );
-            clearCallbacks( & callbacks );
-            PyErr_SetString( PyExc_RuntimeError, "Cannot read file" );
-            return NULL;
+            PyObject *  modInfo = buildModuleInfo( infoType,
+                                                   & pool.jobs[ next ] );
+            clearEventBuffer( & pool.jobs[ next ].events );
+            if ( modInfo == NULL )
+            {
+                failed = 1;
+                break;
+            }
+            PyList_SET_ITEM( results, next, modInfo );
         }
+    }
+
+    pthread_mutex_lock( & pool.lock );
+    pool.cancelled = 1;
+    pthread_mutex_unlock( & pool.lock );
+
+    Py_BEGIN_ALLOW_THREADS
+    for ( int  k = 0; k < started; ++k )
+        pthread_join( threads[ k ], NULL );
+    Py_END_ALLOW_THREADS
 
-        buffer[ st.st_size ] = '\n';
-        buffer[ st.st_size + 1 ] = '\0';
-        fclose( f );
+    for ( Py_ssize_t  k = 0; k < count; ++k )
+        clearEventBuffer( & pool.jobs[ k ].events );
+    pthread_cond_destroy( & pool.finished );
+    pthread_mutex_destroy( & pool.lock );
+    free( threads );
+    free( pool.jobs );
+    Py_DECREF( paths );
 
-        retValue = parse_input( buffer, fileName, & callbacks );
+    if ( failed )
+    {
+        Py_DECREF( results );
+        return NULL;
     }
-    else
+    return results;
+}
+
+
+/* Adds the delta to an integer attribute */
+static int
+shiftAttr( PyObject *  object, enum AttrName  attr, long  delta )
+{
+    PyObject *  value = getAttr( object, attr );
+    if ( value == NULL )
+        return -1;
+
+    long        current = PyInt_AsLong( value );
+    Py_DECREF( value );
+    if ( current == -1 && PyErr_Occurred() )
+        return -1;
+    return setAttr( object, attr, newInt( current + delta ) );
+}
+
+
+static int
+shiftDocstring( PyObject *  owner, long  lineDelta )
+{
+    PyObject *  docstring = getAttr( owner, DOCSTRING_ATTR );
+    int         ret = 0;
+
+    if ( docstring == NULL )
+        return -1;
+    if ( docstring != Py_None )
     {
-        fclose( f );
-        clearCallbacks( & callbacks );
-        Py_INCREF( Py_None );
-        return Py_None;
+        if ( shiftAttr( docstring, START_LINE_ATTR, lineDelta ) != 0 ||
+             shiftAttr( docstring, END_LINE_ATTR, lineDelta ) != 0 ||
+             shiftAttr( docstring, LINE_ATTR, lineDelta ) != 0 )
+            ret = -1;
     }
+    Py_DECREF( docstring );
+    return ret;
+}
 
-    clearCallbacks( & callbacks );
-    return retValue;
+
+static int  shiftItems( PyObject *  items, long  lineDelta, long  absDelta );
+
+static int
+shiftNestedItems( PyObject *  owner, enum AttrName  attr,
+                  long  lineDelta, long  absDelta )
+{
+    PyObject *  items = getAttr( owner, attr );
+    if ( items == NULL )
+        return -1;
+
+    int         ret = shiftItems( items, lineDelta, absDelta );
+    Py_DECREF( items );
+    return ret;
 }
 
 
-/* Parses the given code */
-static char py_modinfo_from_mem_doc[] = "Get brief module info from memory";
-static PyObject *
-py_modinfo_from_mem( PyObject *  self,      /* unused */
-                     PyObject *  args )
+/* Shifts the positions of the items and all their nested items */
+static int
+shiftItem( PyObject *  item, long  lineDelta, long  absDelta )
 {
-    PyObject *                  callbackClass;
-    char *                      content;
-    struct instanceCallbacks    callbacks;
-    int                         length;
-    PyObject *                  retValue;
+    if ( shiftAttr( item, LINE_ATTR, lineDelta ) != 0 ||
+         shiftAttr( item, ABS_POSITION_ATTR, absDelta ) != 0 )
+        return -1;
+
+    if ( PyObject_TypeCheck( item, (PyTypeObject *) importType ) )
+        return shiftNestedItems( item, WHAT_ATTR, lineDelta, absDelta );
+    if ( PyObject_TypeCheck( item, (PyTypeObject *) statementType ) )
+        return shiftAttr( item, END_LINE_ATTR, lineDelta );
+
+    int     isClass = PyObject_TypeCheck( item, (PyTypeObject *) classType );
+    if ( ! isClass &&
+         ! PyObject_TypeCheck( item, (PyTypeObject *) functionType ) )
+        return 0;
+
+    if ( shiftAttr( item, KEYWORD_LINE_ATTR, lineDelta ) != 0 ||
+         shiftAttr( item, COLON_LINE_ATTR, lineDelta ) != 0 ||
+         shiftDocstring( item, lineDelta ) != 0 ||
+         shiftNestedItems( item, DECORATORS_ATTR, lineDelta, absDelta ) != 0 ||
+         shiftNestedItems( item, FUNCTIONS_ATTR, lineDelta, absDelta ) != 0 ||
+         shiftNestedItems( item, CLASSES_ATTR, lineDelta, absDelta ) != 0 )
+        return -1;
+    if ( isClass )
+    {
+        if ( shiftNestedItems( item, CLASS_ATTRIBUTES_ATTR,
+                               lineDelta, absDelta ) != 0 ||
+             shiftNestedItems( item, INSTANCE_ATTRIBUTES_ATTR,
+                               lineDelta, absDelta ) != 0 )
+            return -1;
+    }
+    return 0;
+}
 
 
-    /* Parse the passed arguments */
-    if ( ! PyArg_ParseTuple( args, "Os", & callbackClass, & content ) )
+static int
+shiftItems( PyObject *  items, long  lineDelta, long  absDelta )
+{
+    if ( ! PyList_Check( items ) )
     {
-        PyErr_SetString( PyExc_TypeError, "Incorrect arguments. "
-                                          "Expected: callback class "
-                                          "instance and buffer with python code" );
-        return NULL;
+        PyErr_SetString( PyExc_TypeError, "A list of items is expected" );
+        return -1;
     }
 
-    /* Check the passed argument */
-    if ( ! content )
+    for ( Py_ssize_t  k = 0; k < PyList_GET_SIZE( items ); ++k )
     {
-        PyErr_SetString( PyExc_TypeError, "Incorrect memory buffer" );
-        return NULL;
+        PyObject *  item = PyList_GET_ITEM( items, k );
+        int         ret;
+
+        Py_INCREF( item );
+        ret = shiftItem( item, lineDelta, absDelta );
+        Py_DECREF( item );
+        if ( ret != 0 )
+            return -1;
     }
-    if ( ! callbackClass )
+    return 0;
+}
+
+
+/* Shifts the positions of the brief module info items after an edit */
+static char py_shift_items_doc[] = "Shift the items positions";
+static PyObject *
+py_shift_items( PyObject *  self,      /* unused */
+                PyObject *  args )
+{
+    PyObject *      items;
+    long            lineDelta;
+    long            absDelta;
+
+    if ( ! PyArg_ParseTuple( args, "Oll", & items, & lineDelta, & absDelta ) )
+        return NULL;
+
+    if ( functionType == NULL )
     {
-        PyErr_SetString( PyExc_TypeError, "Invalid callback class argument" );
+        PyErr_SetString( PyExc_RuntimeError, "The result types are not set" );
         return NULL;
     }
-    /*
-       Ommit the check below: the old style classes worked fine with
-       PyInstance_Check(...). With new style classes (i.e. derived from
-       'object') none of the checks PyInstance_Check(...) or PyType_Check(...)
-       is working. It is though more or less ok not to have the check at all
-       because the member functions are retrieved with checks anyway.
-       if ( ! PyInstance_Check( callbackClass ) )
-       if ( ! PyType_Check( callbackClass ) )
-       {
-           PyErr_SetString( PyExc_TypeError, "Incorrect callback class instance" );
-           return NULL;
-       }
-    */
+    if ( ( lineDelta != 0 || absDelta != 0 ) &&
+         shiftItems( items, lineDelta, absDelta ) != 0 )
+        return NULL;
 
-    /* Get pointers to the members */
-    if ( getInstanceCallbacks( callbackClass, & callbacks ) != 0 )
-    {
-        clearCallbacks( & callbacks );
+    Py_INCREF( Py_None );
+    return Py_None;
+}
+
+
+static char py_set_result_types_doc[] = "Register the native mode result types";
+static PyObject *
+py_set_result_types( PyObject *  self,      /* unused */
+                     PyObject *  args )
+{
+    PyObject *      types;
+
+    if ( ! PyArg_ParseTuple( args, "O!", & PyDict_Type, & types ) )
         return NULL;
+
+    /* Check all first so that a partial registration is not possible */
+    for ( int  k = 0; resultTypes[ k ].name != NULL; ++k )
+    {
+        PyObject *  item = PyDict_GetItemString( types, resultTypes[ k ].name );
+        if ( item == NULL || ! PyCallable_Check( item ) )
+        {
+            PyErr_Format( PyExc_TypeError, "Cannot get %s", resultTypes[ k ].name );
+            return NULL;
+        }
+        if ( ! PyType_Check( item ) )
+        {
+            PyErr_Format( PyExc_TypeError, "%s is not a type", resultTypes[ k ].name );
+            return NULL;
+        }
     }
 
-    length = strlen( content );
-    if ( content[ length - 1 ] == '\n' )
+    for ( int  k = 0; resultTypes[ k ].name != NULL; ++k )
     {
-        retValue = parse_input( content, "dummy.py", & callbacks );
+        PyObject *  item = PyDict_GetItemString( types, resultTypes[ k ].name );
+        PyObject *  old = * resultTypes[ k ].object;
+
+        Py_INCREF( item );
+        * resultTypes[ k ].object = item;
+        Py_XDECREF( old );
     }
+
+    Py_INCREF( Py_None );
+    return Py_None;
+}
+
+
+
+static char py_set_parser_backend_doc[] = "Select what finds the items: 'parser' or 'scanner'";
+static PyObject *
+py_set_parser_backend( PyObject *  self,    /* unused */
+                       PyObject *  args )
+{
+    char *      name;
+
+    if ( ! PyArg_ParseTuple( args, "s", & name ) )
+        return NULL;
+
+    if ( strcmp( name, parserBackendNames[ SCANNER_BACKEND ] ) == 0 )
+        parserBackend = SCANNER_BACKEND;
+#ifdef CDM_INTERPRETER_PARSER
+    else if ( strcmp( name,
+                      parserBackendNames[ INTERPRETER_PARSER_BACKEND ] ) == 0 )
+        parserBackend = INTERPRETER_PARSER_BACKEND;
+#endif
     else
     {
-        char *  buffer = (char *)malloc( length + 2 );
-        memcpy( buffer, content, length );
-        buffer[ length ] = '\n';
-        buffer[ length + 1 ] = '\0';
-
-        retValue = parse_input( content, "dummy.py", & callbacks );
-        free( buffer );
+        PyErr_Format( PyExc_ValueError, "Unsupported parser backend: %s",
+                      name );
+        return NULL;
     }
 
-    clearCallbacks( & callbacks );
-    return retValue;
+    Py_INCREF( Py_None );
+    return Py_None;
+}
+
+
+static char py_get_parser_backend_doc[] = "Provide the current parser backend name";
+static PyObject *
+py_get_parser_backend( PyObject *  self,    /* unused */
+                       PyObject *  args )   /* unused */
+{
+    return PyString_FromString( parserBackendNames[ parserBackend ] );
+}
+
+
+/* The backends the extension is built with */
+static PyObject *
+getParserBackends( void )
+{
+#ifdef CDM_INTERPRETER_PARSER
+    return Py_BuildValue( "(ss)",
+                          parserBackendNames[ INTERPRETER_PARSER_BACKEND ],
+                          parserBackendNames[ SCANNER_BACKEND ] );
+#else
+    return Py_BuildValue( "(s)", parserBackendNames[ SCANNER_BACKEND ] );
+#endif
 }
 
 
+/* The exception for the abandoned parses; one reference is kept here and
+ * the other one is given to the module */
+static int
+initParseCancelledError( void )
+{
+    parseCancelledError = PyErr_NewExceptionWithDoc(
+                "_cdmpyparser.ParseCancelled",
+                "The parse has been cancelled or its deadline has passed",
+                NULL, NULL );
+    if ( parseCancelledError == NULL )
+        return 1;
+    Py_INCREF( parseCancelledError );
+    return 0;
+}
+
 
 static PyMethodDef _cdm_py_parser_methods[] =
 {
@@ -2118,6 +10436,30 @@ static PyMethodDef _cdm_py_parser_methods[] =
                                       py_modinfo_from_file_doc },
     { "getBriefModuleInfoFromMemory", py_modinfo_from_mem,  METH_VARARGS,
                                       py_modinfo_from_mem_doc },
+    { "getBriefModuleEventsFromFile", py_events_from_file,  METH_VARARGS,
+                                      py_events_from_file_doc },
+    { "getBriefModuleEventsFromMemory", py_events_from_mem, METH_VARARGS,
+                                      py_events_from_mem_doc },
+    { "getBriefModuleInfoFromFiles",  py_modinfo_from_files, METH_VARARGS,
+                                      py_modinfo_from_files_doc },
+    { "getBriefModuleDataFromFile",   py_data_from_file,    METH_VARARGS,
+                                      py_data_from_file_doc },
+    { "getBriefModuleDataFromMemory", py_data_from_mem,     METH_VARARGS,
+                                      py_data_from_mem_doc },
+    { "readBriefModuleData",          py_read_data,         METH_VARARGS,
+                                      py_read_data_doc },
+    { "loadBriefModuleData",          py_load_data,         METH_VARARGS,
+                                      py_load_data_doc },
+    { "getBriefModuleDataChildren",   py_data_children,     METH_VARARGS,
+                                      py_data_children_doc },
+    { "shiftItems",                   py_shift_items,       METH_VARARGS,
+                                      py_shift_items_doc },
+    { "setResultTypes",               py_set_result_types,  METH_VARARGS,
+                                      py_set_result_types_doc },
+    { "setParserBackend",             py_set_parser_backend, METH_VARARGS,
+                                      py_set_parser_backend_doc },
+    { "getParserBackend",             py_get_parser_backend, METH_NOARGS,
+                                      py_get_parser_backend_doc },
     { NULL, NULL, 0, NULL }
 };
 
@@ -2126,9 +10468,21 @@ static PyMethodDef _cdm_py_parser_methods[] =
     /* Python 2 initialization */
     void init_cdmpyparser( void )
     {
+        if ( initNativeNames() != 0 )
+            return;
+
         PyObject *  module = Py_InitModule( "_cdmpyparser",
                                             _cdm_py_parser_methods );
         PyModule_AddStringConstant( module, "version", CDM_PY_PARSER_VERSION );
+        initNewlineKernel();
+        PyModule_AddIntConstant( module, "eventBufferVersion",
+                                 EVENT_BUFFER_VERSION );
+        PyModule_AddIntConstant( module, "moduleDataVersion",
+                                 MODULE_DATA_VERSION );
+        PyModule_AddObject( module, "parserBackends", getParserBackends() );
+        if ( initParseCancelledError() == 0 )
+            PyModule_AddObject( module, "ParseCancelled",
+                                parseCancelledError );
     }
 #else
     /* Python 3 initialization */
@@ -2145,8 +10499,24 @@ static PyMethodDef _cdm_py_parser_methods[] =
     PyInit__cdmpyparser( void )
     {
         PyObject *  module;
+
+        if ( initNativeNames() != 0 )
+            return NULL;
+
         module = PyModule_Create( & _cdm_py_parser_module );
         PyModule_AddStringConstant( module, "version", CDM_PY_PARSER_VERSION );
+        initNewlineKernel();
+        PyModule_AddIntConstant( module, "eventBufferVersion",
+                                 EVENT_BUFFER_VERSION );
+        PyModule_AddIntConstant( module, "moduleDataVersion",
+                                 MODULE_DATA_VERSION );
+        PyModule_AddObject( module, "parserBackends", getParserBackends() );
+        if ( initParseCancelledError() != 0 )
+        {
+            Py_DECREF( module );
+            return NULL;
+        }
+        PyModule_AddObject( module, "ParseCancelled", parseCancelledError );
         return module;
     }
 #endif
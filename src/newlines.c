@@ -0,0 +1,284 @@
+/*
+ * codimension - graphics python two-way code editor and analyzer
+ * Copyright (C) 2010-2022  Sergey Satskiy <sergey.satskiy@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Line endings scanning kernel: SSE2 and AVX2 implementations selected at
+ * runtime with a scalar fallback
+ */
+
+#include "newlines.h"
+
+#include <string.h>
+
+#if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+#define NEWLINES_X86    1
+#include <immintrin.h>
+#endif
+
+
+/* CR and LF at the positions of the bits of the masks are counted. A CR at
+ * the end of the previous block is passed as carry; a CR followed by a LF
+ * is a single line ending. */
+static int
+countMaskedLineEnds( unsigned int  crMask, unsigned int  lfMask,
+                     unsigned int  carry )
+{
+    return __builtin_popcount( crMask ) + __builtin_popcount( lfMask ) -
+           __builtin_popcount( ( ( crMask << 1 ) | carry ) & lfMask );
+}
+
+
+static const char *
+scalarFindLineEnd( const char *  start, const char *  end )
+{
+    while ( start < end )
+    {
+        if ( *start == '\n' || *start == '\r' )
+            return start;
+        ++start;
+    }
+    return end;
+}
+
+
+/* Counts the tail of a buffer; prevCR tells if the previous symbol was CR */
+static int
+scalarCountTail( const char *  start, const char *  end, int  prevCR )
+{
+    int     count = 0;
+
+    for ( ; start < end; ++start )
+    {
+        if ( *start == '\r' )
+        {
+            ++count;
+            prevCR = 1;
+            continue;
+        }
+        if ( *start == '\n' && ! prevCR )
+            ++count;
+        prevCR = 0;
+    }
+    return count;
+}
+
+
+static int
+scalarCountLineEnds( const char *  start, const char *  end )
+{
+    return scalarCountTail( start, end, 0 );
+}
+
+
+#ifdef NEWLINES_X86
+
+__attribute__(( target( "sse2" ) ))
+static const char *
+sse2FindLineEnd( const char *  start, const char *  end )
+{
+    const __m128i   lf = _mm_set1_epi8( '\n' );
+    const __m128i   cr = _mm_set1_epi8( '\r' );
+
+    for ( ; end - start >= 16; start += 16 )
+    {
+        __m128i     block = _mm_loadu_si128( (const __m128i *) start );
+        int         mask = _mm_movemask_epi8(
+                                _mm_or_si128( _mm_cmpeq_epi8( block, lf ),
+                                              _mm_cmpeq_epi8( block, cr ) ) );
+        if ( mask != 0 )
+            return start + __builtin_ctz( mask );
+    }
+    return scalarFindLineEnd( start, end );
+}
+
+
+__attribute__(( target( "sse2" ) ))
+static int
+sse2CountLineEnds( const char *  start, const char *  end )
+{
+    const __m128i   lf = _mm_set1_epi8( '\n' );
+    const __m128i   cr = _mm_set1_epi8( '\r' );
+    unsigned int    carry = 0;
+    int             count = 0;
+
+    for ( ; end - start >= 16; start += 16 )
+    {
+        __m128i         block = _mm_loadu_si128( (const __m128i *) start );
+        unsigned int    crMask = _mm_movemask_epi8(
+                                        _mm_cmpeq_epi8( block, cr ) );
+        unsigned int    lfMask = _mm_movemask_epi8(
+                                        _mm_cmpeq_epi8( block, lf ) );
+
+        count += countMaskedLineEnds( crMask, lfMask, carry );
+        carry = ( crMask >> 15 ) & 1;
+    }
+    return count + scalarCountTail( start, end, carry );
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static const char *
+avx2FindLineEnd( const char *  start, const char *  end )
+{
+    const __m256i   lf = _mm256_set1_epi8( '\n' );
+    const __m256i   cr = _mm256_set1_epi8( '\r' );
+
+    for ( ; end - start >= 32; start += 32 )
+    {
+        __m256i         block = _mm256_loadu_si256( (const __m256i *) start );
+        unsigned int    mask = _mm256_movemask_epi8(
+                            _mm256_or_si256( _mm256_cmpeq_epi8( block, lf ),
+                                             _mm256_cmpeq_epi8( block, cr ) ) );
+        if ( mask != 0 )
+            return start + __builtin_ctz( mask );
+    }
+    return sse2FindLineEnd( start, end );
+}
+
+
+__attribute__(( target( "avx2" ) ))
+static int
+avx2CountLineEnds( const char *  start, const char *  end )
+{
+    const __m256i   lf = _mm256_set1_epi8( '\n' );
+    const __m256i   cr = _mm256_set1_epi8( '\r' );
+    unsigned int    carry = 0;
+    int             count = 0;
+
+    for ( ; end - start >= 32; start += 32 )
+    {
+        __m256i         block = _mm256_loadu_si256( (const __m256i *) start );
+        unsigned int    crMask = _mm256_movemask_epi8(
+                                        _mm256_cmpeq_epi8( block, cr ) );
+        unsigned int    lfMask = _mm256_movemask_epi8(
+                                        _mm256_cmpeq_epi8( block, lf ) );
+
+        count += countMaskedLineEnds( crMask, lfMask, carry );
+        carry = crMask >> 31;
+    }
+    return count + scalarCountTail( start, end, carry );
+}
+
+#endif
+
+
+struct newlineKernel
+{
+    const char *    name;
+    const char *    (* findLineEnd)( const char *  start, const char *  end );
+    int             (* countLineEnds)( const char *  start, const char *  end );
+};
+
+static const struct newlineKernel    kernels[] =
+{
+    { "scalar", scalarFindLineEnd, scalarCountLineEnds },
+#ifdef NEWLINES_X86
+    { "sse2",   sse2FindLineEnd,   sse2CountLineEnds },
+    { "avx2",   avx2FindLineEnd,   avx2CountLineEnds },
+#endif
+};
+
+static const struct newlineKernel *     kernel = NULL;
+
+
+static int
+isKernelSupported( const char *  name )
+{
+    if ( strcmp( name, "scalar" ) == 0 )
+        return 1;
+#ifdef NEWLINES_X86
+    __builtin_cpu_init();
+    if ( strcmp( name, "sse2" ) == 0 )
+        return __builtin_cpu_supports( "sse2" );
+    if ( strcmp( name, "avx2" ) == 0 )
+        return __builtin_cpu_supports( "avx2" );
+#endif
+    return 0;
+}
+
+
+void
+initNewlineKernel( void )
+{
+    /* The last supported kernel is the fastest one */
+    const struct newlineKernel *    best = & kernels[ 0 ];
+    int                             count = sizeof( kernels ) /
+                                            sizeof( kernels[ 0 ] );
+
+    for ( int  k = 0; k < count; ++k )
+        if ( isKernelSupported( kernels[ k ].name ) )
+            best = & kernels[ k ];
+    kernel = best;
+}
+
+
+int
+setNewlineKernel( const char *  name )
+{
+    int     count = sizeof( kernels ) / sizeof( kernels[ 0 ] );
+
+    for ( int  k = 0; k < count; ++k )
+    {
+        if ( strcmp( kernels[ k ].name, name ) == 0 )
+        {
+            if ( ! isKernelSupported( name ) )
+                return -1;
+            kernel = & kernels[ k ];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+
+const char *
+getNewlineKernel( void )
+{
+    if ( kernel == NULL )
+        initNewlineKernel();
+    return kernel->name;
+}
+
+
+const char *
+findLineEnd( const char *  start, const char *  end )
+{
+    if ( kernel == NULL )
+        initNewlineKernel();
+    return kernel->findLineEnd( start, end );
+}
+
+
+const char *
+findNextLine( const char *  start, const char *  end )
+{
+    const char *    lineEnd = findLineEnd( start, end );
+
+    if ( lineEnd == end )
+        return NULL;
+    if ( lineEnd[ 0 ] == '\r' && lineEnd + 1 < end && lineEnd[ 1 ] == '\n' )
+        return lineEnd + 2;
+    return lineEnd + 1;
+}
+
+
+int
+countLineEnds( const char *  start, const char *  end )
+{
+    if ( kernel == NULL )
+        initNewlineKernel();
+    return kernel->countLineEnds( start, end );
+}
@@ -0,0 +1,48 @@
+/*
+ * codimension - graphics python two-way code editor and analyzer
+ * Copyright (C) 2010-2022  Sergey Satskiy <sergey.satskiy@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Line endings scanning kernel. A line ends with '\n', '\r' or "\r\n".
+ */
+
+#ifndef NEWLINES_H
+#define NEWLINES_H
+
+#include <stddef.h>
+
+
+/* Selects the best kernel the CPU supports. It is called implicitly by the
+ * scanning functions; calling it upfront avoids a race of the first calls */
+void  initNewlineKernel( void );
+
+/* Forces a kernel: "scalar", "sse2" or "avx2". Returns 0 if the kernel is
+ * available on this CPU. Used by the benchmark and the tests. */
+int  setNewlineKernel( const char *  name );
+
+/* Provides the currently used kernel name */
+const char *  getNewlineKernel( void );
+
+/* Provides the first '\r' or '\n' in [start, end) or end if there is none */
+const char *  findLineEnd( const char *  start, const char *  end );
+
+/* Provides the beginning of the line next to the one which has start or
+ * NULL if there are no more line endings in [start, end) */
+const char *  findNextLine( const char *  start, const char *  end );
+
+/* Provides the number of line endings in [start, end) */
+int  countLineEnds( const char *  start, const char *  end );
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * codimension - graphics python two-way code editor and analyzer
+ * Copyright (C) 2010-2022  Sergey Satskiy <sergey.satskiy@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Micro benchmark of the line endings scanning kernels. It also checks that
+ * all the kernels provide the same results.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "newlines.h"
+
+
+#define SOURCE_SIZE         ( 64 * 1024 * 1024 )
+#define DOCSTRING_LINES     5000
+#define DOCSTRING_LOOPS     200
+
+static const char *     kernelNames[] = { "scalar", "sse2", "avx2" };
+
+static const char *     sourceLines[] =
+{
+    "class Message(object):",
+    "    \"\"\"Generated message\"\"\"",
+    "",
+    "    def __init__(self, value=0, name='message'):",
+    "        self.value = value",
+    "        self.name = name",
+    "",
+    "    def serialize(self, stream):",
+    "        stream.write(self.name)  # a comment which makes the line longer",
+    "        return self.value",
+    "",
+};
+
+
+static double
+now( void )
+{
+    struct timespec     ts;
+
+    clock_gettime( CLOCK_MONOTONIC, & ts );
+    return ts.tv_sec + ts.tv_nsec / 1E9;
+}
+
+
+/* Fills the buffer with the lines repeated; provides the used size */
+static size_t
+generate( char *  buffer, size_t  size, const char **  lines, int  count,
+          const char *  eol )
+{
+    size_t      used = 0;
+    size_t      eolLength = strlen( eol );
+
+    for ( int  k = 0; ; k = ( k + 1 ) % count )
+    {
+        size_t  length = strlen( lines[ k ] );
+        if ( used + length + eolLength >= size )
+            break;
+        memcpy( buffer + used, lines[ k ], length );
+        memcpy( buffer + used + length, eol, eolLength );
+        used += length + eolLength;
+    }
+    buffer[ used ] = '\0';
+    return used;
+}
+
+
+/* The same as the extension does for the line shifts */
+static long
+lineShifts( const char *  buffer, size_t  size )
+{
+    const char *    current = buffer;
+    const char *    end = buffer + size;
+    long            checksum = 0;
+
+    while ( ( current = findNextLine( current, end ) ) != NULL )
+        checksum += current - buffer;
+    return checksum;
+}
+
+
+static int
+benchmark( const char *  title, const char *  source, size_t  sourceSize,
+           const char *  docstring, size_t  docstringSize )
+{
+    long        expectedShifts = -1;
+    int         expectedCount = -1;
+    int         kernels = sizeof( kernelNames ) / sizeof( kernelNames[ 0 ] );
+
+    printf( "%s\n", title );
+    for ( int  k = 0; k < kernels; ++k )
+    {
+        if ( setNewlineKernel( kernelNames[ k ] ) != 0 )
+        {
+            printf( "    %-7s not supported\n", kernelNames[ k ] );
+            continue;
+        }
+
+        double  start = now();
+        long    shifts = lineShifts( source, sourceSize );
+        double  shiftsTime = now() - start;
+
+        start = now();
+        int     count = 0;
+        for ( int  loop = 0; loop < DOCSTRING_LOOPS; ++loop )
+            count += countLineEnds( docstring, docstring + docstringSize );
+        double  countTime = now() - start;
+
+        printf( "    %-7s line shifts: %8.1f MB/s   "
+                "docstring lines: %8.1f MB/s\n", kernelNames[ k ],
+                sourceSize / shiftsTime / 1048576.0,
+                docstringSize * (double) DOCSTRING_LOOPS /
+                        countTime / 1048576.0 );
+
+        if ( expectedShifts == -1 )
+        {
+            expectedShifts = shifts;
+            expectedCount = count;
+        }
+        else if ( shifts != expectedShifts || count != expectedCount )
+        {
+            printf( "    %s results differ from the scalar ones\n",
+                    kernelNames[ k ] );
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+int main( void )
+{
+    char *          source = (char *)malloc( SOURCE_SIZE );
+    char *          docstring = (char *)malloc( DOCSTRING_LINES * 80 );
+    const char *    docstringLines[] =
+    {
+        "    Multi thousand lines docstring with some text in it",
+        "",
+        "    :param value: the value to be serialized",
+    };
+    const char *    eols[] = { "\n", "\r\n" };
+    const char *    titles[] = { "LF line endings:", "CRLF line endings:" };
+    int             rc = 0;
+
+    if ( source == NULL || docstring == NULL )
+    {
+        fprintf( stderr, "No memory\n" );
+        return EXIT_FAILURE;
+    }
+
+    initNewlineKernel();
+    printf( "Default kernel: %s\n", getNewlineKernel() );
+
+    for ( int  k = 0; k < 2; ++k )
+    {
+        size_t  sourceSize = generate( source, SOURCE_SIZE, sourceLines,
+                                       sizeof( sourceLines ) /
+                                       sizeof( sourceLines[ 0 ] ), eols[ k ] );
+        size_t  docstringSize = generate( docstring, DOCSTRING_LINES * 80,
+                                          docstringLines, 3, eols[ k ] );
+        rc |= benchmark( titles[ k ], source, sourceSize,
+                         docstring, docstringSize );
+    }
+
+    free( source );
+    free( docstring );
+    return rc == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -20,8 +20,12 @@
 
 
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 
 #include <iostream>
+#include <vector>
 
 
 /*
@@ -51,6 +55,60 @@ struct PythonEnvironment
 };
 
 
+// The file content terminated with "\n\0" in a heap buffer; the file is
+// read in one go. A file truncated meanwhile gives a short read.
+struct FileContent
+{
+    const char *        buffer;
+    size_t              size;
+    std::vector<char>   copy;
+
+    FileContent() : buffer( NULL ), size( 0 ) {}
+
+    bool  read( int  fd )
+    {
+        size_t      total = 0;
+        while ( total < size )
+        {
+            ssize_t     count = ::read( fd, & copy[ total ], size - total );
+            if ( count < 0 && errno == EINTR )
+                continue;
+            if ( count <= 0 )
+                return false;
+            total += count;
+        }
+        return true;
+    }
+
+    bool  load( const char *  fileName )
+    {
+        int     fd = open( fileName, O_RDONLY );
+        if ( fd < 0 )
+            return false;
+
+        struct stat     st;
+        if ( fstat( fd, &st ) != 0 )
+        {
+            close( fd );
+            return false;
+        }
+
+        size = st.st_size;
+        copy.resize( size + 2 );
+
+        bool    loaded = read( fd );
+        close( fd );
+        if ( ! loaded )
+            return false;
+
+        copy[ size ] = '\n';
+        copy[ size + 1 ] = '\0';
+        buffer = & copy[ 0 ];
+        return true;
+    }
+};
+
+
 
 std::string errorCodeToString( int  error )
 {
@@ -339,13 +397,6 @@ int main( int  argc, char *  argv[] )
         return EXIT_FAILURE;
     }
 
-    FILE *              f = fopen( argv[1], "r" );
-    if ( f == NULL )
-    {
-        std::cerr << "Cannot open " << argv[1] << std::endl;
-        return EXIT_FAILURE;
-    }
-
     int     loops = 1;
     if ( argc == 3 )
     {
@@ -358,22 +409,13 @@ int main( int  argc, char *  argv[] )
     }
 
 
-    struct stat     st;
-    stat( argv[1], &st );
-
-    char            buffer[st.st_size + 2];
-    size_t          itemCount = fread( buffer, st.st_size, 1, f );
-    if (itemCount != 1)
+    FileContent     content;
+    if ( ! content.load( argv[1] ) )
     {
-        std::cerr << "Unexpected number of read items. Must be 1, received "
-                  << itemCount << std::endl;
+        std::cerr << "Cannot read " << argv[1] << std::endl;
         return EXIT_FAILURE;
     }
 
-    buffer[ st.st_size ] = '\n';
-    buffer[ st.st_size + 1 ] = '\0';
-    fclose( f );
-
     PythonEnvironment   pyEnv;
     perrdetail          error;
     PyCompilerFlags     flags = { 0 };
@@ -381,7 +423,7 @@ int main( int  argc, char *  argv[] )
     for ( int  k = 0; k < loops; ++k )
     {
         node *              n = PyParser_ParseStringFlagsFilename(
-                                    buffer,
+                                    content.buffer,
                                     argv[1],
                                     &_PyParser_Grammar,
                                     file_input, &error, flags.cf_flags );
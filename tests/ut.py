@@ -25,6 +25,7 @@ from __future__ import print_function
 import unittest
 import os.path
 import sys
+import tempfile
 import cdmpyparser
 
 
@@ -85,6 +86,39 @@ class CDMBriefParserTest(unittest.TestCase):
         if not files_equal(outFileName, okFileName):
             self.fail(errorMsg)
 
+        nativeInfo = cdmpyparser.getBriefModuleInfoFromFile(pythonFile,
+                                                            native=True)
+        if nativeInfo.niceStringify() != info.niceStringify():
+            self.fail(errorMsg + ". Option: native mode from a file.")
+        nativeInfo = cdmpyparser.getBriefModuleInfoFromMemory(content,
+                                                              native=True)
+        if nativeInfo.niceStringify() != info.niceStringify():
+            self.fail(errorMsg + ". Option: native mode from memory.")
+
+        events = cdmpyparser.getBriefModuleEventsFromFile(pythonFile)
+        if events != cdmpyparser.getBriefModuleEventsFromMemory(content):
+            self.fail(errorMsg + ". Option: events from memory.")
+        replayed = cdmpyparser.replayEvents(events)
+        if replayed.niceStringify() != info.niceStringify():
+            self.fail(errorMsg + ". Option: replayed events.")
+        raw = cdmpyparser.getBriefModuleEventsFromFile(pythonFile, raw=True)
+        if cdmpyparser.decodeEvents(raw) != events:
+            self.fail(errorMsg + ". Option: raw events.")
+
+        data = cdmpyparser.getBriefModuleDataFromFile(pythonFile)
+        if data != cdmpyparser.getBriefModuleDataFromMemory(content):
+            self.fail(errorMsg + ". Option: module data from memory.")
+        restored = cdmpyparser.BriefModuleData(data).toModuleInfo()
+        f = open(okFileName)
+        expected = f.read()
+        f.close()
+        if restored.niceStringify().strip() != expected.strip():
+            self.fail(errorMsg + ". Option: module data round trip.")
+        lazyInfo = cdmpyparser.getBriefModuleInfoFromFile(pythonFile,
+                                                          lazy=True)
+        if lazyInfo.niceStringify() != restored.niceStringify():
+            self.fail(errorMsg + ". Option: lazy results.")
+
     def test_empty(self):
         """Test empty file"""
         self.meat(self.dir + "empty.py",
@@ -189,6 +223,855 @@ class CDMBriefParserTest(unittest.TestCase):
         if not files_equal(outFileName, okFileName):
             self.fail("errors test failed")
 
+    def test_native_errors(self):
+        """Test errors in the native mode"""
+        pythonFile = self.dir + "errors.py"
+        info = cdmpyparser.getBriefModuleInfoFromFile(pythonFile)
+        nativeInfo = cdmpyparser.getBriefModuleInfoFromFile(pythonFile,
+                                                            native=True)
+        if nativeInfo.isOK:
+            self.fail("Expected parsing error for file " + pythonFile +
+                      ". Option: native mode.")
+        if nativeInfo.errors != info.errors or \
+           nativeInfo.niceStringify() != info.niceStringify():
+            self.fail("native mode errors test failed")
+
+    def test_event_mask(self):
+        """Test collecting only some kinds of items"""
+        pythonFile = self.dir + "class_members.py"
+        events = cdmpyparser.getBriefModuleEventsFromFile(pythonFile)
+        for kinds in [(cdmpyparser.EVENT_CLASS, cdmpyparser.EVENT_FUNCTION),
+                      (cdmpyparser.EVENT_CLASS, cdmpyparser.EVENT_FUNCTION,
+                       cdmpyparser.EVENT_INSTANCE_ATTRIBUTE,
+                       cdmpyparser.EVENT_DOCSTRING),
+                      (cdmpyparser.EVENT_IMPORT, cdmpyparser.EVENT_GLOBAL)]:
+            mask = cdmpyparser.eventMask(*kinds)
+            expected = [event for event in events if event[0] in kinds]
+            if cdmpyparser.getBriefModuleEventsFromFile(
+                    pythonFile, mask=mask) != expected:
+                self.fail("event mask test failed for kinds " + str(kinds))
+
+            info = cdmpyparser.replayEvents(expected)
+            for native in [False, True]:
+                maskedInfo = cdmpyparser.getBriefModuleInfoFromFile(
+                    pythonFile, native=native, mask=mask)
+                if maskedInfo.niceStringify() != info.niceStringify():
+                    self.fail("event mask test failed for kinds " +
+                              str(kinds) + ". Native mode: " + str(native))
+
+    def test_event_mask_dependencies(self):
+        """Test the items are not collected without their owners"""
+        pythonFile = self.dir + "class_members.py"
+        mask = cdmpyparser.eventMask(cdmpyparser.EVENT_CLASS,
+                                     cdmpyparser.EVENT_INSTANCE_ATTRIBUTE,
+                                     cdmpyparser.EVENT_ARGUMENT)
+        info = cdmpyparser.getBriefModuleInfoFromFile(pythonFile, mask=mask)
+        if not info.classes or info.functions:
+            self.fail("event mask dependencies test failed")
+        for klass in info.classes:
+            if klass.functions or klass.instanceAttributes:
+                self.fail("event mask dependencies test failed")
+
+        pythonFile = self.dir + "errors.py"
+        info = cdmpyparser.getBriefModuleInfoFromFile(pythonFile, mask=0)
+        if info.isOK:
+            self.fail("errors are expected regardless of the event mask")
+
+    def test_multiple_files(self):
+        """Test parsing many files on the worker threads"""
+        fileNames = [self.dir + name for name in sorted(os.listdir(self.dir))
+                     if name.endswith(".py") and name != "ut.py"]
+        for workers in [0, 1, 3]:
+            infos = cdmpyparser.getBriefModuleInfoFromFiles(fileNames,
+                                                            workers=workers)
+            if len(infos) != len(fileNames):
+                self.fail("multiple files test failed")
+            for fileName, info in zip(fileNames, infos):
+                expected = cdmpyparser.getBriefModuleInfoFromFile(fileName)
+                if info.niceStringify() != expected.niceStringify() or \
+                   info.isOK != expected.isOK or \
+                   info.errors != expected.errors:
+                    self.fail("multiple files test failed for " + fileName +
+                              ". Workers: " + str(workers))
+
+        try:
+            cdmpyparser.getBriefModuleInfoFromFiles(
+                fileNames + [self.dir + "nonexistent.py"], workers=2)
+            self.fail("multiple files test failed: expected an exception")
+        except RuntimeError:
+            pass
+
+    def test_parser_backends(self):
+        """Test that all the backends find the same items"""
+        fileNames = [self.dir + name for name in sorted(os.listdir(self.dir))
+                     if name.endswith(".py")]
+        default = cdmpyparser.getParserBackend()
+        if default not in cdmpyparser.PARSER_BACKENDS:
+            self.fail("parser backends test failed: unknown default")
+        try:
+            expected = {}
+            for backend in cdmpyparser.PARSER_BACKENDS:
+                cdmpyparser.setParserBackend(backend)
+                if cdmpyparser.getParserBackend() != backend:
+                    self.fail("parser backends test failed: " + backend)
+                for fileName in fileNames:
+                    events = cdmpyparser.getBriefModuleEventsFromFile(fileName)
+                    info = cdmpyparser.getBriefModuleInfoFromFile(fileName,
+                                                                  native=True)
+                    if expected.setdefault(fileName, events) != events:
+                        self.fail("parser backends test failed for " +
+                                  fileName + ". Backend: " + backend)
+                    if info.niceStringify() != \
+                       cdmpyparser.replayEvents(events).niceStringify():
+                        self.fail("parser backends test failed for " +
+                                  fileName + ". Native mode: " + backend)
+        finally:
+            cdmpyparser.setParserBackend(default)
+
+        try:
+            cdmpyparser.setParserBackend("unknown")
+            self.fail("parser backends test failed: expected an exception")
+        except ValueError:
+            pass
+
+    def test_non_ascii_names(self):
+        """Test that the backends agree on the non ASCII names"""
+        default = cdmpyparser.getParserBackend()
+        try:
+            for backend in cdmpyparser.PARSER_BACKENDS:
+                cdmpyparser.setParserBackend(backend)
+                info = cdmpyparser.getBriefModuleInfoFromMemory(
+                    u"\u00e9 = 1\nclass C:\n    a\u00b7b = 2\n"
+                    u"\u0928\u093e\u092e = 3\n")
+                if not info.isOK or \
+                   [item.name for item in info.globals] != \
+                        [u"\u00e9", u"\u0928\u093e\u092e"] or \
+                   info.classes[0].classAttributes[0].name != u"a\u00b7b":
+                    self.fail("non ASCII names test failed: valid names. "
+                              "Backend: " + backend)
+                for code in [u"\u20ac = 2\n", u"x\u20ac = 2\n",
+                             u"x = 1\ndef f():\n    \u00bf = 2\n"]:
+                    info = cdmpyparser.getBriefModuleInfoFromMemory(code)
+                    if info.isOK or not info.errors:
+                        self.fail("non ASCII names test failed: " +
+                                  repr(code) + ". Backend: " + backend)
+        finally:
+            cdmpyparser.setParserBackend(default)
+
+    def test_skip_function_bodies(self):
+        """Test skipping the function bodies"""
+        content = "import os\n" \
+                  "def f(a):\n" \
+                  "    \"\"\"Doc\"\"\"\n" \
+                  "    import sys\n" \
+                  "    x = {'a': [1,\n" \
+                  "        2]}\n" \
+                  "    if x:\n" \
+                  "        def g(): return 1\n" \
+                  "    return x\n" \
+                  "class C:\n" \
+                  "    y = 1\n" \
+                  "    def m(self, b):\n" \
+                  "        for i in b:\n" \
+                  "            z, self.a = i, 'def h():'\n" \
+                  "        self.b += 1\n" \
+                  "        class D: pass\n"
+        mask = cdmpyparser.ALL_EVENTS | cdmpyparser.SKIP_FUNCTION_BODIES
+        default = cdmpyparser.getParserBackend()
+        try:
+            for backend in cdmpyparser.PARSER_BACKENDS:
+                cdmpyparser.setParserBackend(backend)
+                full = cdmpyparser.getBriefModuleInfoFromMemory(content)
+                info = cdmpyparser.getBriefModuleInfoFromMemory(content,
+                                                                mask=mask)
+                if not info.isOK or \
+                   [imp.name for imp in info.imports] != ["os"] or \
+                   [imp.name for imp in full.imports] != ["os", "sys"]:
+                    self.fail("skip function bodies test failed: imports. "
+                              "Backend: " + backend)
+                func = info.functions[0]
+                klass = info.classes[0]
+                if func.docstring.text != "Doc" or \
+                   [item.name for item in func.functions] != ["g"] or \
+                   [item.name for item in klass.instanceAttributes] != \
+                   ["a"] or \
+                   [item.name for item in klass.functions[0].classes] != \
+                   ["D"] or \
+                   [item.name for item in klass.classAttributes] != ["y"]:
+                    self.fail("skip function bodies test failed: items. "
+                              "Backend: " + backend)
+                full.imports = info.imports
+                if info.niceStringify() != full.niceStringify():
+                    self.fail("skip function bodies test failed. "
+                              "Backend: " + backend)
+        finally:
+            cdmpyparser.setParserBackend(default)
+
+    def test_imports_only(self):
+        """Test the imports only parse"""
+        content = "\"\"\"Doc\"\"\"\n" \
+                  "import os, sys as system\n" \
+                  "try:\n" \
+                  "    import json\n" \
+                  "except ImportError:\n" \
+                  "    json = None\n" \
+                  "if os.name == 'nt':\n" \
+                  "    from ntpath import join\n" \
+                  "def f():\n" \
+                  "    import re\n" \
+                  "class C:\n" \
+                  "    import io\n" \
+                  "from collections import (OrderedDict,\n" \
+                  "                         deque)\n"
+        default = cdmpyparser.getParserBackend()
+        try:
+            for backend in cdmpyparser.PARSER_BACKENDS:
+                cdmpyparser.setParserBackend(backend)
+                for headerOnly, expected in \
+                        [(False, ["os", "sys", "json", "ntpath",
+                                  "collections"]),
+                         (True, ["os", "sys", "json", "ntpath"])]:
+                    info = cdmpyparser.getBriefModuleImportsFromMemory(
+                        content, headerOnly)
+                    if not info.isOK or info.functions or info.classes or \
+                       info.docstring is not None or \
+                       [imp.name for imp in info.imports] != expected:
+                        self.fail("imports only test failed. Backend: " +
+                                  backend + ". Header only: " +
+                                  str(headerOnly))
+                    full = cdmpyparser.getBriefModuleInfoFromMemory(content)
+                    fullImports = [str(imp) for imp in full.imports]
+                    if [imp for imp in info.imports
+                            if str(imp) not in fullImports]:
+                        self.fail("imports only test failed: what. "
+                                  "Backend: " + backend)
+
+                fileName = self.dir + "import.py"
+                info = cdmpyparser.getBriefModuleImportsFromFile(fileName)
+                infos = cdmpyparser.getBriefModuleImportsFromFiles(
+                    [fileName], workers=1)
+                full = cdmpyparser.getBriefModuleInfoFromFile(fileName)
+                if [str(imp) for imp in info.imports] != \
+                   [str(imp) for imp in full.imports] or \
+                   infos[0].niceStringify() != info.niceStringify():
+                    self.fail("imports only test failed: " + fileName +
+                              ". Backend: " + backend)
+        finally:
+            cdmpyparser.setParserBackend(default)
+
+    def test_long_texts(self):
+        """Test the docstrings and the values longer than the old limits"""
+        docstring = "d" * 70000
+        value = "[" + ", ".join(["1"] * 2000) + "]"
+        code = 'def f(a: "' + "x" * 3000 + '" = ' + value + \
+               ', *' + "v" * 600 + '):\n    """' + docstring + '"""\n'
+        default = cdmpyparser.getParserBackend()
+        try:
+            for backend in cdmpyparser.PARSER_BACKENDS:
+                cdmpyparser.setParserBackend(backend)
+                info = cdmpyparser.getBriefModuleInfoFromMemory(code)
+                func = info.functions[0]
+                if not info.isOK or func.docstring.text != docstring or \
+                   func.arguments[0].annotation != '"' + "x" * 3000 + '"' or \
+                   func.arguments[0].value != value or \
+                   func.arguments[1].name != "*" + "v" * 600:
+                    self.fail("long texts test failed. Backend: " + backend)
+        finally:
+            cdmpyparser.setParserBackend(default)
+
+    def test_shared_names(self):
+        """Test that the parses share the name strings"""
+        code = "import os\nclass C(Base):\n    @property\n" \
+               "    def method(self, arg):\n        self.attr = arg\n"
+        for native in [False, True]:
+            first = cdmpyparser.getBriefModuleInfoFromMemory(code,
+                                                             native=native)
+            second = cdmpyparser.getBriefModuleInfoFromMemory(code,
+                                                              native=native)
+            for name in [lambda info: info.imports[0].name,
+                         lambda info: info.classes[0].name,
+                         lambda info: info.classes[0].base[0],
+                         lambda info: info.classes[0].functions[0].name,
+                         lambda info:
+                            info.classes[0].functions[0].decorators[0].name,
+                         lambda info:
+                            info.classes[0].functions[0].arguments[1].name,
+                         lambda info:
+                            info.classes[0].instanceAttributes[0].name]:
+                if name(first) is not name(second):
+                    self.fail("shared names test failed for " +
+                              name(first))
+                # The interned strings are immortal since Python 3.12; the
+                # one character strings are shared by the interpreter anyway
+                if len(name(first)) > 1 and \
+                   sys.getrefcount(name(first)) > 1000:
+                    self.fail("shared names test failed: interned " +
+                              name(first))
+
+    def test_item_layouts(self):
+        """Test that the items have the fixed slots layout only"""
+        code = "import os\nfrom sys import path as p\nG = 1\n" \
+               "@deco(1)\nclass C(Base):\n    '''Doc'''\n    x = 1\n" \
+               "    def method(self, arg: int = 2):\n        self.attr = arg\n"
+        for native in [False, True]:
+            info = cdmpyparser.getBriefModuleInfoFromMemory(code,
+                                                            native=native)
+            klass = info.classes[0]
+            method = klass.functions[0]
+            for item in [info.imports[0], info.imports[1].what[0],
+                         info.globals[0], klass, klass.decorators[0],
+                         klass.docstring, klass.classAttributes[0],
+                         method, method.arguments[1],
+                         klass.instanceAttributes[0]]:
+                if hasattr(item, '__dict__'):
+                    self.fail("item layout test failed for " +
+                              type(item).__name__)
+            self.assertEqual(method.arguments[1].annotation, 'int')
+            self.assertEqual(method.arguments[1].value, '2')
+            self.assertEqual(info.imports[1].what[0].alias, 'p')
+
+    def test_result_types(self):
+        """Test that the native mode respects the result type __setattr__"""
+        class UpperGlobal(cdmpyparser.Global):
+            __slots__ = []
+
+            def __setattr__(self, name, value):
+                if name == "name":
+                    value = value.upper()
+                cdmpyparser.Global.__setattr__(self, name, value)
+
+        names = ['Encoding', 'Import', 'ImportWhat', 'Global',
+                 'ClassAttribute', 'InstanceAttribute', 'Decorator',
+                 'Docstring', 'Argument', 'Function', 'Class', 'Statement']
+        types = dict((name, getattr(cdmpyparser, name)) for name in names)
+        cdmpyparser._cdmpyparser.setResultTypes(dict(types,
+                                                     Global=UpperGlobal))
+        try:
+            info = cdmpyparser.getBriefModuleInfoFromMemory("abc = 1\n",
+                                                            native=True)
+        finally:
+            cdmpyparser._cdmpyparser.setResultTypes(types)
+        if [item.name for item in info.globals] != ["ABC"]:
+            self.fail("result types test failed")
+
+    def test_unique_names(self):
+        """Test that the repeated names are dropped per owner in order"""
+        code = "b = 1\na = 2\nb = 3\n" \
+               "class C:\n    x = 1\n    y = 2\n    x = 3\n" \
+               "    def f(self):\n        self.v = 1\n        self.u = 2\n" \
+               "    def g(self):\n        self.v = 3\n" \
+               "class D:\n    x = 1\n    def f(self):\n        self.v = 1\n" \
+               "a = 4\n"
+        events = cdmpyparser.getBriefModuleEventsFromMemory(code)
+        raw = cdmpyparser.getBriefModuleEventsFromMemory(code, raw=True)
+        if cdmpyparser.decodeEvents(raw) != events:
+            self.fail("unique names test failed: raw events differ")
+        named = [(event[0], event[1]) for event in events
+                 if event[0] in (cdmpyparser.EVENT_GLOBAL,
+                                 cdmpyparser.EVENT_CLASS_ATTRIBUTE,
+                                 cdmpyparser.EVENT_INSTANCE_ATTRIBUTE)]
+        if len(named) != 8:
+            self.fail("unique names test failed: events " + repr(named))
+        for info in [cdmpyparser.getBriefModuleInfoFromMemory(code),
+                     cdmpyparser.getBriefModuleInfoFromMemory(code,
+                                                              native=True),
+                     cdmpyparser.replayEvents(events)]:
+            names = [[item.name for item in info.globals],
+                     [item.name for item in info.classes[0].classAttributes],
+                     [item.name
+                      for item in info.classes[0].instanceAttributes],
+                     [item.name for item in info.classes[1].classAttributes],
+                     [item.name
+                      for item in info.classes[1].instanceAttributes]]
+            if names != [["b", "a"], ["x", "y"], ["v", "u"], ["x"], ["v"]]:
+                self.fail("unique names test failed: " + repr(names))
+            if info.globals[0].line != 1 or \
+               info.classes[0].classAttributes[0].line != 5:
+                self.fail("unique names test failed: not the first item")
+
+    def test_old_callbacks(self):
+        """Test the callbacks written before the content hashes"""
+        class OldInfo(cdmpyparser.BriefModuleInfo):
+            def _onClass(self, name, line, pos, absPosition,
+                         keywordLine, keywordPos, colonLine, colonPos, level):
+                cdmpyparser.BriefModuleInfo._onClass(
+                    self, name, line, pos, absPosition, keywordLine,
+                    keywordPos, colonLine, colonPos, level)
+
+            def _onFunction(self, name, line, pos, absPosition,
+                            keywordLine, keywordPos, colonLine, colonPos,
+                            level, isAsync, returnAnnotation):
+                cdmpyparser.BriefModuleInfo._onFunction(
+                    self, name, line, pos, absPosition, keywordLine,
+                    keywordPos, colonLine, colonPos, level, isAsync,
+                    returnAnnotation)
+
+        class OldCallbacks:
+            """No _onStatement()"""
+            def __init__(self):
+                self.info = OldInfo()
+
+            def __getattr__(self, name):
+                if name == "_onStatement":
+                    raise AttributeError(name)
+                return getattr(self.info, name)
+
+        code = "import os\nclass C:\n    def f(self):\n        pass\n"
+        expected = cdmpyparser.getBriefModuleInfoFromMemory(code)
+        events = cdmpyparser.getBriefModuleEventsFromMemory(code)
+        default = cdmpyparser.getParserBackend()
+        try:
+            for backend in cdmpyparser.PARSER_BACKENDS:
+                cdmpyparser.setParserBackend(backend)
+                for make in [OldInfo, OldCallbacks]:
+                    direct = make()
+                    cdmpyparser._cdmpyparser.getBriefModuleInfoFromMemory(
+                        direct, code)
+                    direct.flush()
+                    replayed = cdmpyparser.replayEvents(events, make())
+                    statements = len(expected.statements) \
+                        if make is OldInfo else 0
+                    for callbacks in [direct, replayed]:
+                        info = getattr(callbacks, "info", callbacks)
+                        klass = info.classes[0]
+                        if klass.name != "C" or \
+                           klass.functions[0].name != "f" or \
+                           klass.contentHash is not None or \
+                           klass.functions[0].contentHash is not None or \
+                           len(info.statements) != statements:
+                            self.fail("old callbacks test failed for " +
+                                      make.__name__ + ". Backend: " +
+                                      backend)
+        finally:
+            cdmpyparser.setParserBackend(default)
+
+    def test_trimmed_docstrings(self):
+        """Test the docstrings trimming by the extension"""
+        docstrings = ["", " ", "\n\n", "One", "  One  \n", "\n  One\n  ",
+                      "One\n    Two\n      Three\n    ",
+                      "\tOne\n\tTwo\n  \t  Three\t\n\n",
+                      "One\n   \n \t\n", "\n\n  \n", "a\tb\n\tc\td\n    e",
+                      "One\fTwo\x0bThree\n    Four\x1c  Five\x85 Six",
+                      " One　\n  Two  Three",
+                      "One\n\x1f  Two\n   é é\n\té"]
+        default = cdmpyparser.getParserBackend()
+        try:
+            for backend in cdmpyparser.PARSER_BACKENDS:
+                cdmpyparser.setParserBackend(backend)
+                for doc in docstrings:
+                    code = "def f():\n    '''" + doc + "'''\n"
+                    raw = cdmpyparser.getBriefModuleInfoFromMemory(
+                        code, mask=cdmpyparser.ALL_EVENTS |
+                        cdmpyparser.RAW_DOCSTRINGS)
+                    texts = [raw.functions[0].docstring.text]
+                    for native in [False, True]:
+                        info = cdmpyparser.getBriefModuleInfoFromMemory(
+                            code, native=native)
+                        texts.append(info.functions[0].docstring.text)
+                    if texts != [doc] + [cdmpyparser.trim_docstring(doc)] * 2:
+                        self.fail("trimmed docstrings test failed: " +
+                                  repr(texts) + ". Backend: " + backend)
+        finally:
+            cdmpyparser.setParserBackend(default)
+
+    def test_file_sizes(self):
+        """Test the file input of various sizes"""
+        pageSize = os.sysconf('SC_PAGESIZE')
+        fileName = os.path.join(tempfile.mkdtemp(), "sizes.py")
+        for tail in ["\n", "", "  \n", "#"]:
+            for size in [pageSize, pageSize + 7, 3 * pageSize]:
+                content = "class C:\n    x = 1\n"
+                content += "#" * (size - len(content) - len(tail)) + tail
+                content = content[:size]
+                f = open(fileName, "w")
+                f.write(content)
+                f.close()
+
+                info = cdmpyparser.getBriefModuleInfoFromFile(fileName)
+                expected = cdmpyparser.getBriefModuleInfoFromMemory(content)
+                if not info.isOK or \
+                   info.niceStringify() != expected.niceStringify():
+                    self.fail("file size " + str(size) + " test failed")
+        os.unlink(fileName)
+        os.rmdir(os.path.dirname(fileName))
+
+    def test_memory_buffers(self):
+        """Test parsing bytes-like objects"""
+        pythonFile = self.dir + "func_defs.py"
+        f = open(pythonFile, "rb")
+        content = f.read()
+        f.close()
+
+        expected = cdmpyparser.getBriefModuleInfoFromFile(pythonFile)
+        tail = b"\n# tail which is not a part of the code"
+        for code in [content, bytearray(content), memoryview(content),
+                     memoryview(content + tail)[:len(content)],
+                     content.rstrip()]:
+            for native in [False, True]:
+                info = cdmpyparser.getBriefModuleInfoFromMemory(code, native)
+                if info.niceStringify() != expected.niceStringify():
+                    self.fail("memory buffers test failed for " +
+                              type(code).__name__)
+
+        info = cdmpyparser.getBriefModuleInfoFromMemory(b"")
+        if not info.isOK or info.niceStringify() != "":
+            self.fail("memory buffers test failed for an empty buffer")
+        for code in [b"a = 1\0\n", "a = 1\0\n"]:
+            try:
+                cdmpyparser.getBriefModuleInfoFromMemory(code)
+                self.fail("memory buffers test failed: expected an exception")
+            except ValueError:
+                pass
+
+    def test_line_endings(self):
+        """Test the absolute positions with various line endings"""
+        for eol in [b"\n", b"\r\n", b"\r"]:
+            code = eol.join([b"import os", b"", b"import sys", b"x = 1",
+                             b"class C:", b"    pass", b""])
+            info = cdmpyparser.getBriefModuleInfoFromMemory(code)
+            if [item.absPosition for item in info.imports] != \
+                    [code.index(b"os"), code.index(b"sys")] or \
+               info.globals[0].absPosition != code.index(b"x =") or \
+               info.classes[0].absPosition != code.index(b"C:") or \
+               info.classes[0].line != 5:
+                self.fail("line endings test failed for " + repr(eol))
+
+    def test_nested_parse(self):
+        """Test parsing from a callback of another parse"""
+        class NestedInfo(cdmpyparser.BriefModuleInfo):
+            def _onGlobal(self, name, line, pos, absPosition, level):
+                cdmpyparser.getBriefModuleInfoFromMemory(
+                    "\n" * 100 + "y = 1\n")
+                cdmpyparser.BriefModuleInfo._onGlobal(
+                    self, name, line, pos, absPosition, level)
+
+        pythonFile = self.dir + "globals.py"
+        info = NestedInfo()
+        cdmpyparser._cdmpyparser.getBriefModuleInfoFromFile(info, pythonFile)
+        info.flush()
+        expected = cdmpyparser.getBriefModuleInfoFromFile(pythonFile)
+        if info.niceStringify() != expected.niceStringify():
+            self.fail("nested parse test failed")
+
+    def test_module_data(self):
+        """Test the serialized brief module info queries"""
+        code = "import os as o\n" \
+               "class A(B):\n" \
+               "    def f(self, x=1):\n" \
+               "        def g(): pass\n" \
+               "        self.y = x\n" \
+               "def h(): pass\n"
+        data = cdmpyparser.BriefModuleData(
+            cdmpyparser.getBriefModuleDataFromMemory(code))
+        if not data.isOK:
+            self.fail("module data test failed: unexpected error")
+
+        names = [node[3] for node in data.outline()]
+        if names != ["A", "f", "g", "h"]:
+            self.fail("module data test failed: outline " + repr(names))
+        names = [node[3] for node in data.outline(depth=1)]
+        if names != ["A", "f", "h"]:
+            self.fail("module data test failed: depth " + repr(names))
+
+        outline = data.outline()
+        if [node[2] for node in outline][:3] != [-1, outline[0][0],
+                                                   outline[1][0]]:
+            self.fail("module data test failed: parents")
+
+        nodes = data.nodes(cdmpyparser.eventMask(cdmpyparser.EVENT_IMPORT,
+                                                 cdmpyparser.EVENT_ARGUMENT))
+        if [node[1:] for node in nodes] != \
+                [(cdmpyparser.EVENT_IMPORT, -1, "os", 1, 8, 7, "o"),
+                 (cdmpyparser.EVENT_ARGUMENT, outline[1][0], "self",
+                  None, None),
+                 (cdmpyparser.EVENT_ARGUMENT, outline[1][0], "x",
+                  None, "1")]:
+            self.fail("module data test failed: nodes " + repr(nodes))
+
+        code = "def k(:\n"
+        info = cdmpyparser.getBriefModuleInfoFromMemory(code)
+        restored = cdmpyparser.BriefModuleData(
+            cdmpyparser.getBriefModuleDataFromMemory(code)).toModuleInfo()
+        if restored.isOK or not restored.errors or \
+           restored.errors != info.errors:
+            self.fail("module data test failed: errors")
+
+        for corrupted in [b"", b"CDMB", data.data[:-1], data.data + b"\0",
+                          b"XXXX" + data.data[4:]]:
+            try:
+                cdmpyparser.BriefModuleData(corrupted).nodes()
+                self.fail("module data test failed: corrupted data")
+            except ValueError:
+                pass
+        for corrupted in [b"", b"CDM", b"CDMB" + data.data[4:5],
+                          b"XXXX" + data.data[4:],
+                          b"CDMB\xff" + data.data[5:]]:
+            try:
+                cdmpyparser.BriefModuleData(corrupted)
+                self.fail("module data test failed: corrupted header")
+            except ValueError:
+                pass
+
+    def test_lazy_results(self):
+        """Test the lazily built brief module info"""
+        code = "import os\n" \
+               "class A(B):\n" \
+               "    'Doc'\n" \
+               "    def f(self):\n" \
+               "        self.y = 1\n" \
+               "def h(): pass\n"
+        info = cdmpyparser.getBriefModuleInfoFromMemory(code, lazy=True)
+        if not isinstance(info, cdmpyparser.BriefModuleInfo) or \
+           not info.isOK:
+            self.fail("lazy results test failed: info")
+
+        cls = info.classes[0]
+        if not isinstance(cls, cdmpyparser.Class) or cls.name != "A" or \
+           cls.line != 2 or cls.colonLine != 2:
+            self.fail("lazy results test failed: class")
+        try:
+            cdmpyparser.Class.functions.__get__(cls)
+            self.fail("lazy results test failed: materialized too early")
+        except AttributeError:
+            pass
+        if [func.name for func in cls.functions] != ["f"] or \
+           cls.functions[0].arguments[0].name != "self" or \
+           cls.instanceAttributes[0].name != "y" or \
+           cls.docstring.text != "Doc" or cls.base != ["B"]:
+            self.fail("lazy results test failed: class members")
+
+        info.functions = []
+        if info.functions != [] or info.imports[0].name != "os":
+            self.fail("lazy results test failed: assignment")
+
+    def test_incremental(self):
+        """Test the incremental reparse after edits"""
+        code = "import os\n" \
+               "a = 1\n" \
+               "def f(x):\n" \
+               "    return x\n" \
+               "\n" \
+               "class C:\n" \
+               "    def m(self):\n" \
+               "        self.v = 1\n" \
+               "a = 2\n" \
+               "b = 3\n"
+        info = cdmpyparser.getBriefModuleInfoFromMemory(code, incremental=True)
+
+        # The edits are (text to find, deleted length, inserted text)
+        edits = [("x):", 1, "arg"),                 # inside a statement
+                 ("class", 0, "def g(): pass\n"),   # a new statement
+                 ("b = 3", 0, "    "),              # indent into the previous
+                 ("    b = 3", 4, ""),
+                 ("import", 0, "'''Doc'''\n"),      # module docstring
+                 ("a = 1", 6, ""),                  # the first of the globals
+                 ("return", 0, "(\n"),              # an error
+                 ("(\n", 2, "")]
+        for text, deleted, inserted in edits:
+            start = code.index(text)
+            cdmpyparser.reparseBriefModuleInfo(info, start, deleted, inserted)
+            code = code[:start] + inserted + code[start + deleted:]
+            expected = cdmpyparser.getBriefModuleInfoFromMemory(code)
+            if info.niceStringify() != expected.niceStringify() or \
+               info.isOK != expected.isOK or info.errors != expected.errors or \
+               list(map(str, info.statements)) != \
+               list(map(str, expected.statements)):
+                self.fail("incremental test failed: edit " +
+                          repr((text, deleted, inserted)))
+        if [item.name for item in info.globals] != ["a", "b"]:
+            self.fail("incremental test failed: globals")
+
+        try:
+            cdmpyparser.reparseBriefModuleInfo(
+                cdmpyparser.getBriefModuleInfoFromMemory(code), 0, 0, "")
+            self.fail("incremental test failed: not incremental info")
+        except ValueError:
+            pass
+
+    def test_content_hashes(self):
+        """Test the statements and definitions content hashes"""
+        code = "import os\n" \
+               "@deco\n" \
+               "def f(x):\n" \
+               "    return '''a\n" \
+               "b'''\n" \
+               "class C:\n" \
+               "    def m(self):\n" \
+               "        pass\n"
+        info = cdmpyparser.getBriefModuleInfoFromMemory(code)
+        spans = [(item.line, item.endLine) for item in info.statements]
+        if spans != [(1, 1), (2, 5), (6, 8)]:
+            self.fail("content hashes test failed: statements " + str(spans))
+
+        # The hashes stay while the text stays wherever it is
+        moved = cdmpyparser.getBriefModuleInfoFromMemory(
+            "\n# comment\n" + code.replace("pass", "return"))
+        if moved.statements[1].contentHash != info.statements[1].contentHash or \
+           moved.functions[0].contentHash != info.functions[0].contentHash or \
+           moved.statements[2].contentHash == info.statements[2].contentHash or \
+           moved.classes[0].contentHash == info.classes[0].contentHash:
+            self.fail("content hashes test failed: moved code")
+
+        def hashes(modInfo):
+            return [item.contentHash for item in modInfo.statements] + \
+                [modInfo.functions[0].contentHash,
+                 modInfo.classes[0].contentHash,
+                 modInfo.classes[0].functions[0].contentHash]
+
+        data = cdmpyparser.getBriefModuleDataFromMemory(code)
+        events = cdmpyparser.getBriefModuleEventsFromMemory(code, raw=True)
+        for other in [
+                cdmpyparser.getBriefModuleInfoFromMemory(code, native=True),
+                cdmpyparser.replayEvents(cdmpyparser.decodeEvents(events)),
+                cdmpyparser.BriefModuleData(data).toModuleInfo(),
+                cdmpyparser.BriefModuleData(data).toModuleInfo(lazy=True)]:
+            if hashes(other) != hashes(info):
+                self.fail("content hashes test failed: " +
+                          other.__class__.__name__)
+
+    def test_cancel(self):
+        """Test the cancelled and time bounded parses"""
+        code = "".join("class C%d:\n    def f(self):\n        self.x = 1\n" % k
+                       for k in range(2000))
+        for kwargs in [{}, {"native": True}, {"lazy": True},
+                       {"incremental": True}]:
+            try:
+                cdmpyparser.getBriefModuleInfoFromMemory(
+                    code, cancel=cdmpyparser.CancelToken(0), **kwargs)
+                self.fail("cancel test failed: deadline " + str(kwargs))
+            except cdmpyparser.ParseCancelled:
+                pass
+            info = cdmpyparser.getBriefModuleInfoFromMemory(
+                code, cancel=cdmpyparser.CancelToken(60), **kwargs)
+            if len(info.classes) != 2000:
+                self.fail("cancel test failed: not cancelled " + str(kwargs))
+
+        # The walker stops soon after the token is cancelled
+        token = cdmpyparser.CancelToken()
+
+        class CancellingInfo(cdmpyparser.BriefModuleInfo):
+            def _onClass(self, *args):
+                token.cancel()
+                cdmpyparser.BriefModuleInfo._onClass(self, *args)
+
+        info = CancellingInfo()
+        try:
+            cdmpyparser._cdmpyparser.getBriefModuleInfoFromMemory(
+                info, code, False, cdmpyparser.ALL_EVENTS, None,
+                token._flag, -1.0)
+            self.fail("cancel test failed: walker")
+        except cdmpyparser.ParseCancelled:
+            pass
+        info.flush()
+        if not token.isCancelled() or len(info.classes) >= 2000:
+            self.fail("cancel test failed: walker stop")
+
+        # The cancelled reparse keeps the previous info
+        info = cdmpyparser.getBriefModuleInfoFromMemory(code, incremental=True)
+        try:
+            cdmpyparser.reparseBriefModuleInfo(info, 0, 0, "(",
+                                               cancel=token)
+            self.fail("cancel test failed: reparse")
+        except cdmpyparser.ParseCancelled:
+            pass
+        cdmpyparser.reparseBriefModuleInfo(info, 0, 0, "\n")
+        if not info.isOK or len(info.classes) != 2000:
+            self.fail("cancel test failed: info after the cancelled reparse")
+
+    def test_cache(self):
+        """Test the persistent parse cache"""
+        cacheDir = os.path.join(tempfile.mkdtemp(), "cache")
+        fileName = os.path.join(os.path.dirname(cacheDir), "cached.py")
+
+        def check(content, message, mask=cdmpyparser.ALL_EVENTS):
+            expected = cdmpyparser.getBriefModuleInfoFromMemory(content,
+                                                                mask=mask)
+            for native in [False, True, False]:
+                info = cdmpyparser.getBriefModuleInfoFromFile(
+                    fileName, native, mask, cacheDir)
+                if info.niceStringify() != expected.niceStringify():
+                    self.fail("cache test failed: " + message)
+
+        def write(content):
+            f = open(fileName, "w")
+            f.write(content)
+            f.close()
+
+        f = open(self.dir + "class_defs.py")
+        content = f.read()
+        f.close()
+
+        write(content)
+        check(content, "cold and warm cache")
+        check(content, "masked items",
+              cdmpyparser.eventMask(cdmpyparser.EVENT_CLASS))
+        if len(os.listdir(cacheDir)) != 1:
+            self.fail("cache test failed: no single cache file")
+
+        write(content + "x = 1\n")
+        check(content + "x = 1\n", "changed content")
+
+        # The same content with another time is found by the content hash
+        os.utime(fileName, (1000000000, 1000000000))
+        check(content + "x = 1\n", "changed time")
+
+        cacheFile = os.path.join(cacheDir, os.listdir(cacheDir)[0])
+        for garbage in ["", "CDMC", "x" * 4096]:
+            f = open(cacheFile, "w")
+            f.write(garbage)
+            f.close()
+            check(content + "x = 1\n", "corrupted cache file")
+
+        write("def f(:\n")
+        check("def f(:\n", "parse errors")
+
+        os.unlink(fileName)
+        os.unlink(cacheFile)
+        os.rmdir(cacheDir)
+        os.rmdir(os.path.dirname(cacheDir))
+
+    def test_cache_backends(self):
+        """Test that the cache entries of another backend are not used"""
+        cacheDir = os.path.join(tempfile.mkdtemp(), "cache")
+        fileName = os.path.join(os.path.dirname(cacheDir), "cached.py")
+        f = open(fileName, "w")
+        f.write("class C:\n    x = 1\n")
+        f.close()
+
+        def parse():
+            """Provides the cache file identity; a miss rewrites the file"""
+            info = cdmpyparser.getBriefModuleInfoFromFile(
+                fileName, cacheDir=cacheDir)
+            if info.niceStringify() != expected.niceStringify():
+                self.fail("cache backends test failed: items")
+            cacheFile = os.path.join(cacheDir, os.listdir(cacheDir)[0])
+            return os.stat(cacheFile).st_ino
+
+        expected = cdmpyparser.getBriefModuleInfoFromMemory(
+            "class C:\n    x = 1\n")
+        default = cdmpyparser.getParserBackend()
+        try:
+            previous = None
+            for backend in cdmpyparser.PARSER_BACKENDS * 2:
+                cdmpyparser.setParserBackend(backend)
+                written = parse()
+                if written == previous and \
+                   len(cdmpyparser.PARSER_BACKENDS) > 1:
+                    self.fail("cache backends test failed: the entry of "
+                              "another backend is used. Backend: " +
+                              backend)
+                if parse() != written:
+                    self.fail("cache backends test failed: no hit. "
+                              "Backend: " + backend)
+                previous = written
+        finally:
+            cdmpyparser.setParserBackend(default)
+
+        os.unlink(fileName)
+        os.unlink(os.path.join(cacheDir, os.listdir(cacheDir)[0]))
+        os.rmdir(cacheDir)
+        os.rmdir(os.path.dirname(cacheDir))
+
     def test_wrong_indent(self):
         """Test wrong indent"""
         pythonFile = self.dir + "wrong_indent.py"
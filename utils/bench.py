@@ -0,0 +1,279 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# codimension - graphics python two-way code editor and analyzer
+# Copyright (C) 2010-2022  Sergey Satskiy <sergey.satskiy@gmail.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""Micro benchmarks for the brief parser.
+
+Usage: bench.py [benchmark name ...]
+No names means all the benchmarks.
+"""
+
+from __future__ import print_function
+
+import gc
+import os
+import os.path
+import sys
+import shutil
+import tempfile
+import time
+import resource
+import subprocess
+import cdmpyparser
+
+
+def generateModule(fileName, sizeMB):
+    """Generates a big module similar to the generated code"""
+    chunk = '''
+class Message{0}(object):
+    """Generated message {0}"""
+
+    FIELD_{0} = {0}
+
+    def __init__(self, value={0}, name="message {0}"):
+        self.value = value
+        self.name = name
+
+    def serialize(self, stream):
+        stream.write(self.name)
+        return self.value
+'''
+    with open(fileName, 'w') as f:
+        index = 0
+        while f.tell() < sizeMB * 1024 * 1024:
+            f.write(chunk.format(index))
+            index += 1
+
+
+def peakRSS():
+    """Provides the process peak resident set size in MB"""
+    return resource.getrusage(resource.RUSAGE_SELF).ru_maxrss / 1024.0
+
+
+def parseLargeFile(variant, fileName):
+    """Parses the file in the current process and reports the timing"""
+    size = os.path.getsize(fileName) / (1024.0 * 1024.0)
+    cdmpyparser.setParserBackend('scanner')
+    rss = peakRSS()
+    spent = None
+    for _ in range(5):
+        start = time.time()
+        if variant == 'file':
+            cdmpyparser.getBriefModuleInfoFromFile(fileName, native=True)
+        else:
+            with open(fileName) as f:
+                content = f.read()
+            cdmpyparser.getBriefModuleInfoFromMemory(content, native=True)
+        if spent is None or time.time() - start < spent:
+            spent = time.time() - start
+    print('From %-7s %.3f s, %.1f MB/s, peak RSS growth %.1f MB' %
+          (variant + ':', spent, size / spent, peakRSS() - rss))
+
+
+def largeFileBenchmark():
+    """Parsing a large generated module with the scanner backend: the file
+       input which reads the content once into the parser buffer vs reading
+       the content in Python and parsing from memory, the best of 5 runs.
+       Each variant runs in a separate process so that the peak memory usage
+       is comparable"""
+    sizeMB = 8
+    fileName = os.path.join(tempfile.mkdtemp(), 'generated.py')
+    generateModule(fileName, sizeMB)
+    for variant in ['file', 'memory']:
+        subprocess.call([sys.executable, os.path.abspath(__file__),
+                         '--large-file', variant, fileName])
+    os.unlink(fileName)
+    os.rmdir(os.path.dirname(fileName))
+
+
+def cacheBenchmark():
+    """Parsing the python standard library modules with an empty and then
+       with a filled persistent cache"""
+    libDir = os.path.dirname(os.__file__)
+    fileNames = [os.path.join(libDir, name) for name in os.listdir(libDir)
+                 if name.endswith('.py')]
+    cacheDir = tempfile.mkdtemp()
+    for title in ['No cache:', 'Cold cache:', 'Warm cache:']:
+        start = time.time()
+        for fileName in fileNames:
+            cdmpyparser.getBriefModuleInfoFromFile(
+                fileName, native=True,
+                cacheDir=None if title == 'No cache:' else cacheDir)
+        print('%-12s %d files, %.3f s' % (title, len(fileNames),
+                                          time.time() - start))
+    shutil.rmtree(cacheDir)
+
+
+def incrementalBenchmark():
+    """Typing in the middle of a generated module: parsing the whole module
+       after each key stroke vs reparsing the edited statement only"""
+    fileName = os.path.join(tempfile.mkdtemp(), 'generated.py')
+    generateModule(fileName, 1)
+    with open(fileName, 'rb') as f:
+        content = f.read()
+    os.unlink(fileName)
+    os.rmdir(os.path.dirname(fileName))
+
+    keyStrokes = 50
+    offset = content.index(b'stream.write', len(content) // 2)
+    start = time.time()
+    for index in range(keyStrokes):
+        edited = content[:offset + index] + b'x' * (index + 1) + \
+            content[offset:]
+        cdmpyparser.getBriefModuleInfoFromMemory(edited, native=True)
+    full = (time.time() - start) / keyStrokes
+
+    modInfo = cdmpyparser.getBriefModuleInfoFromMemory(content,
+                                                       incremental=True)
+    start = time.time()
+    for index in range(keyStrokes):
+        cdmpyparser.reparseBriefModuleInfo(modInfo, offset + index, 0, 'x')
+    incremental = (time.time() - start) / keyStrokes
+    print('Whole module: %.3f ms per key stroke' % (full * 1000.0))
+    print('Incremental:  %.3f ms per key stroke' % (incremental * 1000.0))
+
+
+class NoOpModuleInfo:
+    """Ignores all the parser events so that only the call cost is left"""
+
+
+def noOpHandler(self, *args):
+    """Does nothing with the event"""
+
+
+for handlerName in cdmpyparser.EVENT_HANDLERS:
+    setattr(NoOpModuleInfo, handlerName, noOpHandler)
+
+
+# Title, the mask event kinds with the measured one last and the module
+# text block which produces one event of the measured kind
+CALLBACK_SAMPLES = [
+    ('global', [cdmpyparser.EVENT_GLOBAL], 'g{0} = {0}\n'),
+    ('import', [cdmpyparser.EVENT_IMPORT], 'import m{0}\n'),
+    ('import as', [cdmpyparser.EVENT_IMPORT, cdmpyparser.EVENT_AS],
+     'import m{0} as a{0}\n'),
+    ('import what', [cdmpyparser.EVENT_IMPORT, cdmpyparser.EVENT_WHAT],
+     'from m{0} import w{0}\n'),
+    ('function', [cdmpyparser.EVENT_FUNCTION], 'def f{0}(): pass\n'),
+    ('class', [cdmpyparser.EVENT_CLASS], 'class C{0}: pass\n'),
+    ('base class', [cdmpyparser.EVENT_CLASS, cdmpyparser.EVENT_BASE_CLASS],
+     'class C{0}(B{0}): pass\n'),
+    ('class attribute',
+     [cdmpyparser.EVENT_CLASS, cdmpyparser.EVENT_CLASS_ATTRIBUTE],
+     'class C{0}:\n    a{0} = {0}\n'),
+    ('instance attribute',
+     [cdmpyparser.EVENT_CLASS, cdmpyparser.EVENT_FUNCTION,
+      cdmpyparser.EVENT_INSTANCE_ATTRIBUTE],
+     'class C{0}:\n    def f(self):\n        self.a{0} = {0}\n'),
+    ('argument', [cdmpyparser.EVENT_FUNCTION, cdmpyparser.EVENT_ARGUMENT],
+     'def f{0}(a{0}): pass\n'),
+    ('decorator', [cdmpyparser.EVENT_FUNCTION, cdmpyparser.EVENT_DECORATOR],
+     '@d{0}\ndef f{0}(): pass\n'),
+    ('docstring', [cdmpyparser.EVENT_FUNCTION, cdmpyparser.EVENT_DOCSTRING],
+     'def f{0}():\n    """Doc {0}"""\n'),
+    ('statement', [cdmpyparser.EVENT_STATEMENT], 'x{0} = {0}\n')]
+
+
+def timeCallbacks(content, masks):
+    """Provides the best of 9 object mode parse times with no-op handlers for
+       each mask; the masks are interleaved so that a slower period affects
+       all of them"""
+    best = [None] * len(masks)
+    gc.disable()
+    try:
+        for _ in range(9):
+            for index, mask in enumerate(masks):
+                start = time.time()
+                cdmpyparser._cdmpyparser.getBriefModuleInfoFromMemory(
+                    NoOpModuleInfo(), content, False, mask, None, None, -1.0)
+                spent = time.time() - start
+                if best[index] is None or spent < best[index]:
+                    best[index] = spent
+    finally:
+        gc.enable()
+    return best
+
+
+def callbacksBenchmark():
+    """Object mode parsing with no-op event handlers by the scanner backend:
+       the cost of delivering one event of each kind to python, i.e. the
+       parse time with the kind minus the parse time without it, and the
+       python standard library top level parsed with the BriefModuleInfo
+       handlers"""
+    backend = cdmpyparser.getParserBackend()
+    cdmpyparser.setParserBackend('scanner')
+    try:
+        count = 100000
+        for title, kinds, block in CALLBACK_SAMPLES:
+            content = ''.join(block.format(index) for index in range(count))
+            withKind, withoutKind = timeCallbacks(
+                content, [cdmpyparser.eventMask(*kinds),
+                          cdmpyparser.eventMask(*kinds[:-1])])
+            spent = withKind - withoutKind
+            print('%-20s %6.0f ns per event' % (title,
+                                                spent * 1e9 / count))
+
+        libDir = os.path.dirname(os.__file__)
+        fileNames = [os.path.join(libDir, name)
+                     for name in sorted(os.listdir(libDir))
+                     if name.endswith('.py')]
+        contents = []
+        for fileName in fileNames:
+            with open(fileName, 'rb') as f:
+                contents.append(f.read())
+        best = None
+        for _ in range(5):
+            start = time.time()
+            for content in contents:
+                cdmpyparser.getBriefModuleInfoFromMemory(content)
+            spent = time.time() - start
+            if best is None or spent < best:
+                best = spent
+        print('Standard library:    %d files, %.3f s' % (len(contents), best))
+    finally:
+        cdmpyparser.setParserBackend(backend)
+
+
+BENCHMARKS = {'large-file': largeFileBenchmark,
+              'cache': cacheBenchmark,
+              'incremental': incrementalBenchmark,
+              'callbacks': callbacksBenchmark}
+
+
+def main(names):
+    """Runs the requested benchmarks"""
+    print('cdmpyparser version: ' + cdmpyparser.getVersion())
+    print('Module file: ' + cdmpyparser.__file__)
+
+    for name in names or sorted(BENCHMARKS.keys()):
+        if name not in BENCHMARKS:
+            print('Unknown benchmark ' + name + '. Available: ' +
+                  ', '.join(sorted(BENCHMARKS.keys())))
+            return 1
+        print('')
+        print(name + ': ' + ' '.join(BENCHMARKS[name].__doc__.split()))
+        BENCHMARKS[name]()
+    return 0
+
+
+if __name__ == '__main__':
+    if len(sys.argv) == 4 and sys.argv[1] == '--large-file':
+        parseLargeFile(sys.argv[2], sys.argv[3])
+        sys.exit(0)
+    sys.exit(main(sys.argv[1:]))
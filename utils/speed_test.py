@@ -63,6 +63,16 @@ def pyclbrTest(files):
     print("pyclbr: processed " + str(count) + " files")
 
 
+def showErrors(fileName, info):
+    """Prints the errors of a module if SHOW_ERRORS is set"""
+    if SHOW_ERRORS:
+        print("Failed to parse: " + fileName)
+        for item in info.errors:
+            print(item)
+        for item in info.lexerErrors:
+            print("    L: " + item)
+
+
 def cdmpyparserTest(files):
     """Loop for the codimension parser"""
     errorCount = 0
@@ -70,19 +80,63 @@ def cdmpyparserTest(files):
     for item in files:
         # print("Processing " + item + " ...")
         tempObj = cdmpyparser.getBriefModuleInfoFromFile(item)
-        if SHOW_ERRORS:
-            if not tempObj.isOK:
-                errorCount += 1
-                print("Failed to parse: " + item)
-                for item in tempObj.errors:
-                    print(item)
-                for item in tempObj.lexerErrors:
-                    print("    L: " + item)
+        if not tempObj.isOK:
+            errorCount += 1
+            showErrors(item, tempObj)
         count += 1
     print("cdmpyparser: processed " + str(count) + " file(s)")
     print("cdmpyparser: number of errors: " + str(errorCount))
 
 
+def cdmpyparserParallelTest(files):
+    """The codimension parser with the worker threads"""
+    errorCount = 0
+    files = list(files)
+    infos = cdmpyparser.getBriefModuleInfoFromFiles(files)
+    for fileName, item in zip(files, infos):
+        if not item.isOK:
+            errorCount += 1
+            showErrors(fileName, item)
+    print("cdmpyparser parallel: processed " + str(len(infos)) + " file(s)")
+    print("cdmpyparser parallel: number of errors: " + str(errorCount))
+
+
+def collectNames(item, names):
+    """Collects the name strings of the module info items"""
+    for attr in ["imports", "what", "globals", "functions", "classes",
+                 "arguments", "decorators", "classAttributes",
+                 "instanceAttributes"]:
+        for child in getattr(item, attr, None) or []:
+            if not hasattr(child, "name"):
+                continue    # decorator arguments
+            names.append(child.name)
+            if getattr(child, "alias", None):
+                names.append(child.alias)
+            collectNames(child, names)
+    names.extend(getattr(item, "base", []))
+
+
+def identifierSharingTest(files):
+    """Memory taken by the names of the resident module infos"""
+    infos = cdmpyparser.getBriefModuleInfoFromFiles(list(files))
+    names = []
+    for info in infos:
+        collectNames(info, names)
+    distinct = {}
+    for name in names:
+        distinct[id(name)] = name
+    unshared = sum(sys.getsizeof(name) for name in names)
+    shared = sum(sys.getsizeof(name) for name in distinct.values())
+    print("cdmpyparser names: " + str(len(names)) + " reference(s), " +
+          str(len(distinct)) + " string object(s)")
+    print("cdmpyparser names memory: " + str(shared) + " byte(s), " +
+          str(unshared) + " byte(s) with a string per reference")
+    if unshared > 0:
+        print("cdmpyparser names memory saved: " +
+              str(unshared - shared) + " byte(s), " +
+              "%.1f%%" % (100.0 * (unshared - shared) / unshared))
+
+
 def deltaToFloat(delta):
     """Converts time delta to float"""
     return delta.seconds + delta.microseconds / 1E6 + delta.days * 86400
@@ -144,4 +198,40 @@ print("End:   " + str(end))
 print("Delta: " + str(delta2) + " as float: " + str(deltaToFloat(delta2)))
 print("GC collected: " + str(count) + " object(s)")
 
+print("")
+
+# timing for cdmpyparser with the worker threads
+start = datetime.datetime.now()
+cdmpyparserParallelTest(pythonFiles)
+end = datetime.datetime.now()
+delta3 = end - start
+count = gc.collect()
+
+print("cdmpyparser parallel timing:")
+print("Start: " + str(start))
+print("End:   " + str(end))
+print("Delta: " + str(delta3) + " as float: " + str(deltaToFloat(delta3)))
+print("GC collected: " + str(count) + " object(s)")
+
+print("")
+
+# timing for each of the cdmpyparser backends
+defaultBackend = cdmpyparser.getParserBackend()
+for backend in cdmpyparser.PARSER_BACKENDS:
+    try:
+        cdmpyparser.setParserBackend(backend)
+    except ValueError:
+        print("cdmpyparser '" + backend + "' backend is not available")
+        continue
+    start = datetime.datetime.now()
+    cdmpyparserTest(pythonFiles)
+    end = datetime.datetime.now()
+    print("cdmpyparser '" + backend + "' backend delta: " +
+          str(deltaToFloat(end - start)))
+cdmpyparser.setParserBackend(defaultBackend)
+
+print("")
+identifierSharingTest(pythonFiles)
+
 print("\nRatio: " + str(deltaToFloat(delta) / deltaToFloat(delta2)))
+print("Parallel ratio: " + str(deltaToFloat(delta) / deltaToFloat(delta3)))